@@ -0,0 +1,340 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <stdio.h>
+#include <thread>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "iso_stats.h"
+#include "iso_sim.h"
+
+
+#define BUFFER 1000
+#define PACKET_MAX 4096
+
+
+/**
+  * @brief: Tutorial 10: Isochronous receive statistics
+  *
+  *     my_iso_recv_handler in tutorial 5 ignores its cycle and dropped
+  *     arguments, so there is no way to tell when the host falls behind the
+  *     bus. This tutorial instruments the handler with iso_stats.h:
+  *         - cycle gaps: the 8000 Hz cycle number of consecutive packets on a
+  *           channel should differ by one, anything larger is a gap
+  *         - dropped: packets the kernel threw away because the DMA ring was full
+  *         - packets/s, bytes/s and a histogram of the handler duration
+  *
+  *     Counters are per thread and lock free. Once per second a reporter
+  *     thread publishes a snapshot to the shared memory page /iso_recv_stats
+  *     (and optionally a text file), so another process can watch it:
+  *         - 10_iso_recv_stats                 receive and publish
+  *         - 10_iso_recv_stats -a              print the published snapshot
+  *         - 10_iso_recv_stats -f stats.txt    also rewrite stats.txt every second
+  *
+  *     - without hardware: 10_iso_recv_stats -s 80000 -g 1000 -w 50000
+  *       (-g leaves a cycle empty every N packets, -w slows the handler down)
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+IsoStatsRegistry iso_stats;
+long work_ns = 0;   /*!< emulated extra work per packet */
+
+volatile sig_atomic_t running = 1;
+
+
+/* signal handler stops the event loop */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+raw1394_iso_disposition
+my_iso_recv_handler(raw1394handle_t handle,
+                    unsigned char *data,
+                    unsigned int len,
+                    unsigned char channel,
+                    unsigned char tag,
+                    unsigned char sy,
+                    unsigned int cycle,
+                    unsigned int dropped)
+{
+    IsoStatsThread *stats = iso_stats.local();
+    IsoStatsScope timer(stats);   // measures until return
+    if (stats) stats->packet(channel, len, cycle, dropped);
+
+    if (work_ns > 0) {
+        const uint64_t until = iso_stats_now_ns() + work_ns;
+        while (iso_stats_now_ns() < until) {}
+    }
+
+    // see raw1394_iso_disposition
+    return RAW1394_ISO_OK;
+}
+
+
+// publishes a snapshot every second until the receive loop stops
+void reporter_thread(const char *shm_name, const char *file_path)
+{
+    IsoStatsPublisher publisher;
+    if (publisher.open(shm_name)) {
+        std::cerr << "**** Warning: could not create shared memory " << shm_name << " "
+                  << strerror(errno) << std::endl;
+    }
+
+    iso_stats_snapshot prev, snap;
+    iso_stats_collect(iso_stats, NULL, prev);
+    while (running) {
+        for (int i = 0; i < 10 && running; i++) usleep(100000);
+
+        iso_stats_collect(iso_stats, &prev, snap);
+        publisher.publish(snap);
+        if (file_path && IsoStatsPublisher::write_file(file_path, snap)) {
+            std::cerr << "**** Warning: could not write " << file_path << " "
+                      << strerror(errno) << std::endl;
+        }
+
+        printf("%8.0f pkt/s %8.2f MB/s  dropped %llu  gaps %llu (%llu cycles)  "
+               "callback p50 < %llu ns  p99 < %llu ns\n",
+               snap.packets_per_sec, snap.bytes_per_sec / 1e6,
+               (unsigned long long)snap.dropped, (unsigned long long)snap.cycle_gaps,
+               (unsigned long long)snap.cycles_missed,
+               (unsigned long long)iso_stats_percentile_ns(snap, 0.50),
+               (unsigned long long)iso_stats_percentile_ns(snap, 0.99));
+        fflush(stdout);
+        IsoStatsPublisher::copy_fields(prev, snap);
+    }
+
+    // final totals
+    iso_stats_collect(iso_stats, NULL, snap);
+    std::cout << "---- final ----" << std::endl;
+    iso_stats_print(stdout, snap);
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 10_iso_recv_stats [-h] [-p port] [-c channel] [-m shm] [-f file]\n"
+              << "                         [-s packets] [-l len] [-r rate] [-g N] [-w ns]\n"
+              << "       10_iso_recv_stats -a [-m shm]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -c  iso channel to receive (default 5)\n"
+              << "    -m  shared memory name (default /iso_recv_stats)\n"
+              << "    -f  also rewrite this text file every second\n"
+              << "    -a  attach to a running receiver and print its statistics\n"
+              << "    -s  simulate N packets, no FireWire card needed\n"
+              << "    -l  simulated payload length in bytes (default 64)\n"
+              << "    -r  simulated packet rate per second, 0 = unpaced (default 8000)\n"
+              << "    -g  simulate an empty cycle every N packets\n"
+              << "    -w  emulated handler cost per packet in ns\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    unsigned char channel = 0x5;
+    const char *shm_name = "/iso_recv_stats";
+    const char *file_path = NULL;
+    bool attach = false;
+    unsigned long long sim_packets = 0;
+    IsoSimConfig sim_config;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:c:m:f:as:l:r:g:w:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'c':
+            channel = atoi(optarg);
+            break;
+        case 'm':
+            shm_name = optarg;
+            break;
+        case 'f':
+            file_path = optarg;
+            break;
+        case 'a':
+            attach = true;
+            break;
+        case 's':
+            sim_packets = strtoull(optarg, 0, 10);
+            break;
+        case 'l':
+            sim_config.payload_len = atoi(optarg);
+            break;
+        case 'r':
+            sim_config.packet_rate = atof(optarg);
+            break;
+        case 'g':
+            sim_config.skip_every = atoi(optarg);
+            break;
+        case 'w':
+            work_ns = atol(optarg);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+
+    // ----- reader side: print what another process published -----
+    if (attach) {
+        iso_stats_snapshot snap;
+        if (iso_stats_read(shm_name, snap)) {
+            std::cerr << "**** Error: could not read " << shm_name << " "
+                      << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+        iso_stats_print(stdout, snap);
+        return EXIT_SUCCESS;
+    }
+
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+    std::thread reporter(reporter_thread, shm_name, file_path);
+
+
+    // ----------------------------------------------------------------------------
+    // Simulation: drive the handler from a software packet source
+    // ----------------------------------------------------------------------------
+    if (sim_packets > 0) {
+        sim_config.buf_packets = BUFFER;
+        sim_config.max_packet_size = PACKET_MAX;
+        sim_config.channels.assign(1, channel);
+        IsoSimRecv sim(my_iso_recv_handler, sim_config);
+
+        while (running && sim.packets() < sim_packets) {
+            if (sim.iterate(NULL)) break;
+        }
+
+        running = 0;
+        reporter.join();
+        std::cout << "simulator: " << sim.skipped_cycles() << " empty cycles, "
+                  << sim.dropped() << " dropped" << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+
+    // ----- Get handle and set port for the handle -------
+    // create handle
+    handle = raw1394_new_handle();
+    if (handle == NULL) {
+        std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+        running = 0;
+        reporter.join();
+        return EXIT_FAILURE;
+    }
+
+    // get port number & sanity check
+    int numPorts = raw1394_get_port_info(handle, NULL, 0);
+    if (port < 0 || port >= numPorts) {
+        std::cerr << "Invalid port number" << std::endl;
+        running = 0;
+        reporter.join();
+        return EXIT_FAILURE;
+    }
+
+    // let user to choose which port to use
+    rc = raw1394_set_port(handle, port);
+    if (rc) {
+        std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+        running = 0;
+        reporter.join();
+        return EXIT_FAILURE;
+    }
+
+
+    // -------- Set FireWire bus reset handler --------
+
+    // set bus reset handler
+    raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 10 iso receive statistics
+    // ----------------------------------------------------------------------------
+
+    rc = raw1394_iso_recv_init(handle,
+                               my_iso_recv_handler,
+                               BUFFER,      // buf_packets
+                               PACKET_MAX,  // max_packet_size
+                               channel,     // channel
+                               RAW1394_DMA_DEFAULT,  // dma mode
+                               -1);         // irq_interval
+    if (rc) {
+        perror("raw1394_iso_recv_init");
+        running = 0;
+        reporter.join();
+        return EXIT_FAILURE;
+    }
+
+    // start receiving
+    rc = raw1394_iso_recv_start(handle, -1, -1, 0);
+    if (rc) {
+        perror("raw1394_iso_recv_start");
+        running = 0;
+        reporter.join();
+        return EXIT_FAILURE;
+    }
+
+    while (running)
+    {
+        rc = raw1394_loop_iterate(handle);
+        if (rc) break;
+    }
+
+    // stop, clean up & exit
+    raw1394_iso_stop(handle);
+    running = 0;
+    reporter.join();
+    raw1394_iso_shutdown(handle);
+    raw1394_destroy_handle(handle);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,459 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <stdio.h>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "iso_sim.h"
+
+
+#define PACKET_MAX 4096
+#define CYCLES_PER_SEC 8000
+
+
+/**
+  * @brief: Tutorial 11: Adaptive isochronous receive buffering
+  *
+  *     Tutorials 5 - 10 use a fixed BUFFER of 1000 packets and irq_interval -1.
+  *     Those two numbers set the latency / CPU trade off:
+  *         - irq_interval: packets per wakeup. At 8000 packets/s an interval of
+  *           80 means 100 wakeups/s and up to 10 ms before a packet is seen
+  *         - buf_packets: how long the host may be late before the kernel
+  *           drops packets, it must be a few times larger than irq_interval
+  *
+  *     This tutorial picks them from a target latency. Once per second a
+  *     controller looks at
+  *         - the packet rate and the wakeup rate
+  *         - the average handler cost per packet
+  *         - the dropped count
+  *         - the measured latency: when a wakeup delivers its first (oldest)
+  *           packet, its cycle is compared with the bus cycle timer
+  *     and re-initialises raw1394_iso_recv_init when its choice differs by
+  *     more than 25% from the running setting. Drops double the buffer floor.
+  *     Every window and every decision is logged.
+  *
+  *     Presets (-P):
+  *         - adaptive     target latency from -L (default 10 ms)
+  *         - low-latency  1 ms target, small buffers, many wakeups
+  *         - low-cpu      100 ms target, large buffers, few wakeups
+  *     -F keeps the preset's initial setting fixed, for comparison.
+  *
+  *     - without hardware: 11_iso_recv_adaptive -s 80000 -P low-latency
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+// what is passed to raw1394_iso_recv_init
+struct iso_recv_params
+{
+    unsigned int buf_packets;
+    int irq_interval;
+};
+
+struct adapt_policy
+{
+    const char *name;
+    double target_latency_ms;
+    unsigned int min_buf;
+    unsigned int max_buf;
+};
+
+const adapt_policy presets[] = {
+    { "adaptive",     10.0,   64, 16000 },
+    { "low-latency",   1.0,   64,  2000 },
+    { "low-cpu",     100.0, 1000, 16000 },
+};
+
+// preset called @name, NULL if there is none
+const adapt_policy *find_preset(const char *name)
+{
+    for (size_t i = 0; i < sizeof(presets) / sizeof(presets[0]); i++) {
+        if (strcmp(name, presets[i].name) == 0) return &presets[i];
+    }
+    return NULL;
+}
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+IsoSimRecv *sim = NULL;        /*!< software packet source instead of handle */
+IsoSimConfig sim_config;
+unsigned char channel = 0x5;
+double cycle_rate = CYCLES_PER_SEC;   /*!< the simulator ties cycles to its packet rate */
+long work_ns = 0;                     /*!< emulated processing cost per packet */
+
+// current window, only touched from the loop thread
+unsigned long long win_packets = 0;
+unsigned long long win_bytes = 0;
+unsigned long long win_dropped = 0;
+unsigned long long win_wakeups = 0;
+unsigned long long win_callback_ns = 0;
+unsigned long long win_latency_cycles = 0;
+unsigned long long win_latency_max = 0;
+unsigned long long win_latency_samples = 0;
+bool need_latency_sample = false;
+unsigned long long total_packets = 0;
+
+volatile sig_atomic_t running = 1;
+
+
+/* signal handler stops the event loop */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+// current bus cycle (0 - 7999) or -1 if unknown
+int current_bus_cycle()
+{
+    if (sim) return sim->bus_cycle();
+
+    u_int32_t cycle_timer;
+    u_int64_t local_time;
+    if (raw1394_read_cycle_timer(handle, &cycle_timer, &local_time)) return -1;
+    // seconds[31:25] cycle[24:12] offset[11:0]
+    return (cycle_timer >> 12) & 0x1fff;
+}
+
+
+raw1394_iso_disposition
+my_iso_recv_handler(raw1394handle_t handle,
+                    unsigned char *data,
+                    unsigned int len,
+                    unsigned char channel,
+                    unsigned char tag,
+                    unsigned char sy,
+                    unsigned int cycle,
+                    unsigned int dropped)
+{
+    const uint64_t start = iso_sim_now_ns();
+
+    // the first packet of a wakeup is the one that waited longest
+    if (need_latency_sample) {
+        need_latency_sample = false;
+        int now = current_bus_cycle();
+        if (now >= 0) {
+            unsigned int lat = (now + CYCLES_PER_SEC - (cycle % CYCLES_PER_SEC)) % CYCLES_PER_SEC;
+            win_latency_cycles += lat;
+            if (lat > win_latency_max) win_latency_max = lat;
+            win_latency_samples++;
+        }
+    }
+
+    win_packets++;
+    win_bytes += len;
+    win_dropped += dropped;
+    total_packets++;
+
+    if (work_ns > 0) {
+        const uint64_t until = iso_sim_now_ns() + work_ns;
+        while (iso_sim_now_ns() < until) {}
+    }
+
+    win_callback_ns += iso_sim_now_ns() - start;
+
+    // see raw1394_iso_disposition
+    return RAW1394_ISO_OK;
+}
+
+
+// (re)start receiving with @params
+int start_receiver(const iso_recv_params &params)
+{
+    if (sim) {
+        delete sim;
+        sim_config.buf_packets = params.buf_packets;
+        sim_config.irq_interval = params.irq_interval;
+        sim = new IsoSimRecv(my_iso_recv_handler, sim_config);
+        return 0;
+    }
+
+    raw1394_iso_stop(handle);
+    raw1394_iso_shutdown(handle);
+    int rc = raw1394_iso_recv_init(handle,
+                                   my_iso_recv_handler,
+                                   params.buf_packets,   // buf_packets
+                                   PACKET_MAX,           // max_packet_size
+                                   channel,              // channel
+                                   RAW1394_DMA_DEFAULT,  // dma mode
+                                   params.irq_interval); // irq_interval
+    if (rc) {
+        perror("raw1394_iso_recv_init");
+        return rc;
+    }
+    rc = raw1394_iso_recv_start(handle, -1, -1, 0);
+    if (rc) {
+        perror("raw1394_iso_recv_start");
+    }
+    return rc;
+}
+
+
+// starting point for a policy, assumes one packet per cycle
+iso_recv_params initial_params(const adapt_policy &policy)
+{
+    iso_recv_params params;
+    params.irq_interval = (int)(policy.target_latency_ms * 1e-3 * CYCLES_PER_SEC);
+    if (params.irq_interval < 1) params.irq_interval = 1;
+    params.buf_packets = 4 * params.irq_interval;
+    if (params.buf_packets < policy.min_buf) params.buf_packets = policy.min_buf;
+    if (params.buf_packets > policy.max_buf) params.buf_packets = policy.max_buf;
+    return params;
+}
+
+
+bool differs(double a, double b)
+{
+    return a > 1.25 * b || a < 0.8 * b;
+}
+
+
+/**
+ * One controller step at the end of a window.
+ * Returns true and fills @next when the receiver should be re-initialised.
+ */
+bool controller_step(const adapt_policy &policy, const iso_recv_params &current,
+                     unsigned int &buf_floor, double dt, iso_recv_params &next)
+{
+    const double rate = win_packets / dt;
+    const double wakeups = win_wakeups / dt;
+    const double cb_ns = win_packets ? (double)win_callback_ns / win_packets : 0.0;
+    const double lat_avg_ms = win_latency_samples ?
+            (double)win_latency_cycles / win_latency_samples * 1e3 / cycle_rate : 0.0;
+    const double lat_max_ms = win_latency_max * 1e3 / cycle_rate;
+
+    printf("window: %7.0f pkt/s %6.0f wakeups/s  handler %5.0f ns/pkt  dropped %llu  "
+           "latency avg %.2f ms max %.2f ms  [buf %u irq %d]\n",
+           rate, wakeups, cb_ns, win_dropped, lat_avg_ms, lat_max_ms,
+           current.buf_packets, current.irq_interval);
+
+    if (rate < 1.0) return false;
+
+    // packets per wakeup that meet the target at the measured rate
+    next.irq_interval = (int)(policy.target_latency_ms * 1e-3 * rate + 0.5);
+    if (next.irq_interval < 1) next.irq_interval = 1;
+    if ((unsigned int)next.irq_interval > policy.max_buf / 4) next.irq_interval = policy.max_buf / 4;
+
+    // the kernel dropped packets, the host is later than the buffer allows
+    if (win_dropped) {
+        unsigned int grown = current.buf_packets * 2;
+        if (grown > buf_floor) buf_floor = grown;
+        if (buf_floor > policy.max_buf) buf_floor = policy.max_buf;
+    }
+
+    next.buf_packets = 4 * next.irq_interval;
+    if (next.buf_packets < policy.min_buf) next.buf_packets = policy.min_buf;
+    if (next.buf_packets < buf_floor) next.buf_packets = buf_floor;
+    if (next.buf_packets > policy.max_buf) next.buf_packets = policy.max_buf;
+
+    return differs(next.irq_interval, current.irq_interval) ||
+           differs(next.buf_packets, current.buf_packets);
+}
+
+
+void log_decision(const adapt_policy &policy, const iso_recv_params &next, double dt)
+{
+    const double rate = win_packets / dt;
+    printf("adapt:  %s target %.2f ms at %.0f pkt/s -> buf_packets %u irq_interval %d "
+           "(expect %.2f ms, %.0f wakeups/s)%s\n",
+           policy.name, policy.target_latency_ms, rate,
+           next.buf_packets, next.irq_interval,
+           next.irq_interval * 1e3 / rate, rate / next.irq_interval,
+           win_dropped ? " after drops" : "");
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 11_iso_recv_adaptive [-h] [-p port] [-c channel] [-P preset] [-L ms] [-F]\n"
+              << "                            [-s packets] [-l len] [-r rate] [-w ns]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -c  iso channel to receive (default 5)\n"
+              << "    -P  adaptive (default), low-latency or low-cpu\n"
+              << "    -L  target latency in ms for the adaptive preset (default 10)\n"
+              << "    -F  fixed: keep the preset's initial setting, no adaptation\n"
+              << "    -s  simulate N packets, no FireWire card needed\n"
+              << "    -l  simulated payload length in bytes (default 64)\n"
+              << "    -r  simulated packet rate per second (default 8000)\n"
+              << "    -w  emulated processing cost per packet in ns\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    adapt_policy policy = presets[0];
+    bool fixed = false;
+    unsigned long long sim_packets = 0;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:c:P:L:Fs:l:r:w:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'c':
+            channel = atoi(optarg);
+            break;
+        case 'P':
+            if (find_preset(optarg) == NULL) {
+                std::cerr << "**** Error: unknown preset " << optarg << std::endl;
+                print_usage();
+                return EXIT_FAILURE;
+            }
+            policy = *find_preset(optarg);
+            break;
+        case 'L':
+            policy.target_latency_ms = atof(optarg);
+            break;
+        case 'F':
+            fixed = true;
+            break;
+        case 's':
+            sim_packets = strtoull(optarg, 0, 10);
+            break;
+        case 'l':
+            sim_config.payload_len = atoi(optarg);
+            break;
+        case 'r':
+            sim_config.packet_rate = atof(optarg);
+            break;
+        case 'w':
+            work_ns = atol(optarg);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+    if (sim_packets > 0) {
+        // simulation: a software packet source stands in for the handle
+        sim_config.max_packet_size = PACKET_MAX;
+        sim_config.channels.assign(1, channel);
+        if (sim_config.packet_rate > 0) cycle_rate = sim_config.packet_rate;
+        sim = new IsoSimRecv(my_iso_recv_handler, sim_config);
+    } else {
+        // ----- Get handle and set port for the handle -------
+        // create handle
+        handle = raw1394_new_handle();
+        if (handle == NULL) {
+            std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // get port number & sanity check
+        int numPorts = raw1394_get_port_info(handle, NULL, 0);
+        if (port < 0 || port >= numPorts) {
+            std::cerr << "Invalid port number" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // let user to choose which port to use
+        rc = raw1394_set_port(handle, port);
+        if (rc) {
+            std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // set bus reset handler
+        raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+    }
+
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 11 adaptive iso receive
+    // ----------------------------------------------------------------------------
+
+    iso_recv_params params = initial_params(policy);
+    unsigned int buf_floor = 0;
+    printf("start:  %s target %.2f ms -> buf_packets %u irq_interval %d%s\n",
+           policy.name, policy.target_latency_ms, params.buf_packets, params.irq_interval,
+           fixed ? " (fixed)" : "");
+    if (start_receiver(params)) {
+        return EXIT_FAILURE;
+    }
+
+    uint64_t win_start = iso_sim_now_ns();
+    uint64_t last_reinit = win_start;
+    while (running && (sim_packets == 0 || total_packets < sim_packets))
+    {
+        need_latency_sample = true;
+        rc = sim ? sim->iterate(NULL) : raw1394_loop_iterate(handle);
+        if (rc) break;
+        win_wakeups++;
+
+        const uint64_t now = iso_sim_now_ns();
+        if (now - win_start < 1000000000ULL) continue;
+
+        iso_recv_params next;
+        const double dt = (now - win_start) * 1e-9;
+        const bool change = controller_step(policy, params, buf_floor, dt, next);
+
+        // give each setting a few seconds before judging it again
+        if (change && !fixed && now - last_reinit >= 3000000000ULL) {
+            log_decision(policy, next, dt);
+            params = next;
+            if (start_receiver(params)) break;
+            last_reinit = iso_sim_now_ns();
+        }
+        fflush(stdout);
+
+        win_packets = win_bytes = win_dropped = win_wakeups = 0;
+        win_callback_ns = win_latency_cycles = win_latency_max = win_latency_samples = 0;
+        win_start = iso_sim_now_ns();
+    }
+
+    // stop, clean up & exit
+    if (sim) {
+        delete sim;
+    } else {
+        raw1394_iso_stop(handle);
+        raw1394_iso_shutdown(handle);
+        raw1394_destroy_handle(handle);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,590 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "spsc_ring.h"
+#include "iso_sim.h"
+
+
+#define BUFFER 1000
+#define MAX_PACKET 4096
+#define POOL_PACKETS 1024
+#define MAX_PRODUCERS 8
+
+
+/**
+  * @brief: Tutorial 12: Callback driven isochronous transmit with a packet pool
+  *
+  *     Tutorial 6 passes a NULL handler to raw1394_iso_xmit_init and calls
+  *     raw1394_iso_xmit_write for every packet in a tight loop. That thread
+  *     generates, copies and queues one packet per call and never sleeps
+  *     unless the kernel buffer is full. This tutorial turns it around:
+  *         - producer threads build packets ahead of time in a preallocated
+  *           pool (one slab + one lock-free SPSC ring per producer)
+  *         - my_iso_xmit_handler is called by libraw1394 whenever the kernel
+  *           has free slots; it copies one ready packet from the pool straight
+  *           into the DMA buffer
+  *         - raw1394_loop_iterate only wakes every irq_interval packets
+  *         - an empty pool is an underrun: it is counted and the handler returns
+  *           RAW1394_ISO_DEFER instead of waiting, the next wakeup tries again
+  *
+  *     Both modes report packets per CPU-second (process CPU clock, producers
+  *     included), so the two approaches can be compared directly:
+  *         - 12_iso_xmit_pool                  handler + pool
+  *         - 12_iso_xmit_pool -W               write loop, like tutorial 6
+  *         - 12_iso_xmit_pool -C -d 5          both, 5 s each, and the ratio
+  *
+  *     - run 5_iso_recv or 10_iso_recv_stats on another computer to watch
+  *     - or run without hardware: 12_iso_xmit_pool -s 80000 -C
+  *       (-w slows the producers down to provoke underruns)
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+// one prepared packet, payload lives in the producer's slab
+struct iso_xmit_desc
+{
+    unsigned char *data;
+    unsigned int len;
+    unsigned char tag;
+    unsigned char sy;
+};
+
+
+// one producer thread and the packets it prepared
+struct iso_xmit_pool
+{
+    iso_xmit_pool()
+        : id(0), ring(POOL_PACKETS), slab(ring.capacity() * MAX_PACKET), sequence(0) {}
+
+    unsigned int id;
+    SpscRing<iso_xmit_desc> ring;
+    std::vector<unsigned char> slab;   /*!< slab slot i belongs to ring slot i */
+    quadlet_t sequence;
+    std::thread thread;
+};
+
+
+struct xmit_result
+{
+    unsigned long long packets;
+    unsigned long long bytes;
+    unsigned long long underruns;   /*!< empty pool seen by the handler */
+    unsigned long long dropped;     /*!< empty cycles reported by the kernel */
+    unsigned long long wakeups;
+    double wall_sec;
+    double cpu_sec;
+};
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+// allocated once, packets left over from one run are sent by the next
+iso_xmit_pool pool_storage[MAX_PRODUCERS];
+std::vector<iso_xmit_pool *> pools;   /*!< the pools in use */
+size_t next_pool = 0;   /*!< round robin position, handler only */
+
+// written by the handler (single writer)
+unsigned long long tx_packets = 0;
+unsigned long long tx_bytes = 0;
+unsigned long long tx_underruns = 0;
+unsigned long long tx_dropped = 0;
+
+// options
+unsigned int payload_len = 64;
+unsigned char xmit_tag = 1;
+unsigned char xmit_sy = 0;
+long work_ns = 0;   /*!< emulated cost to produce one packet */
+
+volatile sig_atomic_t running = 1;
+std::atomic<bool> producing(false);
+
+
+/* signal handler stops the event loop */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+double clock_sec(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// payload: producer id and sequence number, then a counting pattern
+void fill_payload(unsigned char *data, unsigned int id, quadlet_t sequence)
+{
+    quadlet_t *q = (quadlet_t *)data;
+    const unsigned int quadlets = payload_len / 4;
+    if (quadlets > 0) q[0] = htonl((id << 24) | (sequence & 0xffffff));
+    for (unsigned int i = 1; i < quadlets; i++) q[i] = htonl(sequence + i);
+
+    if (work_ns > 0) {
+        const uint64_t until = iso_sim_now_ns() + work_ns;
+        while (iso_sim_now_ns() < until) {}
+    }
+}
+
+
+// producer thread: keeps its pool full, sleeps while it is
+void producer_thread(iso_xmit_pool *pool)
+{
+    while (producing.load(std::memory_order_relaxed)) {
+        if (pool->ring.full()) {
+            usleep(250);
+            continue;
+        }
+        iso_xmit_desc desc;
+        desc.data = &pool->slab[pool->ring.next_slot() * MAX_PACKET];
+        desc.len = payload_len;
+        desc.tag = xmit_tag;
+        desc.sy = xmit_sy;
+        fill_payload(desc.data, pool->id, pool->sequence++);
+        pool->ring.push(desc);
+    }
+}
+
+
+//raw1394_iso_xmit_handler_t
+raw1394_iso_disposition
+my_iso_xmit_handler(raw1394handle_t handle,
+                    unsigned char *data,
+                    unsigned int *len,
+                    unsigned char *tag,
+                    unsigned char *sy,
+                    int cycle, /* -1 if unknown */
+                    unsigned int dropped)
+{
+    tx_dropped += dropped;
+
+    // take the next ready packet, producers in round robin order
+    for (size_t i = 0; i < pools.size(); i++) {
+        iso_xmit_pool *pool = pools[(next_pool + i) % pools.size()];
+        iso_xmit_desc *desc = pool->ring.front();
+        if (desc == NULL) continue;
+
+        memcpy(data, desc->data, desc->len);
+        *len = desc->len;
+        *tag = desc->tag;
+        *sy = desc->sy;
+        pool->ring.consume();
+
+        next_pool = (next_pool + i + 1) % pools.size();
+        tx_packets++;
+        tx_bytes += *len;
+        return RAW1394_ISO_OK;
+    }
+
+    // nothing ready: do not wait here, the next wakeup asks again
+    tx_underruns++;
+    return RAW1394_ISO_DEFER;
+}
+
+
+void start_producers(unsigned int count)
+{
+    producing = true;
+    for (unsigned int i = 0; i < count; i++) {
+        pool_storage[i].id = i;
+        pools.push_back(&pool_storage[i]);
+        pools.back()->thread = std::thread(producer_thread, pools.back());
+    }
+
+    // prime the pools so the first wakeup does not underrun
+    const uint64_t until = iso_sim_now_ns() + 100000000ULL;
+    for (size_t i = 0; i < pools.size(); i++) {
+        while (pools[i]->ring.size() < pools[i]->ring.capacity() && iso_sim_now_ns() < until)
+            usleep(1000);
+    }
+}
+
+
+void stop_producers()
+{
+    producing = false;
+    for (size_t i = 0; i < pools.size(); i++) {
+        pools[i]->thread.join();
+    }
+    pools.clear();
+    next_pool = 0;
+}
+
+
+void reset_counters()
+{
+    tx_packets = tx_bytes = tx_underruns = tx_dropped = 0;
+}
+
+
+// prints a line once per second while a run is going
+class RateReporter
+{
+public:
+    explicit RateReporter(const char *name)
+        : name_(name), last_wall_(clock_sec(CLOCK_MONOTONIC)),
+          last_cpu_(clock_sec(CLOCK_PROCESS_CPUTIME_ID)), last_packets_(0), last_wakeups_(0) {}
+
+    void update(unsigned long long packets, unsigned long long wakeups,
+                unsigned long long underruns)
+    {
+        const double wall = clock_sec(CLOCK_MONOTONIC);
+        if (wall - last_wall_ < 1.0) return;
+        const double cpu = clock_sec(CLOCK_PROCESS_CPUTIME_ID);
+        const double dt = wall - last_wall_;
+        printf("%-5s %9.0f pkt/s %7.0f wakeups/s  underruns %llu  cpu %5.1f%%\n",
+               name_, (packets - last_packets_) / dt, (wakeups - last_wakeups_) / dt,
+               underruns, (cpu - last_cpu_) / dt * 100.0);
+        fflush(stdout);
+        last_wall_ = wall;
+        last_cpu_ = cpu;
+        last_packets_ = packets;
+        last_wakeups_ = wakeups;
+    }
+
+private:
+    const char *name_;
+    double last_wall_;
+    double last_cpu_;
+    unsigned long long last_packets_;
+    unsigned long long last_wakeups_;
+};
+
+
+// ---- software stand-in for the kernel ----
+
+xmit_result run_sim(bool write_loop, const IsoSimConfig &config, unsigned int producers,
+                    unsigned long long packets, double seconds)
+{
+    xmit_result r;
+    memset(&r, 0, sizeof(r));
+    reset_counters();
+
+    IsoSimXmit sim(write_loop ? NULL : my_iso_xmit_handler, config);
+    RateReporter reporter(write_loop ? "write" : "pool");
+    if (!write_loop) start_producers(producers);
+
+    const double wall0 = clock_sec(CLOCK_MONOTONIC);
+    const double cpu0 = clock_sec(CLOCK_PROCESS_CPUTIME_ID);
+    sim.start();
+    std::vector<unsigned char> buffer(MAX_PACKET);
+    quadlet_t sequence = 0;
+    while (running && sim.queued() < packets &&
+           (seconds <= 0 || clock_sec(CLOCK_MONOTONIC) - wall0 < seconds)) {
+        if (write_loop) {
+            // tutorial 6: build and queue one packet per call
+            fill_payload(&buffer[0], 0, sequence++);
+            if (sim.write(&buffer[0], payload_len, xmit_tag, xmit_sy)) break;
+            tx_packets++;
+            tx_bytes += payload_len;
+        } else {
+            if (sim.iterate(NULL)) break;
+        }
+        reporter.update(sim.queued(), sim.wakeups(), tx_underruns);
+    }
+    r.cpu_sec = clock_sec(CLOCK_PROCESS_CPUTIME_ID) - cpu0;
+    r.wall_sec = clock_sec(CLOCK_MONOTONIC) - wall0;
+
+    if (!write_loop) stop_producers();
+    r.packets = tx_packets;
+    r.bytes = tx_bytes;
+    r.underruns = tx_underruns;
+    r.dropped = sim.underruns();
+    r.wakeups = sim.wakeups();
+    return r;
+}
+
+
+// ---- real transmitter ----
+
+xmit_result run_hw(bool write_loop, unsigned char channel, int irq_interval,
+                   unsigned int producers, double seconds)
+{
+    xmit_result r;
+    memset(&r, 0, sizeof(r));
+    reset_counters();
+
+    int rc = raw1394_iso_xmit_init(handle,      // 1394 handle
+                                   write_loop ? NULL : my_iso_xmit_handler,
+                                   BUFFER,      // iso packets to buffer
+                                   MAX_PACKET,  // max packet size
+                                   channel,     // channel
+                                   RAW1394_ISO_SPEED_400,
+                                   irq_interval);  // wake up every irq_interval packets
+    if (rc) {
+        perror("raw1394_iso_xmit_init");
+        return r;
+    }
+    if (!write_loop) start_producers(producers);
+
+    // with a handler, start prebuffers by calling it until the buffer is full
+    rc = raw1394_iso_xmit_start(handle, -1, -1);
+    if (rc) {
+        perror("raw1394_iso_xmit_start");
+        if (!write_loop) stop_producers();
+        raw1394_iso_shutdown(handle);
+        return r;
+    }
+
+    RateReporter reporter(write_loop ? "write" : "pool");
+    const double wall0 = clock_sec(CLOCK_MONOTONIC);
+    const double cpu0 = clock_sec(CLOCK_PROCESS_CPUTIME_ID);
+    std::vector<unsigned char> buffer(MAX_PACKET);
+    quadlet_t sequence = 0;
+    while (running && (seconds <= 0 || clock_sec(CLOCK_MONOTONIC) - wall0 < seconds)) {
+        if (write_loop) {
+            fill_payload(&buffer[0], 0, sequence++);
+            rc = raw1394_iso_xmit_write(handle, &buffer[0], payload_len, xmit_tag, xmit_sy);
+            if (rc) {
+                perror("raw1394_iso_xmit_write");
+                break;
+            }
+            tx_packets++;
+            tx_bytes += payload_len;
+        } else {
+            // sleeps until irq_interval packets went out, then calls the handler
+            rc = raw1394_loop_iterate(handle);
+            if (rc) break;
+            r.wakeups++;
+        }
+        reporter.update(tx_packets, r.wakeups, tx_underruns);
+    }
+    r.cpu_sec = clock_sec(CLOCK_PROCESS_CPUTIME_ID) - cpu0;
+    r.wall_sec = clock_sec(CLOCK_MONOTONIC) - wall0;
+
+    raw1394_iso_stop(handle);
+    if (!write_loop) stop_producers();
+    raw1394_iso_shutdown(handle);
+
+    r.packets = tx_packets;
+    r.bytes = tx_bytes;
+    r.underruns = tx_underruns;
+    r.dropped = tx_dropped;
+    return r;
+}
+
+
+double packets_per_cpu_sec(const xmit_result &r)
+{
+    return r.cpu_sec > 0 ? r.packets / r.cpu_sec : 0.0;
+}
+
+
+void print_result(const char *name, const xmit_result &r)
+{
+    printf("%-5s %llu packets, %.2f MB in %.2f s, %.3f CPU-s, %llu wakeups, "
+           "%llu underruns, %llu empty cycles\n"
+           "      %.0f packets per CPU-second\n",
+           name, r.packets, r.bytes / 1e6, r.wall_sec, r.cpu_sec, r.wakeups,
+           r.underruns, r.dropped, packets_per_cpu_sec(r));
+    fflush(stdout);
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 12_iso_xmit_pool [-h] [-p port] [-c channel] [-i irq] [-l len]\n"
+              << "                        [-P producers] [-w ns] [-W | -C] [-d seconds]\n"
+              << "                        [-s packets] [-r rate]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -c  iso channel to transmit on (default 5)\n"
+              << "    -i  irq_interval in packets (default 64)\n"
+              << "    -l  payload length in bytes, multiple of 4 (default 64)\n"
+              << "    -P  number of producer threads, up to 8 (default 1)\n"
+              << "    -w  emulated cost to produce one packet in ns\n"
+              << "    -W  use the raw1394_iso_xmit_write loop of tutorial 6\n"
+              << "    -C  run the write loop, then the pool, and compare\n"
+              << "    -d  seconds per run, 0 = until Ctrl-C (default 0, 5 with -C)\n"
+              << "    -s  simulate N packets per run, no FireWire card needed\n"
+              << "    -r  simulated bus packet rate, 0 = unpaced (default 8000)\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    unsigned char channel = 0x5;
+    int irq_interval = 64;
+    unsigned int producers = 1;
+    bool write_loop = false;
+    bool compare = false;
+    double seconds = -1.0;
+    unsigned long long sim_packets = 0;  /*!< > 0 runs the software stand-in */
+    IsoSimConfig sim_config;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:c:i:l:P:w:WCd:s:r:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'c':
+            channel = atoi(optarg);
+            break;
+        case 'i':
+            irq_interval = atoi(optarg);
+            break;
+        case 'l':
+            payload_len = atoi(optarg) & ~3u;
+            break;
+        case 'P':
+            producers = atoi(optarg);
+            break;
+        case 'w':
+            work_ns = atol(optarg);
+            break;
+        case 'W':
+            write_loop = true;
+            break;
+        case 'C':
+            compare = true;
+            break;
+        case 'd':
+            seconds = atof(optarg);
+            break;
+        case 's':
+            sim_packets = strtoull(optarg, 0, 10);
+            break;
+        case 'r':
+            sim_config.packet_rate = atof(optarg);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+    if (payload_len > MAX_PACKET) payload_len = MAX_PACKET;
+    if (producers == 0) producers = 1;
+    if (producers > MAX_PRODUCERS) producers = MAX_PRODUCERS;
+    if (seconds < 0) seconds = compare ? 5.0 : 0.0;
+
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+
+    // ----------------------------------------------------------------------------
+    // Simulation: a software bus takes one packet per cycle
+    // ----------------------------------------------------------------------------
+    if (sim_packets > 0) {
+        sim_config.buf_packets = BUFFER;
+        sim_config.max_packet_size = MAX_PACKET;
+        sim_config.irq_interval = irq_interval;
+
+        if (compare) {
+            xmit_result w = run_sim(true, sim_config, producers, sim_packets, seconds);
+            print_result("write", w);
+            xmit_result p = run_sim(false, sim_config, producers, sim_packets, seconds);
+            print_result("pool", p);
+            if (packets_per_cpu_sec(w) > 0) {
+                printf("pool / write: %.1fx packets per CPU-second\n",
+                       packets_per_cpu_sec(p) / packets_per_cpu_sec(w));
+            }
+        } else {
+            xmit_result r = run_sim(write_loop, sim_config, producers, sim_packets, seconds);
+            print_result(write_loop ? "write" : "pool", r);
+        }
+        return EXIT_SUCCESS;
+    }
+
+
+    // ----- Get handle and set port for the handle -------
+    // create handle
+    handle = raw1394_new_handle();
+    if (handle == NULL) {
+        std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // get port number & sanity check
+    int numPorts = raw1394_get_port_info(handle, NULL, 0);
+    if (port < 0 || port >= numPorts) {
+        std::cerr << "Invalid port number" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // let user to choose which port to use
+    rc = raw1394_set_port(handle, port);
+    if (rc) {
+        std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+
+    // -------- Set FireWire bus reset handler --------
+
+    // set bus reset handler
+    raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 12 callback driven isochronous send
+    // ----------------------------------------------------------------------------
+
+    if (compare) {
+        xmit_result w = run_hw(true, channel, irq_interval, producers, seconds);
+        print_result("write", w);
+        xmit_result p = run_hw(false, channel, irq_interval, producers, seconds);
+        print_result("pool", p);
+        if (packets_per_cpu_sec(w) > 0) {
+            printf("pool / write: %.1fx packets per CPU-second\n",
+                   packets_per_cpu_sec(p) / packets_per_cpu_sec(w));
+        }
+    } else {
+        xmit_result r = run_hw(write_loop, channel, irq_interval, producers, seconds);
+        print_result(write_loop ? "write" : "pool", r);
+    }
+
+    // clean up & exit
+    raw1394_destroy_handle(handle);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,492 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "arm_region_map.h"
+#include "arm_shm_mirror.h"
+#include "iso_sim.h"
+
+
+/**
+  * @brief: Tutorial 13: ARM server with many register windows
+  *
+  *     Tutorial 2 serves a single 4 byte range. This server emulates a device
+  *     with a table of register windows, each with its own behaviour:
+  *         - identity   read only block, libraw1394 answers on its own
+  *         - control    writing a command here updates status
+  *         - status     read only, last command and a command counter
+  *         - mailbox    lock transactions (compare-swap etc.)
+  *         - scratch    plain read/write memory
+  *         - window N   -n generated windows with a shared handler
+  *
+  *     All regions share one ARM callback, ArmRegionMap (arm_region_map.h)
+  *     looks the region up from the destination offset in constant time and
+  *     calls the region's handler.
+  *
+  *     With -m the regions are mirrored into POSIX shared memory
+  *     (arm_shm_mirror.h), local processes read them without a 1394 handle:
+  *     13_arm_multi_region -a attaches to the mirror and prints it, -a -w
+  *     keeps reading the windows and checks every snapshot is consistent.
+  *
+  *     - to run this example
+  *         - run 13_arm_multi_region on one computer
+  *         - read/write its windows from another one, e.g. with 3_async_client
+  *     - 13_arm_multi_region -t measures the lookup without hardware
+  *     - 13_arm_multi_region -s 1000000 simulates remote writes into the
+  *       mirror, run 13_arm_multi_region -a -w next to it
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+#define ARM_BASE        0xffffff000000ULL
+#define WINDOW_BASE     (ARM_BASE + 0x10000)
+#define WINDOW_SIZE     0x100
+#define MIRROR_NAME     "/arm_mirror"
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+volatile sig_atomic_t running = 1;
+
+// shared memory mirror of the regions, NULL without -m
+ArmShmMirror *mirror = NULL;
+bool verbose = true;
+
+// device state behind the status window
+quadlet_t last_command = 0;
+quadlet_t command_count = 0;
+
+
+/* signal handler stops the event loop */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+// ---- per-region handlers ----
+
+// a write to quadlet 0 of control is a command, reflect it in status
+int control_handler(raw1394handle_t handle, ArmRegion &region,
+                    const struct raw1394_arm_request *request, byte_t request_type)
+{
+    if (region.offset(request->destination_offset) != 0 || request->buffer_length < 4) return 0;
+
+    quadlet_t command;
+    memcpy(&command, request->buffer, 4);
+    last_command = command;   // stays big endian, as on the wire
+    command_count++;
+
+    quadlet_t status[2] = { last_command, htonl(command_count) };
+    if (mirror) mirror->set_buf(handle, ARM_BASE + 0x1040, sizeof(status), status);
+    else raw1394_arm_set_buf(handle, ARM_BASE + 0x1040, sizeof(status), status);
+    return 0;
+}
+
+
+int mailbox_handler(raw1394handle_t handle, ArmRegion &region,
+                    const struct raw1394_arm_request *request, byte_t request_type)
+{
+    std::cout << "mailbox " << (request_type == RAW1394_ARM_LOCK ? "lock" : "write")
+              << " from node " << std::hex << request->source_nodeid << std::dec
+              << " extcode " << (int)request->extended_transaction_code << std::endl;
+    return 0;
+}
+
+
+// shared by all generated windows, context is the window number
+int window_handler(raw1394handle_t handle, ArmRegion &region,
+                   const struct raw1394_arm_request *request, byte_t request_type)
+{
+    const size_t window = (size_t)region.context;
+    if (!verbose) return 0;
+    std::cout << "window " << window << " +0x" << std::hex
+              << region.offset(request->destination_offset) << std::dec
+              << " written, " << request->buffer_length << " bytes" << std::endl;
+    return 0;
+}
+
+
+// the fixed part of the device
+const arm_region_desc device_regions[] = {
+    // name        start               length  access                                          notify                              handler
+    { "identity",  ARM_BASE + 0x0000,  0x100,  RAW1394_ARM_READ,                               0,                                  NULL },
+    { "control",   ARM_BASE + 0x1000,  0x40,   RAW1394_ARM_READ | RAW1394_ARM_WRITE,           RAW1394_ARM_WRITE,                  control_handler },
+    { "status",    ARM_BASE + 0x1040,  0x40,   RAW1394_ARM_READ,                               0,                                  NULL },
+    { "mailbox",   ARM_BASE + 0x1100,  0x8,    RAW1394_ARM_READ | RAW1394_ARM_WRITE | RAW1394_ARM_LOCK,
+                                                                                               RAW1394_ARM_WRITE | RAW1394_ARM_LOCK, mailbox_handler },
+    { "scratch",   ARM_BASE + 0x2000,  0x1000, RAW1394_ARM_READ | RAW1394_ARM_WRITE,           0,                                  NULL },
+};
+
+
+// fill @map with the device table and @windows generated windows
+int build_device(ArmRegionMap &map, unsigned int windows, nodeaddr_t window_stride)
+{
+    static const char identity[] = "libraw1394 tutorial 13 multi region device";
+    std::vector<byte_t> init(0x100, 0);
+    memcpy(&init[0], identity, sizeof(identity));
+
+    for (size_t i = 0; i < sizeof(device_regions) / sizeof(device_regions[0]); i++) {
+        const bool ident = (i == 0);
+        if (map.add(device_regions[i], ident ? &init[0] : NULL) < 0) return -1;
+    }
+    for (unsigned int w = 0; w < windows; w++) {
+        arm_region_desc desc = { "window", WINDOW_BASE + w * window_stride, WINDOW_SIZE,
+                                 RAW1394_ARM_READ | RAW1394_ARM_WRITE, RAW1394_ARM_WRITE,
+                                 window_handler };
+        if (map.add(desc, NULL, (void *)(size_t)w) < 0) return -1;
+    }
+    return 0;
+}
+
+
+void print_regions(ArmRegionMap &map)
+{
+    for (size_t i = 0; i < map.size(); i++) {
+        const ArmRegion &r = map.at(i);
+        printf("  0x%012llx - 0x%012llx  %-9s %c%c%c  notify %c%c%c  %llu requests\n",
+               (unsigned long long)r.desc.start, (unsigned long long)r.end(), r.desc.name,
+               r.desc.access & RAW1394_ARM_READ ? 'r' : '-',
+               r.desc.access & RAW1394_ARM_WRITE ? 'w' : '-',
+               r.desc.access & RAW1394_ARM_LOCK ? 'l' : '-',
+               r.desc.notify & RAW1394_ARM_READ ? 'r' : '-',
+               r.desc.notify & RAW1394_ARM_WRITE ? 'w' : '-',
+               r.desc.notify & RAW1394_ARM_LOCK ? 'l' : '-',
+               r.requests);
+    }
+}
+
+
+// time find() over every quadlet of every region
+double lookup_ns(ArmRegionMap &map, unsigned int rounds)
+{
+    std::vector<nodeaddr_t> addrs;
+    for (size_t i = 0; i < map.size(); i++) {
+        for (nodeaddr_t a = map.at(i).desc.start; a < map.at(i).end(); a += 4) addrs.push_back(a);
+    }
+    // visit them out of order, like requests from the bus would
+    for (size_t i = addrs.size(); i > 1; i--) std::swap(addrs[i - 1], addrs[rand() % i]);
+
+    unsigned long long found = 0;
+    const uint64_t start = iso_sim_now_ns();
+    for (unsigned int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < addrs.size(); i++) found += map.find(addrs[i], 4) != NULL;
+    }
+    const uint64_t elapsed = iso_sim_now_ns() - start;
+    if (found != (unsigned long long)rounds * addrs.size()) {
+        std::cerr << "**** Error: lookup missed " << rounds * addrs.size() - found << std::endl;
+    }
+    return (double)elapsed / ((double)rounds * addrs.size());
+}
+
+
+// -t: lookup cost as the number of regions grows, no hardware needed
+int self_test()
+{
+    const unsigned int counts[] = { 8, 64, 512, 4096 };
+    printf("%8s %14s %10s %14s %10s\n", "windows", "dense ns/find", "index", "sparse ns/find", "index");
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        ArmRegionMap dense, sparse;
+        // back to back windows fit the flat table, 1 MiB apart they do not
+        if (build_device(dense, counts[c], WINDOW_SIZE) || dense.build() ||
+            build_device(sparse, counts[c], 0x100000) || sparse.build()) {
+            std::cerr << "**** Error: bad region table " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+        const unsigned int rounds = 4000000 / (counts[c] * WINDOW_SIZE / 4) + 1;
+        printf("%8u %14.1f %10s %14.1f %10s\n", counts[c],
+               lookup_ns(dense, rounds), dense.flat() ? "flat" : "bsearch",
+               lookup_ns(sparse, rounds), sparse.flat() ? "flat" : "bsearch");
+    }
+    return EXIT_SUCCESS;
+}
+
+
+// -s: feed @writes fake remote writes through the ARM callback into the
+// mirror, every write fills one window with copies of its sequence number
+int simulate(const char *shm_name, unsigned int windows, unsigned long long writes)
+{
+    ArmRegionMap map;
+    ArmShmMirror shm;
+    if (build_device(map, windows, WINDOW_SIZE) || shm.create(shm_name, map)) {
+        std::cerr << "**** Error: failed to create mirror " << shm_name << " "
+                  << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    mirror = &shm;
+    verbose = false;
+    std::cout << "simulating " << writes << " writes into " << windows
+              << " windows, mirror " << shm_name << std::endl;
+
+    quadlet_t data[WINDOW_SIZE / 4];
+    struct raw1394_arm_request request;
+    struct raw1394_arm_request_response req_resp;
+    memset(&request, 0, sizeof(request));
+    req_resp.request = &request;
+    req_resp.response = NULL;
+
+    const uint64_t start = iso_sim_now_ns();
+    unsigned long long k;
+    for (k = 0; k < writes && running && windows; k++) {
+        const quadlet_t value = htonl(k);
+        for (size_t q = 0; q < WINDOW_SIZE / 4; q++) data[q] = value;
+        request.destination_offset = WINDOW_BASE + (k % windows) * WINDOW_SIZE;
+        request.tcode = 1;   // block write request
+        request.buffer_length = sizeof(data);
+        request.buffer = (byte_t *)data;
+        ArmRegionMap::arm_callback(NULL, &req_resp, sizeof(data), &map, RAW1394_ARM_WRITE);
+    }
+    const uint64_t elapsed = iso_sim_now_ns() - start;
+    printf("%llu writes, %.1f ns per mirrored write\n", k, k ? (double)elapsed / k : 0.0);
+
+    mirror = NULL;
+    shm.close();
+    return EXIT_SUCCESS;
+}
+
+
+// -a: print the mirror of a running server, -w keeps checking the windows
+int attach(const char *shm_name, bool watch)
+{
+    ArmShmReader reader;
+    if (reader.open(shm_name)) {
+        std::cerr << "**** Error: failed to open mirror " << shm_name << " "
+                  << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < reader.size(); i++) {
+        const arm_shm_region &r = reader.region(i);
+        quadlet_t first = 0;
+        reader.read(i, 0, &first, 4);
+        printf("  0x%012llx - 0x%012llx  %-9s seq %-8u %llu updates  [0] = 0x%08x\n",
+               (unsigned long long)r.start, (unsigned long long)(r.start + r.length), r.name,
+               r.seq.load(), (unsigned long long)r.updates, ntohl(first));
+    }
+    if (!watch) return EXIT_SUCCESS;
+
+    // a consistent snapshot of a window holds one value only
+    const int first_window = reader.find(WINDOW_BASE);
+    if (first_window < 0) {
+        std::cerr << "**** Error: no windows in " << shm_name << std::endl;
+        return EXIT_FAILURE;
+    }
+    unsigned long long snapshots = 0, retries = 0, torn = 0, stalled = 0;
+    uint64_t next_report = iso_sim_now_ns() + 1000000000ULL;
+    while (running)
+    {
+        for (size_t i = first_window; i < reader.size() && running; i++) {
+            uint32_t seq;
+            if (reader.begin(i, seq)) {
+                if (errno == ESRCH) {
+                    std::cerr << "**** Error: server gone in the middle of an update" << std::endl;
+                    return EXIT_FAILURE;
+                }
+                stalled++;   // the server is alive but did not finish in time
+                continue;
+            }
+            const quadlet_t *q = (const quadlet_t *)reader.data(i);
+            bool same = true;
+            for (size_t n = 1; n < reader.region(i).length / 4; n++) same &= (q[n] == q[0]);
+            if (!reader.consistent(i, seq)) {
+                retries++;   // changed meanwhile, the next round looks again
+                continue;
+            }
+            snapshots++;
+            if (!same) torn++;
+        }
+        const uint64_t now = iso_sim_now_ns();
+        if (now >= next_report) {
+            printf("%llu consistent snapshots, %llu retries, %llu torn, %llu stalled updates\n",
+                   snapshots, retries, torn, stalled);
+            next_report = now + 1000000000ULL;
+        }
+    }
+    printf("%llu consistent snapshots, %llu retries, %llu torn, %llu stalled updates\n",
+           snapshots, retries, torn, stalled);
+    return torn ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 13_arm_multi_region [-h] [-p port] [-n windows] [-t] [-m shm] [-a shm [-w]]\n"
+              << "                           [-s writes]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -n  number of generated windows (default 32)\n"
+              << "    -t  measure the region lookup, no FireWire card needed\n"
+              << "    -m  mirror the regions into shared memory (e.g. " MIRROR_NAME ")\n"
+              << "    -a  attach to the mirror of a running server and print it\n"
+              << "    -w  with -a, keep checking the windows for consistent snapshots\n"
+              << "    -s  simulate remote writes into the -m mirror, no FireWire card needed\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    unsigned int windows = 32;
+    const char *shm_name = NULL;
+    const char *attach_name = NULL;
+    bool watch = false;
+    unsigned long long sim_writes = 0;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:n:tm:a:ws:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            windows = atoi(optarg);
+            break;
+        case 't':
+            return self_test();
+            break;
+        case 'm':
+            shm_name = optarg;
+            break;
+        case 'a':
+            attach_name = optarg;
+            break;
+        case 'w':
+            watch = true;
+            break;
+        case 's':
+            sim_writes = strtoull(optarg, NULL, 0);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+    if (attach_name) return attach(attach_name, watch);
+    if (sim_writes) return simulate(shm_name ? shm_name : MIRROR_NAME, windows, sim_writes);
+
+
+    // ----- Get handle and set port for the handle -------
+    // create handle
+    handle = raw1394_new_handle();
+    if (handle == NULL) {
+        std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // get port number & sanity check
+    int numPorts = raw1394_get_port_info(handle, NULL, 0);
+    if (port < 0 || port >= numPorts) {
+        std::cerr << "Invalid port number" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // let user to choose which port to use
+    rc = raw1394_set_port(handle, port);
+    if (rc) {
+        std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+
+    // -------- Set FireWire bus reset handler --------
+
+    // set bus reset handler
+    raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 13 multi region arm server
+    // ----------------------------------------------------------------------------
+
+    ArmRegionMap map;
+    if (build_device(map, windows, WINDOW_SIZE)) {
+        std::cerr << "**** Error: bad region table " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    // the mirror observes the map, set it up before registering
+    ArmShmMirror shm;
+    if (shm_name) {
+        if (shm.create(shm_name, map)) {
+            std::cerr << "**** Error: failed to create mirror " << shm_name << " "
+                      << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+        mirror = &shm;
+    }
+    if (map.register_all(handle)) {
+        std::cerr << "**** Error: failed to setup arm registers, error "
+                  << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "--------- Now start arm server -----------" << std::endl
+              << " node id = " << std::hex << raw1394_get_local_id(handle) << std::dec
+              << ", " << map.size() << " regions, ";
+    if (map.flat()) std::cout << "flat index, " << map.table_entries() << " entries of "
+                              << map.granule() << " bytes" << std::endl;
+    else std::cout << "binary search index" << std::endl;
+    print_regions(map);
+    if (mirror) std::cout << "mirrored to shared memory " << shm_name << std::endl;
+
+    while (running)
+    {
+        if (raw1394_loop_iterate(handle) && errno != EINTR) break;
+    }
+
+    std::cout << "---- requests per region ----" << std::endl;
+    print_regions(map);
+    std::cout << "unmatched requests " << map.unmatched() << std::endl;
+
+    // clean up & exit
+    mirror = NULL;
+    shm.close();
+    map.unregister_all();
+    raw1394_destroy_handle(handle);
+
+    return EXIT_SUCCESS;
+}
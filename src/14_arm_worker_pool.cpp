@@ -0,0 +1,404 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <stdio.h>
+#include <atomic>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "arm_worker_pool.h"
+
+
+/**
+  * @brief: Tutorial 14: ARM requests served by a worker pool
+  *
+  *     In tutorial 2 my_arm_req_callback does its work inside
+  *     raw1394_loop_iterate: a slow request holds back every request behind
+  *     it and the bus reset handler. Here the callback only queues the
+  *     request (ArmWorkerPool, arm_worker_pool.h) and returns:
+  *         - -w worker threads run the slow part (-d microseconds each)
+  *         - a write of a command to quadlet 0 is answered in the result
+  *           quadlets at +0x10: the command and a sequence number
+  *         - the loop thread polls the 1394 fd and the pool's eventfd and
+  *           stores finished results with raw1394_arm_set_buf
+  *         - once per second: queue depth, drops and request latency
+  *     -w 0 handles requests inside the callback, like tutorial 2.
+  *
+  *     - to run this example
+  *         - run 14_arm_worker_pool on one computer
+  *         - write commands to 0xffffff000000 from another one
+  *     - 14_arm_worker_pool -s 20000 simulates 20000 requests per second
+  *       without hardware, compare -w 0 with -w 4
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+#define ARM_BASE        0xffffff000000ULL
+#define ARM_LENGTH      0x100
+#define RESULT_OFFSET   0x10
+#define DELAY_BUCKETS   32
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+volatile sig_atomic_t running = 1;
+
+ArmWorkerPool *pool = NULL;          /*!< NULL = handle inside the callback */
+unsigned int work_us = 200;          /*!< emulated work per command */
+std::atomic<unsigned int> commands(0);
+
+// time from the arrival of a request until the callback saw it, sim only
+unsigned long long delay_hist[DELAY_BUCKETS];
+unsigned long long delay_count = 0;
+uint64_t delay_max = 0;
+
+
+/* signal handler stops the event loop */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+// the slow part, runs on a worker (or in the callback with -w 0)
+void command_handler(arm_work &work, byte_t *payload, void *context)
+{
+    if (work.type != RAW1394_ARM_WRITE || work.addr != ARM_BASE || work.length < 4) return;
+
+    // emulate a device doing something, e.g. talking to hardware
+    const uint64_t until = arm_work_now_ns() + work_us * 1000ULL;
+    while (arm_work_now_ns() < until) {}
+
+    quadlet_t result[2];
+    memcpy(&result[0], payload, 4);
+    result[1] = htonl(commands.fetch_add(1) + 1);
+    memcpy(payload, result, sizeof(result));
+    work.response_addr = ARM_BASE + RESULT_OFFSET;
+    work.response_length = sizeof(result);
+}
+
+
+// arm callback, only queues the request when there is a pool
+int my_arm_req_callback(raw1394handle_t handle,
+                        struct raw1394_arm_request_response *arm_req_resp,
+                        unsigned int requested_length,
+                        void *pcontext, byte_t request_type)
+{
+    const struct raw1394_arm_request *req = arm_req_resp->request;
+    if (pool) {
+        pool->submit(req, request_type, requested_length);
+        return 0;
+    }
+
+    arm_work work;
+    memset(&work, 0, sizeof(work));
+    work.addr = req->destination_offset;
+    work.type = request_type;
+    byte_t payload[8] = { 0 };
+    work.length = std::min<size_t>(req->buffer_length, sizeof(payload));
+    memcpy(payload, req->buffer, work.length);
+    command_handler(work, payload, NULL);
+    if (handle && work.response_length) {
+        raw1394_arm_set_buf(handle, work.response_addr, work.response_length, payload);
+    }
+    return 0;
+}
+
+
+void record_delay(uint64_t ns)
+{
+    int bucket = 0;
+    while (bucket < DELAY_BUCKETS - 1 && (ns >> (bucket + 1))) bucket++;
+    delay_hist[bucket]++;
+    delay_count++;
+    if (ns > delay_max) delay_max = ns;
+}
+
+uint64_t delay_ns(double p)
+{
+    const unsigned long long target = (unsigned long long)(p * delay_count);
+    unsigned long long seen = 0;
+    for (int i = 0; i < DELAY_BUCKETS; i++) {
+        seen += delay_hist[i];
+        if (seen > target) return std::min<uint64_t>(2ULL << i, delay_max);
+    }
+    return delay_max;
+}
+
+
+void print_metrics(unsigned long long handled)
+{
+    if (pool) {
+        printf("%8llu req  %6llu dropped  %6llu truncated  depth %3zu (max %3zu)  latency p50 %7.1f us  p99 %7.1f us  max %7.1f us",
+               pool->completed(), pool->dropped(), pool->truncated(), pool->depth(), pool->max_depth(),
+               pool->latency_ns(0.5) / 1e3, pool->latency_ns(0.99) / 1e3,
+               pool->max_latency_ns() / 1e3);
+        pool->reset_metrics();
+    } else {
+        printf("%8llu req  inline", handled);
+    }
+    if (delay_count) {
+        printf("  dispatch delay p99 %7.1f us  max %7.1f us", delay_ns(0.99) / 1e3, delay_max / 1e3);
+    }
+    printf("\n");
+    fflush(stdout);
+    memset(delay_hist, 0, sizeof(delay_hist));
+    delay_count = 0;
+    delay_max = 0;
+}
+
+
+// -s: requests arrive at @rate per second for @seconds, no hardware needed
+int simulate(unsigned int rate, unsigned int seconds)
+{
+    struct raw1394_arm_request request;
+    struct raw1394_arm_request_response req_resp;
+    memset(&request, 0, sizeof(request));
+    req_resp.request = &request;
+    req_resp.response = NULL;
+    quadlet_t command;
+
+    const uint64_t period = 1000000000ULL / (rate ? rate : 1);
+    const uint64_t start = arm_work_now_ns();
+    const uint64_t end = start + seconds * 1000000000ULL;
+    uint64_t next_arrival = start;
+    uint64_t next_report = start + 1000000000ULL;
+    unsigned long long sent = 0, handled = 0;
+
+    while (running)
+    {
+        uint64_t now = arm_work_now_ns();
+        if (now >= end) break;
+
+        // every request that should have arrived by now, late if the
+        // loop thread was busy; an overloaded loop still reports and ends
+        while (next_arrival <= now && now < next_report && now < end && running) {
+            command = htonl(sent);
+            request.destination_offset = ARM_BASE;
+            request.buffer_length = sizeof(command);
+            request.buffer = (byte_t *)&command;
+            record_delay(arm_work_now_ns() - next_arrival);
+            my_arm_req_callback(NULL, &req_resp, sizeof(command), NULL, RAW1394_ARM_WRITE);
+            sent++;
+            handled++;
+            next_arrival += period;
+            now = arm_work_now_ns();
+        }
+
+        // wait for the next arrival or finished work
+        const int timeout_ms = (next_arrival > now) ? (int)((next_arrival - now) / 1000000) : 0;
+        if (pool) {
+            struct pollfd pfd = { pool->fd(), POLLIN, 0 };
+            if (poll(&pfd, 1, timeout_ms) > 0) pool->complete(NULL);
+        } else if (next_arrival > now) {
+            usleep((next_arrival - now) / 1000);
+        }
+
+        if (now >= next_report) {
+            print_metrics(handled);
+            handled = 0;
+            next_report += 1000000000ULL;
+        }
+    }
+    std::cout << sent << " requests sent, " << commands.load() << " handled" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 14_arm_worker_pool [-h] [-p port] [-w workers] [-q depth] [-d us]\n"
+              << "                          [-s rate] [-T seconds]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -w  worker threads (default 4, 0 = handle inside the callback)\n"
+              << "    -q  queue depth (default 256)\n"
+              << "    -d  emulated work per command in microseconds (default 200)\n"
+              << "    -s  simulate requests per second, no FireWire card needed\n"
+              << "    -T  simulation length in seconds (default 3)\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    unsigned int workers = 4;
+    unsigned int depth = 256;
+    unsigned int sim_rate = 0;
+    unsigned int sim_seconds = 3;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:w:q:d:s:T:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'w':
+            workers = atoi(optarg);
+            break;
+        case 'q':
+            depth = atoi(optarg);
+            break;
+        case 'd':
+            work_us = atoi(optarg);
+            break;
+        case 's':
+            sim_rate = atoi(optarg);
+            break;
+        case 'T':
+            sim_seconds = atoi(optarg);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+    ArmWorkerPool worker_pool(depth, 8);
+    if (workers) {
+        if (worker_pool.start(workers, command_handler, NULL)) {
+            std::cerr << "**** Error: failed to start workers " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+        pool = &worker_pool;
+    }
+    std::cout << (workers ? "worker pool: " : "inline: ") << workers << " workers, depth "
+              << depth << ", " << work_us << " us per command" << std::endl;
+
+    if (sim_rate) return simulate(sim_rate, sim_seconds);
+
+
+    // ----- Get handle and set port for the handle -------
+    // create handle
+    handle = raw1394_new_handle();
+    if (handle == NULL) {
+        std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // get port number & sanity check
+    int numPorts = raw1394_get_port_info(handle, NULL, 0);
+    if (port < 0 || port >= numPorts) {
+        std::cerr << "Invalid port number" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // let user to choose which port to use
+    rc = raw1394_set_port(handle, port);
+    if (rc) {
+        std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+
+    // -------- Set FireWire bus reset handler --------
+
+    // set bus reset handler
+    raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 14 arm server with worker pool
+    // ----------------------------------------------------------------------------
+
+    byte_t arm_init_buffer[ARM_LENGTH];
+    memset(arm_init_buffer, 0, sizeof(arm_init_buffer));
+
+    raw1394_arm_reqhandle arm_reqhandle;
+    arm_reqhandle.pcontext = NULL;
+    arm_reqhandle.arm_callback = my_arm_req_callback;
+    arm_reqhandle.buffer_length = 0;
+
+    rc = raw1394_arm_register(handle,
+                              ARM_BASE,                     // arm start address
+                              ARM_LENGTH,                   // bytes
+                              arm_init_buffer,              // arm init buffer value
+                              (octlet_t) &arm_reqhandle,    // arm request handler
+                              RAW1394_ARM_READ | RAW1394_ARM_WRITE,   // access permission
+                              RAW1394_ARM_WRITE,            // callback will be notified
+                              0);                           // libraw1394 answers all transactions
+    if (rc) {
+        std::cerr << "**** Error: failed to setup arm register, error "
+                  << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "--------- Now start arm server -----------" << std::endl
+              << " node id = " << std::hex << raw1394_get_local_id(handle)
+              << ", commands at 0x" << ARM_BASE << ", results at 0x"
+              << ARM_BASE + RESULT_OFFSET << std::dec << std::endl;
+
+    // the 1394 fd and the pool's eventfd, completions are stored from here
+    struct pollfd fds[2];
+    fds[0].fd = raw1394_get_fd(handle);
+    fds[0].events = POLLIN;
+    fds[1].fd = pool ? pool->fd() : -1;   // ignored by poll when negative
+    fds[1].events = POLLIN;
+
+    uint64_t next_report = arm_work_now_ns() + 1000000000ULL;
+    unsigned long long handled = commands.load();
+    while (running)
+    {
+        rc = poll(fds, 2, 100);
+        if (rc < 0 && errno != EINTR) break;
+        if (rc > 0 && (fds[0].revents & POLLIN)) {
+            if (raw1394_loop_iterate(handle) && errno != EINTR) break;
+        }
+        if (rc > 0 && (fds[1].revents & POLLIN)) pool->complete(handle);
+
+        if (arm_work_now_ns() >= next_report) {
+            print_metrics(commands.load() - handled);
+            handled = commands.load();
+            next_report += 1000000000ULL;
+        }
+    }
+
+    // clean up & exit
+    worker_pool.stop();
+    raw1394_arm_unregister(handle, ARM_BASE);
+    raw1394_destroy_handle(handle);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,338 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "async_engine.h"
+
+
+/**
+  * @brief: Tutorial 15: Pipelined asynchronous reads
+  *
+  *     Tutorial 3 uses raw1394_read: one request, wait for the response, next
+  *     request. main1394.cpp shows the building block to do better,
+  *     raw1394_start_read with a tag handler. AsyncEngine (async_engine.h)
+  *     keeps many such transactions in flight, limited by a window in total
+  *     and per node, and finds each completion by its tag.
+  *
+  *     This tutorial reads the same addresses of one or more nodes
+  *         - with a window of 1, which is what raw1394_read does
+  *         - with the configured window
+  *     and prints the transaction rate of both.
+  *
+  *     - to run this example
+  *         - run 2_arm_server on the other computers
+  *         - 15_async_pipeline -n 1,2 (physical ids of the server nodes)
+  *     - or without hardware against in-process stand-ins of 2_arm_server:
+  *       15_async_pipeline -s 4
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+#define ARM_BASE        0xffffff000000ULL
+#define ARM_LENGTH      16                  /*!< the 4 quadlets 2_arm_server registers */
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+volatile sig_atomic_t running = 1;
+
+// read buffers, one per engine slot, handed out through the request context
+struct read_run
+{
+    std::vector<quadlet_t> buffers;
+    std::vector<int> free;
+    size_t quadlets;
+    unsigned long long done;
+    unsigned long long errors;
+    unsigned long long mismatches;
+    bool verify;
+};
+
+read_run run;
+
+
+/* signal handler stops the benchmark */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+// the stand-in nodes hold (phy id << 24 | quadlet index) in every quadlet
+quadlet_t pattern(unsigned int phy_id, nodeaddr_t addr)
+{
+    return htonl((phy_id << 24) | (unsigned int)((addr - ARM_BASE) / 4));
+}
+
+
+void read_done(const async_request &request, int error, void *context)
+{
+    const int b = (int)(size_t)context;
+    run.done++;
+    if (error) {
+        run.errors++;
+    } else if (run.verify && request.buffer[0] != pattern(request.node & ASYNC_NODE_MASK, request.addr)) {
+        run.mismatches++;
+    }
+    run.free.push_back(b);
+}
+
+
+// @count reads of @length bytes spread over @nodes, returns reads per second
+double pipelined_reads(AsyncEngine &engine, const std::vector<nodeid_t> &nodes,
+                       size_t length, unsigned long long count)
+{
+    run.done = run.errors = run.mismatches = 0;
+    const uint64_t start = async_now_ns();
+    for (unsigned long long k = 0; k < count && running; k++) {
+        while (run.free.empty()) engine.iterate();
+        const int b = run.free.back();
+        run.free.pop_back();
+
+        const nodeid_t node = nodes[k % nodes.size()];
+        const nodeaddr_t addr = ARM_BASE + ((k / nodes.size()) * length) % (ARM_LENGTH - length + 1) / 4 * 4;
+        while (engine.read(node, addr, length, &run.buffers[b * run.quadlets],
+                           read_done, (void *)(size_t)b)) {
+            engine.iterate();
+        }
+    }
+    engine.drain();
+    const double seconds = (async_now_ns() - start) * 1e-9;
+    return run.done / seconds;
+}
+
+
+// what tutorial 3 does, for comparison on real hardware
+double blocking_reads(const std::vector<nodeid_t> &nodes, size_t length, unsigned long long count)
+{
+    std::vector<quadlet_t> buffer(run.quadlets);
+    run.done = run.errors = 0;
+    const uint64_t start = async_now_ns();
+    for (unsigned long long k = 0; k < count && running; k++) {
+        const nodeaddr_t addr = ARM_BASE + ((k / nodes.size()) * length) % (ARM_LENGTH - length + 1) / 4 * 4;
+        if (raw1394_read(handle, nodes[k % nodes.size()], addr, length, &buffer[0])) run.errors++;
+        run.done++;
+    }
+    return run.done / ((async_now_ns() - start) * 1e-9);
+}
+
+
+void print_result(const char *name, double rate, size_t length, double baseline)
+{
+    printf("%-26s %10.0f reads/s %8.2f MB/s", name, rate, rate * length / 1e6);
+    if (baseline > 0) printf("  x%.1f", rate / baseline);
+    printf("  errors %llu", run.errors);
+    if (run.verify) printf("  mismatches %llu", run.mismatches);
+    printf("\n");
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 15_async_pipeline [-h] [-p port] [-n nodes] [-l bytes] [-c count]\n"
+              << "                         [-w window] [-N per node] [-s nodes] [-L us] [-V speed]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -n  comma separated physical ids of the server nodes (default 0)\n"
+              << "    -l  bytes per read, at most 16 (default 4)\n"
+              << "    -c  reads per run (default 20000)\n"
+              << "    -w  transactions in flight (default 32)\n"
+              << "    -N  transactions in flight per node (default 8)\n"
+              << "    -s  simulate this many server nodes, no FireWire card needed\n"
+              << "    -L  response time of a simulated node in microseconds (default 10)\n"
+              << "    -V  speed of the simulated bus, 100/200/400/800 (default 400)\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    std::vector<nodeid_t> phy_ids;
+    size_t length = 4;
+    unsigned long long count = 20000;
+    unsigned int window = 32;
+    unsigned int per_node = 8;
+    unsigned int sim_nodes = 0;
+    unsigned int response_us = 10;
+    int speed = RAW1394_ISO_SPEED_400;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:n:l:c:w:N:s:L:V:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            for (char *s = strtok(optarg, ","); s; s = strtok(NULL, ",")) phy_ids.push_back(atoi(s));
+            break;
+        case 'l':
+            length = (atoi(optarg) + 3) & ~3;
+            break;
+        case 'c':
+            count = strtoull(optarg, NULL, 0);
+            break;
+        case 'w':
+            window = atoi(optarg);
+            break;
+        case 'N':
+            per_node = atoi(optarg);
+            break;
+        case 's':
+            sim_nodes = atoi(optarg);
+            break;
+        case 'L':
+            response_us = atoi(optarg);
+            break;
+        case 'V':
+            speed = RAW1394_ISO_SPEED_100;
+            for (int v = atoi(optarg); v > 100 && speed < RAW1394_ISO_SPEED_800; v /= 2) speed++;
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+    if (length == 0 || length > ARM_LENGTH) {
+        std::cerr << "Invalid read size" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+    const unsigned int slots = 256;
+    run.quadlets = length / 4;
+    run.buffers.assign(slots * run.quadlets, 0);
+    for (unsigned int b = slots; b > 0; b--) run.free.push_back(b - 1);
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 15 pipelined reads
+    // ----------------------------------------------------------------------------
+
+    AsyncTransport *transport;
+    AsyncLoopback *loopback = NULL;
+    std::vector<nodeid_t> nodes;
+
+    if (sim_nodes) {
+        // stand-ins for 2_arm_server on physical ids 1..sim_nodes
+        loopback = new AsyncLoopback(speed, response_us * 1000ULL);
+        std::vector<quadlet_t> memory(ARM_LENGTH / 4);
+        for (unsigned int n = 1; n <= sim_nodes && n < ASYNC_MAX_NODES - 1; n++) {
+            for (size_t q = 0; q < memory.size(); q++) memory[q] = pattern(n, ARM_BASE + q * 4);
+            loopback->add_node(n, ARM_BASE, ARM_LENGTH, &memory[0]);
+            nodes.push_back((loopback->local_id() & 0xffc0) | n);
+        }
+        transport = loopback;
+        run.verify = true;
+        std::cout << "simulating " << nodes.size() << " nodes, response time " << response_us
+                  << " us" << std::endl;
+    } else {
+        // ----- Get handle and set port for the handle -------
+        // create handle
+        handle = raw1394_new_handle();
+        if (handle == NULL) {
+            std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // get port number & sanity check
+        int numPorts = raw1394_get_port_info(handle, NULL, 0);
+        if (port < 0 || port >= numPorts) {
+            std::cerr << "Invalid port number" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // let user to choose which port to use
+        rc = raw1394_set_port(handle, port);
+        if (rc) {
+            std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // set bus reset handler
+        raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+
+        if (phy_ids.empty()) phy_ids.push_back(0);
+        for (size_t i = 0; i < phy_ids.size(); i++) {
+            nodes.push_back((raw1394_get_local_id(handle) & 0xffc0) | (phy_ids[i] & ASYNC_NODE_MASK));
+        }
+        transport = new Raw1394Transport(handle);
+        run.verify = false;
+    }
+
+    printf("%llu reads of %zu bytes from %zu nodes\n", count, length, nodes.size());
+
+    double baseline = 0;
+    if (!sim_nodes) {
+        // blocking reads need the default tag handler back for a moment
+        delete transport;
+        baseline = blocking_reads(nodes, length, count);
+        print_result("blocking raw1394_read", baseline, length, 0);
+        transport = new Raw1394Transport(handle);
+    }
+
+    {
+        AsyncEngine sequential(*transport, slots, 1, 1);
+        const double one = pipelined_reads(sequential, nodes, length, count);
+        print_result("window 1", one, length, baseline);
+        if (baseline == 0) baseline = one;
+    }
+
+    {
+        AsyncEngine pipelined(*transport, slots, window, per_node);
+        char name[64];
+        snprintf(name, sizeof(name), "window %u, %u per node", window, per_node);
+        const double many = pipelined_reads(pipelined, nodes, length, count);
+        print_result(name, many, length, baseline);
+        printf("max in flight %u, stale completions %llu\n",
+               pipelined.max_in_flight(), pipelined.stale());
+    }
+
+    // clean up & exit
+    delete transport;
+    if (handle) raw1394_destroy_handle(handle);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,428 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "async_batch.h"
+
+
+/**
+  * @brief: Tutorial 16: Scatter/gather batches of register accesses
+  *
+  *     A servo loop reads tens of scattered registers every cycle. Tutorial 3
+  *     would call raw1394_read for each one. AsyncBatch (async_batch.h) takes
+  *     the register list once, merges neighbours into block transactions up
+  *     to each node's max payload and runs all of them through an
+  *     AsyncEngine at the same time.
+  *
+  *     This tutorial builds a list of scattered registers on one or more
+  *     nodes, prints the merge decisions and times a cycle
+  *         - one transaction per register, one at a time (raw1394_read)
+  *         - one transaction per register, pipelined
+  *         - merged and pipelined
+  *     then writes the registers as a batch and reads them back.
+  *
+  *     - to run this example
+  *         - run 13_arm_multi_region on the other computers, its scratch
+  *           region is large enough for the registers
+  *         - 16_async_batch -n 1,2 (physical ids of the server nodes)
+  *     - or without hardware against in-process stand-ins of that region:
+  *       16_async_batch -s 2
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+#define ARM_BASE        0xffffff002000ULL   /*!< scratch region of 13_arm_multi_region */
+#define ARM_LENGTH      0x1000
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+volatile sig_atomic_t running = 1;
+
+
+/* signal handler stops the cycles */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+// the stand-in nodes hold (phy id << 24 | quadlet index) in every quadlet
+quadlet_t pattern(unsigned int phy_id, nodeaddr_t addr)
+{
+    return htonl((phy_id << 24) | (unsigned int)((addr - ARM_BASE) / 4));
+}
+
+
+// max_rec of the bus info block: the node accepts blocks of 2^(max_rec + 1) bytes
+size_t read_max_payload(nodeid_t node)
+{
+    quadlet_t bus_options;
+    if (raw1394_read(handle, node, CSR_REGISTER_BASE + CSR_CONFIG_ROM + 8, 4, &bus_options)) {
+        return 512;   // at least S400 nodes take that
+    }
+    const unsigned int max_rec = (ntohl(bus_options) >> 12) & 0xf;
+    return (max_rec >= 1 && max_rec <= 12) ? (size_t)2 << max_rec : 512;
+}
+
+
+/**
+ * @count registers spread over the first half of the ARM range of @nodes:
+ * mostly quadlets, some 2 and 4 quadlet blocks, a few of them neighbours.
+ * No two overlap, so each is one transaction unless the batch merges it.
+ * Returns the number made, less than @count when the range is full
+ */
+size_t make_registers(const std::vector<nodeid_t> &nodes, size_t count,
+                      std::vector<quadlet_t> &data, std::vector<async_batch_entry> &list)
+{
+    const size_t slots = ARM_LENGTH / 8;   // quadlets in the first half, per node
+    std::vector<bool> used(nodes.size() * slots, false);
+    unsigned int seed = 1394;
+    list.resize(count);
+    size_t quadlets = 0;
+    for (size_t i = 0; i < count; i++) {
+        const unsigned int r = rand_r(&seed);
+        const size_t n = i % nodes.size();
+        list[i].node = nodes[n];
+        list[i].length = (r % 8 == 0) ? 16 : (r % 8 == 1) ? 8 : 4;
+        size_t slot = 0;
+        bool placed = false;
+        for (int attempt = 0; attempt < 100 + (int)slots && !placed; attempt++) {
+            // random places first, then the first free one
+            slot = attempt < 100 ? rand_r(&seed) % (slots - list[i].length / 4 + 1) : attempt - 100;
+            if (slot + list[i].length / 4 > slots) continue;
+            placed = true;
+            for (size_t q = 0; q < list[i].length / 4; q++) placed &= !used[n * slots + slot + q];
+        }
+        if (!placed && list[i].length > 4) {
+            // no room for the block, a quadlet may still fit
+            list[i].length = 4;
+            for (slot = 0; slot < slots && used[n * slots + slot]; slot++) {}
+            placed = slot < slots;
+        }
+        if (!placed) {
+            list.resize(i);
+            break;
+        }
+        for (size_t q = 0; q < list[i].length / 4; q++) used[n * slots + slot + q] = true;
+        list[i].addr = ARM_BASE + slot * 4;
+        quadlets += list[i].length / 4;
+    }
+    count = list.size();
+    data.assign(quadlets, 0);
+    size_t q = 0;
+    for (size_t i = 0; i < count; i++) {
+        list[i].buffer = &data[q];
+        q += list[i].length / 4;
+    }
+    return count;
+}
+
+
+void add_registers(AsyncBatch &batch, const std::vector<async_batch_entry> &list)
+{
+    for (size_t i = 0; i < list.size(); i++) {
+        batch.add(list[i].node, list[i].addr, list[i].length, list[i].buffer);
+    }
+}
+
+
+// count registers whose data differs from the stand-in pattern (or @xor_mask of it)
+size_t check(const AsyncBatch &batch, quadlet_t xor_mask)
+{
+    size_t bad = 0;
+    for (size_t i = 0; i < batch.num_entries(); i++) {
+        const async_batch_entry &e = batch.entry(i);
+        for (size_t q = 0; q < e.length / 4; q++) {
+            if (e.buffer[q] != (pattern(e.node & ASYNC_NODE_MASK, e.addr + q * 4) ^ xor_mask)) {
+                bad++;
+                break;
+            }
+        }
+    }
+    return bad;
+}
+
+
+// @cycles batch reads, returns the mean cycle time in microseconds
+double time_cycles(AsyncBatch &batch, unsigned int cycles, unsigned long long *errors)
+{
+    uint64_t total = 0;
+    unsigned int done = 0;
+    for (; done < cycles && running; done++) {
+        if (batch.read()) (*errors)++;
+        total += batch.run_ns();
+    }
+    return done ? total / 1e3 / done : 0;
+}
+
+
+// tutorial 3 style, one raw1394_read per register
+double time_blocking(const std::vector<async_batch_entry> &list, unsigned int cycles,
+                     unsigned long long *errors)
+{
+    const uint64_t start = async_now_ns();
+    unsigned int done = 0;
+    for (; done < cycles && running; done++) {
+        for (size_t i = 0; i < list.size(); i++) {
+            const async_batch_entry &e = list[i];
+            if (raw1394_read(handle, e.node, e.addr, e.length, e.buffer)) (*errors)++;
+        }
+    }
+    return done ? (async_now_ns() - start) / 1e3 / done : 0;
+}
+
+
+void print_result(const char *name, size_t transactions, double us, double baseline,
+                  unsigned long long errors)
+{
+    printf("%-28s %4zu transactions %9.1f us/cycle", name, transactions, us);
+    if (baseline > 0 && us > 0) printf("  x%.1f", baseline / us);
+    printf("  errors %llu\n", errors);
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 16_async_batch [-h] [-p port] [-n nodes] [-r registers] [-g gap]\n"
+              << "                      [-c cycles] [-w window] [-s nodes] [-L us] [-V speed]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -n  comma separated physical ids of the server nodes (default 0)\n"
+              << "    -r  registers per cycle (default 64)\n"
+              << "    -g  bytes a read may skip to merge two registers (default 16)\n"
+              << "    -c  cycles per run (default 1000)\n"
+              << "    -w  transactions in flight (default 32)\n"
+              << "    -s  simulate this many server nodes, no FireWire card needed\n"
+              << "    -L  response time of a simulated node in microseconds (default 10)\n"
+              << "    -V  speed of the simulated bus, 100/200/400/800 (default 400)\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    std::vector<nodeid_t> phy_ids;
+    size_t registers = 64;
+    size_t max_gap = 16;
+    unsigned int cycles = 1000;
+    unsigned int window = 32;
+    unsigned int sim_nodes = 0;
+    unsigned int response_us = 10;
+    int speed = RAW1394_ISO_SPEED_400;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:n:r:g:c:w:s:L:V:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            for (char *s = strtok(optarg, ","); s; s = strtok(NULL, ",")) phy_ids.push_back(atoi(s));
+            break;
+        case 'r':
+            registers = atoi(optarg);
+            break;
+        case 'g':
+            max_gap = atoi(optarg);
+            break;
+        case 'c':
+            cycles = atoi(optarg);
+            break;
+        case 'w':
+            window = atoi(optarg);
+            break;
+        case 's':
+            sim_nodes = atoi(optarg);
+            break;
+        case 'L':
+            response_us = atoi(optarg);
+            break;
+        case 'V':
+            speed = RAW1394_ISO_SPEED_100;
+            for (int v = atoi(optarg); v > 100 && speed < RAW1394_ISO_SPEED_800; v /= 2) speed++;
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+    if (registers == 0) {
+        std::cerr << "Invalid number of registers" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 16 batch reads and writes
+    // ----------------------------------------------------------------------------
+
+    AsyncTransport *transport;
+    AsyncLoopback *loopback = NULL;
+    std::vector<nodeid_t> nodes;
+    std::vector<size_t> max_payload;
+
+    if (sim_nodes) {
+        // stand-ins for the scratch region on physical ids 1..sim_nodes
+        loopback = new AsyncLoopback(speed, response_us * 1000ULL);
+        std::vector<quadlet_t> memory(ARM_LENGTH / 4);
+        for (unsigned int n = 1; n <= sim_nodes && n < ASYNC_MAX_NODES - 1; n++) {
+            for (size_t q = 0; q < memory.size(); q++) memory[q] = pattern(n, ARM_BASE + q * 4);
+            loopback->add_node(n, ARM_BASE, ARM_LENGTH, &memory[0]);
+            nodes.push_back((loopback->local_id() & 0xffc0) | n);
+            max_payload.push_back((size_t)512 << speed);   // max payload of the bus speed
+        }
+        transport = loopback;
+        std::cout << "simulating " << nodes.size() << " nodes, response time " << response_us
+                  << " us" << std::endl;
+    } else {
+        // ----- Get handle and set port for the handle -------
+        // create handle
+        handle = raw1394_new_handle();
+        if (handle == NULL) {
+            std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // get port number & sanity check
+        int numPorts = raw1394_get_port_info(handle, NULL, 0);
+        if (port < 0 || port >= numPorts) {
+            std::cerr << "Invalid port number" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // let user to choose which port to use
+        rc = raw1394_set_port(handle, port);
+        if (rc) {
+            std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // set bus reset handler
+        raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+
+        if (phy_ids.empty()) phy_ids.push_back(0);
+        for (size_t i = 0; i < phy_ids.size(); i++) {
+            nodes.push_back((raw1394_get_local_id(handle) & 0xffc0) | (phy_ids[i] & ASYNC_NODE_MASK));
+            max_payload.push_back(read_max_payload(nodes.back()));
+        }
+        transport = NULL;   // after the blocking reads, it takes over the tag handler
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        printf("node %d: max payload %zu bytes\n", nodes[i] & ASYNC_NODE_MASK, max_payload[i]);
+    }
+
+    std::vector<quadlet_t> data;
+    std::vector<async_batch_entry> list;
+    if (make_registers(nodes, registers, data, list) < registers) {
+        registers = list.size();
+        printf("the ARM ranges hold only %zu registers\n", registers);
+    }
+
+    double baseline = 0;
+    unsigned long long errors = 0;
+    if (!sim_nodes) {
+        baseline = time_blocking(list, cycles, &errors);
+        print_result("raw1394_read per register", registers, baseline, 0, errors);
+        transport = new Raw1394Transport(handle);
+    }
+
+    {
+        AsyncEngine engine(*transport, 256, window, window);
+        AsyncBatch unmerged(engine, 0);
+        AsyncBatch batched(engine, max_gap);
+        add_registers(unmerged, list);
+        add_registers(batched, list);
+        for (size_t i = 0; i < nodes.size(); i++) {
+            unmerged.set_max_payload(nodes[i], 4);   // nothing merges with a quadlet limit
+            batched.set_max_payload(nodes[i], max_payload[i]);
+        }
+
+        // merge decisions
+        batched.plan(false);
+        std::cout << "read plan, max gap " << max_gap << " bytes" << std::endl;
+        batched.print_plan(std::cout);
+
+        if (sim_nodes) {
+            // window 1 is what raw1394_read does
+            engine.set_window(1, 1);
+            errors = 0;
+            baseline = time_cycles(unmerged, cycles, &errors);
+            print_result("one at a time", unmerged.num_transactions(), baseline, 0, errors);
+            engine.set_window(window, window);
+        }
+
+        errors = 0;
+        const double us_unmerged = time_cycles(unmerged, cycles, &errors);
+        print_result("pipelined", unmerged.num_transactions(), us_unmerged, baseline, errors);
+
+        errors = 0;
+        const double us_batched = time_cycles(batched, cycles, &errors);
+        print_result("merged and pipelined", batched.num_transactions(), us_batched, baseline, errors);
+        if (sim_nodes) printf("registers not matching the pattern: %zu\n", check(batched, 0));
+
+        // write the registers back inverted as a batch, only adjacent ones merge
+        for (size_t q = 0; q < data.size(); q++) data[q] = ~data[q];
+        batched.plan(true);
+        std::cout << "write plan" << std::endl;
+        batched.print_plan(std::cout);
+        if (batched.write()) {
+            std::cerr << "**** Error: batch write failed " << strerror(errno) << std::endl;
+        } else if (batched.read()) {
+            std::cerr << "**** Error: batch read failed " << strerror(errno) << std::endl;
+        } else if (sim_nodes) {
+            printf("registers not matching after the write: %zu\n", check(batched, 0xffffffff));
+        }
+    }
+
+    // clean up & exit
+    delete transport;
+    if (handle) raw1394_destroy_handle(handle);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,316 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "async_retry.h"
+
+
+/**
+  * @brief: Tutorial 17: Transactions across bus resets
+  *
+  *     Tutorial 3 gives up when raw1394_read fails after a bus reset: the
+  *     handle's generation is stale and the server node may have a new node
+  *     id. AsyncRetry (async_retry.h) addresses nodes by GUID, reads the
+  *     GUIDs again after every reset and issues the interrupted transactions
+  *     once more, so the reader below only sees a latency blip.
+  *
+  *     This tutorial keeps reads in flight to one or more nodes and resets
+  *     the bus every few milliseconds, then prints errors (there should be
+  *     none), how many transactions were retried and the time from a reset
+  *     to the first retried transaction that succeeded.
+  *
+  *     - to run this example
+  *         - run 2_arm_server on the other computers
+  *         - 17_async_retry -n 1,2 -R 500 (reset the bus every 500 ms)
+  *     - or without hardware against in-process stand-ins of 2_arm_server
+  *       that swap node ids at every reset: 17_async_retry -s 4
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+#define ARM_BASE        0xffffff000000ULL
+#define ARM_LENGTH      16                  /*!< the 4 quadlets 2_arm_server registers */
+#define SIM_GUID        0x0030bb0000000000ULL   /*!< | phy id the stand-in started with */
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+volatile sig_atomic_t running = 1;
+
+// one read in flight, the context of its callback
+struct read_slot
+{
+    octlet_t guid;
+    unsigned int origin;        /*!< stand-ins: phy id whose pattern it holds */
+    uint64_t submit_ns;
+    quadlet_t data;
+};
+
+std::vector<read_slot> slots;
+std::vector<int> free_slots;
+unsigned long long done_reads = 0;
+unsigned long long errors = 0;
+unsigned long long mismatches = 0;
+uint64_t max_latency_ns = 0;
+bool verify = false;
+
+
+/* signal handler stops the reads */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+// the stand-in nodes hold (phy id << 24 | quadlet index) in every quadlet
+quadlet_t pattern(unsigned int phy_id, nodeaddr_t addr)
+{
+    return htonl((phy_id << 24) | (unsigned int)((addr - ARM_BASE) / 4));
+}
+
+
+void read_done(const async_request &request, int error, void *context)
+{
+    read_slot &s = *(read_slot *)context;
+    const uint64_t latency = async_now_ns() - s.submit_ns;
+    if (latency > max_latency_ns) max_latency_ns = latency;
+    done_reads++;
+    if (error) {
+        errors++;
+        std::cerr << "**** Error: read failed " << strerror(error) << std::endl;
+    } else if (verify && s.data != pattern(s.origin, request.addr)) {
+        mismatches++;   // answered by another node
+    }
+    free_slots.push_back((int)(&s - &slots[0]));
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 17_async_retry [-h] [-p port] [-n nodes] [-c count] [-w window]\n"
+              << "                      [-R ms] [-s nodes] [-L us]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -n  comma separated physical ids of the server nodes (default 0)\n"
+              << "    -c  reads (default 200000)\n"
+              << "    -w  transactions in flight (default 16)\n"
+              << "    -R  reset the bus every ms milliseconds (default 20 simulated, 0 = never)\n"
+              << "    -s  simulate this many server nodes, no FireWire card needed\n"
+              << "    -L  response time of a simulated node in microseconds (default 10)\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    std::vector<nodeid_t> phy_ids;
+    unsigned long long count = 200000;
+    unsigned int window = 16;
+    int reset_ms = -1;
+    unsigned int sim_nodes = 0;
+    unsigned int response_us = 10;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:n:c:w:R:s:L:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            for (char *s = strtok(optarg, ","); s; s = strtok(NULL, ",")) phy_ids.push_back(atoi(s));
+            break;
+        case 'c':
+            count = strtoull(optarg, NULL, 0);
+            break;
+        case 'w':
+            window = atoi(optarg);
+            break;
+        case 'R':
+            reset_ms = atoi(optarg);
+            break;
+        case 's':
+            sim_nodes = atoi(optarg);
+            break;
+        case 'L':
+            response_us = atoi(optarg);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+    if (window == 0) window = 1;
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 17 reads across bus resets
+    // ----------------------------------------------------------------------------
+
+    AsyncTransport *transport;
+    AsyncLoopback *loopback = NULL;
+
+    if (sim_nodes) {
+        // stand-ins for 2_arm_server on physical ids 1..sim_nodes, with GUIDs
+        if (sim_nodes > ASYNC_MAX_NODES - 2) sim_nodes = ASYNC_MAX_NODES - 2;
+        loopback = new AsyncLoopback(RAW1394_ISO_SPEED_400, response_us * 1000ULL);
+        std::vector<quadlet_t> memory(ARM_LENGTH / 4);
+        for (unsigned int n = 1; n <= sim_nodes; n++) {
+            for (size_t q = 0; q < memory.size(); q++) memory[q] = pattern(n, ARM_BASE + q * 4);
+            loopback->add_node(n, ARM_BASE, ARM_LENGTH, &memory[0]);
+            loopback->set_guid(n, SIM_GUID | n);
+        }
+        transport = loopback;
+        verify = true;
+        if (reset_ms < 0) reset_ms = 20;
+        std::cout << "simulating " << sim_nodes << " nodes, response time " << response_us
+                  << " us" << std::endl;
+    } else {
+        // ----- Get handle and set port for the handle -------
+        // create handle
+        handle = raw1394_new_handle();
+        if (handle == NULL) {
+            std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // get port number & sanity check
+        int numPorts = raw1394_get_port_info(handle, NULL, 0);
+        if (port < 0 || port >= numPorts) {
+            std::cerr << "Invalid port number" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // let user to choose which port to use
+        rc = raw1394_set_port(handle, port);
+        if (rc) {
+            std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // set bus reset handler, the transport calls it before AsyncRetry
+        raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+        transport = new Raw1394Transport(handle);
+        if (reset_ms < 0) reset_ms = 0;
+    }
+
+    {
+        AsyncEngine engine(*transport, 256, window, window);
+        AsyncRetry retry(engine);
+
+        // who is who, the servers are addressed by GUID from now on
+        if (retry.resolve()) {
+            std::cerr << "**** Error: could not read the GUIDs " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::vector<octlet_t> guids;
+        std::vector<unsigned int> origins;
+        if (sim_nodes) {
+            for (unsigned int n = 1; n <= sim_nodes; n++) phy_ids.push_back(n);
+        } else if (phy_ids.empty()) {
+            phy_ids.push_back(0);
+        }
+        for (size_t i = 0; i < phy_ids.size(); i++) {
+            const octlet_t guid = retry.guid_of(phy_ids[i]);
+            if (guid == ASYNC_GUID_NONE) {
+                std::cerr << "**** Error: node " << phy_ids[i] << " has no GUID" << std::endl;
+                return EXIT_FAILURE;
+            }
+            guids.push_back(guid);
+            origins.push_back(phy_ids[i]);
+            printf("node %u: GUID %016llx\n", (unsigned int)phy_ids[i], (unsigned long long)guid);
+        }
+
+        slots.resize(window);
+        for (unsigned int i = window; i > 0; i--) free_slots.push_back(i - 1);
+
+        const uint64_t start = async_now_ns();
+        uint64_t next_reset = reset_ms ? start + reset_ms * 1000000ULL : 0;
+        unsigned int seed = 1394;
+        for (unsigned long long k = 0; k < count && running; k++) {
+            while (free_slots.empty()) retry.iterate();
+            read_slot &s = slots[free_slots.back()];
+            free_slots.pop_back();
+
+            const size_t target = k % guids.size();
+            const nodeaddr_t addr = ARM_BASE + ((k / guids.size()) * 4) % ARM_LENGTH;
+            s.guid = guids[target];
+            s.origin = origins[target];
+            s.submit_ns = async_now_ns();
+            while (retry.read(s.guid, addr, 4, &s.data, read_done, &s)) retry.iterate();
+
+            if (next_reset && async_now_ns() >= next_reset) {
+                if (loopback) {
+                    // a reset may hand out the physical ids in another order
+                    const unsigned int a = 1 + rand_r(&seed) % sim_nodes;
+                    const unsigned int b = 1 + rand_r(&seed) % sim_nodes;
+                    loopback->move_node(a, b);
+                    loopback->bus_reset();
+                } else if (raw1394_reset_bus(handle)) {
+                    std::cerr << "**** Error: failed to reset the bus " << strerror(errno) << std::endl;
+                }
+                next_reset = async_now_ns() + reset_ms * 1000000ULL;
+            }
+        }
+        retry.drain();
+        const double seconds = (async_now_ns() - start) * 1e-9;
+
+        printf("%llu reads in %.2f s, errors %llu", done_reads, seconds, errors);
+        if (verify) printf(", answered by the wrong node %llu", mismatches);
+        printf("\n");
+        printf("bus resets %llu, transactions retried %llu, given up %llu\n",
+               retry.resets(), retry.retried(), retry.lost());
+        printf("reset to first successful retry: mean %.1f us, max %.1f us (%llu resets)\n",
+               retry.mean_recovery_ns() / 1e3, retry.max_recovery_ns() / 1e3, retry.recoveries());
+        printf("max read latency %.1f us\n", max_latency_ns / 1e3);
+    }
+
+    // clean up & exit
+    delete transport;
+    if (handle) raw1394_destroy_handle(handle);
+
+    return EXIT_SUCCESS;
+}
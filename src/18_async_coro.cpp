@@ -0,0 +1,294 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "async_coro.h"
+
+
+/**
+  * @brief: Tutorial 18: Transactions in coroutines
+  *
+  *     main1394.cpp starts a read and picks the result up in a tag handler,
+  *     tutorial 15 hands completions to callbacks. Both split one sequence
+  *     of transactions over several functions. With C++20 coroutines and
+  *     FwScheduler (async_coro.h) the sequence stays one function:
+  *
+  *         quadlet_t old;
+  *         int error = co_await fw.lock(node, addr, FETCH_ADD, htonl(1), 0, &old);
+  *
+  *     The co_await suspends the coroutine, the tag completion resumes it.
+  *     This tutorial runs thousands of such coroutines on one thread, each
+  *     reading a register of 2_arm_server and incrementing the counter in
+  *     its first quadlet with a lock, then checks the counter. It runs the
+  *     tasks twice and counts coroutine frames taken from the heap: the
+  *     first pass allocates them, the second reuses them. The transactions
+  *     themselves use the engine's preallocated slots.
+  *
+  *     - to run this example
+  *         - run 2_arm_server on the other computers
+  *         - 18_async_coro -n 1,2 (physical ids of the server nodes)
+  *     - or without hardware against in-process stand-ins of 2_arm_server:
+  *       18_async_coro -s 4
+  *     - build with a C++20 compiler (-std=c++2a, gcc 10 also -fcoroutines)
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+#define ARM_BASE        0xffffff000000ULL
+#define ARM_QUADLETS    4               /*!< the register of 2_arm_server */
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+volatile sig_atomic_t running = 1;
+
+unsigned long long errors = 0;
+unsigned long long finished = 0;
+
+
+/* signal handler stops the tasks */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+void report(int error, const char *what)
+{
+    if (errors++ == 0) {
+        std::cerr << "**** Error: " << what << " failed " << strerror(error) << std::endl;
+    }
+}
+
+
+// one logical client: read a register, count the visit, @rounds times
+FwTask client(FwScheduler &fw, nodeid_t node, unsigned int rounds)
+{
+    for (unsigned int r = 0; r < rounds && running; r++) {
+        quadlet_t value;
+        int error = co_await fw.read(node, ARM_BASE + 4 * (1 + r % (ARM_QUADLETS - 1)), value);
+        if (error) {
+            report(error, "read");
+            co_return;
+        }
+
+        // operands and old value in bus byte order
+        quadlet_t old;
+        error = co_await fw.lock(node, ARM_BASE, RAW1394_EXTCODE_FETCH_ADD, htonl(1), 0, &old);
+        if (error) {
+            report(error, "lock");
+            co_return;
+        }
+    }
+    finished++;
+}
+
+
+// reads the counter of @node into *@count
+FwTask read_counter(FwScheduler &fw, nodeid_t node, quadlet_t *count)
+{
+    quadlet_t value;
+    const int error = co_await fw.read(node, ARM_BASE, value);
+    if (error) report(error, "counter read");
+    else *count = ntohl(value);
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 18_async_coro [-h] [-p port] [-n nodes] [-t tasks] [-r rounds]\n"
+              << "                     [-w window] [-s nodes] [-L us]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -n  comma separated physical ids of the server nodes (default 0)\n"
+              << "    -t  coroutines (default 4096)\n"
+              << "    -r  read and lock rounds of each coroutine (default 4)\n"
+              << "    -w  transactions in flight (default 32)\n"
+              << "    -s  simulate this many server nodes, no FireWire card needed\n"
+              << "    -L  response time of a simulated node in microseconds (default 10)\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    std::vector<nodeid_t> phy_ids;
+    unsigned int tasks = 4096;
+    unsigned int rounds = 4;
+    unsigned int window = 32;
+    unsigned int sim_nodes = 0;
+    unsigned int response_us = 10;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:n:t:r:w:s:L:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            for (char *s = strtok(optarg, ","); s; s = strtok(NULL, ",")) phy_ids.push_back(atoi(s));
+            break;
+        case 't':
+            tasks = atoi(optarg);
+            break;
+        case 'r':
+            rounds = atoi(optarg);
+            break;
+        case 'w':
+            window = atoi(optarg);
+            break;
+        case 's':
+            sim_nodes = atoi(optarg);
+            break;
+        case 'L':
+            response_us = atoi(optarg);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+    if (window == 0) window = 1;
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 18 transactions in coroutines
+    // ----------------------------------------------------------------------------
+
+    AsyncTransport *transport;
+    std::vector<nodeid_t> nodes;
+
+    if (sim_nodes) {
+        // stand-ins for 2_arm_server on physical ids 1..sim_nodes
+        AsyncLoopback *loopback = new AsyncLoopback(RAW1394_ISO_SPEED_400, response_us * 1000ULL);
+        quadlet_t memory[ARM_QUADLETS];
+        memset(memory, 0x02, sizeof(memory));   // 2_arm_server's initial value
+        for (unsigned int n = 1; n <= sim_nodes && n < ASYNC_MAX_NODES - 1; n++) {
+            loopback->add_node(n, ARM_BASE, sizeof(memory), memory);
+            nodes.push_back((loopback->local_id() & 0xffc0) | n);
+        }
+        transport = loopback;
+        std::cout << "simulating " << nodes.size() << " nodes, response time " << response_us
+                  << " us" << std::endl;
+    } else {
+        // ----- Get handle and set port for the handle -------
+        // create handle
+        handle = raw1394_new_handle();
+        if (handle == NULL) {
+            std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // get port number & sanity check
+        int numPorts = raw1394_get_port_info(handle, NULL, 0);
+        if (port < 0 || port >= numPorts) {
+            std::cerr << "Invalid port number" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // let user to choose which port to use
+        rc = raw1394_set_port(handle, port);
+        if (rc) {
+            std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // set bus reset handler
+        raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+
+        if (phy_ids.empty()) phy_ids.push_back(0);
+        for (size_t i = 0; i < phy_ids.size(); i++) {
+            nodes.push_back((raw1394_get_local_id(handle) & 0xffc0) | (phy_ids[i] & ASYNC_NODE_MASK));
+        }
+        transport = new Raw1394Transport(handle);
+    }
+
+    {
+        AsyncEngine engine(*transport, 256, window, window);
+        FwScheduler fw(engine);
+
+        std::vector<quadlet_t> before(nodes.size(), 0), after(nodes.size(), 0);
+        for (size_t i = 0; i < nodes.size(); i++) fw.spawn(read_counter(fw, nodes[i], &before[i]));
+        fw.run();
+
+        printf("%u coroutines, %u rounds of read + lock each, window %u\n", tasks, rounds, window);
+        for (int pass = 1; pass <= 2 && running && !errors; pass++) {
+            const unsigned long long transactions = fw.transactions();
+            const unsigned long long waited = fw.waited();
+            const unsigned long long allocated = FwFramePool::allocated();
+            const uint64_t start = async_now_ns();
+
+            for (unsigned int t = 0; t < tasks; t++) fw.spawn(client(fw, nodes[t % nodes.size()], rounds));
+            if (fw.run()) {
+                std::cerr << "**** Error: loop failed " << strerror(errno) << std::endl;
+                break;
+            }
+
+            const double seconds = (async_now_ns() - start) * 1e-9;
+            const unsigned long long done = fw.transactions() - transactions;
+            printf("pass %d: %llu transactions in %.3f s, %.0f trans/s, waited for a slot %llu, "
+                   "new frames %llu\n", pass, done, seconds, seconds > 0 ? done / seconds : 0.0,
+                   fw.waited() - waited, FwFramePool::allocated() - allocated);
+        }
+
+        for (size_t i = 0; i < nodes.size(); i++) fw.spawn(read_counter(fw, nodes[i], &after[i]));
+        fw.run();
+
+        // each finished coroutine counted @rounds visits on its node
+        unsigned long long counted = 0;
+        for (size_t i = 0; i < nodes.size(); i++) counted += (quadlet_t)(after[i] - before[i]);
+        printf("finished coroutines %llu, counted visits %llu (expected %llu), errors %llu\n",
+               finished, counted, finished * rounds, errors);
+        printf("max in flight %u\n", engine.max_in_flight());
+    }
+
+    // clean up & exit
+    delete transport;
+    if (handle) raw1394_destroy_handle(handle);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
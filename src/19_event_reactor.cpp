@@ -0,0 +1,349 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "async_engine.h"
+#include "event_reactor.h"
+#include "latency_hist.h"
+
+
+/**
+  * @brief: Tutorial 19: One event loop for handles, timers and threads
+  *
+  *     The other tutorials spin in raw1394_loop_iterate, which owns the
+  *     thread. EventReactor (event_reactor.h) puts raw1394_get_fd of every
+  *     handle into one epoll set next to timerfds and eventfds and calls
+  *     raw1394_loop_iterate only when the handle has something to read.
+  *
+  *     This tutorial opens a handle per port and, from a timer, reads the
+  *     bus info block of a node through an AsyncEngine on each handle. A
+  *     helper thread wakes the loop through an eventfd at a fixed rate.
+  *     Both run first with the reactor sleeping in epoll_wait, then in busy
+  *     poll mode, and the tutorial prints wake-up and read latency and
+  *     timer jitter percentiles, events per wake-up and the CPU time used.
+  *
+  *     - to run this example
+  *         - 19_event_reactor -p 0,1 -n 0 (ports to open, node to read)
+  *     - or without a FireWire card, eventfd and timer only (the timer
+  *       then just ticks): 19_event_reactor -s
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+volatile sig_atomic_t running = 1;
+
+EventReactor *reactor = NULL;
+
+// one open port, read from its timer
+struct port_reads
+{
+    raw1394handle_t handle;
+    Raw1394Transport *transport;
+    AsyncEngine *engine;
+    nodeid_t node;
+    quadlet_t data;
+    bool busy;
+    uint64_t submit_ns;
+};
+
+LatencyHistogram wake_latency;      /*!< eventfd notify() to callback */
+LatencyHistogram read_latency;      /*!< bus info block read round trip */
+LatencyHistogram tick_jitter;       /*!< timer period deviation */
+uint64_t tick_period_ns = 0;
+uint64_t last_tick_ns = 0;
+unsigned long long read_errors = 0;
+
+std::atomic<uint64_t> stamp_ns(0);
+std::atomic<bool> producing(false);
+
+
+/* signal handler stops the loop */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+    if (reactor) reactor->stop();   // also ends a busy poll
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+// helper thread: stamp, then wake the reactor
+void producer(int fd, unsigned int interval_us)
+{
+    struct timespec pause = { 0, (long)interval_us * 1000 };
+    while (producing.load()) {
+        nanosleep(&pause, NULL);
+        stamp_ns.store(reactor_now_ns());
+        EventReactor::notify(fd);
+    }
+}
+
+
+void on_wake(int fd, uint64_t count, void *context)
+{
+    // count > 1: notifications coalesced, the stamp is the latest one
+    wake_latency.record(reactor_now_ns() - stamp_ns.load());
+}
+
+
+void read_done(const async_request &request, int error, void *context)
+{
+    port_reads &p = *(port_reads *)context;
+    p.busy = false;
+    if (error) {
+        if (read_errors++ == 0) {
+            std::cerr << "**** Error: read failed " << strerror(error) << std::endl;
+        }
+        return;
+    }
+    read_latency.record(reactor_now_ns() - p.submit_ns);
+}
+
+
+// timer: one read per port, unless the last one is still out
+void on_tick(int fd, uint64_t expirations, void *context)
+{
+    const uint64_t now = reactor_now_ns();
+    if (last_tick_ns && expirations == 1) {
+        const uint64_t interval = now - last_tick_ns;
+        tick_jitter.record(interval > tick_period_ns ? interval - tick_period_ns : tick_period_ns - interval);
+    }
+    last_tick_ns = now;
+
+    std::vector<port_reads> &ports = *(std::vector<port_reads> *)context;
+    for (size_t i = 0; i < ports.size(); i++) {
+        port_reads &p = ports[i];
+        if (p.busy) continue;
+        p.busy = true;
+        p.submit_ns = reactor_now_ns();
+        if (p.engine->read(p.node, ASYNC_BUS_INFO_BLOCK, 4, &p.data, read_done, &p)) {
+            p.busy = false;
+            read_errors++;
+        }
+    }
+}
+
+
+void print_latency(const char *name, const LatencyHistogram &h)
+{
+    if (h.count() == 0) return;
+    printf("    %-14s %8llu  p50 %7.1f us  p99 %7.1f us  max %7.1f us\n", name,
+           (unsigned long long)h.count(), h.percentile(0.50) / 1e3, h.percentile(0.99) / 1e3,
+           h.max() / 1e3);
+}
+
+
+double cpu_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 19_event_reactor [-h] [-p ports] [-n node] [-T ms] [-i us] [-d s] [-s]\n"
+              << "    -h  show usage\n"
+              << "    -p  comma separated port numbers to open (default 0)\n"
+              << "    -n  physical id of the node to read (default 0)\n"
+              << "    -T  read period in milliseconds (default 1)\n"
+              << "    -i  eventfd wake-up interval in microseconds (default 200)\n"
+              << "    -d  seconds per mode (default 2)\n"
+              << "    -s  no FireWire card: eventfd and timer only\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    std::vector<int> port_numbers;
+    nodeid_t phy_id = 0;
+    unsigned int period_ms = 1;
+    unsigned int interval_us = 200;
+    unsigned int seconds = 2;
+    bool sim = false;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:n:T:i:d:s";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            for (char *s = strtok(optarg, ","); s; s = strtok(NULL, ",")) port_numbers.push_back(atoi(s));
+            break;
+        case 'n':
+            phy_id = atoi(optarg);
+            break;
+        case 'T':
+            period_ms = atoi(optarg);
+            break;
+        case 'i':
+            interval_us = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atoi(optarg);
+            break;
+        case 's':
+            sim = true;
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+    if (period_ms == 0) period_ms = 1;
+    if (port_numbers.empty()) port_numbers.push_back(0);
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 19 epoll reactor
+    // ----------------------------------------------------------------------------
+
+    EventReactor loop;
+    if (!loop.valid()) {
+        std::cerr << "**** Error: could not create the epoll set " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    reactor = &loop;
+
+    // ----- Get a handle per port, each served by the reactor -------
+    std::vector<port_reads> ports;
+    for (size_t i = 0; i < port_numbers.size() && !sim; i++) {
+        // create handle
+        raw1394handle_t h = raw1394_new_handle();
+        if (h == NULL) {
+            std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // get port number & sanity check
+        int numPorts = raw1394_get_port_info(h, NULL, 0);
+        if (port_numbers[i] < 0 || port_numbers[i] >= numPorts) {
+            std::cerr << "Invalid port number " << port_numbers[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // let user to choose which port to use
+        rc = raw1394_set_port(h, port_numbers[i]);
+        if (rc) {
+            std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // set bus reset handler, the transport chains to it
+        raw1394_set_bus_reset_handler(h, my_bus_reset_handler);
+
+        port_reads p;
+        p.handle = h;
+        p.transport = new Raw1394Transport(h);
+        p.engine = new AsyncEngine(*p.transport, 16, 1, 1);
+        p.node = (raw1394_get_local_id(h) & 0xffc0) | (phy_id & ASYNC_NODE_MASK);
+        p.busy = false;
+        ports.push_back(p);
+        if (loop.add_handle(h) < 0) {
+            std::cerr << "**** Error: could not watch the 1394 fd " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (!ports.empty()) handle = ports[0].handle;
+
+    const int wake_fd = loop.add_event(on_wake, NULL);
+    tick_period_ns = period_ms * 1000000ULL;
+    const int tick_fd = loop.add_timer(tick_period_ns, tick_period_ns, on_tick, &ports);
+    if (wake_fd < 0 || tick_fd < 0) {
+        std::cerr << "**** Error: could not create timer or eventfd " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    printf("%zu handles, eventfd every %u us, %u s per mode\n", ports.size(), interval_us, seconds);
+    for (int mode = 0; mode < 2 && running; mode++) {
+        loop.set_busy_poll(mode == 1);
+        wake_latency.reset();
+        read_latency.reset();
+        tick_jitter.reset();
+        last_tick_ns = 0;
+        const unsigned long long wakeups = loop.wakeups();
+        const unsigned long long served = loop.served();
+        const unsigned long long iterations = loop.iterations();
+        const unsigned long long empty = loop.empty_polls();
+        const double cpu = cpu_seconds();
+
+        producing = true;
+        std::thread helper(producer, wake_fd, interval_us);
+        const uint64_t end = reactor_now_ns() + seconds * 1000000000ULL;
+        while (running && reactor_now_ns() < end) {
+            if (loop.run_once(100) < 0 && errno != EINTR) {
+                std::cerr << "**** Error: event loop failed " << strerror(errno) << std::endl;
+                running = 0;
+            }
+        }
+        producing = false;
+        helper.join();
+
+        const unsigned long long w = loop.wakeups() - wakeups;
+        printf("%s:\n", mode ? "busy poll" : "epoll_wait sleeping");
+        print_latency("eventfd wake", wake_latency);
+        print_latency("1394 read", read_latency);
+        print_latency("timer jitter", tick_jitter);
+        printf("    wake-ups %llu, events per wake-up %.2f (max %u), loop_iterate %llu, "
+               "empty polls %llu, cpu %.2f s\n", w, w ? (double)(loop.served() - served) / w : 0.0,
+               loop.max_batch(), loop.iterations() - iterations, loop.empty_polls() - empty,
+               cpu_seconds() - cpu);
+    }
+    if (read_errors) printf("read errors %llu\n", read_errors);
+
+    // clean up & exit
+    reactor = NULL;
+    for (size_t i = 0; i < ports.size(); i++) {
+        loop.remove(raw1394_get_fd(ports[i].handle));
+        delete ports[i].engine;
+        delete ports[i].transport;
+        raw1394_destroy_handle(ports[i].handle);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,313 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "async_fanout.h"
+#include "latency_hist.h"
+
+
+/**
+  * @brief: Tutorial 20: Broadcast updates with per-node confirmation
+  *
+  *     Tutorial 4 broadcasts a quadlet and a block to node 0xffff and hopes
+  *     everybody got them. AsyncFanout (async_fanout.h) sends the update
+  *     once as a broadcast, reads back from every node in one pipelined
+  *     round and repairs only the nodes that missed it with unicast writes.
+  *
+  *     This tutorial sends the same stream of updates to all server nodes
+  *         - as one raw1394_write per node, one after the other
+  *         - as unicast writes to all nodes at once (pipelined)
+  *         - as broadcast + read back of the whole block
+  *         - as broadcast + read back of a status quadlet, here the update's
+  *           sequence number in its first quadlet
+  *     and prints the time and transactions per update and how many node
+  *     updates needed the unicast repair.
+  *
+  *     - to run this example
+  *         - run 2_arm_server on the other computers
+  *         - 20_broadcast_fanout -n 1,2 (physical ids of the server nodes)
+  *     - or without hardware against in-process stand-ins of 2_arm_server,
+  *       each missing 5% of the broadcasts: 20_broadcast_fanout -s 8 -l 5
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+#define ARM_BASE        0xffffff000000ULL   /*!< above CSR_CONFIG_END, broadcasts allowed */
+#define ARM_LENGTH      16                  /*!< the register of 2_arm_server */
+#define SIM_LENGTH      0x1000
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+volatile sig_atomic_t running = 1;
+
+size_t pending_writes = 0;
+unsigned long long write_errors = 0;
+
+
+/* signal handler stops the updates */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+// update @seq: its sequence number, then a pattern
+void make_update(std::vector<quadlet_t> &update, unsigned int seq)
+{
+    update[0] = htonl(seq);
+    for (size_t q = 1; q < update.size(); q++) update[q] = htonl((seq << 8) ^ (unsigned int)q);
+}
+
+
+void unicast_done(const async_request &request, int error, void *context)
+{
+    pending_writes--;
+    if (error && write_errors++ == 0) {
+        std::cerr << "**** Error: write failed " << strerror(error) << std::endl;
+    }
+}
+
+
+// one write per node through @engine, its window decides how many overlap
+void unicast_update(AsyncEngine &engine, const std::vector<nodeid_t> &nodes, std::vector<quadlet_t> &update)
+{
+    for (size_t i = 0; i < nodes.size(); i++) {
+        pending_writes++;
+        if (engine.write(nodes[i], ARM_BASE, update.size() * 4, &update[0], unicast_done, NULL)) {
+            unicast_done(async_request(), errno, NULL);
+        }
+    }
+    while (pending_writes) {
+        if (engine.iterate() && errno != EINTR) {
+            unicast_done(async_request(), errno, NULL);
+            pending_writes = 0;
+        }
+    }
+}
+
+
+void print_result(const char *name, const LatencyHistogram &h, double transactions, double baseline)
+{
+    printf("  %-30s %8.1f us/update  p99 %8.1f us  %5.1f trans/update", name, h.mean() / 1e3,
+           h.percentile(0.99) / 1e3, transactions);
+    if (baseline > 0) printf("  %.2fx", baseline / h.mean());
+    printf("\n");
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 20_broadcast_fanout [-h] [-p port] [-n nodes] [-c count] [-b bytes]\n"
+              << "                           [-s nodes] [-l percent] [-L us]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -n  comma separated physical ids of the server nodes (default 0)\n"
+              << "    -c  updates per method (default 2000)\n"
+              << "    -b  bytes per update (default 16, the register of 2_arm_server)\n"
+              << "    -s  simulate this many server nodes, no FireWire card needed\n"
+              << "    -l  simulated nodes miss this percentage of the broadcasts (default 5)\n"
+              << "    -L  response time of a simulated node in microseconds (default 10)\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    std::vector<nodeid_t> phy_ids;
+    unsigned long long count = 2000;
+    size_t length = ARM_LENGTH;
+    unsigned int sim_nodes = 0;
+    unsigned int loss = 5;
+    unsigned int response_us = 10;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:n:c:b:s:l:L:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            for (char *s = strtok(optarg, ","); s; s = strtok(NULL, ",")) phy_ids.push_back(atoi(s));
+            break;
+        case 'c':
+            count = strtoull(optarg, NULL, 0);
+            break;
+        case 'b':
+            length = atoi(optarg);
+            break;
+        case 's':
+            sim_nodes = atoi(optarg);
+            break;
+        case 'l':
+            loss = atoi(optarg);
+            break;
+        case 'L':
+            response_us = atoi(optarg);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+    length = (length + 3) & ~(size_t)3;
+    if (length < 4) length = 4;
+    if (length > SIM_LENGTH) length = SIM_LENGTH;
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 20 broadcast fan-out
+    // ----------------------------------------------------------------------------
+
+    AsyncTransport *transport;
+    AsyncLoopback *loopback = NULL;
+    std::vector<nodeid_t> nodes;
+
+    if (sim_nodes) {
+        // stand-ins for 2_arm_server on physical ids 1..sim_nodes
+        loopback = new AsyncLoopback(RAW1394_ISO_SPEED_400, response_us * 1000ULL);
+        loopback->set_broadcast_loss(loss);
+        for (unsigned int n = 1; n <= sim_nodes && n < ASYNC_BROADCAST; n++) {
+            loopback->add_node(n, ARM_BASE, SIM_LENGTH);
+            nodes.push_back((loopback->local_id() & 0xffc0) | n);
+        }
+        transport = loopback;
+        std::cout << "simulating " << nodes.size() << " nodes, response time " << response_us
+                  << " us, " << loss << "% of the broadcasts lost per node" << std::endl;
+    } else {
+        // ----- Get handle and set port for the handle -------
+        // create handle
+        handle = raw1394_new_handle();
+        if (handle == NULL) {
+            std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // get port number & sanity check
+        int numPorts = raw1394_get_port_info(handle, NULL, 0);
+        if (port < 0 || port >= numPorts) {
+            std::cerr << "Invalid port number" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // let user to choose which port to use
+        rc = raw1394_set_port(handle, port);
+        if (rc) {
+            std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // set bus reset handler
+        raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+
+        if (phy_ids.empty()) phy_ids.push_back(0);
+        for (size_t i = 0; i < phy_ids.size(); i++) {
+            nodes.push_back((raw1394_get_local_id(handle) & 0xffc0) | (phy_ids[i] & ASYNC_NODE_MASK));
+        }
+        transport = new Raw1394Transport(handle);
+        if (length > ARM_LENGTH) length = ARM_LENGTH;
+    }
+
+    printf("%llu updates of %zu bytes to %zu nodes\n", count, length, nodes.size());
+
+    std::vector<quadlet_t> update(length / 4);
+    unsigned int seq = 0;
+    double baseline = 0;
+
+    // one raw1394_write after the other, then all at once
+    for (int pipelined = 0; pipelined < 2 && running; pipelined++) {
+        AsyncEngine engine(*transport, 256, pipelined ? 64 : 1, pipelined ? 64 : 1);
+        LatencyHistogram h;
+        const unsigned long long before = engine.completed();
+        for (unsigned long long k = 0; k < count && running; k++) {
+            make_update(update, ++seq);
+            const uint64_t start = async_now_ns();
+            unicast_update(engine, nodes, update);
+            h.record(async_now_ns() - start);
+        }
+        print_result(pipelined ? "unicast, pipelined" : "unicast, one after the other", h,
+                     (double)(engine.completed() - before) / count, baseline);
+        if (baseline == 0) baseline = h.mean();
+    }
+
+    // broadcast, confirmed by a block read or by the sequence number
+    bool matches = true;
+    for (int status = 0; status < 2 && running; status++) {
+        AsyncEngine engine(*transport, 256, 64, 64);
+        AsyncFanout fanout(engine);
+        for (size_t i = 0; i < nodes.size(); i++) fanout.add_node(nodes[i]);
+        if (status) fanout.verify_status(ARM_BASE);
+
+        LatencyHistogram h;
+        for (unsigned long long k = 0; k < count && running; k++) {
+            make_update(update, ++seq);
+            if (fanout.write(ARM_BASE, length, &update[0], update[0])) {
+                if (write_errors++ == 0) {
+                    std::cerr << "**** Error: fan-out failed " << strerror(errno) << std::endl;
+                }
+            }
+            h.record(fanout.run_ns());
+        }
+        print_result(status ? "broadcast + status read" : "broadcast + block read back", h,
+                     (double)fanout.transactions() / fanout.updates(), baseline);
+        printf("  %32s node updates by broadcast %llu, repaired by unicast %llu, failed %llu\n", "",
+               fanout.confirmed(), fanout.repaired(), fanout.failed());
+
+        // the stand-ins must all hold the last update
+        for (unsigned int n = 1; loopback && n <= nodes.size(); n++) {
+            if (memcmp(loopback->memory(n), &update[0], length)) matches = false;
+        }
+    }
+    if (loopback) printf("every node holds the last update: %s\n", matches ? "yes" : "NO");
+    if (write_errors) printf("errors %llu\n", write_errors);
+
+    // clean up & exit
+    delete transport;
+    if (handle) raw1394_destroy_handle(handle);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,299 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "async_sampler.h"
+#include "latency_hist.h"
+
+
+/**
+  * @brief: Tutorial 21: Synchronized sampling with a broadcast latch
+  *
+  *     Multi-axis control: every node latches its sensors at the same
+  *     instant, then the host collects all samples. AsyncSampler
+  *     (async_sampler.h) broadcasts the latch quadlet as in tutorial 4 and,
+  *     once the broadcast went out, reads every node's sample block, pipelined.
+  *
+  *     This tutorial runs the cycle three ways
+  *         - latch and read node by node, the raw1394_write/raw1394_read loop
+  *         - a latch write per node, all at once, then the reads
+  *         - one broadcast latch, then the reads
+  *     and prints the cycle time and, when the nodes put the CYCLE_TIME of
+  *     the latch in their samples (-t), the skew between the nodes.
+  *
+  *     - to run this example
+  *         - run 2_arm_server on the other computers, the latch goes to its
+  *           first quadlet and the samples are the other three
+  *         - 21_sync_sampling -n 1,2 (physical ids of the server nodes)
+  *     - or without hardware against stand-ins that latch a timestamp, the
+  *       latch value and a sensor pattern: 21_sync_sampling -s 8
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+#define ARM_BASE        0xffffff000000ULL   /*!< above CSR_CONFIG_END, broadcasts allowed */
+#define ARM_LENGTH      16                  /*!< the register of 2_arm_server */
+#define SIM_LENGTH      0x1000
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+volatile sig_atomic_t running = 1;
+
+
+/* signal handler stops the cycles */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+/**
+ * Stand-in for a sensor node: a write to the latch address fills the
+ * sample block with the CYCLE_TIME the request arrived at, the latch value
+ * and sensor readings
+ */
+class LatchingLoopback : public AsyncLoopback
+{
+public:
+    LatchingLoopback(uint64_t response_ns, nodeaddr_t latch_addr, nodeaddr_t sample_addr, size_t length)
+        : AsyncLoopback(RAW1394_ISO_SPEED_400, response_ns), latch_addr_(latch_addr),
+          sample_addr_(sample_addr), length_(length) {}
+
+protected:
+    void written(unsigned int phy_id, const transaction &t)
+    {
+        if (t.addr != latch_addr_ || t.length != 4) return;
+        quadlet_t *sample = (quadlet_t *)(memory(phy_id) + (sample_addr_ - ARM_BASE));
+        sample[0] = htonl(ns_to_cycle_time(t.arrive_ns));
+        if (length_ >= 8) sample[1] = t.buffer[0];
+        for (size_t q = 2; q < length_ / 4; q++) {
+            sample[q] = htonl((phy_id << 24) | (unsigned int)((t.arrive_ns / 1000) & 0xfff000) | q);
+        }
+    }
+
+private:
+    nodeaddr_t latch_addr_;
+    nodeaddr_t sample_addr_;
+    size_t length_;
+};
+
+
+void print_usage()
+{
+    std::cout << "Usage: 21_sync_sampling [-h] [-p port] [-n nodes] [-c cycles] [-b bytes]\n"
+              << "                        [-a addr] [-A addr] [-t] [-s nodes] [-L us]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -n  comma separated physical ids of the server nodes (default 0)\n"
+              << "    -c  cycles per method (default 2000)\n"
+              << "    -b  sample bytes per node (default 12)\n"
+              << "    -a  latch address (default 0xffffff000000)\n"
+              << "    -A  sample address (default latch address + 4)\n"
+              << "    -t  samples start with the node's CYCLE_TIME at the latch (always simulated)\n"
+              << "    -s  simulate this many server nodes, no FireWire card needed\n"
+              << "    -L  response time of a simulated node in microseconds (default 10)\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    std::vector<nodeid_t> phy_ids;
+    unsigned long long count = 2000;
+    size_t length = ARM_LENGTH - 4;
+    nodeaddr_t latch_addr = ARM_BASE;
+    nodeaddr_t sample_addr = 0;
+    bool timestamped = false;
+    unsigned int sim_nodes = 0;
+    unsigned int response_us = 10;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:n:c:b:a:A:ts:L:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            for (char *s = strtok(optarg, ","); s; s = strtok(NULL, ",")) phy_ids.push_back(atoi(s));
+            break;
+        case 'c':
+            count = strtoull(optarg, NULL, 0);
+            break;
+        case 'b':
+            length = atoi(optarg);
+            break;
+        case 'a':
+            latch_addr = strtoull(optarg, NULL, 0);
+            break;
+        case 'A':
+            sample_addr = strtoull(optarg, NULL, 0);
+            break;
+        case 't':
+            timestamped = true;
+            break;
+        case 's':
+            sim_nodes = atoi(optarg);
+            break;
+        case 'L':
+            response_us = atoi(optarg);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+    length = (length + 3) & ~(size_t)3;
+    if (length < 4) length = 4;
+    if (sample_addr == 0) sample_addr = latch_addr + 4;
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 21 synchronized sampling
+    // ----------------------------------------------------------------------------
+
+    AsyncTransport *transport;
+    std::vector<nodeid_t> nodes;
+
+    if (sim_nodes) {
+        if (latch_addr < ARM_BASE || latch_addr + 4 > ARM_BASE + SIM_LENGTH ||
+            sample_addr < ARM_BASE || sample_addr + length > ARM_BASE + SIM_LENGTH) {
+            std::cerr << "Simulated nodes have " << SIM_LENGTH << " bytes at 0x" << std::hex
+                      << ARM_BASE << std::endl;
+            return EXIT_FAILURE;
+        }
+        // sensor nodes on physical ids 1..sim_nodes
+        LatchingLoopback *loopback = new LatchingLoopback(response_us * 1000ULL, latch_addr,
+                                                          sample_addr, length);
+        for (unsigned int n = 1; n <= sim_nodes && n < ASYNC_BROADCAST; n++) {
+            loopback->add_node(n, ARM_BASE, SIM_LENGTH);
+            nodes.push_back((loopback->local_id() & 0xffc0) | n);
+        }
+        transport = loopback;
+        timestamped = true;
+        std::cout << "simulating " << nodes.size() << " nodes, response time " << response_us
+                  << " us" << std::endl;
+    } else {
+        // ----- Get handle and set port for the handle -------
+        // create handle
+        handle = raw1394_new_handle();
+        if (handle == NULL) {
+            std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // get port number & sanity check
+        int numPorts = raw1394_get_port_info(handle, NULL, 0);
+        if (port < 0 || port >= numPorts) {
+            std::cerr << "Invalid port number" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // let user to choose which port to use
+        rc = raw1394_set_port(handle, port);
+        if (rc) {
+            std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // set bus reset handler
+        raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+
+        if (phy_ids.empty()) phy_ids.push_back(0);
+        for (size_t i = 0; i < phy_ids.size(); i++) {
+            nodes.push_back((raw1394_get_local_id(handle) & 0xffc0) | (phy_ids[i] & ASYNC_NODE_MASK));
+        }
+        transport = new Raw1394Transport(handle);
+    }
+
+    printf("%llu cycles, %zu sample bytes from %zu nodes, latch at 0x%llx, samples at 0x%llx\n",
+           count, length, nodes.size(), (unsigned long long)latch_addr, (unsigned long long)sample_addr);
+
+    const int modes[] = { SAMPLE_SEQUENTIAL, SAMPLE_UNICAST, SAMPLE_BROADCAST };
+    const char *names[] = { "latch + read, node by node", "unicast latches, pipelined",
+                            "broadcast latch, pipelined" };
+    double baseline = 0;
+    unsigned long long errors = 0, stale = 0;
+
+    for (int m = 0; m < 3 && running; m++) {
+        AsyncEngine engine(*transport, 256, modes[m] == SAMPLE_SEQUENTIAL ? 1 : 64, 8);
+        AsyncSampler sampler(engine, latch_addr, sample_addr, length);
+        sampler.set_mode(modes[m]);
+        sampler.set_timestamped(timestamped);
+        for (size_t i = 0; i < nodes.size(); i++) sampler.add_node(nodes[i]);
+
+        LatencyHistogram cycle, skew;
+        for (unsigned long long k = 0; k < count && running; k++) {
+            const quadlet_t latch = htonl((unsigned int)k + 1);
+            if (sampler.sample(latch)) {
+                if (errors++ == 0) std::cerr << "**** Error: cycle failed " << strerror(errno) << std::endl;
+                continue;
+            }
+            cycle.record(sampler.cycle_ns());
+            if (sampler.skew_ns() >= 0) skew.record(sampler.skew_ns());
+            // the stand-ins echo the latch value, each sample must be from this cycle
+            for (size_t i = 0; sim_nodes && length >= 8 && i < sampler.num_nodes(); i++) {
+                if (sampler.data(i)[1] != latch) stale++;
+            }
+        }
+
+        printf("  %-28s cycle %7.1f us (p99 %7.1f)", names[m], cycle.mean() / 1e3,
+               cycle.percentile(0.99) / 1e3);
+        if (skew.count()) printf("  skew %7.2f us (max %7.2f)", skew.mean() / 1e3, skew.max() / 1e3);
+        if (baseline > 0) printf("  %.2fx", baseline / cycle.mean());
+        printf("\n");
+        if (baseline == 0) baseline = cycle.mean();
+    }
+    if (sim_nodes) printf("samples not from their cycle %llu\n", stale);
+    if (errors) printf("failed cycles %llu\n", errors);
+
+    // clean up & exit
+    delete transport;
+    if (handle) raw1394_destroy_handle(handle);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,369 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "topology_cache.h"
+#include "latency_hist.h"
+
+
+/**
+  * @brief: Tutorial 22: Keep the bus topology across bus resets
+  *
+  *     Tutorial 1 prints the new generation after a reset, and then every
+  *     node id may have changed. Reading all config ROMs again is what
+  *     makes a reset slow on a big bus. TopologyCache (topology_cache.h)
+  *     reads the self-IDs from the topology map, the GUID and ROM
+  *     generation of every node, and the full ROM only of nodes that are
+  *     new or changed; GUID to node id is then a hash lookup.
+  *
+  *     - to run this example
+  *         - 22_topology_cache, then plug and unplug devices; the table of
+  *           nodes is printed after every reset
+  *     - or without hardware: stand-ins on physical ids 1..N, and every
+  *       simulated reset swaps, unplugs, replugs or reprograms some of
+  *       them; the incremental refresh is checked against, and timed
+  *       against, reading everything again: 22_topology_cache -s 32
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+#define SIM_GUID        0x0030bb0000000000ULL   /*!< | phy id the stand-in started with */
+#define SIM_VENDOR      0x0030bb                /*!< vendor id in the stand-in ROMs */
+#define SIM_BASE        0xffffff000000ULL
+#define SIM_LENGTH      16
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+volatile sig_atomic_t running = 1;
+
+
+/* signal handler stops the loop */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+// value of root directory entry @key, -1 if absent
+long directory_value(const topology_node &t, unsigned int key)
+{
+    for (size_t q = 6; q < t.rom.size(); q++) {
+        if ((t.rom[q] >> 24) == key) return t.rom[q] & 0xffffff;
+    }
+    return -1;
+}
+
+
+// root directory of a stand-in: vendor, node capabilities, model, a unit
+std::vector<quadlet_t> sim_directory(unsigned int model)
+{
+    std::vector<quadlet_t> entries;
+    entries.push_back(0x03000000 | SIM_VENDOR);     // module vendor id
+    entries.push_back(0x0c0083c0);                  // node capabilities
+    entries.push_back(0x17000000 | model);          // model id
+    entries.push_back(0x81000008);                  // textual descriptor leaf
+    entries.push_back(0xd1000004);                  // unit directory
+    return entries;
+}
+
+
+void print_nodes(const TopologyCache &cache)
+{
+    printf("generation %u, %d nodes, root %d%s\n", cache.generation(), cache.node_count(), cache.root(),
+           cache.has_topology_map() ? "" : " (no topology map)");
+    for (int n = 0; n < cache.node_count(); n++) {
+        const quadlet_t self_id = cache.self_id(n);
+        printf("  phy %2d", n);
+        if (cache.has_topology_map()) {
+            printf("  S%-4d %s", 100 << ((self_id >> 14) & 3), (self_id >> 22) & 1 ? "link  " : "no link");
+        }
+        const topology_node *t = cache.at(n);
+        if (t) {
+            printf("  guid %016llx  rom gen %2u  vendor %06lx  model %06lx  read %llu times",
+                   (unsigned long long)t->guid, t->rom_generation, directory_value(*t, 0x03),
+                   directory_value(*t, 0x17), t->reads);
+        }
+        printf("\n");
+    }
+}
+
+
+// @cache against what the stand-ins hold; returns the number of differences
+unsigned int verify(const TopologyCache &cache, AsyncLoopback &loopback,
+                    const std::vector<octlet_t> &guids, const std::vector<unsigned int> &models)
+{
+    unsigned int wrong = 0;
+    const nodeid_t bus = loopback.local_id() & 0xffc0;
+    for (size_t i = 0; i < guids.size(); i++) {
+        int phy = -1;
+        for (int n = 1; n < ASYNC_BROADCAST && phy < 0; n++) {
+            if (loopback.memory(n) && loopback.memory(n)[0] == (byte_t)i) phy = n;
+        }
+        const int node = cache.node_of(guids[i]);
+        if (node != (phy < 0 ? -1 : (int)(bus | phy))) wrong++;
+        const topology_node *t = cache.find(guids[i]);
+        if (phy >= 0 && (!t || directory_value(*t, 0x17) != (long)models[i])) wrong++;
+    }
+    return wrong;
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 22_topology_cache [-h] [-p port] [-s nodes] [-R resets] [-L us]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -s  simulate this many nodes, no FireWire card needed\n"
+              << "    -R  simulated bus resets (default 20)\n"
+              << "    -L  response time of a simulated node in microseconds (default 10)\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    unsigned int sim_nodes = 0;
+    unsigned int resets = 20;
+    unsigned int response_us = 10;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:s:R:L:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 's':
+            sim_nodes = atoi(optarg);
+            break;
+        case 'R':
+            resets = atoi(optarg);
+            break;
+        case 'L':
+            response_us = atoi(optarg);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 22 topology cache
+    // ----------------------------------------------------------------------------
+
+    if (!sim_nodes) {
+        // ----- Get handle and set port for the handle -------
+        // create handle
+        handle = raw1394_new_handle();
+        if (handle == NULL) {
+            std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // get port number & sanity check
+        int numPorts = raw1394_get_port_info(handle, NULL, 0);
+        if (port < 0 || port >= numPorts) {
+            std::cerr << "Invalid port number" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // let user to choose which port to use
+        rc = raw1394_set_port(handle, port);
+        if (rc) {
+            std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // set bus reset handler, the transport chains to it
+        raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+
+        Raw1394Transport transport(handle);
+        AsyncEngine engine(transport, 256, 64, 8);
+        TopologyCache cache(engine);
+
+        // refresh after every reset, the reset wakes raw1394_loop_iterate
+        while (running) {
+            if (cache.stale()) {
+                if (cache.refresh()) {
+                    std::cerr << "**** Error: refresh failed " << strerror(errno) << std::endl;
+                } else {
+                    print_nodes(cache);
+                    printf("  refresh %.1f ms, %llu ROMs read, %llu reused so far\n",
+                           cache.refresh_ns() / 1e6, cache.roms_read(), cache.roms_reused());
+                }
+            }
+            if (engine.iterate() && errno != EINTR) break;
+        }
+
+        raw1394_destroy_handle(handle);
+        return EXIT_SUCCESS;
+    }
+
+    // stand-ins on physical ids 1..sim_nodes, memory[0] tells which one it is
+    if (sim_nodes > ASYNC_MAX_NODES - 2) sim_nodes = ASYNC_MAX_NODES - 2;
+    AsyncLoopback loopback(RAW1394_ISO_SPEED_400, response_us * 1000ULL);
+    std::vector<octlet_t> guids;
+    std::vector<unsigned int> models;
+    for (unsigned int n = 1; n <= sim_nodes; n++) {
+        byte_t memory[SIM_LENGTH] = { (byte_t)(n - 1) };
+        loopback.add_node(n, SIM_BASE, SIM_LENGTH, memory);
+        loopback.set_guid(n, SIM_GUID | n);
+        guids.push_back(SIM_GUID | n);
+        models.push_back(0x100 + n);
+        loopback.set_rom_directory(n, sim_directory(models.back()));
+    }
+    std::cout << "simulating " << sim_nodes << " nodes, response time " << response_us << " us, "
+              << resets << " bus resets" << std::endl;
+
+    AsyncEngine engine(loopback, 256, 64, 8);
+    TopologyCache cache(engine);
+    if (cache.refresh()) {
+        std::cerr << "**** Error: refresh failed " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    print_nodes(cache);
+    printf("first refresh %.1f us, %llu quadlet reads\n\n", cache.refresh_ns() / 1e3, cache.quadlets());
+
+    LatencyHistogram incremental, full;
+    unsigned long long incremental_quadlets = 0, full_quadlets = 0;
+    unsigned int seed = 1394, wrong = 0, failed = 0;
+    std::vector<unsigned int> unplugged;      /*!< phy id | stand-in index << 8 */
+    for (unsigned int r = 0; r < resets && running; r++) {
+        // what happens at this reset: nodes swap places, leave, come back, get new firmware
+        const unsigned int a = 1 + rand_r(&seed) % sim_nodes, b = 1 + rand_r(&seed) % sim_nodes;
+        const char *what;
+        switch (r % 4) {
+        case 0:
+            if (loopback.memory(a) && loopback.memory(b)) loopback.move_node(a, b);
+            what = "two nodes swap ids";
+            break;
+        case 1:
+            if (loopback.memory(a)) {
+                unplugged.push_back(a | loopback.memory(a)[0] << 8);
+                loopback.remove_node(a);
+            }
+            what = "a node leaves";
+            break;
+        case 2:
+            if (!unplugged.empty()) {
+                // same place, it kept its GUID and ROM
+                byte_t memory[SIM_LENGTH] = { (byte_t)(unplugged.back() >> 8) };
+                loopback.add_node(unplugged.back() & ASYNC_NODE_MASK, SIM_BASE, SIM_LENGTH, memory);
+                unplugged.pop_back();
+            }
+            what = "a node comes back";
+            break;
+        default:
+            if (loopback.memory(a)) {
+                const unsigned int i = loopback.memory(a)[0];
+                models[i] += 0x10000;
+                loopback.set_rom_directory(a, sim_directory(models[i]));
+            }
+            what = "a node changes its ROM";
+            break;
+        }
+        loopback.bus_reset();
+        engine.iterate();   // reports the reset
+        usleep(ASYNC_RESET_NS / 1000);   // self identification, the same for both ways
+
+        const unsigned long long before = cache.quadlets();
+        const unsigned long long read = cache.roms_read(), reused = cache.roms_reused();
+        if (cache.refresh()) {
+            failed++;
+            std::cerr << "**** Error: refresh failed " << strerror(errno) << std::endl;
+            continue;
+        }
+        incremental.record(cache.refresh_ns());
+        incremental_quadlets += cache.quadlets() - before;
+        wrong += verify(cache, loopback, guids, models);
+
+        // the same bus discovered from scratch
+        TopologyCache scratch(engine);
+        if (scratch.refresh()) {
+            failed++;
+            continue;
+        }
+        full.record(scratch.refresh_ns());
+        full_quadlets += scratch.quadlets();
+        wrong += verify(scratch, loopback, guids, models);
+
+        printf("reset %2u: %-24s ROMs read %2llu reused %2llu  %7.1f us (full %7.1f us)\n", r + 1, what,
+               cache.roms_read() - read, cache.roms_reused() - reused, cache.refresh_ns() / 1e3,
+               scratch.refresh_ns() / 1e3);
+    }
+
+    if (incremental.count()) {
+        printf("\nafter a reset     %8.1f us  %6.1f quadlet reads\n", incremental.mean() / 1e3,
+               (double)incremental_quadlets / incremental.count());
+        printf("full rediscovery  %8.1f us  %6.1f quadlet reads  %.2fx\n", full.mean() / 1e3,
+               (double)full_quadlets / full.count(), full.mean() / incremental.mean());
+        printf("GUIDs seen at a new node id %llu\n", cache.moved());
+    }
+
+    // GUID to node id: the cache's table against a scan of all physical ids
+    const unsigned int lookups = 1000000;
+    volatile long sum = 0;   // keeps the loops
+    uint64_t start = async_now_ns();
+    for (unsigned int k = 0; k < lookups; k++) sum += cache.node_of(guids[k % guids.size()]);
+    const double hashed = (double)(async_now_ns() - start) / lookups;
+    start = async_now_ns();
+    for (unsigned int k = 0; k < lookups; k++) {
+        const octlet_t guid = guids[k % guids.size()];
+        for (int n = 0; n < ASYNC_MAX_NODES; n++) {
+            if (cache.guid_of(n) == guid) {
+                sum += n;
+                break;
+            }
+        }
+    }
+    const double scanned = (double)(async_now_ns() - start) / lookups;
+    printf("node_of %.1f ns, scan of the physical ids %.1f ns\n", hashed, scanned);
+    printf("differences from the stand-ins %u\n", wrong);
+    if (failed) printf("failed refreshes %u\n", failed);
+
+    return EXIT_SUCCESS;
+}
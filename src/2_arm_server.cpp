@@ -2,25 +2,43 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
 #include <iostream>
 #include <byteswap.h>
+#include <vector>
 
 // libraw1394
 #include <libraw1394/raw1394.h>
 #include <libraw1394/csr.h>
 
+#include "arm_dirty.h"
+#include "arm_snapshot.h"
+#include "iso_sim.h"
+
 
 /**
   * @brief: Tutorial 2: arm server
   *
   *     This tutorial shows how to register arm to handle incoming firewire request:
   *         - arm: Address Range Mapping
-  *         - 1 register arm buffer for read/write access
+  *         - 1 register arm buffer for read/write/lock access
   *         - 2 read first 4 quadlet (should be initial value)
   *         - 3 write value to frist 4 quadlets
   *         - 4 read back for verification
   *     NOTE: this program will be used in the next tutorial as server program.
   *
+  *     Every remote write is also applied to an ArmSnapshot (arm_snapshot.h),
+  *     other threads read complete blocks from it instead of calling
+  *     raw1394_arm_get_buf, which can return a block torn by a write in
+  *     progress. -s starts such a reader thread, -t tests the snapshot
+  *     against a fast local writer, no FireWire card needed.
+  *
+  *     Written quadlets are also marked in an ArmDirtyMap (arm_dirty.h): -c
+  *     starts a thread that sleeps on its eventfd and prints only the ranges
+  *     that changed, -d tests it against a local writer.
+  *
   * @date 2013-08-30
   * @author Zihan Chen
   *
@@ -32,6 +50,12 @@
 // Global variable fw handle
 raw1394handle_t handle;
 
+// consistent copy of the arm buffer, written by the arm callback
+ArmSnapshot snapshot;
+
+// quadlets changed by remote nodes since the consumer last looked
+ArmDirtyMap dirty;
+
 
 /* signal handler cleans up and exits the program */
 void signal_handler(int sig) {
@@ -59,6 +83,229 @@ int my_arm_req_callback(raw1394handle_t handle,
                         void *pcontext, byte_t request_type)
 {
     std::cout << "arm_req_callback, type = " << std::dec << (int)request_type << std::endl;
+
+    // the request carries the whole block, apply it in one go
+    snapshot.update(handle, arm_req_resp->request, request_type);
+    dirty.update(arm_req_resp->request, request_type);
+    return 0;
+}
+
+
+// -c: wait for changes and print only the changed ranges
+void *change_consumer(void *arg)
+{
+    std::vector<arm_dirty_range> ranges;
+    std::vector<byte_t> block(snapshot.length());
+    while (true)
+    {
+        if (dirty.wait(-1) <= 0) continue;
+        if (dirty.collect(ranges) == 0) continue;
+        snapshot.read(&block[0]);
+        for (size_t r = 0; r < ranges.size(); r++) {
+            std::cout << "changed +0x" << std::hex << ranges[r].offset << ":";
+            for (size_t i = 0; i < ranges[r].length; i++) {
+                std::cout << " " << (int)block[ranges[r].offset + i];
+            }
+            std::cout << std::dec << std::endl;
+        }
+    }
+    return NULL;
+}
+
+
+// -s: print every new complete block, from a thread of its own
+void *snapshot_reader(void *arg)
+{
+    std::vector<byte_t> block(snapshot.length());
+    uint32_t seen = snapshot.version();
+    while (true)
+    {
+        if (snapshot.version() == seen) {
+            usleep(1000);
+            continue;
+        }
+        seen = snapshot.read(&block[0]);
+        std::cout << "snapshot " << std::dec << seen << ":" << std::hex;
+        for (size_t i = 0; i < block.size(); i++) std::cout << " " << (int)block[i];
+        std::cout << std::dec << std::endl;
+    }
+    return NULL;
+}
+
+
+// -t: a writer fills the whole block with its counter as fast as it can,
+// readers check every snapshot holds a single counter value
+struct snapshot_test
+{
+    ArmSnapshot snap;
+    volatile bool stop;
+    unsigned long long reads[4], retries[4], torn[4];
+};
+
+void *snapshot_test_reader(void *arg)
+{
+    snapshot_test *t = (snapshot_test *)((void **)arg)[0];
+    const size_t id = (size_t)((void **)arg)[1];
+    std::vector<quadlet_t> block(t->snap.length() / 4);
+    while (!t->stop)
+    {
+        unsigned int retries;
+        t->snap.read(&block[0], &retries);
+        t->reads[id]++;
+        t->retries[id] += retries;
+        for (size_t i = 1; i < block.size(); i++) {
+            if (block[i] != block[0]) {
+                t->torn[id]++;
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+int self_test(unsigned int readers)
+{
+    const nodeaddr_t start = 0xffffff000000ULL;
+    const size_t quadlets = 64;
+    static snapshot_test t;
+    if (readers < 1 || readers > 4) readers = 4;
+    t.snap.init(start, quadlets * 4);
+    t.stop = false;
+
+    pthread_t threads[4];
+    void *args[4][2];
+    for (size_t i = 0; i < readers; i++) {
+        t.reads[i] = t.retries[i] = t.torn[i] = 0;
+        args[i][0] = &t;
+        args[i][1] = (void *)i;
+        pthread_create(&threads[i], NULL, snapshot_test_reader, args[i]);
+    }
+
+    std::vector<quadlet_t> block(quadlets);
+    const uint64_t begin = iso_sim_now_ns();
+    unsigned long long writes = 0;
+    while (iso_sim_now_ns() - begin < 1000000000ULL)
+    {
+        for (size_t i = 0; i < quadlets; i++) block[i] = htonl(writes);
+        t.snap.write(start, &block[0], quadlets * 4);
+        writes++;
+    }
+    t.stop = true;
+
+    unsigned long long reads = 0, retries = 0, torn = 0;
+    for (size_t i = 0; i < readers; i++) {
+        pthread_join(threads[i], NULL);
+        reads += t.reads[i];
+        retries += t.retries[i];
+        torn += t.torn[i];
+    }
+    std::cout << writes << " writes of " << quadlets << " quadlets, " << readers << " readers: "
+              << reads << " reads, " << retries << " retries, " << torn << " torn" << std::endl;
+    return torn ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+// -d: a writer marks random ranges of a 64 KiB region for one second while
+// this thread collects them; nothing may be lost or invented
+struct dirty_test_writer
+{
+    ArmDirtyMap *map;
+    std::vector<bool> marked;     /*!< quadlets the writer marked */
+    unsigned long long marks;
+    volatile bool stop;
+};
+
+void *dirty_test_mark(void *arg)
+{
+    dirty_test_writer *w = (dirty_test_writer *)arg;
+    const size_t quadlets = w->marked.size();
+    unsigned int seed = 1;
+    while (!w->stop)
+    {
+        for (int i = 0; i < 16; i++) {
+            const size_t q = rand_r(&seed) % quadlets;
+            const size_t n = std::min<size_t>(1 + rand_r(&seed) % 8, quadlets - q);
+            w->map->mark(w->map->start() + q * 4, n * 4);
+            for (size_t k = q; k < q + n; k++) w->marked[k] = true;
+            w->marks++;
+        }
+        usleep(100);
+    }
+    return NULL;
+}
+
+int dirty_test()
+{
+    const nodeaddr_t start = 0xffffff000000ULL;
+    const size_t length = 0x10000;
+    static ArmDirtyMap map;
+    map.init(start, length);
+
+    dirty_test_writer w;
+    w.map = &map;
+    w.marked.assign(length / 4, false);
+    w.marks = 0;
+    w.stop = false;
+    pthread_t writer;
+    pthread_create(&writer, NULL, dirty_test_mark, &w);
+
+    std::vector<bool> seen(length / 4, false);
+    std::vector<arm_dirty_range> ranges;
+    unsigned long long collects = 0, collected = 0;
+    uint64_t collect_ns = 0;
+    const uint64_t begin = iso_sim_now_ns();
+    bool last = false;
+    while (true)
+    {
+        if (!last && iso_sim_now_ns() - begin >= 1000000000ULL) {
+            w.stop = true;
+            pthread_join(writer, NULL);
+            last = true;   // one more collect picks up the rest
+        } else if (!last && map.wait(10) <= 0) {
+            continue;
+        }
+        const uint64_t t0 = iso_sim_now_ns();
+        map.collect(ranges);
+        collect_ns += iso_sim_now_ns() - t0;
+        collects++;
+        for (size_t r = 0; r < ranges.size(); r++) {
+            for (size_t q = ranges[r].offset / 4; q < (ranges[r].offset + ranges[r].length) / 4; q++) {
+                seen[q] = true;
+            }
+            collected++;
+        }
+        if (last) break;
+    }
+
+    // what polling would cost: compare the whole region with a copy
+    std::vector<byte_t> a(length, 0), b(length, 0);
+    const uint64_t t0 = iso_sim_now_ns();
+    volatile int diff = 0;
+    for (int i = 0; i < 1000; i++) diff += memcmp(&a[0], &b[0], length);
+    const double scan_ns = (iso_sim_now_ns() - t0) / 1000.0;
+
+    size_t lost = 0, invented = 0;
+    for (size_t q = 0; q < seen.size(); q++) {
+        if (w.marked[q] && !seen[q]) lost++;
+        if (!w.marked[q] && seen[q]) invented++;
+    }
+    std::cout << w.marks << " marks, " << collects << " collects, " << collected << " ranges, "
+              << lost << " lost, " << invented << " invented" << std::endl
+              << "collect " << (collects ? collect_ns / collects : 0) << " ns on average, full "
+              << length / 1024 << " KiB compare " << (uint64_t)scan_ns << " ns" << std::endl;
+    return (lost || invented) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 2_arm_server [-h] [-p port] [-s] [-c] [-t readers] [-d]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -s  print every complete block from a snapshot reader thread\n"
+              << "    -c  print only the changed ranges from a consumer thread\n"
+              << "    -t  test snapshots with 1-4 reader threads, no FireWire card needed\n"
+              << "    -d  test the dirty range tracking, no FireWire card needed\n";
 }
 
 
@@ -66,18 +313,36 @@ int main(int argc, char** argv)
 {
     int rc; /**< return code */
     int port = 0;  /*!< fw handle port number */
+    bool reader = false;
+    bool consumer = false;
 
     // parse command line (port number)
     opterr = 0;  // getopt no err output
-    const char short_options[] = "p:";
+    const char short_options[] = "hp:sct:d";
     int next_opt;
     do {
         next_opt = getopt(argc, argv, short_options);
         switch(next_opt)
         {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
         case 'p':
             port = atoi(optarg);
             break;
+        case 's':
+            reader = true;
+            break;
+        case 'c':
+            consumer = true;
+            break;
+        case 'd':
+            return dirty_test();
+            break;
+        case 't':
+            return self_test(atoi(optarg));
+            break;
         case '?':
             std::cerr << "Invalid argument" << std::endl;
             break;
@@ -132,8 +397,10 @@ int main(int argc, char** argv)
     const size_t arm_length = 4;  // arm length to register
 
     // arm initial buffer
-    byte_t arm_init_buffer[arm_length];
-    memset(arm_init_buffer, 0x02, arm_length);  // set inital value to all 0x02
+    byte_t arm_init_buffer[arm_length * 4];
+    memset(arm_init_buffer, 0x02, sizeof(arm_init_buffer));  // set inital value to all 0x02
+    snapshot.init(arm_start_addr, sizeof(arm_init_buffer), arm_init_buffer);
+    dirty.init(arm_start_addr, sizeof(arm_init_buffer));
 
     // setup arm request handle
     raw1394_arm_reqhandle arm_reqhandle;
@@ -141,7 +408,7 @@ int main(int argc, char** argv)
     arm_reqhandle.pcontext = my_arm_callback_context;
     arm_reqhandle.arm_callback = my_arm_req_callback;
 
-    int access_mode = RAW1394_ARM_WRITE|RAW1394_ARM_READ;   // allow read and write transaction
+    int access_mode = RAW1394_ARM_WRITE|RAW1394_ARM_READ|RAW1394_ARM_LOCK;   // allow read, write and lock transaction
 
     rc = raw1394_arm_register(handle,  // fw handle
                               arm_start_addr, // arm start address
@@ -185,6 +452,7 @@ int main(int argc, char** argv)
         std::cerr << "**** Error: failed to set arm register, error " << strerror(errno) << std::endl;
         return EXIT_FAILURE;
     } else {
+        snapshot.write(arm_start_addr, arm_write_buffer, arm_write_size);
         std::cout << "ARM buffer set  value: ";
         for (size_t i = 0; i < arm_read_size; i++) {
             std::cout << std::hex << " " << (int)arm_write_buffer[i];
@@ -215,6 +483,11 @@ int main(int argc, char** argv)
               << " address = 0x" << std::hex << arm_start_addr
               << "   size = " << std::dec << arm_length << std::endl;
 
+    pthread_t reader_thread;
+    if (reader) pthread_create(&reader_thread, NULL, snapshot_reader, NULL);
+    pthread_t consumer_thread;
+    if (consumer) pthread_create(&consumer_thread, NULL, change_consumer, NULL);
+
     while (true)
     {
         raw1394_loop_iterate(handle);
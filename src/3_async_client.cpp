@@ -4,11 +4,14 @@
 #include <string.h>
 #include <iostream>
 #include <byteswap.h>
+#include <arpa/inet.h>
 
 // libraw1394
 #include <libraw1394/raw1394.h>
 #include <libraw1394/csr.h>
 
+#include "async_lock.h"
+
 
 /**
   * @brief: Tutorial 3: Asynchronous Cient (Read/Write)
@@ -23,6 +26,9 @@
   *             - quadlet write
   *             - block read
   *             - block write
+  *             - lock transactions (async_lock.h): compare-swap, fetch-add,
+  *               bounded-add, mask-swap, a compare-swap update loop and
+  *               fetch-adds pipelined through an AsyncEngine
   *
   *
   * @date 2013-08-30
@@ -47,6 +53,34 @@ int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
 }
 
 
+// fw_cas_update / AsyncCasUpdate operation: double the counter
+quadlet_t double_counter(quadlet_t value, void *context)
+{
+    return value * 2;
+}
+
+quadlet_t double_counter_sync(quadlet_t value) { return double_counter(value, NULL); }
+
+void fetch_add_done(const async_request &request, int error, void *context)
+{
+    if (error) {
+        std::cerr << "****Error: async fetch-add failed, " << strerror(error) << std::endl;
+    } else {
+        std::cout << "  async fetch-add, old value " << std::dec << async_lock_result(request) << std::endl;
+    }
+}
+
+void cas_update_done(AsyncCasUpdate<quadlet_t> &op, int error, void *context)
+{
+    if (error) {
+        std::cerr << "****Error: async update failed, " << strerror(error) << std::endl;
+    } else {
+        std::cout << "  async update stored " << std::dec << op.value() << " after "
+                  << op.attempts() << " transaction(s)" << std::endl;
+    }
+}
+
+
 int main(int argc, char** argv)
 {
     int rc; /**< return code */
@@ -178,8 +212,69 @@ int main(int argc, char** argv)
     }
 
 
-    // FIX ME:
-    //   add lock tranaction in the future
+    // lock transactions, on the quadlet after the block (host byte order values)
+    const nodeaddr_t counter_addr = arm_start_addr + data_block_write_size * 4;
+    quadlet_t counter;
+    rc = raw1394_read(handle, server_nodeid, counter_addr, 4, &counter);
+    if (rc) {
+        std::cerr << "****Error: failed to read counter, errno = "
+                  << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    counter = ntohl(counter);
+
+    // compare-swap: set the counter to 100 if it still holds what we read
+    quadlet_t old;
+    rc = fw_compare_swap(handle, server_nodeid, counter_addr, counter, 100, &old);
+    if (rc < 0) {
+        std::cerr << "****Error: failed to compare-swap, errno = "
+                  << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Lock compare-swap " << std::dec << old << " -> 100 "
+              << (rc ? "swapped" : "not swapped") << std::endl;
+
+    // fetch-add: add 5, returns the value before
+    if (fw_fetch_add(handle, server_nodeid, counter_addr, 5, &old) == 0) {
+        std::cout << "Lock fetch-add    " << old << " + 5" << std::endl;
+    }
+
+    // bounded-add: add 1 unless the counter reached 105
+    rc = fw_bounded_add(handle, server_nodeid, counter_addr, 105, 1, &old);
+    if (rc >= 0) {
+        std::cout << "Lock bounded-add  " << old << (rc ? " + 1" : " at bound 105") << std::endl;
+    }
+
+    // mask-swap: replace the upper 16 bits only
+    if (fw_mask_swap(handle, server_nodeid, counter_addr, 0xffff0000, 0xabcd0000, &old) == 0) {
+        std::cout << "Lock mask-swap    " << std::hex << old << " -> upper half abcd" << std::endl;
+        counter = (old & 0xffff) | 0xabcd0000;
+    }
+
+    // any read-modify-write through compare-swap, one transaction when the
+    // guess (the value computed above) is right
+    rc = fw_cas_update(handle, server_nodeid, counter_addr, &counter, double_counter_sync);
+    if (rc < 0) {
+        std::cerr << "****Error: failed to update, errno = "
+                  << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Lock update       " << std::hex << counter << " after "
+              << std::dec << rc << " transaction(s)" << std::endl;
+
+    // the same pipelined: 4 fetch-adds in flight, then an update with a stale guess
+    {
+        Raw1394Transport transport(handle);
+        AsyncEngine engine(transport);
+        quadlet_t results[4];
+        for (int i = 0; i < 4; i++) {
+            async_fetch_add(engine, server_nodeid, counter_addr, 1, &results[i], fetch_add_done, NULL);
+        }
+        AsyncCasUpdate<quadlet_t> update;
+        update.start(engine, server_nodeid, counter_addr, counter, double_counter, NULL,
+                     cas_update_done, NULL);
+        engine.drain();
+    }
 
     // clean up & exit
     raw1394_destroy_handle(handle);
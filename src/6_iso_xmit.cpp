@@ -2,14 +2,21 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <iostream>
 #include <byteswap.h>
 #include <stdio.h>
+#include <atomic>
+#include <thread>
 
 // libraw1394
 #include <libraw1394/raw1394.h>
 #include <libraw1394/csr.h>
 
+#include "iso_capture.h"
+#include "iso_sim.h"
+#include "irm_alloc.h"
+
 
 /**
   * @brief: Tutorial 6: Isochronous Transmit
@@ -27,6 +34,21 @@
   *             - quadlet broadcast write
   *             - block broadcast write
   *
+  *     Replay mode (-f) re-injects a stream recorded by 8_iso_capture:
+  *         - the file is mmap'd, a prefetch thread faults in the blocks ahead
+  *           of the transmit position so disk I/O never stalls the handler
+  *         - my_iso_replay_handler is called once per bus cycle and keeps the
+  *           recorded cycle spacing: cycles that were empty in the recording
+  *           go out as zero-length packets (the xmit handler cannot skip a cycle)
+  *         - -b starts transmission on a given bus cycle through
+  *           raw1394_iso_xmit_start, -t/-y start at a point in the recording
+  *         - without hardware: 6_iso_xmit -f capture.iso -s
+  *
+  *     With -a the channel and bandwidth are reserved at the IRM first (see
+  *     irm_alloc.h) and re-claimed in the bus reset handler, so a reset does
+  *     not hand our channel to another talker. -S and -L set the speed and
+  *     the payload size the bandwidth is computed for.
+  *
   *
   * @date 2013-08-30
   * @author Zihan Chen
@@ -40,11 +62,16 @@
 #define MAX_PACKET 4096
 #define BUF_SIZE 4096
 #define BUF_HEAD 8
+#define REPLAY_PREFETCH_BLOCKS 16   // capture blocks kept resident ahead of the handler
 
 
 // Global variable fw handle
 raw1394handle_t handle;
 
+// IRM allocation, NULL unless -a
+IrmAllocator *irm = NULL;
+int irm_stream = -1;
+
 // bus reset handler, update bus generation
 int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
 {
@@ -53,6 +80,16 @@ int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
 
     // update handle gen value
     raw1394_update_generation(h, gen);
+
+    // the IRM registers were reset, get our channel back within 1 second
+    if (irm) {
+        const int lost = irm->reclaim();
+        std::cout << "IRM reclaim took " << irm->reclaim_ns() / 1000 << " us";
+        if (lost) std::cout << ", " << lost << " stream(s) lost their allocation";
+        else std::cout << ", channel " << irm->channel(irm_stream);
+        std::cout << std::endl;
+    }
+    return 0;
 }
 
 
@@ -87,11 +124,228 @@ my_iso_xmit_handler(raw1394handle_t handle,
 }
 
 
+// ---- replay of a recorded stream ----
+
+struct iso_replay
+{
+    iso_replay()
+        : channel(-1), pending(NULL), payload(NULL), pending_cycle(0), first_cycle(0),
+          slot(0), block(0), done(false), packets(0), empty(0), late(0), underruns(0) {}
+
+    IsoCaptureReader reader;
+    int channel;                         /*!< records on other channels are skipped */
+    const iso_capture_record *pending;   /*!< next record to send, NULL at the end */
+    const unsigned char *payload;
+    uint64_t pending_cycle;              /*!< unwrapped cycle of pending */
+    uint64_t first_cycle;                /*!< unwrapped cycle of the first record sent */
+    uint64_t slot;                       /*!< cycles handed to the kernel so far */
+    std::atomic<uint64_t> block;         /*!< reader position, for the prefetch thread */
+    std::atomic<bool> done;
+
+    // handler only
+    unsigned long long packets;
+    unsigned long long empty;       /*!< zero-length packets for silent cycles */
+    unsigned long long late;        /*!< records that shared a cycle with the previous one */
+    unsigned long long underruns;   /*!< reported by the kernel */
+};
+
+iso_replay replay;
+volatile sig_atomic_t running = 1;
+
+
+/* signal handler stops the replay */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// advance to the next record on the replayed channel
+void replay_fetch()
+{
+    const unsigned char *payload = NULL;
+    const iso_capture_record *rec;
+    while ((rec = replay.reader.next(&payload)) != NULL) {
+        if (replay.channel < 0) replay.channel = rec->channel;
+        if (rec->channel == replay.channel) break;
+    }
+    replay.pending = rec;
+    replay.payload = payload;
+    replay.pending_cycle = replay.reader.record_cycle();
+    replay.block.store(replay.reader.current_block(), std::memory_order_relaxed);
+}
+
+
+// called once per transmit cycle, in bus order
+raw1394_iso_disposition
+my_iso_replay_handler(raw1394handle_t handle,
+                      unsigned char *data,
+                      unsigned int *len,
+                      unsigned char *tag,
+                      unsigned char *sy,
+                      int cycle, /* -1 if unknown */
+                      unsigned int dropped)
+{
+    replay.underruns += dropped;
+    if (replay.pending == NULL) {
+        replay.done = true;
+        return RAW1394_ISO_DEFER;
+    }
+
+    const uint64_t due = replay.pending_cycle - replay.first_cycle;
+    if (due > replay.slot) {
+        // nothing was recorded in this cycle
+        *len = 0;
+        *tag = replay.pending->tag;
+        *sy = 0;
+        replay.slot++;
+        replay.empty++;
+        return RAW1394_ISO_OK;
+    }
+    if (due < replay.slot) replay.late++;   // catches up at the next empty cycle
+
+    unsigned int n = replay.pending->len;
+    if (n > MAX_PACKET) n = MAX_PACKET;
+    memcpy(data, replay.payload, n);
+    *len = n;
+    *tag = replay.pending->tag;
+    *sy = replay.pending->sy;
+    replay.slot++;
+    replay.packets++;
+
+    replay_fetch();
+    return RAW1394_ISO_OK;
+}
+
+
+// keeps REPLAY_PREFETCH_BLOCKS blocks resident ahead of the handler
+void replay_prefetch_thread()
+{
+    uint64_t fetched = replay.block.load(std::memory_order_relaxed);
+    while (running && !replay.done) {
+        const uint64_t current = replay.block.load(std::memory_order_relaxed);
+        if (fetched < current) fetched = current;
+        const uint64_t wanted = current + REPLAY_PREFETCH_BLOCKS;
+        if (fetched < wanted) fetched += replay.reader.prefetch(fetched, wanted - fetched);
+        usleep(10000);
+    }
+}
+
+
+// open the recording and position on the first packet to send
+int replay_open(const char *path, double seek_sec, long long seek_cycle, int channel)
+{
+    if (replay.reader.open(path)) return -1;
+    if (seek_cycle >= 0) replay.reader.seek_cycle(seek_cycle);
+    else if (seek_sec > 0) replay.reader.seek_time((uint64_t)(seek_sec * 1e9));
+
+    replay.channel = channel;
+    replay_fetch();
+    if (replay.pending == NULL) {
+        errno = ENODATA;
+        return -1;
+    }
+    replay.first_cycle = replay.pending_cycle;
+
+    // first window synchronously, the thread keeps up from there
+    replay.reader.prefetch(replay.block, REPLAY_PREFETCH_BLOCKS);
+    return 0;
+}
+
+
+void replay_report()
+{
+    std::cout << "replayed " << replay.packets << " packets on channel " << replay.channel
+              << " over " << replay.slot << " cycles: "
+              << replay.empty << " empty cycles, "
+              << replay.late << " late, "
+              << replay.underruns << " underruns" << std::endl;
+}
+
+
+// replay into the software bus
+int replay_sim(double rate, int start_cycle)
+{
+    IsoSimConfig config;
+    config.buf_packets = BUFFER;
+    config.max_packet_size = MAX_PACKET;
+    config.packet_rate = rate;
+    IsoSimXmit sim(my_iso_replay_handler, config);
+
+    std::thread prefetcher(replay_prefetch_thread);
+    sim.start(start_cycle);
+    while (running && !replay.done) {
+        if (sim.iterate(NULL)) break;
+    }
+    // let the bus drain what is still queued
+    while (running && sim.sent() < sim.queued()) usleep(1000);
+    running = 0;
+    prefetcher.join();
+
+    replay_report();
+    return EXIT_SUCCESS;
+}
+
+
+// replay through the real transmitter
+int replay_hw(unsigned char channel, raw1394_iso_speed speed, int start_cycle)
+{
+    int rc = raw1394_iso_xmit_init(handle,      // 1394 handle
+                                   my_iso_replay_handler,
+                                   BUFFER,      // iso packets to buffer
+                                   MAX_PACKET,  // max packet size
+                                   channel,     // recorded or allocated channel
+                                   speed,
+                                   -1);         // irq_interval
+    if (rc) {
+        perror("raw1394_iso_xmit_init");
+        return EXIT_FAILURE;
+    }
+
+    std::thread prefetcher(replay_prefetch_thread);
+
+    // the handler prebuffers up to BUFFER cycles, the first goes out on start_cycle
+    rc = raw1394_iso_xmit_start(handle, start_cycle, -1);
+    if (rc) {
+        perror("raw1394_iso_xmit_start");
+    }
+    while (!rc && running && !replay.done) {
+        rc = raw1394_loop_iterate(handle);
+        if (irm && (!irm->allocated(irm_stream) || irm->take_changed(irm_stream))) {
+            std::cerr << "**** Error: lost channel " << (int)channel
+                      << " after bus reset, replay stopped" << std::endl;
+            break;
+        }
+    }
+    // what is still in the kernel buffer goes out within BUFFER cycles
+    if (!rc && running) usleep(BUFFER * 1000000ULL / ISO_SIM_CYCLES_PER_SEC + 10000);
+
+    running = 0;
+    prefetcher.join();
+    raw1394_iso_stop(handle);
+    raw1394_iso_shutdown(handle);
+
+    replay_report();
+    return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
 void print_usage()
 {
-    std::cout << "Usage: 5_iso_server [-h] [-n server_nodeid]\n"
+    std::cout << "Usage: 6_iso_xmit [-h] [-n server_nodeid] [-c channel] [-a [-S speed] [-L bytes]]\n"
+              << "       6_iso_xmit -f file [-c channel] [-b cycle] [-t sec | -y cycle] [-s [-r rate]]\n"
               << "    -h  show usage\n"
-              << "    -n  specify server nodeid\n";
+              << "    -n  specify server nodeid\n"
+              << "    -c  channel to transmit (default 5) or to replay (default: first packet's)\n"
+              << "    -a  allocate channel and bandwidth at the IRM, -c is only preferred\n"
+              << "    -S  speed 100, 200 or 400 (default 400)\n"
+              << "    -L  payload bytes to reserve bandwidth for (default: 4, 4096 for replay)\n"
+              << "    -f  replay a capture file written by 8_iso_capture\n"
+              << "    -b  start transmitting on this bus cycle, 0 - 7999 (default: now)\n"
+              << "    -t  start at this many seconds into the capture\n"
+              << "    -y  start at this unwrapped cycle number of the capture\n"
+              << "    -s  replay into the software bus, no FireWire card needed\n"
+              << "    -r  software bus packet rate per second (default 8000)\n";
 }
 
 
@@ -100,10 +354,20 @@ int main(int argc, char** argv)
     int rc; /**< return code */
     int port = 0;  /*!< fw handle port number */
     int nodeid = 0;   /*!< arm server node id */
+    const char *replay_path = NULL;
+    int replay_channel = -1;
+    int start_cycle = -1;
+    double seek_sec = 0.0;
+    long long seek_cycle = -1;
+    bool simulate = false;
+    double sim_rate = ISO_SIM_CYCLES_PER_SEC;
+    bool allocate = false;
+    int speed = RAW1394_ISO_SPEED_400;
+    unsigned int reserve_bytes = 0;
 
     // parse command line (port number)
     opterr = 0;  // getopt no err output
-    const char short_options[] = "hp:n:";
+    const char short_options[] = "hp:n:f:c:b:t:y:sr:aS:L:";
     int next_opt;
     do {
         next_opt = getopt(argc, argv, short_options);
@@ -119,6 +383,37 @@ int main(int argc, char** argv)
         case 'n':
             nodeid = atoi(optarg);
             break;
+        case 'f':
+            replay_path = optarg;
+            break;
+        case 'c':
+            replay_channel = atoi(optarg);
+            break;
+        case 'b':
+            start_cycle = atoi(optarg) % ISO_SIM_CYCLES_PER_SEC;
+            break;
+        case 't':
+            seek_sec = atof(optarg);
+            break;
+        case 'y':
+            seek_cycle = strtoll(optarg, 0, 10);
+            break;
+        case 's':
+            simulate = true;
+            break;
+        case 'r':
+            sim_rate = atof(optarg);
+            break;
+        case 'a':
+            allocate = true;
+            break;
+        case 'S':
+            speed = atoi(optarg) >= 400 ? RAW1394_ISO_SPEED_400 :
+                    atoi(optarg) >= 200 ? RAW1394_ISO_SPEED_200 : RAW1394_ISO_SPEED_100;
+            break;
+        case 'L':
+            reserve_bytes = atoi(optarg);
+            break;
         case '?':
             std::cerr << "Invalid argument" << std::endl;
             break;
@@ -129,6 +424,18 @@ int main(int argc, char** argv)
     while(next_opt != -1);
 
 
+    if (replay_path) {
+        if (replay_open(replay_path, seek_sec, seek_cycle, replay_channel)) {
+            std::cerr << "**** Error: could not replay " << replay_path << " "
+                      << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+        // Setup signal handler to exit on Ctrl-C
+        signal(SIGINT, signal_handler);
+        if (simulate) return replay_sim(sim_rate, start_cycle);
+    }
+
+
     // ----- Get handle and set port for the handle -------
     // create handle
     handle = raw1394_new_handle();
@@ -158,6 +465,37 @@ int main(int argc, char** argv)
     raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
 
 
+    // -------- Reserve channel and bandwidth at the IRM --------
+    unsigned char channel = replay_path ? replay.channel :
+                            replay_channel >= 0 ? replay_channel : 5;
+    IrmAllocator allocator(handle);
+    if (allocate) {
+        if (reserve_bytes == 0) reserve_bytes = replay_path ? MAX_PACKET : 4;
+        irm_stream = allocator.allocate(reserve_bytes, speed, channel);
+        if (irm_stream < 0) {
+            std::cerr << "**** Error: IRM allocation failed " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+        irm = &allocator;
+        if (replay_path && allocator.channel(irm_stream) != channel) {
+            std::cout << "replaying channel " << (int)channel << " on channel "
+                      << allocator.channel(irm_stream) << std::endl;
+        }
+        channel = allocator.channel(irm_stream);
+        std::cout << "IRM " << std::hex << raw1394_get_irm_id(handle) << std::dec
+                  << ": channel " << (int)channel << ", "
+                  << allocator.units(irm_stream) << " bandwidth units" << std::endl;
+    }
+
+    if (replay_path) {
+        rc = replay_hw(channel, (raw1394_iso_speed)speed, start_cycle);
+        irm = NULL;
+        allocator.release_all();
+        raw1394_destroy_handle(handle);
+        return rc;
+    }
+
+
 
     // ----------------------------------------------------------------------------
     // Start tutorial 6 isochronous send
@@ -175,14 +513,13 @@ int main(int argc, char** argv)
      * @irq_interval: maximum latency of wake-ups, in packets (-1 if you don't care)
      *
      * Allocates all user and kernel resources necessary for isochronous transmission.
-     * Channel and bandwidth allocation at the IRM is not performed.
+     * Channel and bandwidth allocation at the IRM is not performed (see -a).
      *
      * Returns: 0 on success or -1 on failure (sets errno)
      **/
     size_t length;
-    unsigned char channel, tag, sy;
+    unsigned char tag, sy;
     unsigned char buffer[BUF_SIZE + BUF_HEAD];
-    channel = 5;
     tag = 6;
     sy = 7;
 
@@ -191,8 +528,8 @@ int main(int argc, char** argv)
                                NULL,        // xmit handler
                                BUFFER,      // iso packets to buffer
                                MAX_PACKET,  // max packet size
-                               channel,           // just pick 5 for fun
-                               RAW1394_ISO_SPEED_400,
+                               channel,           // 5 unless -c or the IRM says otherwise
+                               (raw1394_iso_speed)speed,
                                -1);         // irq_interval
     if (rc) {
         perror("raw1394_iso_xmit_init");
@@ -215,6 +552,25 @@ int main(int argc, char** argv)
             perror("\nraw1394_iso_xmit_write");
             break;
         }
+
+        // a bus reset may have moved us to another channel
+        if (irm && !irm->allocated(irm_stream)) {
+            std::cerr << "**** Error: IRM allocation lost after bus reset" << std::endl;
+            break;
+        }
+        if (irm && irm->take_changed(irm_stream)) {
+            channel = irm->channel(irm_stream);
+            std::cout << "moving to channel " << (int)channel << std::endl;
+            raw1394_iso_stop(handle);
+            raw1394_iso_shutdown(handle);
+            rc = raw1394_iso_xmit_init(handle, NULL, BUFFER, MAX_PACKET, channel,
+                                       (raw1394_iso_speed)speed, -1);
+            if (rc == 0) rc = raw1394_iso_xmit_start(handle, -1, -1);
+            if (rc) {
+                perror("raw1394_iso_xmit_init");
+                break;
+            }
+        }
 //        data++;
 //        std::cout << "data = " << data << std::endl;
     }
@@ -222,6 +578,8 @@ int main(int argc, char** argv)
     // stop, clean up & exit
     raw1394_iso_stop(handle);
     raw1394_iso_shutdown(handle);
+    irm = NULL;
+    allocator.release_all();
     raw1394_destroy_handle(handle);
 
     return EXIT_SUCCESS;
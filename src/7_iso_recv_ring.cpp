@@ -0,0 +1,417 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <iomanip>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "spsc_ring.h"
+#include "iso_sim.h"
+
+
+#define BUFFER 1000
+#define PACKET_MAX 4096
+
+
+/**
+  * @brief: Tutorial 7: Isochronous receive with a lock-free consumer thread
+  *
+  *     Tutorial 5 prints from inside my_iso_recv_handler, which runs inside
+  *     raw1394_loop_iterate. Every microsecond spent there delays the next
+  *     wakeup, the kernel DMA ring fills up and packets are dropped.
+  *     This tutorial keeps the handler tight:
+  *         - the handler copies the payload once into a preallocated slab
+  *           (BUFFER x PACKET_MAX, one slot per ring entry)
+  *         - it publishes a small descriptor (pointer, length, header fields)
+  *           into a single-producer/single-consumer lock-free ring
+  *         - a consumer thread does the real work and reports throughput,
+  *           kernel drops and ring overruns once per second
+  *
+  *     The DMA buffer itself cannot be handed out: its slot is recycled by
+  *     the kernel as soon as the handler returns, hence the single copy.
+  *
+  *     - to run this example
+  *         - run 6_iso_xmit on another computer and 7_iso_recv_ring here
+  *         - or run without hardware: 7_iso_recv_ring -s 80000
+  *     - add -w to emulate slow per-packet work, -d to do that work inside
+  *       the handler (tutorial 5 style) and compare the drop counts
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+// one received packet, payload lives in the slab
+struct iso_packet_desc
+{
+    unsigned char *data;
+    unsigned int len;
+    unsigned char channel;
+    unsigned char tag;
+    unsigned char sy;
+    unsigned int cycle;
+    unsigned int dropped;
+};
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+// receive ring and payload slab, slab slot i belongs to ring slot i
+SpscRing<iso_packet_desc> packet_ring(BUFFER);
+std::vector<unsigned char> packet_slab(packet_ring.capacity() * PACKET_MAX);
+
+// written by the handler (single writer), read by the consumer
+std::atomic<unsigned long long> rx_packets(0);
+std::atomic<unsigned long long> rx_bytes(0);
+std::atomic<unsigned long long> rx_dropped(0);    /*!< reported by the kernel */
+std::atomic<unsigned long long> rx_overruns(0);   /*!< ring full, consumer too slow */
+std::atomic<size_t> ring_max_depth(0);            /*!< high-water mark seen at push, reset by the report */
+
+// options
+bool direct_mode = false;   /*!< process inside the handler, like tutorial 5 */
+bool verbose = false;
+long work_ns = 0;           /*!< emulated processing cost per packet */
+
+volatile sig_atomic_t running = 1;
+
+
+/* signal handler stops the event loop, the consumer prints a summary */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+// the actual per-packet work, returns a checksum so it is not optimized away
+quadlet_t process_packet(const iso_packet_desc &pkt)
+{
+    quadlet_t sum = 0;
+    for (unsigned int i = 0; i < pkt.len; i++) {
+        sum += pkt.data[i];
+    }
+
+    if (work_ns > 0) {
+        const uint64_t until = iso_sim_now_ns() + work_ns;
+        while (iso_sim_now_ns() < until) {}
+    }
+
+    if (verbose) {
+        std::cout << "channel = " << (int)pkt.channel
+                  << " cycle = " << pkt.cycle
+                  << " len = " << pkt.len << std::endl;
+    }
+    return sum;
+}
+
+
+raw1394_iso_disposition
+my_iso_recv_handler(raw1394handle_t handle,
+                    unsigned char *data,
+                    unsigned int len,
+                    unsigned char channel,
+                    unsigned char tag,
+                    unsigned char sy,
+                    unsigned int cycle,
+                    unsigned int dropped)
+{
+    // single writer, relaxed load + store is enough
+    rx_packets.store(rx_packets.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    rx_bytes.store(rx_bytes.load(std::memory_order_relaxed) + len, std::memory_order_relaxed);
+    if (dropped) {
+        rx_dropped.store(rx_dropped.load(std::memory_order_relaxed) + dropped,
+                         std::memory_order_relaxed);
+    }
+
+    if (len > PACKET_MAX) len = PACKET_MAX;
+
+    iso_packet_desc pkt;
+    pkt.len = len;
+    pkt.channel = channel;
+    pkt.tag = tag;
+    pkt.sy = sy;
+    pkt.cycle = cycle;
+    pkt.dropped = dropped;
+
+    if (direct_mode) {
+        pkt.data = data;
+        process_packet(pkt);
+        return RAW1394_ISO_OK;
+    }
+
+    // never wait for the consumer, count the loss instead
+    if (packet_ring.full()) {
+        rx_overruns.store(rx_overruns.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+        return RAW1394_ISO_OK;
+    }
+
+    pkt.data = &packet_slab[packet_ring.next_slot() * PACKET_MAX];
+    memcpy(pkt.data, data, len);
+    packet_ring.push(pkt);
+
+    // the ring is deepest right after a push, the consumer may empty it
+    // before it ever looks
+    const size_t depth = packet_ring.size();
+    if (depth > ring_max_depth.load(std::memory_order_relaxed)) {
+        ring_max_depth.store(depth, std::memory_order_relaxed);
+    }
+
+    // see raw1394_iso_disposition
+    return RAW1394_ISO_OK;
+}
+
+
+// consumer thread: drains the ring and prints statistics every second
+void consumer_thread()
+{
+    unsigned long long processed = 0;
+    unsigned long long last_rx = 0, last_bytes = 0, last_processed = 0;
+    quadlet_t checksum = 0;
+    uint64_t last_report = iso_sim_now_ns();
+
+    while (true) {
+        // front/consume keeps the slab slot away from the handler until
+        // the packet has been processed
+        iso_packet_desc *pkt;
+        bool got = false;
+        while ((pkt = packet_ring.front()) != NULL) {
+            checksum += process_packet(*pkt);
+            packet_ring.consume();
+            processed++;
+            got = true;
+        }
+        if (!got) {
+            if (!running) break;
+            usleep(100);
+        }
+
+        uint64_t now = iso_sim_now_ns();
+        if (now - last_report >= 1000000000ULL) {
+            const double dt = (now - last_report) * 1e-9;
+            const unsigned long long rx = rx_packets.load(std::memory_order_relaxed);
+            const unsigned long long bytes = rx_bytes.load(std::memory_order_relaxed);
+            std::cout << std::fixed << std::setprecision(0)
+                      << "rx " << (rx - last_rx) / dt << " pkt/s  "
+                      << std::setprecision(2)
+                      << (bytes - last_bytes) / dt / 1e6 << " MB/s  "
+                      << std::setprecision(0)
+                      << "processed " << (processed - last_processed) / dt << " pkt/s  "
+                      << "dropped " << rx_dropped.load(std::memory_order_relaxed)
+                      << "  overruns " << rx_overruns.load(std::memory_order_relaxed)
+                      << "  ring max " << ring_max_depth.exchange(0, std::memory_order_relaxed)
+                      << "/" << packet_ring.capacity()
+                      << std::endl;
+            last_rx = rx;
+            last_bytes = bytes;
+            last_processed = processed;
+            last_report = now;
+        }
+    }
+
+    std::cout << "consumer done, processed " << processed
+              << " checksum 0x" << std::hex << checksum << std::dec << std::endl;
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 7_iso_recv_ring [-h] [-p port] [-c channel] [-s packets]\n"
+              << "                       [-l len] [-r rate] [-w ns] [-d] [-v]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -c  iso channel to receive (default 5)\n"
+              << "    -s  simulate N packets, no FireWire card needed\n"
+              << "    -l  simulated payload length in bytes (default 64)\n"
+              << "    -r  simulated packet rate per second, 0 = unpaced (default 8000)\n"
+              << "    -w  emulated processing cost per packet in ns\n"
+              << "    -d  process inside the handler (no ring, tutorial 5 style)\n"
+              << "    -v  print every packet\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    unsigned char channel = 0x5;
+    unsigned long long sim_packets = 0;  /*!< > 0 runs the software packet source */
+    IsoSimConfig sim_config;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:c:s:l:r:w:dv";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'c':
+            channel = atoi(optarg);
+            break;
+        case 's':
+            sim_packets = strtoull(optarg, 0, 10);
+            break;
+        case 'l':
+            sim_config.payload_len = atoi(optarg);
+            break;
+        case 'r':
+            sim_config.packet_rate = atof(optarg);
+            break;
+        case 'w':
+            work_ns = atol(optarg);
+            break;
+        case 'd':
+            direct_mode = true;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+    std::thread consumer(consumer_thread);
+
+
+    // ----------------------------------------------------------------------------
+    // Simulation: drive the handler from a software packet source
+    // ----------------------------------------------------------------------------
+    if (sim_packets > 0) {
+        sim_config.buf_packets = BUFFER;
+        sim_config.max_packet_size = PACKET_MAX;
+        sim_config.channels.assign(1, channel);
+        IsoSimRecv sim(my_iso_recv_handler, sim_config);
+
+        while (running && sim.packets() < sim_packets) {
+            if (sim.iterate(NULL)) break;
+        }
+
+        running = 0;
+        consumer.join();
+        std::cout << "simulated " << sim.packets() << " packets, "
+                  << sim.wakeups() << " wakeups, "
+                  << rx_dropped.load() << " dropped, "
+                  << rx_overruns.load() << " ring overruns" << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+
+    // ----- Get handle and set port for the handle -------
+    // create handle
+    handle = raw1394_new_handle();
+    if (handle == NULL) {
+        std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+        running = 0;
+        consumer.join();
+        return EXIT_FAILURE;
+    }
+
+    // get port number & sanity check
+    int numPorts = raw1394_get_port_info(handle, NULL, 0);
+    if (port < 0 || port >= numPorts) {
+        std::cerr << "Invalid port number" << std::endl;
+        running = 0;
+        consumer.join();
+        return EXIT_FAILURE;
+    }
+
+    // let user to choose which port to use
+    rc = raw1394_set_port(handle, port);
+    if (rc) {
+        std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+        running = 0;
+        consumer.join();
+        return EXIT_FAILURE;
+    }
+
+
+    // -------- Set FireWire bus reset handler --------
+
+    // set bus reset handler
+    raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 7 iso receive with consumer thread
+    // ----------------------------------------------------------------------------
+
+    rc = raw1394_iso_recv_init(handle,
+                               my_iso_recv_handler,
+                               BUFFER,      // buf_packets
+                               PACKET_MAX,  // max_packet_size
+                               channel,     // channel
+                               RAW1394_DMA_DEFAULT,  // dma mode
+                               -1);         // irq_interval
+    if (rc) {
+        perror("raw1394_iso_recv_init");
+        running = 0;
+        consumer.join();
+        return EXIT_FAILURE;
+    }
+
+    // start receiving
+    rc = raw1394_iso_recv_start(handle, -1, -1, 0);
+    if (rc) {
+        perror("raw1394_iso_recv_start");
+        running = 0;
+        consumer.join();
+        return EXIT_FAILURE;
+    }
+
+    // this loop does nothing but wait for the kernel, all work is in the consumer
+    while (running)
+    {
+        rc = raw1394_loop_iterate(handle);
+        if (rc) break;
+    }
+
+    // stop, clean up & exit
+    raw1394_iso_stop(handle);
+    running = 0;
+    consumer.join();
+    raw1394_iso_shutdown(handle);
+    raw1394_destroy_handle(handle);
+
+    return EXIT_SUCCESS;
+}
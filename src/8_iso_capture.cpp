@@ -0,0 +1,349 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <iomanip>
+#include <stdio.h>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "iso_capture.h"
+#include "iso_sim.h"
+
+
+#define BUFFER 1000
+#define PACKET_MAX 4096
+
+
+/**
+  * @brief: Tutorial 8: Isochronous capture to disk
+  *
+  *     This tutorial records an isochronous stream into an indexed capture
+  *     file (see iso_capture.h) and reads it back.
+  *         - capture: the receive handler only calls IsoCaptureWriter::record,
+  *           which copies the packet into a preallocated 256 KiB block. Full
+  *           blocks are written by a separate thread with O_DIRECT, so the
+  *           callback never waits for the disk.
+  *         - read back: the file is mmap'd, IsoCaptureReader seeks to a time
+  *           or cycle through the sparse block index and prints packets.
+  *
+  *     - to run this example
+  *         - run 6_iso_xmit on another computer
+  *         - 8_iso_capture -o stream.cap        (Ctrl-C to stop)
+  *         - 8_iso_capture -i stream.cap -t 2.5 -n 10
+  *     - without hardware: 8_iso_capture -o stream.cap -s 80000
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+// capture file, 64 x 256 KiB blocks = 16 MiB of slack for a slow disk
+IsoCaptureWriter capture(64);
+
+volatile sig_atomic_t running = 1;
+
+
+/* signal handler stops the event loop, main closes the capture file */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+raw1394_iso_disposition
+my_iso_recv_handler(raw1394handle_t handle,
+                    unsigned char *data,
+                    unsigned int len,
+                    unsigned char channel,
+                    unsigned char tag,
+                    unsigned char sy,
+                    unsigned int cycle,
+                    unsigned int dropped)
+{
+    // copy into the current block, never blocks
+    capture.record(data, len, channel, tag, sy, cycle, dropped);
+
+    // see raw1394_iso_disposition
+    return RAW1394_ISO_OK;
+}
+
+
+// print progress once per second from the loop thread, outside the handler
+void print_progress(uint64_t &last_report)
+{
+    uint64_t now = iso_sim_now_ns();
+    if (now - last_report < 1000000000ULL) return;
+    last_report = now;
+    std::cout << "captured " << capture.packets()
+              << "  blocks written " << capture.blocks_written()
+              << "  backlog " << capture.backlog()
+              << "  lost " << capture.lost()
+              << "  write errors " << capture.write_errors() << std::endl;
+}
+
+
+// read back a capture file starting at a time or cycle
+int dump_capture(const char *path, double start_sec, long long start_cycle, long count)
+{
+    IsoCaptureReader reader;
+    if (reader.open(path)) {
+        std::cerr << "**** Error: could not open capture " << path << " "
+                  << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const iso_capture_header &hdr = reader.header();
+    std::cout << "capture " << path << ": " << reader.num_blocks() << " blocks, "
+              << (reader.has_index() ? "indexed" : "no index (unclean close)")
+              << ", " << hdr.num_packets << " packets" << std::endl;
+
+    if (start_cycle >= 0) {
+        reader.seek_cycle(start_cycle);
+    } else {
+        reader.seek_time((uint64_t)(start_sec * 1e9));
+    }
+
+    const iso_capture_record *rec;
+    const unsigned char *payload;
+    for (long i = 0; (count < 0 || i < count); i++) {
+        rec = reader.next(&payload);
+        if (rec == NULL) break;
+
+        std::cout << std::fixed << std::setprecision(6)
+                  << rec->time_ns * 1e-9 << "s  seq " << rec->seq
+                  << "  cycle " << rec->cycle << " (" << reader.record_cycle() << ")"
+                  << "  ch " << (int)rec->channel
+                  << "  tag " << (int)rec->tag << "  sy " << (int)rec->sy
+                  << "  dropped " << rec->dropped
+                  << "  len " << rec->len << "  data";
+        for (unsigned int j = 0; j < rec->len && j < 8; j++) {
+            std::cout << " " << std::hex << std::setw(2) << std::setfill('0')
+                      << (int)payload[j] << std::dec << std::setfill(' ');
+        }
+        std::cout << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 8_iso_capture [-h] [-p port] [-c channel] -o file [-s packets] [-l len] [-r rate]\n"
+              << "       8_iso_capture -i file [-t seconds | -y cycle] [-n count]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -c  iso channel to receive (default 5)\n"
+              << "    -o  capture into file\n"
+              << "    -s  simulate N packets, no FireWire card needed\n"
+              << "    -l  simulated payload length in bytes (default 64)\n"
+              << "    -r  simulated packet rate per second, 0 = unpaced (default 8000)\n"
+              << "    -i  read back a capture file\n"
+              << "    -t  start at this many seconds into the capture\n"
+              << "    -y  start at this unwrapped cycle number\n"
+              << "    -n  number of packets to print (default 20, -1 = all)\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    unsigned char channel = 0x5;
+    const char *capture_path = NULL;
+    const char *read_path = NULL;
+    double start_sec = 0.0;
+    long long start_cycle = -1;
+    long count = 20;
+    unsigned long long sim_packets = 0;
+    IsoSimConfig sim_config;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:c:o:s:l:r:i:t:y:n:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'c':
+            channel = atoi(optarg);
+            break;
+        case 'o':
+            capture_path = optarg;
+            break;
+        case 's':
+            sim_packets = strtoull(optarg, 0, 10);
+            break;
+        case 'l':
+            sim_config.payload_len = atoi(optarg);
+            break;
+        case 'r':
+            sim_config.packet_rate = atof(optarg);
+            break;
+        case 'i':
+            read_path = optarg;
+            break;
+        case 't':
+            start_sec = atof(optarg);
+            break;
+        case 'y':
+            start_cycle = atoll(optarg);
+            break;
+        case 'n':
+            count = atol(optarg);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+    if (read_path) {
+        return dump_capture(read_path, start_sec, start_cycle, count);
+    }
+    if (capture_path == NULL) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+    if (capture.open(capture_path)) {
+        std::cerr << "**** Error: could not create capture file " << capture_path << " "
+                  << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    uint64_t last_report = iso_sim_now_ns();
+
+
+    // ----------------------------------------------------------------------------
+    // Simulation: drive the handler from a software packet source
+    // ----------------------------------------------------------------------------
+    if (sim_packets > 0) {
+        sim_config.buf_packets = BUFFER;
+        sim_config.max_packet_size = PACKET_MAX;
+        sim_config.channels.assign(1, channel);
+        IsoSimRecv sim(my_iso_recv_handler, sim_config);
+
+        while (running && sim.packets() < sim_packets) {
+            if (sim.iterate(NULL)) break;
+            print_progress(last_report);
+        }
+
+        rc = capture.close();
+        if (rc) std::cerr << "**** Error: capture incomplete " << strerror(errno) << std::endl;
+        std::cout << "captured " << capture.packets() << " packets into " << capture_path
+                  << ", " << capture.blocks_written() << " blocks, "
+                  << capture.lost() << " lost, "
+                  << capture.write_errors() << " write errors" << std::endl;
+        return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+
+    // ----- Get handle and set port for the handle -------
+    // create handle
+    handle = raw1394_new_handle();
+    if (handle == NULL) {
+        std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // get port number & sanity check
+    int numPorts = raw1394_get_port_info(handle, NULL, 0);
+    if (port < 0 || port >= numPorts) {
+        std::cerr << "Invalid port number" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // let user to choose which port to use
+    rc = raw1394_set_port(handle, port);
+    if (rc) {
+        std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+
+    // -------- Set FireWire bus reset handler --------
+
+    // set bus reset handler
+    raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 8 iso capture
+    // ----------------------------------------------------------------------------
+
+    rc = raw1394_iso_recv_init(handle,
+                               my_iso_recv_handler,
+                               BUFFER,      // buf_packets
+                               PACKET_MAX,  // max_packet_size
+                               channel,     // channel
+                               RAW1394_DMA_DEFAULT,  // dma mode
+                               -1);         // irq_interval
+    if (rc) {
+        perror("raw1394_iso_recv_init");
+        return EXIT_FAILURE;
+    }
+
+    // start receiving
+    rc = raw1394_iso_recv_start(handle, -1, -1, 0);
+    if (rc) {
+        perror("raw1394_iso_recv_start");
+        return EXIT_FAILURE;
+    }
+
+    while (running)
+    {
+        rc = raw1394_loop_iterate(handle);
+        if (rc) break;
+        print_progress(last_report);
+    }
+
+    // stop, flush the capture, clean up & exit
+    raw1394_iso_stop(handle);
+    rc = capture.close();
+    if (rc) std::cerr << "**** Error: capture incomplete " << strerror(errno) << std::endl;
+    std::cout << "captured " << capture.packets() << " packets into " << capture_path
+              << ", " << capture.lost() << " lost, "
+              << capture.write_errors() << " write errors" << std::endl;
+    raw1394_iso_shutdown(handle);
+    raw1394_destroy_handle(handle);
+
+    return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
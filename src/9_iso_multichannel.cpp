@@ -0,0 +1,444 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <iostream>
+#include <iomanip>
+#include <stdio.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "iso_sim.h"
+
+
+#define BUFFER 1000
+#define PACKET_MAX 4096
+#define ISO_CHANNELS 64
+
+
+/**
+  * @brief: Tutorial 9: Multichannel isochronous receive
+  *
+  *     Tutorial 5 receives exactly one channel per DMA context. This tutorial
+  *     receives many channels on a single context:
+  *         - raw1394_iso_multichannel_recv_init sets up one receive context
+  *         - raw1394_iso_recv_listen_channel / unlisten_channel add and remove
+  *           channels while the context keeps running
+  *         - a 64 entry table indexed by channel number routes every packet
+  *           to the consumer registered for that channel, O(1), no search
+  *
+  *     Channels can be changed at runtime by typing on stdin:
+  *         +N   listen to channel N     -N   stop listening to channel N
+  *         s    print per channel statistics
+  *
+  *     - to run this example
+  *         - transmit on a few channels from another computer (6_iso_xmit)
+  *         - 9_iso_multichannel -c 1,2,5
+  *     - without hardware: 9_iso_multichannel -c 1,2 -b 1,2,3,5 -s 80000
+  *       (-b lists the channels the simulated bus carries)
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+// per channel consumer, called from the receive handler
+typedef void (*iso_channel_consumer_t)(void *context,
+                                       unsigned char channel,
+                                       const unsigned char *data,
+                                       unsigned int len,
+                                       unsigned char tag,
+                                       unsigned char sy,
+                                       unsigned int cycle);
+
+struct iso_channel_entry
+{
+    iso_channel_consumer_t consumer;   /*!< NULL if nobody listens */
+    void *context;
+    unsigned long long packets;
+    unsigned long long bytes;
+};
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+// dispatch table, only touched from the loop thread so no locking is needed
+iso_channel_entry channel_table[ISO_CHANNELS];
+unsigned long long unrouted_packets = 0;   /*!< packets for channels without consumer */
+unsigned long long dropped_packets = 0;
+
+volatile sig_atomic_t running = 1;
+
+
+/* signal handler stops the event loop */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+// ---------- example consumers ----------
+
+// sums the payload, stands in for real stream processing
+void checksum_consumer(void *context, unsigned char channel,
+                       const unsigned char *data, unsigned int len,
+                       unsigned char tag, unsigned char sy, unsigned int cycle)
+{
+    quadlet_t *sum = (quadlet_t *)context;
+    for (unsigned int i = 0; i < len; i++) {
+        *sum += data[i];
+    }
+}
+
+// prints the first quadlet of every 8000th packet
+void trace_consumer(void *context, unsigned char channel,
+                    const unsigned char *data, unsigned int len,
+                    unsigned char tag, unsigned char sy, unsigned int cycle)
+{
+    unsigned long long *count = (unsigned long long *)context;
+    if ((*count)++ % 8000 == 0 && len >= 4) {
+        quadlet_t q;
+        memcpy(&q, data, 4);
+        std::cout << "channel " << (int)channel << " cycle " << cycle
+                  << " first quadlet 0x" << std::hex << q << std::dec << std::endl;
+    }
+}
+
+
+// ---------- dispatch table ----------
+
+/**
+ * Register @consumer for @channel and start listening on it.
+ * @handle may be NULL in simulation mode.
+ * Returns 0 on success or -1 on failure (sets errno)
+ */
+int iso_demux_add(raw1394handle_t handle, unsigned char channel,
+                  iso_channel_consumer_t consumer, void *context)
+{
+    if (channel >= ISO_CHANNELS || consumer == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (handle && channel_table[channel].consumer == NULL &&
+        raw1394_iso_recv_listen_channel(handle, channel)) {
+        return -1;
+    }
+    channel_table[channel].consumer = consumer;
+    channel_table[channel].context = context;
+    channel_table[channel].packets = 0;
+    channel_table[channel].bytes = 0;
+    return 0;
+}
+
+
+// Stop listening on @channel and drop its consumer
+int iso_demux_remove(raw1394handle_t handle, int channel)
+{
+    if (channel < 0 || channel >= ISO_CHANNELS || channel_table[channel].consumer == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (handle && raw1394_iso_recv_unlisten_channel(handle, channel)) {
+        return -1;
+    }
+    channel_table[channel].consumer = NULL;
+    channel_table[channel].context = NULL;
+    return 0;
+}
+
+
+raw1394_iso_disposition
+my_iso_recv_handler(raw1394handle_t handle,
+                    unsigned char *data,
+                    unsigned int len,
+                    unsigned char channel,
+                    unsigned char tag,
+                    unsigned char sy,
+                    unsigned int cycle,
+                    unsigned int dropped)
+{
+    dropped_packets += dropped;
+
+    // O(1) route by channel number
+    iso_channel_entry &entry = channel_table[channel & (ISO_CHANNELS - 1)];
+    if (entry.consumer == NULL) {
+        unrouted_packets++;
+        return RAW1394_ISO_OK;
+    }
+    entry.packets++;
+    entry.bytes += len;
+    entry.consumer(entry.context, channel, data, len, tag, sy, cycle);
+
+    // see raw1394_iso_disposition
+    return RAW1394_ISO_OK;
+}
+
+
+// ---------- runtime control ----------
+
+quadlet_t checksums[ISO_CHANNELS];
+unsigned long long trace_counts[ISO_CHANNELS];
+
+void print_stats()
+{
+    std::cout << "---- channel stats ----" << std::endl;
+    for (int ch = 0; ch < ISO_CHANNELS; ch++) {
+        const iso_channel_entry &entry = channel_table[ch];
+        if (entry.consumer == NULL) continue;
+        std::cout << "  channel " << std::setw(2) << ch
+                  << "  packets " << entry.packets
+                  << "  bytes " << entry.bytes << std::endl;
+    }
+    std::cout << "  unrouted " << unrouted_packets
+              << "  dropped " << dropped_packets << std::endl;
+}
+
+// even channels get the checksum consumer, odd ones the trace consumer
+int add_channel(raw1394handle_t handle, int channel)
+{
+    if (channel < 0 || channel >= ISO_CHANNELS) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (channel % 2 == 0) {
+        return iso_demux_add(handle, channel, checksum_consumer, &checksums[channel]);
+    }
+    return iso_demux_add(handle, channel, trace_consumer, &trace_counts[channel]);
+}
+
+// handle the lines waiting on stdin: +N, -N or s, returns false once stdin is closed
+bool handle_commands(raw1394handle_t handle)
+{
+    // read the fd directly, stdio buffering would hide lines from poll
+    char buffer[256];
+    ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer) - 1);
+    if (n <= 0) return false;
+    buffer[n] = '\0';
+
+    for (char *line = strtok(buffer, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        int rc = 0;
+        int channel = atoi(line + 1);
+        if (line[0] == '+') {
+            rc = add_channel(handle, channel);
+            if (!rc) std::cout << "listening on channel " << channel << std::endl;
+        } else if (line[0] == '-') {
+            rc = iso_demux_remove(handle, channel);
+            if (!rc) std::cout << "stopped channel " << channel << std::endl;
+        } else if (line[0] == 's') {
+            print_stats();
+        }
+        if (rc) {
+            std::cerr << "**** Error: channel " << channel << " " << strerror(errno) << std::endl;
+        }
+    }
+    return true;
+}
+
+// parse a comma separated channel list
+std::vector<unsigned char> parse_channels(const char *arg)
+{
+    std::vector<unsigned char> channels;
+    const char *p = arg;
+    while (*p) {
+        channels.push_back((unsigned char)strtoul(p, (char **)&p, 10));
+        if (*p == ',') p++;
+        else break;
+    }
+    return channels;
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: 9_iso_multichannel [-h] [-p port] [-c list] [-s packets] [-b list] [-r rate]\n"
+              << "    -h  show usage\n"
+              << "    -p  specify port number\n"
+              << "    -c  comma separated channels to listen to (default 5)\n"
+              << "    -s  simulate N packets, no FireWire card needed\n"
+              << "    -b  channels present on the simulated bus (default: same as -c)\n"
+              << "    -r  simulated packet rate per second, 0 = unpaced (default 8000)\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    std::vector<unsigned char> channels(1, 0x5);
+    std::vector<unsigned char> bus_channels;
+    unsigned long long sim_packets = 0;
+    IsoSimConfig sim_config;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hp:c:s:b:r:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'c':
+            channels = parse_channels(optarg);
+            break;
+        case 's':
+            sim_packets = strtoull(optarg, 0, 10);
+            break;
+        case 'b':
+            bus_channels = parse_channels(optarg);
+            break;
+        case 'r':
+            sim_config.packet_rate = atof(optarg);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+    struct pollfd fds[2];
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+
+
+    // ----------------------------------------------------------------------------
+    // Simulation: drive the handler from a software packet source
+    // ----------------------------------------------------------------------------
+    if (sim_packets > 0) {
+        for (size_t i = 0; i < channels.size(); i++) {
+            add_channel(NULL, channels[i]);
+        }
+        sim_config.buf_packets = BUFFER;
+        sim_config.max_packet_size = PACKET_MAX;
+        sim_config.channels = bus_channels.empty() ? channels : bus_channels;
+        IsoSimRecv sim(my_iso_recv_handler, sim_config);
+
+        while (running && sim.packets() < sim_packets) {
+            if (sim.iterate(NULL)) break;
+            if (poll(fds, 1, 0) > 0 && fds[0].revents) {
+                if (!handle_commands(NULL)) fds[0].fd = -1;
+            }
+        }
+        print_stats();
+        return EXIT_SUCCESS;
+    }
+
+
+    // ----- Get handle and set port for the handle -------
+    // create handle
+    handle = raw1394_new_handle();
+    if (handle == NULL) {
+        std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // get port number & sanity check
+    int numPorts = raw1394_get_port_info(handle, NULL, 0);
+    if (port < 0 || port >= numPorts) {
+        std::cerr << "Invalid port number" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // let user to choose which port to use
+    rc = raw1394_set_port(handle, port);
+    if (rc) {
+        std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+
+    // -------- Set FireWire bus reset handler --------
+
+    // set bus reset handler
+    raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+
+
+
+    // ----------------------------------------------------------------------------
+    // Start tutorial 9 multichannel receive
+    // ----------------------------------------------------------------------------
+
+    // one DMA context for all channels, no channel argument here
+    rc = raw1394_iso_multichannel_recv_init(handle,
+                                            my_iso_recv_handler,
+                                            BUFFER,      // buf_packets
+                                            PACKET_MAX,  // max_packet_size
+                                            -1);         // irq_interval
+    if (rc) {
+        perror("raw1394_iso_multichannel_recv_init");
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < channels.size(); i++) {
+        if (add_channel(handle, channels[i])) {
+            std::cerr << "**** Error: failed to listen on channel " << (int)channels[i]
+                      << " " << strerror(errno) << std::endl;
+        }
+    }
+
+    // start receiving
+    rc = raw1394_iso_recv_start(handle, -1, -1, 0);
+    if (rc) {
+        perror("raw1394_iso_recv_start");
+        return EXIT_FAILURE;
+    }
+
+    // wait on the 1394 fd and stdin, so channel changes need no extra thread
+    fds[1].fd = raw1394_get_fd(handle);
+    fds[1].events = POLLIN;
+    while (running)
+    {
+        rc = poll(fds, 2, 1000);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            if (raw1394_loop_iterate(handle)) break;
+        }
+        if (fds[0].revents) {
+            if (!handle_commands(handle)) fds[0].fd = -1;  // stdin closed, stop polling it
+        }
+    }
+
+    // stop, clean up & exit
+    raw1394_iso_stop(handle);
+    print_stats();
+    raw1394_iso_shutdown(handle);
+    raw1394_destroy_handle(handle);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+#ifndef ARM_DIRTY_H
+#define ARM_DIRTY_H
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+#include "arm_request.h"
+
+
+/**
+  * @brief: Which quadlets of an ARM region remote nodes changed
+  *
+  *     Instead of comparing the whole ARM buffer with a copy, ArmDirtyMap
+  *     keeps one bit per quadlet, set from the ARM write callback:
+  *         - mark() sets the bits of the written quadlets and one summary bit
+  *           per 64 quadlets, both with fetch_or, no lock
+  *         - the first mark() after a collect() signals an eventfd, so a
+  *           consumer can poll/epoll fd() next to anything else
+  *         - collect() swaps the summary words and then the marked bitmap
+  *           words with zero and returns the changed ranges, so the cost
+  *           grows with what changed, not with the size of the region;
+  *           a write racing with collect() is reported now or next time,
+  *           never lost
+  *
+  *     Any number of threads may mark(), one thread collects.
+  *
+  * @date 2026-10-17
+  */
+
+
+// [offset, offset + length) in bytes from the region start, quadlet aligned
+struct arm_dirty_range
+{
+    size_t offset;
+    size_t length;
+};
+
+
+class ArmDirtyMap
+{
+public:
+    ArmDirtyMap() : start_(0), length_(0), event_fd_(-1), armed_(false) {}
+    ~ArmDirtyMap()
+    {
+        if (event_fd_ >= 0) close(event_fd_);
+    }
+
+    /**
+     * Track @length bytes at @start. Call before any mark().
+     * Returns 0 on success or -1 on failure (sets errno)
+     */
+    int init(nodeaddr_t start, size_t length)
+    {
+        if (length == 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (event_fd_ < 0) event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (event_fd_ < 0) return -1;
+        start_ = start;
+        length_ = length;
+        const size_t quadlets = (length + 3) / 4;
+        std::vector<std::atomic<uint64_t> > bits((quadlets + 63) / 64);
+        std::vector<std::atomic<uint64_t> > summary((bits.size() + 63) / 64);
+        bits_.swap(bits);
+        summary_.swap(summary);
+        for (size_t i = 0; i < bits_.size(); i++) bits_[i].store(0);
+        for (size_t i = 0; i < summary_.size(); i++) summary_[i].store(0);
+        armed_.store(false);
+        return 0;
+    }
+
+    // mark @len bytes written at @addr, any thread; outside parts are ignored
+    void mark(nodeaddr_t addr, size_t len)
+    {
+        if (len == 0 || addr >= start_ + length_ || addr + len <= start_) return;
+        if (addr < start_) {
+            len -= start_ - addr;
+            addr = start_;
+        }
+        if (addr + len > start_ + length_) len = start_ + length_ - addr;
+
+        size_t first = (addr - start_) / 4;
+        const size_t last = (addr - start_ + len - 1) / 4;   // inclusive
+        while (first <= last) {
+            const size_t word = first / 64;
+            const size_t bit = first % 64;
+            const size_t n = std::min<size_t>(64 - bit, last - first + 1);
+            const uint64_t mask = (n == 64) ? ~0ULL : (((1ULL << n) - 1) << bit);
+            bits_[word].fetch_or(mask);
+            summary_[word / 64].fetch_or(1ULL << (word % 64));
+            first += n;
+        }
+
+        if (!armed_.exchange(true)) {
+            const uint64_t one = 1;
+            if (write(event_fd_, &one, sizeof(one)) < 0) {}
+        }
+    }
+
+    // feed an ARM request, writes and locks change the region
+    void update(const struct raw1394_arm_request *request, byte_t request_type)
+    {
+        if (request_type == RAW1394_ARM_WRITE || request_type == RAW1394_ARM_LOCK) {
+            mark(request->destination_offset, arm_request_length(request, request_type));
+        }
+    }
+
+    /**
+     * Move the changed ranges into @ranges (cleared first) and clear them.
+     * Returns the number of ranges.
+     */
+    size_t collect(std::vector<arm_dirty_range> &ranges)
+    {
+        uint64_t events;
+        if (read(event_fd_, &events, sizeof(events)) < 0) {}
+        armed_.store(false);
+
+        ranges.clear();
+        bool open = false;
+        size_t run_start = 0, run_end = 0;   // quadlets
+        for (size_t s = 0; s < summary_.size(); s++) {
+            uint64_t words = summary_[s].exchange(0);
+            while (words) {
+                const size_t word = s * 64 + __builtin_ctzll(words);
+                words &= words - 1;
+                uint64_t bits = bits_[word].exchange(0);
+                while (bits) {
+                    // one run of set bits inside this word
+                    const size_t lo = __builtin_ctzll(bits);
+                    const uint64_t shifted = bits >> lo;
+                    const size_t n = (~shifted == 0) ? 64 - lo : __builtin_ctzll(~shifted);
+                    const size_t q = word * 64 + lo;
+                    if (open && q == run_end) {
+                        run_end = q + n;   // continues the previous run
+                    } else {
+                        if (open) push(ranges, run_start, run_end);
+                        run_start = q;
+                        run_end = q + n;
+                        open = true;
+                    }
+                    bits = (lo + n >= 64) ? 0 : bits & ~(((1ULL << n) - 1) << lo);
+                }
+            }
+        }
+        if (open) push(ranges, run_start, run_end);
+        return ranges.size();
+    }
+
+    /**
+     * Wait until something is marked or @timeout_ms passed (-1 = forever).
+     * Returns 1 when marked, 0 on timeout, -1 on failure (sets errno)
+     */
+    int wait(int timeout_ms)
+    {
+        struct pollfd pfd = { event_fd_, POLLIN, 0 };
+        return poll(&pfd, 1, timeout_ms);
+    }
+
+    // readable after a mark(), until the next collect()
+    int fd() const { return event_fd_; }
+
+    nodeaddr_t start() const { return start_; }
+    size_t length() const { return length_; }
+
+private:
+    void push(std::vector<arm_dirty_range> &ranges, size_t first, size_t end)
+    {
+        arm_dirty_range r;
+        r.offset = first * 4;
+        r.length = std::min(end * 4, length_) - r.offset;
+        ranges.push_back(r);
+    }
+
+    nodeaddr_t start_;
+    size_t length_;
+    std::vector<std::atomic<uint64_t> > bits_;      /*!< one bit per quadlet */
+    std::vector<std::atomic<uint64_t> > summary_;   /*!< one bit per bits_ word */
+    int event_fd_;
+    std::atomic<bool> armed_;                       /*!< eventfd signalled since the last collect */
+};
+
+#endif // ARM_DIRTY_H
@@ -0,0 +1,298 @@
+#ifndef ARM_REGION_MAP_H
+#define ARM_REGION_MAP_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+#include "arm_request.h"
+
+
+/**
+  * @brief: Many ARM ranges behind one callback
+  *
+  *     Tutorial 2 registers one range with its own raw1394_arm_reqhandle.
+  *     A device emulator exposes dozens of register windows, each with its
+  *     own semantics. ArmRegionMap takes a declarative table of regions:
+  *         - every region is registered with raw1394_arm_register, all of
+  *           them share one reqhandle and one callback
+  *         - the callback maps destination_offset to its region through an
+  *           index built once at registration and calls the region's handler
+  *         - the index is a flat table (one uint16_t per granule, granule =
+  *           the coarsest power of two all region bounds are aligned to), so
+  *           a lookup is one shift and one load however many regions exist.
+  *           If the regions are too sparse for a table of ARM_REGION_FLAT_MAX
+  *           entries it falls back to a binary search over the sorted starts
+  *         - no allocation or locking on the request path
+  *
+  *     libraw1394 serves reads/writes/locks from the region buffer itself
+  *     (client_transactions = 0) and calls the handler afterwards for the
+  *     transactions in the region's notify mask. Handlers update what remote
+  *     nodes see with raw1394_arm_set_buf.
+  *
+  *     An observer (set_observer) sees every request of the given types in
+  *     every region before the region handler does, e.g. to mirror writes.
+  *
+  * @date 2026-10-17
+  */
+
+
+#define ARM_REGION_FLAT_MAX   262144   /*!< max entries of the flat index (512 KiB) */
+#define ARM_REGION_NONE       0xffff
+
+
+struct ArmRegion;
+
+/**
+ * Per-region handler, runs inside raw1394_loop_iterate after libraw1394
+ * completed the transaction. @request_type is RAW1394_ARM_READ/WRITE/LOCK.
+ */
+typedef int (*arm_region_handler_t)(raw1394handle_t handle,
+                                    ArmRegion &region,
+                                    const struct raw1394_arm_request *request,
+                                    byte_t request_type);
+
+// same signature, called for every region, @context as passed to set_observer
+typedef void (*arm_region_observer_t)(raw1394handle_t handle,
+                                      ArmRegion &region,
+                                      const struct raw1394_arm_request *request,
+                                      byte_t request_type,
+                                      void *context);
+
+
+// one line of the declarative table
+struct arm_region_desc
+{
+    const char *name;
+    nodeaddr_t start;
+    size_t length;                   /*!< bytes */
+    arm_options_t access;            /*!< RAW1394_ARM_READ | WRITE | LOCK */
+    arm_options_t notify;            /*!< transactions the handler is told about */
+    arm_region_handler_t handler;    /*!< NULL = plain memory */
+};
+
+
+struct ArmRegion
+{
+    arm_region_desc desc;
+    unsigned int id;                 /*!< position in the table as added */
+    std::vector<byte_t> init;        /*!< initial contents */
+    void *context;                   /*!< free for the handler */
+    unsigned long long requests;     /*!< loop thread only */
+
+    nodeaddr_t end() const { return desc.start + desc.length; }
+    size_t offset(nodeaddr_t addr) const { return addr - desc.start; }
+};
+
+
+class ArmRegionMap
+{
+public:
+    ArmRegionMap()
+        : handle_(NULL), registered_(0), base_(0), shift_(0), unmatched_(0),
+          observer_(NULL), observer_context_(NULL), observer_mask_(0)
+    {
+        reqhandle_.arm_callback = &ArmRegionMap::arm_callback;
+        reqhandle_.pcontext = this;
+        reqhandle_.buffer_length = 0;
+    }
+    ~ArmRegionMap() { unregister_all(); }
+
+    /**
+     * Add a region before register_all(). @init may be NULL (zero filled).
+     * Returns the region id or -1 on failure (sets errno).
+     */
+    int add(const arm_region_desc &desc, const void *init = NULL, void *context = NULL)
+    {
+        if (registered_ || desc.length == 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        ArmRegion region;
+        region.desc = desc;
+        region.id = regions_.size();
+        region.init.assign(desc.length, 0);
+        if (init) memcpy(&region.init[0], init, desc.length);
+        region.context = context;
+        region.requests = 0;
+        regions_.push_back(region);
+        return region.id;
+    }
+
+    /**
+     * Sort the table, build the index and check for overlaps.
+     * Returns 0 on success or -1 on failure (sets errno, EEXIST on overlap).
+     */
+    int build()
+    {
+        std::sort(regions_.begin(), regions_.end(), by_start);
+        by_id_.assign(regions_.size(), 0);
+        starts_.clear();
+        for (size_t i = 0; i < regions_.size(); i++) {
+            if (i > 0 && regions_[i].desc.start < regions_[i - 1].end()) {
+                errno = EEXIST;
+                return -1;
+            }
+            starts_.push_back(regions_[i].desc.start);
+            by_id_[regions_[i].id] = i;
+        }
+        if (regions_.size() >= ARM_REGION_NONE) {
+            table_.clear();
+            return 0;
+        }
+
+        // coarsest granule every region boundary is aligned to
+        table_.clear();
+        if (regions_.empty()) return 0;
+        base_ = regions_[0].desc.start;
+        uint64_t bounds = 0;
+        for (size_t i = 0; i < regions_.size(); i++) {
+            bounds |= (regions_[i].desc.start - base_) | regions_[i].desc.length;
+        }
+        shift_ = __builtin_ctzll(bounds);
+        const uint64_t entries = (regions_.back().end() - base_) >> shift_;
+        if (entries > ARM_REGION_FLAT_MAX) return 0;   // binary search instead
+
+        table_.assign(entries, ARM_REGION_NONE);
+        for (size_t i = 0; i < regions_.size(); i++) {
+            const uint64_t first = (regions_[i].desc.start - base_) >> shift_;
+            const uint64_t last = (regions_[i].end() - base_) >> shift_;
+            for (uint64_t e = first; e < last; e++) table_[e] = i;
+        }
+        return 0;
+    }
+
+    /**
+     * Call @observer for every request of a type in @mask, in all regions.
+     * Set it before register_all(), the mask is added to every region's
+     * notify mask at registration.
+     */
+    void set_observer(arm_region_observer_t observer, void *context, arm_options_t mask)
+    {
+        observer_ = observer;
+        observer_context_ = context;
+        observer_mask_ = mask;
+    }
+
+    /**
+     * Build the index and register every region with libraw1394.
+     * Returns 0 on success or -1 on failure (sets errno), nothing stays
+     * registered on failure.
+     */
+    int register_all(raw1394handle_t handle)
+    {
+        if (build()) return -1;
+        handle_ = handle;
+        for (size_t i = 0; i < regions_.size(); i++) {
+            ArmRegion &r = regions_[i];
+            int rc = raw1394_arm_register(handle,
+                                          r.desc.start,     // arm start address
+                                          r.desc.length,    // bytes
+                                          &r.init[0],       // arm init buffer value
+                                          (octlet_t) &reqhandle_,  // shared request handler
+                                          r.desc.access,    // access permission
+                                          r.desc.notify | observer_mask_,  // callback will be notified
+                                          0);               // libraw1394 answers all transactions
+            if (rc) {
+                const int err = errno;
+                unregister_all();
+                errno = err;
+                return -1;
+            }
+            registered_++;
+        }
+        return 0;
+    }
+
+    void unregister_all()
+    {
+        for (size_t i = 0; i < registered_; i++) {
+            raw1394_arm_unregister(handle_, regions_[i].desc.start);
+        }
+        registered_ = 0;
+    }
+
+    // region containing [addr, addr + len), NULL if none
+    ArmRegion *find(nodeaddr_t addr, size_t len = 1)
+    {
+        size_t i;
+        if (!table_.empty()) {
+            const uint64_t e = (addr - base_) >> shift_;
+            if (addr < base_ || e >= table_.size() || table_[e] == ARM_REGION_NONE) return NULL;
+            i = table_[e];
+        } else {
+            std::vector<nodeaddr_t>::const_iterator it =
+                    std::upper_bound(starts_.begin(), starts_.end(), addr);
+            if (it == starts_.begin()) return NULL;
+            i = (it - starts_.begin()) - 1;
+        }
+        ArmRegion &r = regions_[i];
+        return (addr + len <= r.end()) ? &r : NULL;
+    }
+
+    size_t size() const { return regions_.size(); }
+    // by the id add() returned, valid after build()
+    ArmRegion &region(unsigned int id) { return regions_[by_id_[id]]; }
+    // in address order
+    ArmRegion &at(size_t i) { return regions_[i]; }
+    size_t index_of(const ArmRegion &region) const { return &region - &regions_[0]; }
+
+    bool flat() const { return !table_.empty(); }
+    size_t table_entries() const { return table_.size(); }
+    unsigned int granule() const { return 1u << shift_; }
+    unsigned long long unmatched() const { return unmatched_; }
+
+    // the shared ARM callback, dispatches to the region handler
+    static int arm_callback(raw1394handle_t handle,
+                            struct raw1394_arm_request_response *arm_req_resp,
+                            unsigned int requested_length,
+                            void *pcontext, byte_t request_type)
+    {
+        ArmRegionMap *map = (ArmRegionMap *)pcontext;
+        const struct raw1394_arm_request *req = arm_req_resp->request;
+        // a lock touches one operand, not argument plus data
+        size_t len = arm_request_length(req, request_type);
+        if (len == 0) len = requested_length;
+
+        ArmRegion *region = map->find(req->destination_offset, len ? len : 1);
+        if (region == NULL) {
+            map->unmatched_++;
+            return 0;
+        }
+        region->requests++;
+        if (map->observer_ && (request_type & map->observer_mask_)) {
+            map->observer_(handle, *region, req, request_type, map->observer_context_);
+        }
+        if (region->desc.handler && (request_type & region->desc.notify)) {
+            return region->desc.handler(handle, *region, req, request_type);
+        }
+        return 0;
+    }
+
+private:
+    static bool by_start(const ArmRegion &a, const ArmRegion &b)
+    {
+        return a.desc.start < b.desc.start;
+    }
+
+    raw1394handle_t handle_;
+    std::vector<ArmRegion> regions_;     /*!< sorted by start after build() */
+    std::vector<size_t> by_id_;          /*!< id -> position in regions_ */
+    std::vector<nodeaddr_t> starts_;     /*!< region starts, for the binary search */
+    std::vector<uint16_t> table_;        /*!< granule -> region, empty if sparse */
+    size_t registered_;
+    nodeaddr_t base_;
+    unsigned int shift_;
+    unsigned long long unmatched_;
+    arm_region_observer_t observer_;
+    void *observer_context_;
+    arm_options_t observer_mask_;
+    struct raw1394_arm_reqhandle reqhandle_;
+};
+
+#endif // ARM_REGION_MAP_H
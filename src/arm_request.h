@@ -0,0 +1,33 @@
+#ifndef ARM_REQUEST_H
+#define ARM_REQUEST_H
+
+#include <stddef.h>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+
+/**
+  * @brief: Helpers for raw1394_arm_request
+  *
+  *     The buffer of an ARM lock request holds what the lock transaction
+  *     carried: fetch_add and little_add one operand, the other extended
+  *     transaction codes an argument and a data value. The bytes the lock
+  *     touches at destination_offset are one operand.
+  *
+  * @date 2026-10-17
+  */
+
+
+// bytes of the region a write or lock @request changes, 0 for reads
+static inline size_t arm_request_length(const struct raw1394_arm_request *request, byte_t request_type)
+{
+    if (request_type == RAW1394_ARM_WRITE) return request->buffer_length;
+    if (request_type != RAW1394_ARM_LOCK) return 0;
+    const int ext = request->extended_transaction_code;
+    size_t len = request->buffer_length;
+    if (ext != RAW1394_EXTCODE_FETCH_ADD && ext != RAW1394_EXTCODE_LITTLE_ADD) len /= 2;
+    return len ? len : 4;
+}
+
+#endif // ARM_REQUEST_H
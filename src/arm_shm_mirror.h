@@ -0,0 +1,345 @@
+#ifndef ARM_SHM_MIRROR_H
+#define ARM_SHM_MIRROR_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+#include "arm_region_map.h"
+
+
+/**
+  * @brief: Shared memory mirror of ARM regions
+  *
+  *     A local process that wants to see an ARM region normally calls
+  *     raw1394_arm_get_buf on a 1394 handle: one ioctl and one copy per look.
+  *     ArmShmMirror keeps a copy of every region of an ArmRegionMap in one
+  *     POSIX shared memory segment instead:
+  *
+  *         +---------------------+  0
+  *         | arm_shm_header      |
+  *         +---------------------+  64
+  *         | arm_shm_region  x N |  one 64 byte line each
+  *         +---------------------+
+  *         | region data    x N  |  each 64 byte aligned
+  *         +---------------------+
+  *
+  *     The server side hooks into the map as an observer: every remote write
+  *     is copied from the request, after a lock the new value is read back
+  *     with raw1394_arm_get_buf, and local updates go through set_buf().
+  *     Each region has its own sequence counter, odd while an update is in
+  *     progress, so readers (ArmShmReader) map the segment read-only, read
+  *     without any syscall and retry when the counter moved underneath them.
+  *
+  * @date 2026-10-17
+  */
+
+
+#define ARM_SHM_MAGIC      0x4d534d41   /* "AMSM" */
+#define ARM_SHM_VERSION    1
+#define ARM_SHM_ALIGN      64
+#define ARM_SHM_SPINS      1000         /*!< reads of an odd sequence before a reader yields */
+#define ARM_SHM_TIMEOUT_MS 1000         /*!< wait for an unfinished update before a reader gives up */
+
+
+struct arm_shm_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_regions;
+    uint32_t pid;                /*!< server process */
+    uint64_t size;               /*!< whole segment in bytes */
+    uint8_t reserved[40];
+};
+
+
+struct arm_shm_region
+{
+    std::atomic<uint32_t> seq;   /*!< odd while the server updates the data */
+    uint32_t reserved;
+    uint64_t start;              /*!< 1394 address */
+    uint64_t length;             /*!< bytes */
+    uint64_t data_offset;        /*!< from the start of the segment */
+    uint64_t updates;            /*!< number of mirrored updates */
+    char name[24];
+};
+
+
+class ArmShmMirror
+{
+public:
+    ArmShmMirror() : base_(NULL), size_(0), map_(NULL) { name_[0] = '\0'; }
+    ~ArmShmMirror() { close(); }
+
+    /**
+     * Create the segment @name (e.g. "/arm_mirror") for every region of @map
+     * and start observing it. Call before map.register_all().
+     * Returns 0 on success or -1 on failure (sets errno)
+     */
+    int create(const char *name, ArmRegionMap &map)
+    {
+        if (map.build()) return -1;
+
+        const size_t n = map.size();
+        size_t size = align(sizeof(arm_shm_header) + n * sizeof(arm_shm_region));
+        for (size_t i = 0; i < n; i++) size += align(map.at(i).desc.length);
+
+        int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+        if (fd < 0) return -1;
+        if (ftruncate(fd, size)) {
+            ::close(fd);
+            return -1;
+        }
+        void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mem == MAP_FAILED) return -1;
+
+        base_ = (unsigned char *)mem;
+        size_ = size;
+        map_ = &map;
+        snprintf(name_, sizeof(name_), "%s", name);
+
+        // readers check the magic last, so it is written last
+        arm_shm_header *hdr = header();
+        hdr->magic = 0;
+        hdr->version = ARM_SHM_VERSION;
+        hdr->num_regions = n;
+        hdr->pid = getpid();
+        hdr->size = size;
+
+        uint64_t offset = align(sizeof(arm_shm_header) + n * sizeof(arm_shm_region));
+        for (size_t i = 0; i < n; i++) {
+            const ArmRegion &r = map.at(i);
+            arm_shm_region *reg = region(i);
+            reg->seq.store(0, std::memory_order_relaxed);
+            reg->start = r.desc.start;
+            reg->length = r.desc.length;
+            reg->data_offset = offset;
+            reg->updates = 0;
+            snprintf(reg->name, sizeof(reg->name), "%s", r.desc.name);
+            memcpy(base_ + offset, &r.init[0], r.desc.length);
+            offset += align(r.desc.length);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        hdr->magic = ARM_SHM_MAGIC;
+
+        map.set_observer(&ArmShmMirror::observer, this, RAW1394_ARM_WRITE | RAW1394_ARM_LOCK);
+        return 0;
+    }
+
+    void close()
+    {
+        if (base_) {
+            munmap(base_, size_);
+            shm_unlink(name_);
+        }
+        if (map_) map_->set_observer(NULL, NULL, 0);
+        base_ = NULL;
+        map_ = NULL;
+    }
+
+    /**
+     * Copy @len bytes at @offset into region @index (address order) of the
+     * mirror. Only the thread running raw1394_loop_iterate may call this.
+     */
+    void update(size_t index, size_t offset, const void *data, size_t len)
+    {
+        if (base_ == NULL || index >= header()->num_regions) return;
+        arm_shm_region *reg = region(index);
+        if (offset >= reg->length) return;
+        if (len > reg->length - offset) len = reg->length - offset;
+
+        const uint32_t seq = reg->seq.load(std::memory_order_relaxed);
+        reg->seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(base_ + reg->data_offset + offset, data, len);
+        reg->updates++;
+        reg->seq.store(seq + 2, std::memory_order_release);
+    }
+
+    /**
+     * raw1394_arm_set_buf that keeps the mirror in step, for handlers that
+     * change a region themselves. With a NULL @handle only the mirror is
+     * updated. Returns 0 on success or -1 on failure (sets errno)
+     */
+    int set_buf(raw1394handle_t handle, nodeaddr_t addr, size_t len, const void *data)
+    {
+        if (handle && raw1394_arm_set_buf(handle, addr, len, (void *)data)) return -1;
+        ArmRegion *r = map_ ? map_->find(addr, len) : NULL;
+        if (r) update(map_->index_of(*r), r->offset(addr), data, len);
+        return 0;
+    }
+
+private:
+    static void observer(raw1394handle_t handle, ArmRegion &region,
+                         const struct raw1394_arm_request *request,
+                         byte_t request_type, void *context)
+    {
+        ArmShmMirror *mirror = (ArmShmMirror *)context;
+        const size_t index = mirror->map_->index_of(region);
+        const size_t offset = region.offset(request->destination_offset);
+
+        if (request_type == RAW1394_ARM_WRITE) {
+            mirror->update(index, offset, request->buffer, request->buffer_length);
+        } else if (request_type == RAW1394_ARM_LOCK && handle) {
+            // the result of a lock is only in the ARM buffer, up to an octlet
+            byte_t value[8];
+            size_t len = region.desc.length - offset;
+            if (len > sizeof(value)) len = sizeof(value);
+            if (raw1394_arm_get_buf(handle, request->destination_offset, len, value) == 0) {
+                mirror->update(index, offset, value, len);
+            }
+        }
+    }
+
+    static size_t align(size_t n) { return (n + ARM_SHM_ALIGN - 1) & ~(size_t)(ARM_SHM_ALIGN - 1); }
+
+    arm_shm_header *header() { return (arm_shm_header *)base_; }
+    arm_shm_region *region(size_t i)
+    {
+        return (arm_shm_region *)(base_ + sizeof(arm_shm_header)) + i;
+    }
+
+    unsigned char *base_;
+    size_t size_;
+    ArmRegionMap *map_;
+    char name_[256];
+};
+
+
+class ArmShmReader
+{
+public:
+    ArmShmReader() : base_(NULL), size_(0) {}
+    ~ArmShmReader() { close(); }
+
+    // Returns 0 on success or -1 on failure (sets errno)
+    int open(const char *name)
+    {
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0) return -1;
+        struct stat st;
+        if (fstat(fd, &st) || (size_t)st.st_size < sizeof(arm_shm_header)) {
+            ::close(fd);
+            errno = EINVAL;
+            return -1;
+        }
+        void *mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mem == MAP_FAILED) return -1;
+
+        base_ = (const unsigned char *)mem;
+        size_ = st.st_size;
+        const arm_shm_header *hdr = (const arm_shm_header *)base_;
+        if (hdr->magic != ARM_SHM_MAGIC || hdr->version != ARM_SHM_VERSION || hdr->size > size_) {
+            close();
+            errno = EINVAL;
+            return -1;
+        }
+        return 0;
+    }
+
+    void close()
+    {
+        if (base_) munmap((void *)base_, size_);
+        base_ = NULL;
+    }
+
+    size_t size() const { return ((const arm_shm_header *)base_)->num_regions; }
+    const arm_shm_region &region(size_t i) const
+    {
+        return ((const arm_shm_region *)(base_ + sizeof(arm_shm_header)))[i];
+    }
+
+    // index of the region containing @addr, -1 if none
+    int find(nodeaddr_t addr) const
+    {
+        for (size_t i = 0; i < size(); i++) {
+            if (addr >= region(i).start && addr < region(i).start + region(i).length) return i;
+        }
+        return -1;
+    }
+
+    /**
+     * Zero-copy access: remember begin(), read data() directly, then
+     * consistent() tells whether the server changed the region meanwhile.
+     */
+    const byte_t *data(size_t i) const { return base_ + region(i).data_offset; }
+
+    // true while the server process that created the segment exists
+    bool server_alive() const
+    {
+        const pid_t pid = (pid_t)((const arm_shm_header *)base_)->pid;
+        return kill(pid, 0) == 0 || errno != ESRCH;
+    }
+
+    /**
+     * Wait until no update of region @i is in progress and store its
+     * sequence in @seq. Spins, then yields the CPU to a preempted server.
+     * Returns 0, or -1 when the sequence stayed odd for @timeout_ms:
+     * errno = ESRCH if the server died in the middle of the update,
+     * EAGAIN if it is still running and the caller may try again.
+     */
+    int begin(size_t i, uint32_t &seq, unsigned int timeout_ms = ARM_SHM_TIMEOUT_MS) const
+    {
+        struct timespec start, now;
+        for (unsigned long spin = 0;; spin++) {
+            seq = region(i).seq.load(std::memory_order_acquire);
+            if ((seq & 1) == 0) return 0;
+            if (spin < ARM_SHM_SPINS) continue;
+            if (spin == ARM_SHM_SPINS) clock_gettime(CLOCK_MONOTONIC, &start);
+            sched_yield();
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            const long long ms = (now.tv_sec - start.tv_sec) * 1000LL + (now.tv_nsec - start.tv_nsec) / 1000000;
+            if (ms >= (long long)timeout_ms) break;
+        }
+        errno = server_alive() ? EAGAIN : ESRCH;
+        return -1;
+    }
+
+    bool consistent(size_t i, uint32_t begin) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return region(i).seq.load(std::memory_order_relaxed) == begin;
+    }
+
+    /**
+     * Copy a consistent view of @len bytes at @offset of region @i.
+     * Returns the number of retries needed, or -1 if the server kept
+     * updating for @max_retries attempts or begin() gave up (errno = EAGAIN,
+     * or ESRCH when the server died in the middle of an update).
+     */
+    int read(size_t i, size_t offset, void *buf, size_t len, int max_retries = 1000) const
+    {
+        if (offset + len > region(i).length) {
+            errno = EINVAL;
+            return -1;
+        }
+        for (int attempt = 0; attempt <= max_retries; attempt++) {
+            uint32_t seq;
+            if (begin(i, seq)) return -1;
+            memcpy(buf, data(i) + offset, len);
+            if (consistent(i, seq)) return attempt;
+        }
+        errno = EAGAIN;
+        return -1;
+    }
+
+private:
+    const unsigned char *base_;
+    size_t size_;
+};
+
+#endif // ARM_SHM_MIRROR_H
@@ -0,0 +1,154 @@
+#ifndef ARM_SNAPSHOT_H
+#define ARM_SNAPSHOT_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+
+/**
+  * @brief: Consistent multi-quadlet snapshots of an ARM buffer
+  *
+  *     raw1394_arm_get_buf copies out of the kernel's ARM buffer while remote
+  *     block writes land in it, so a reader can get a block that is half the
+  *     old and half the new write. ArmSnapshot keeps its own copy of the
+  *     region, fed from the ARM callback with the payload of each request:
+  *         - two buffers; the writer builds the next block (previous block
+  *           plus the new write) in the buffer readers are not directed to,
+  *           then flips the version, so one remote write becomes visible at once
+  *         - each buffer has a sequence counter, odd while it is rewritten;
+  *           a reader only retries if the writer flipped twice during its copy
+  *         - readers take no lock and never block the writer, any thread may read
+  *
+  *     There is one writer, the thread that runs raw1394_loop_iterate.
+  *
+  * @date 2026-10-17
+  */
+
+
+class ArmSnapshot
+{
+public:
+    ArmSnapshot() : start_(0), length_(0), version_(0)
+    {
+        seq_[0].store(0);
+        seq_[1].store(0);
+    }
+
+    /**
+     * Mirror @length bytes at @start, initially @init (NULL = zero filled).
+     * Call before any reader or writer runs.
+     * Returns 0 on success or -1 on failure (sets errno)
+     */
+    int init(nodeaddr_t start, size_t length, const void *init = NULL)
+    {
+        if (length == 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        start_ = start;
+        length_ = length;
+        for (int b = 0; b < 2; b++) {
+            buf_[b].assign(length, 0);
+            if (init) memcpy(&buf_[b][0], init, length);
+        }
+        return 0;
+    }
+
+    /**
+     * Apply @len bytes written at @addr as one block. Writer thread only.
+     * Returns 0 on success or -1 (EINVAL) if the range is outside the region.
+     */
+    int write(nodeaddr_t addr, const void *data, size_t len)
+    {
+        if (addr < start_ || len > length_ || addr - start_ > length_ - len) {
+            errno = EINVAL;
+            return -1;
+        }
+        const uint32_t version = version_.load(std::memory_order_relaxed);
+        const int current = version & 1;
+        const int next = current ^ 1;
+
+        const uint32_t seq = seq_[next].load(std::memory_order_relaxed);
+        seq_[next].store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&buf_[next][0], &buf_[current][0], length_);
+        memcpy(&buf_[next][addr - start_], data, len);
+        seq_[next].store(seq + 2, std::memory_order_release);
+
+        version_.store(version + 1, std::memory_order_release);
+        return 0;
+    }
+
+    /**
+     * Feed an ARM request to the snapshot, call from the ARM callback.
+     * Writes carry their payload; the result of a lock is only in the ARM
+     * buffer, so it is read back (up to one octlet) with raw1394_arm_get_buf.
+     */
+    int update(raw1394handle_t handle, const struct raw1394_arm_request *request,
+               byte_t request_type)
+    {
+        if (request_type == RAW1394_ARM_WRITE) {
+            return write(request->destination_offset, request->buffer, request->buffer_length);
+        }
+        if (request_type == RAW1394_ARM_LOCK && handle) {
+            byte_t value[8];
+            const nodeaddr_t addr = request->destination_offset;
+            size_t len = (addr >= start_ && addr < start_ + length_) ? start_ + length_ - addr : 0;
+            if (len > sizeof(value)) len = sizeof(value);
+            if (len == 0 || raw1394_arm_get_buf(handle, addr, len, value)) return -1;
+            return write(addr, value, len);
+        }
+        return 0;
+    }
+
+    /**
+     * Copy @len bytes at @offset of the latest complete block into @buf,
+     * any thread. Returns the version of the block (number of writes applied);
+     * @retries, if given, is set to the number of copies that were discarded.
+     */
+    uint32_t read(void *buf, size_t offset, size_t len, unsigned int *retries = NULL) const
+    {
+        if (offset > length_) offset = length_;
+        if (len > length_ - offset) len = length_ - offset;
+        unsigned int attempts = 0;
+        for (;; attempts++) {
+            const uint32_t version = version_.load(std::memory_order_acquire);
+            const int b = version & 1;
+            const uint32_t seq = seq_[b].load(std::memory_order_acquire);
+            if (seq & 1) continue;   // writer came around to this buffer again
+            memcpy(buf, &buf_[b][offset], len);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_[b].load(std::memory_order_relaxed) == seq) {
+                if (retries) *retries = attempts;
+                return version;
+            }
+        }
+    }
+
+    // the whole region
+    uint32_t read(void *buf, unsigned int *retries = NULL) const
+    {
+        return read(buf, 0, length_, retries);
+    }
+
+    // changes whenever a block was applied, readers can poll it cheaply
+    uint32_t version() const { return version_.load(std::memory_order_acquire); }
+
+    nodeaddr_t start() const { return start_; }
+    size_t length() const { return length_; }
+
+private:
+    nodeaddr_t start_;
+    size_t length_;
+    std::vector<byte_t> buf_[2];
+    alignas(64) std::atomic<uint32_t> version_;   /*!< buffer version & 1 is the latest */
+    alignas(64) std::atomic<uint32_t> seq_[2];    /*!< odd while buffer is rewritten */
+};
+
+#endif // ARM_SNAPSHOT_H
@@ -0,0 +1,294 @@
+#ifndef ARM_WORKER_POOL_H
+#define ARM_WORKER_POOL_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <sys/eventfd.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+#include "mpmc_queue.h"
+
+
+/**
+  * @brief: ARM requests handled by a pool of worker threads
+  *
+  *     An ARM callback runs inside raw1394_loop_iterate; while it works no
+  *     other request, bus reset or iso event of the handle is served.
+  *     ArmWorkerPool moves the work off that thread:
+  *         - submit() (from the ARM callback) copies the payload into a
+  *           preallocated slot and pushes a small descriptor into a bounded
+  *           lock-free MPMC queue, then wakes one worker
+  *         - workers run the handler, which may ask for a response: bytes
+  *           to store into the ARM buffer with raw1394_arm_set_buf
+  *         - finished descriptors go back through a second queue and an
+  *           eventfd; complete() on the loop thread stores the responses and
+  *           recycles the slots, so libraw1394 is only used from that thread
+  *         - metrics: queue depth (current and max), requests dropped when
+  *           all slots are busy, payloads cut to the slot size and a
+  *           log2 histogram of the latency from submit() to complete()
+  *
+  *     With client_transactions = 0 libraw1394 already answered the bus
+  *     transaction; a response here is what the next read of the region sees.
+  *
+  * @date 2026-10-17
+  */
+
+
+#define ARM_WORK_MAX_WORKERS   16
+#define ARM_WORK_HIST_BUCKETS  32    /*!< bucket i counts latencies in [2^i, 2^(i+1)) ns */
+
+
+static inline uint64_t arm_work_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+// one queued request, payload lives in the pool's slot @slot
+struct arm_work
+{
+    nodeaddr_t addr;             /*!< destination offset */
+    unsigned int length;         /*!< payload bytes (write/lock) or requested bytes (read) */
+    byte_t type;                 /*!< RAW1394_ARM_READ/WRITE/LOCK */
+    byte_t extcode;              /*!< lock extended transaction code */
+    nodeid_t source;
+    unsigned int slot;
+    uint64_t submit_ns;
+
+    // set by the handler
+    nodeaddr_t response_addr;
+    unsigned int response_length;   /*!< bytes at the start of the slot, 0 = none */
+    unsigned int worker;
+};
+
+
+/**
+ * Runs on a worker thread. @payload is the request data (slot_size bytes,
+ * may be overwritten with response data, see arm_work::response_length).
+ */
+typedef void (*arm_work_handler_t)(arm_work &work, byte_t *payload, void *context);
+
+
+class ArmWorkerPool
+{
+public:
+    ArmWorkerPool(size_t depth, size_t slot_size)
+        : requests_(depth), done_(depth), slot_size_(slot_size),
+          handler_(NULL), context_(NULL), running_(false), event_fd_(-1),
+          submitted_(0), dropped_(0), truncated_(0), completed_(0), max_depth_(0), max_ns_(0)
+    {
+        slots_.assign(requests_.capacity() * slot_size, 0);
+        for (size_t i = requests_.capacity(); i > 0; i--) free_.push_back(i - 1);
+        memset(hist_, 0, sizeof(hist_));
+        sem_init(&ready_, 0, 0);
+    }
+
+    ~ArmWorkerPool()
+    {
+        stop();
+        sem_destroy(&ready_);
+    }
+
+    /**
+     * Start @workers threads running @handler.
+     * Returns 0 on success or -1 on failure (sets errno)
+     */
+    int start(unsigned int workers, arm_work_handler_t handler, void *context)
+    {
+        if (workers == 0 || workers > ARM_WORK_MAX_WORKERS || handler == NULL || running_) {
+            errno = EINVAL;
+            return -1;
+        }
+        event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (event_fd_ < 0) return -1;
+        handler_ = handler;
+        context_ = context;
+        running_ = true;
+        for (unsigned int i = 0; i < ARM_WORK_MAX_WORKERS; i++) busy_[i].store(0);
+        for (unsigned int i = 0; i < workers; i++) {
+            threads_.push_back(std::thread(&ArmWorkerPool::worker, this, i));
+        }
+        return 0;
+    }
+
+    void stop()
+    {
+        if (!running_) return;
+        running_ = false;
+        for (size_t i = 0; i < threads_.size(); i++) sem_post(&ready_);
+        for (size_t i = 0; i < threads_.size(); i++) threads_[i].join();
+        threads_.clear();
+        close(event_fd_);
+        event_fd_ = -1;
+    }
+
+    /**
+     * Queue an ARM request, call from the ARM callback (loop thread).
+     * Returns false if every slot is in use, the request is then dropped.
+     */
+    bool submit(const struct raw1394_arm_request *request, byte_t request_type,
+                unsigned int requested_length)
+    {
+        submitted_++;
+        if (free_.empty()) {
+            dropped_++;
+            return false;
+        }
+        arm_work work;
+        work.addr = request->destination_offset;
+        work.type = request_type;
+        work.extcode = request->extended_transaction_code;
+        work.source = request->source_nodeid;
+        work.length = (request_type == RAW1394_ARM_READ) ? requested_length : request->buffer_length;
+        if (work.length > slot_size_) {
+            // the handler only sees what fits into the slot
+            work.length = slot_size_;
+            truncated_++;
+        }
+        work.slot = free_.back();
+        work.response_addr = 0;
+        work.response_length = 0;
+        work.worker = 0;
+
+        if (request_type != RAW1394_ARM_READ) memcpy(slot(work.slot), request->buffer, work.length);
+        work.submit_ns = arm_work_now_ns();
+
+        if (!requests_.try_push(work)) {   // cannot happen, slots <= queue capacity
+            dropped_++;
+            return false;
+        }
+        free_.pop_back();
+        const size_t depth = requests_.size();
+        if (depth > max_depth_) max_depth_ = depth;
+        sem_post(&ready_);
+        return true;
+    }
+
+    /**
+     * Store the responses of finished requests and recycle their slots,
+     * call on the loop thread when fd() is readable. A NULL @handle skips
+     * raw1394_arm_set_buf. Returns the number of requests completed.
+     */
+    int complete(raw1394handle_t handle)
+    {
+        uint64_t events;
+        if (read(event_fd_, &events, sizeof(events)) < 0 && errno != EAGAIN) return -1;
+
+        int n = 0;
+        arm_work work;
+        while (done_.try_pop(work)) {
+            if (handle && work.response_length) {
+                raw1394_arm_set_buf(handle, work.response_addr, work.response_length, slot(work.slot));
+            }
+            record(arm_work_now_ns() - work.submit_ns);
+            free_.push_back(work.slot);
+            n++;
+        }
+        completed_ += n;
+        return n;
+    }
+
+    // readable when complete() has work, for poll/epoll next to raw1394_get_fd
+    int fd() const { return event_fd_; }
+
+    // ---- metrics, loop thread ----
+    size_t depth() const { return requests_.size(); }
+    size_t max_depth() const { return max_depth_; }
+    size_t in_flight() const { return requests_.capacity() - free_.size(); }
+    unsigned long long submitted() const { return submitted_; }
+    unsigned long long dropped() const { return dropped_; }
+    // requests longer than a slot, their arm_work::length is the slot size
+    unsigned long long truncated() const { return truncated_; }
+    unsigned long long completed() const { return completed_; }
+    uint64_t max_latency_ns() const { return max_ns_; }
+    unsigned int workers() const { return threads_.size(); }
+    // requests handled by worker @i
+    unsigned long long handled(unsigned int i) const { return busy_[i].load(std::memory_order_relaxed); }
+
+    // upper bound of the bucket holding the @p quantile (0..1) of latencies
+    uint64_t latency_ns(double p) const
+    {
+        const unsigned long long target = (unsigned long long)(p * completed_);
+        unsigned long long seen = 0;
+        for (int i = 0; i < ARM_WORK_HIST_BUCKETS; i++) {
+            seen += hist_[i];
+            if (seen > target) return std::min<uint64_t>(2ULL << i, max_ns_);
+        }
+        return max_ns_;
+    }
+
+    void reset_metrics()
+    {
+        memset(hist_, 0, sizeof(hist_));
+        submitted_ = dropped_ = truncated_ = completed_ = 0;
+        max_depth_ = 0;
+        max_ns_ = 0;
+    }
+
+private:
+    byte_t *slot(unsigned int i) { return &slots_[(size_t)i * slot_size_]; }
+
+    void worker(unsigned int id)
+    {
+        arm_work work;
+        while (true)
+        {
+            while (sem_wait(&ready_) && errno == EINTR) {}
+            if (!running_) break;
+            if (!requests_.try_pop(work)) continue;
+
+            work.worker = id;
+            handler_(work, slot(work.slot), context_);
+            busy_[id].store(busy_[id].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            done_.try_push(work);   // never full, it holds at most all slots
+
+            const uint64_t one = 1;
+            if (write(event_fd_, &one, sizeof(one)) < 0) {}
+        }
+    }
+
+    void record(uint64_t ns)
+    {
+        int bucket = 0;
+        while (bucket < ARM_WORK_HIST_BUCKETS - 1 && (ns >> (bucket + 1))) bucket++;
+        hist_[bucket]++;
+        if (ns > max_ns_) max_ns_ = ns;
+    }
+
+    MpmcQueue<arm_work> requests_;       /*!< loop thread -> workers */
+    MpmcQueue<arm_work> done_;           /*!< workers -> loop thread */
+    std::vector<byte_t> slots_;          /*!< payloads, one slot per queue entry */
+    std::vector<unsigned int> free_;     /*!< free slots, loop thread only */
+    size_t slot_size_;
+
+    arm_work_handler_t handler_;
+    void *context_;
+    std::vector<std::thread> threads_;
+    std::atomic<unsigned long long> busy_[ARM_WORK_MAX_WORKERS];   /*!< one writer per entry */
+    std::atomic<bool> running_;
+    sem_t ready_;
+    int event_fd_;
+
+    // loop thread only
+    unsigned long long submitted_;
+    unsigned long long dropped_;
+    unsigned long long truncated_;
+    unsigned long long completed_;
+    size_t max_depth_;
+    uint64_t max_ns_;
+    unsigned long long hist_[ARM_WORK_HIST_BUCKETS];
+};
+
+#endif // ARM_WORKER_POOL_H
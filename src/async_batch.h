@@ -0,0 +1,326 @@
+#ifndef ASYNC_BATCH_H
+#define ASYNC_BATCH_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <ostream>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+#include "async_engine.h"
+
+
+/**
+  * @brief: Scatter/gather batches of register reads and writes
+  *
+  *     A controller that reads 50 registers per cycle with raw1394_read pays
+  *     50 round trips. AsyncBatch takes the list of (node, address, length)
+  *     entries once and plans the transactions:
+  *         - entries are sorted by node and address; neighbours of the same
+  *           node are merged into one block transaction while the block
+  *           stays within the node's max payload
+  *         - reads also merge across gaps of up to max_gap bytes, the gap is
+  *           read and thrown away; writes merge only exactly adjacent
+  *           entries, a gap would overwrite registers nobody asked for
+  *         - all transactions of a batch go to the AsyncEngine at once, its
+  *           window decides how many are in flight
+  *         - read() scatters each block back into the entry buffers, write()
+  *           gathers the entry buffers into blocks first
+  *     The plan is kept until entries or limits change, so a cycle costs the
+  *     copies and the transactions, no sorting and no allocation.
+  *
+  *     An entry longer than the payload limit keeps its own transaction.
+  *     Overlapping write entries are not merged, their order on the bus is
+  *     undefined.
+  *
+  * @date 2026-10-17
+  */
+
+
+struct async_batch_entry
+{
+    nodeid_t node;
+    nodeaddr_t addr;
+    size_t length;          /*!< bytes */
+    quadlet_t *buffer;      /*!< caller's data, bus byte order */
+    int error;              /*!< errno value of the last run, 0 = ok */
+};
+
+
+// one planned transaction covering entries order[first, first + count)
+struct async_batch_transaction
+{
+    nodeid_t node;
+    nodeaddr_t addr;
+    size_t length;          /*!< bytes on the bus */
+    size_t offset;          /*!< bytes into the batch scratch buffer */
+    size_t first;
+    size_t count;
+    size_t gap_bytes;       /*!< read but not asked for */
+    int error;
+};
+
+
+class AsyncBatch
+{
+public:
+    /**
+     * @max_gap bytes a read may skip to merge two entries, @max_payload
+     * block size for nodes without set_max_payload()
+     */
+    AsyncBatch(AsyncEngine &engine, size_t max_gap = 16, size_t max_payload = 512)
+        : engine_(engine), max_gap_(max_gap), planned_(PLAN_NONE), pending_(0),
+          first_error_(0), run_ns_(0)
+    {
+        for (int n = 0; n < ASYNC_MAX_NODES; n++) max_payload_[n] = max_payload;
+    }
+
+    // block limit of node @node, e.g. from max_rec of its bus info block
+    void set_max_payload(nodeid_t node, size_t bytes)
+    {
+        max_payload_[node & ASYNC_NODE_MASK] = bytes < 4 ? 4 : bytes;
+        planned_ = PLAN_NONE;
+    }
+
+    void set_max_gap(size_t bytes)
+    {
+        max_gap_ = bytes;
+        planned_ = PLAN_NONE;
+    }
+
+    // add an entry, @buffer must hold @length bytes. Returns its index
+    size_t add(nodeid_t node, nodeaddr_t addr, size_t length, quadlet_t *buffer)
+    {
+        async_batch_entry e;
+        e.node = node;
+        e.addr = addr;
+        e.length = length;
+        e.buffer = buffer;
+        e.error = 0;
+        entries_.push_back(e);
+        planned_ = PLAN_NONE;
+        return entries_.size() - 1;
+    }
+
+    void clear()
+    {
+        entries_.clear();
+        transactions_.clear();
+        planned_ = PLAN_NONE;
+    }
+
+    /**
+     * Read all entries, returns when every transaction completed.
+     * Returns 0 on success or -1 when any failed (sets errno to the first
+     * error, see entry(i).error)
+     */
+    int read() { return run(PLAN_READ); }
+
+    // write all entries, as read()
+    int write() { return run(PLAN_WRITE); }
+
+    size_t num_entries() const { return entries_.size(); }
+    const async_batch_entry &entry(size_t i) const { return entries_[i]; }
+
+    // plan of the last read/write (or plan()), in issue order
+    size_t num_transactions() const { return transactions_.size(); }
+    const async_batch_transaction &transaction(size_t t) const { return transactions_[t]; }
+    const async_batch_entry &member(const async_batch_transaction &t, size_t k) const
+    {
+        return entries_[order_[t.first + k]];
+    }
+
+    // plan without running, @write selects the write rules
+    void plan(bool write) { make_plan(write ? PLAN_WRITE : PLAN_READ); }
+
+    size_t gap_bytes() const
+    {
+        size_t bytes = 0;
+        for (size_t t = 0; t < transactions_.size(); t++) bytes += transactions_[t].gap_bytes;
+        return bytes;
+    }
+
+    uint64_t run_ns() const { return run_ns_; }   /*!< duration of the last read/write */
+
+    // one line per merged transaction and a summary
+    void print_plan(std::ostream &os) const
+    {
+        for (size_t t = 0; t < transactions_.size(); t++) {
+            const async_batch_transaction &tr = transactions_[t];
+            if (tr.count < 2) continue;
+            os << "  merged " << tr.count << " entries: node " << (tr.node & ASYNC_NODE_MASK)
+               << " 0x" << std::hex << tr.addr << std::dec << " " << tr.length << " bytes";
+            if (tr.gap_bytes) os << " (" << tr.gap_bytes << " gap bytes)";
+            os << "\n";
+        }
+        os << "  " << entries_.size() << " entries -> " << transactions_.size()
+           << " transactions, " << gap_bytes() << " gap bytes\n";
+    }
+
+private:
+    enum { PLAN_NONE, PLAN_READ, PLAN_WRITE };
+
+    struct pending
+    {
+        AsyncBatch *batch;
+        size_t t;
+    };
+
+    bool before(size_t a, size_t b) const
+    {
+        const async_batch_entry &x = entries_[a], &y = entries_[b];
+        if (x.node != y.node) return x.node < y.node;
+        return x.addr < y.addr;
+    }
+
+    struct order_by_address
+    {
+        const AsyncBatch *batch;
+        bool operator()(size_t a, size_t b) const { return batch->before(a, b); }
+    };
+
+    void make_plan(int kind)
+    {
+        if (planned_ == kind) return;
+        order_.resize(entries_.size());
+        for (size_t i = 0; i < order_.size(); i++) order_[i] = i;
+        order_by_address cmp = { this };
+        std::stable_sort(order_.begin(), order_.end(), cmp);
+
+        transactions_.clear();
+        size_t offset = 0;
+        for (size_t k = 0; k < order_.size(); k++) {
+            const async_batch_entry &e = entries_[order_[k]];
+            if (!transactions_.empty() && fits(transactions_.back(), e, kind)) {
+                async_batch_transaction &tr = transactions_.back();
+                const nodeaddr_t end = tr.addr + tr.length;
+                if (e.addr > end) tr.gap_bytes += e.addr - end;
+                if (e.addr + e.length > end) tr.length = e.addr + e.length - tr.addr;
+                tr.count++;
+                continue;
+            }
+            if (!transactions_.empty()) offset += (transactions_.back().length + 3) & ~(size_t)3;
+            async_batch_transaction tr;
+            tr.node = e.node;
+            tr.addr = e.addr;
+            tr.length = e.length;
+            tr.offset = offset;
+            tr.first = k;
+            tr.count = 1;
+            tr.gap_bytes = 0;
+            tr.error = 0;
+            transactions_.push_back(tr);
+        }
+        if (!transactions_.empty()) offset += (transactions_.back().length + 3) & ~(size_t)3;
+
+        scratch_.assign(offset / 4, 0);
+        pending_ctx_.resize(transactions_.size());
+        for (size_t t = 0; t < transactions_.size(); t++) {
+            pending_ctx_[t].batch = this;
+            pending_ctx_[t].t = t;
+        }
+        planned_ = kind;
+    }
+
+    // can entry @e (sorted after the entries of @tr) join @tr
+    bool fits(const async_batch_transaction &tr, const async_batch_entry &e, int kind) const
+    {
+        if (e.node != tr.node) return false;
+        const nodeaddr_t end = tr.addr + tr.length;
+        const nodeaddr_t new_end = std::max<nodeaddr_t>(end, e.addr + e.length);
+        if (new_end - tr.addr > max_payload_[tr.node & ASYNC_NODE_MASK]) return false;
+        if (kind == PLAN_WRITE) return e.addr == end;
+        return e.addr <= end + max_gap_;
+    }
+
+    byte_t *block(const async_batch_transaction &tr) { return (byte_t *)&scratch_[0] + tr.offset; }
+
+    int run(int kind)
+    {
+        make_plan(kind);
+        const uint64_t start = async_now_ns();
+        first_error_ = 0;
+        for (size_t i = 0; i < entries_.size(); i++) entries_[i].error = 0;
+
+        for (size_t t = 0; t < transactions_.size(); t++) {
+            async_batch_transaction &tr = transactions_[t];
+            tr.error = 0;
+            if (kind == PLAN_WRITE) {
+                for (size_t k = 0; k < tr.count; k++) {
+                    const async_batch_entry &e = entries_[order_[tr.first + k]];
+                    memcpy(block(tr) + (e.addr - tr.addr), e.buffer, e.length);
+                }
+            }
+            quadlet_t *buffer = (quadlet_t *)block(tr);
+            int rc;
+            while ((rc = (kind == PLAN_READ) ?
+                         engine_.read(tr.node, tr.addr, tr.length, buffer, on_complete, &pending_ctx_[t]) :
+                         engine_.write(tr.node, tr.addr, tr.length, buffer, on_complete, &pending_ctx_[t]))
+                   && errno == EAGAIN) {
+                // all engine slots in use, let completions free some
+                if (engine_.iterate() && errno != EINTR) break;
+            }
+            if (rc) complete(t, errno);
+            else pending_++;
+        }
+
+        while (pending_) {
+            if (engine_.iterate() && errno != EINTR) {
+                // the transport gave up, nothing will complete any more
+                const int err = errno;
+                for (size_t t = 0; t < transactions_.size(); t++) {
+                    if (transactions_[t].error == 0) transactions_[t].error = err;
+                }
+                if (!first_error_) first_error_ = err;
+                pending_ = 0;
+            }
+        }
+        run_ns_ = async_now_ns() - start;
+
+        if (first_error_) {
+            errno = first_error_;
+            return -1;
+        }
+        return 0;
+    }
+
+    static void on_complete(const async_request &request, int error, void *context)
+    {
+        pending *p = (pending *)context;
+        if (p->batch->pending_ == 0) return;   // given up on in run()
+        p->batch->pending_--;
+        p->batch->complete(p->t, error);
+    }
+
+    // scatter a read block, or record the error on its entries
+    void complete(size_t t, int error)
+    {
+        async_batch_transaction &tr = transactions_[t];
+        tr.error = error;
+        if (error && !first_error_) first_error_ = error;
+        for (size_t k = 0; k < tr.count; k++) {
+            async_batch_entry &e = entries_[order_[tr.first + k]];
+            e.error = error;
+            if (!error && planned_ == PLAN_READ) memcpy(e.buffer, block(tr) + (e.addr - tr.addr), e.length);
+        }
+    }
+
+    AsyncEngine &engine_;
+    size_t max_gap_;
+    size_t max_payload_[ASYNC_MAX_NODES];
+    std::vector<async_batch_entry> entries_;
+    std::vector<size_t> order_;                        /*!< entry indices by node and address */
+    std::vector<async_batch_transaction> transactions_;
+    std::vector<pending> pending_ctx_;
+    std::vector<quadlet_t> scratch_;                   /*!< one block per transaction */
+    int planned_;
+    size_t pending_;
+    int first_error_;
+    uint64_t run_ns_;
+};
+
+#endif // ASYNC_BATCH_H
@@ -0,0 +1,394 @@
+#ifndef ASYNC_CORO_H
+#define ASYNC_CORO_H
+
+#if !defined(__cpp_impl_coroutine) && !defined(__cpp_coroutines)
+#error "async_coro.h needs C++20 coroutines, build with -std=c++2a"
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <coroutine>
+#include <exception>
+#include <new>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+#include "async_engine.h"
+
+
+/**
+  * @brief: Awaitable asynchronous transactions
+  *
+  *     main1394.cpp shows the tag handler style: start a transaction, come
+  *     back in a handler, keep the state in globals. With FwScheduler the
+  *     same reads and writes are written straight down inside a coroutine:
+  *
+  *         FwTask poll(FwScheduler &fw, nodeid_t node)
+  *         {
+  *             quadlet_t value;
+  *             int error = co_await fw.read(node, addr, value);
+  *             ...
+  *         }
+  *         fw.spawn(poll(fw, node));
+  *         fw.run();
+  *
+  *     - co_await suspends on AsyncEngine::read/write/lock (async_engine.h,
+  *       raw1394_start_read etc. under a tag), the completion resumes the
+  *       coroutine and the co_await yields the errno value, 0 on success
+  *     - one thread: run() resumes ready coroutines and calls the engine's
+  *       iterate() (raw1394_loop_iterate) when none is ready; coroutines
+  *       are resumed from run(), never from inside the tag handler
+  *     - when all engine slots are in use, further awaits wait in a FIFO
+  *       and go out as slots free up, so any number of coroutines can
+  *       have a transaction outstanding
+  *     - the awaiter lives in the coroutine frame and frames come from a
+  *       per-thread free list, so after warm-up neither a transaction nor a
+  *       new task allocates
+  *
+  *     FwTask is fire and forget: the frame is freed when the coroutine
+  *     returns. Exceptions escaping a task terminate the program.
+  *
+  * @date 2026-10-17
+  */
+
+
+// recycles coroutine frames by size, one pool per thread
+class FwFramePool
+{
+public:
+    static void *get(size_t size)
+    {
+        bucket *b = find(size, false);
+        if (b && b->free) {
+            block *p = b->free;
+            b->free = p->next;
+            return p;
+        }
+        frames().allocated++;
+        return ::operator new(size < sizeof(block) ? sizeof(block) : size);
+    }
+
+    static void put(void *frame, size_t size)
+    {
+        bucket *b = find(size, true);
+        if (!b) {
+            ::operator delete(frame);
+            return;
+        }
+        block *p = (block *)frame;
+        p->next = b->free;
+        b->free = p;
+    }
+
+    // frames taken from the heap by this thread so far
+    static unsigned long long allocated() { return frames().allocated; }
+
+private:
+    struct block { block *next; };
+    struct bucket { size_t size; block *free; };
+    enum { BUCKETS = 16 };   /*!< distinct frame sizes kept, one per coroutine function */
+
+    struct pool
+    {
+        bucket buckets[BUCKETS];
+        int used;
+        unsigned long long allocated;
+
+        pool() : used(0), allocated(0) {}
+        ~pool()
+        {
+            for (int i = 0; i < used; i++) {
+                while (block *p = buckets[i].free) {
+                    buckets[i].free = p->next;
+                    ::operator delete(p);
+                }
+            }
+        }
+    };
+
+    static pool &frames()
+    {
+        static thread_local pool frames;
+        return frames;
+    }
+
+    static bucket *find(size_t size, bool create)
+    {
+        pool &p = frames();
+        for (int i = 0; i < p.used; i++) {
+            if (p.buckets[i].size == size) return &p.buckets[i];
+        }
+        if (!create || p.used == BUCKETS) return NULL;
+        bucket &b = p.buckets[p.used++];
+        b.size = size;
+        b.free = NULL;
+        return &b;
+    }
+};
+
+
+class FwScheduler;
+
+class FwTask
+{
+public:
+    struct promise_type
+    {
+        FwScheduler *scheduler;
+
+        promise_type() : scheduler(NULL) {}
+
+        FwTask get_return_object()
+        {
+            return FwTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }   // spawn() starts it
+        inline std::suspend_never final_suspend() noexcept;
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+
+        static void *operator new(size_t size) { return FwFramePool::get(size); }
+        static void operator delete(void *frame, size_t size) { FwFramePool::put(frame, size); }
+    };
+
+    FwTask(FwTask &&other) : handle_(other.handle_) { other.handle_ = nullptr; }
+    ~FwTask()
+    {
+        if (handle_) handle_.destroy();   // never spawned
+    }
+
+private:
+    friend class FwScheduler;
+    explicit FwTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    FwTask(const FwTask &);
+    FwTask &operator=(const FwTask &);
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+
+// one outstanding transaction, co_await it for the errno value
+class FwOp
+{
+public:
+    bool await_ready() const { return false; }
+    inline void await_suspend(std::coroutine_handle<> handle);
+    int await_resume() const { return error_; }
+
+private:
+    friend class FwScheduler;
+    FwOp(FwScheduler &scheduler, async_op op, nodeid_t node, nodeaddr_t addr, size_t length,
+         quadlet_t *buffer, unsigned int extcode = 0, octlet_t data = 0, octlet_t arg = 0)
+        : scheduler_(scheduler), op_(op), node_(node), addr_(addr), length_(length),
+          buffer_(buffer), extcode_(extcode), data_(data), arg_(arg), error_(0), next_(NULL) {}
+
+    FwScheduler &scheduler_;
+    async_op op_;
+    nodeid_t node_;
+    nodeaddr_t addr_;
+    size_t length_;
+    quadlet_t *buffer_;
+    unsigned int extcode_;
+    octlet_t data_;
+    octlet_t arg_;
+    int error_;
+    std::coroutine_handle<> handle_;
+    FwOp *next_;             /*!< in the waiting or the ready FIFO */
+};
+
+
+class FwScheduler
+{
+public:
+    explicit FwScheduler(AsyncEngine &engine)
+        : engine_(engine), tasks_(0), transactions_(0), waited_(0) {}
+
+    // transactions to await, @buffer etc. in bus byte order as for AsyncEngine
+    FwOp read(nodeid_t node, nodeaddr_t addr, size_t length, quadlet_t *buffer)
+    {
+        return FwOp(*this, ASYNC_READ, node, addr, length, buffer);
+    }
+
+    FwOp read(nodeid_t node, nodeaddr_t addr, quadlet_t &quadlet)
+    {
+        return FwOp(*this, ASYNC_READ, node, addr, 4, &quadlet);
+    }
+
+    FwOp write(nodeid_t node, nodeaddr_t addr, size_t length, quadlet_t *buffer)
+    {
+        return FwOp(*this, ASYNC_WRITE, node, addr, length, buffer);
+    }
+
+    FwOp write(nodeid_t node, nodeaddr_t addr, quadlet_t &quadlet)
+    {
+        return FwOp(*this, ASYNC_WRITE, node, addr, 4, &quadlet);
+    }
+
+    FwOp lock(nodeid_t node, nodeaddr_t addr, unsigned int extcode, quadlet_t data,
+              quadlet_t arg, quadlet_t *result)
+    {
+        return FwOp(*this, ASYNC_LOCK, node, addr, 4, result, extcode, data, arg);
+    }
+
+    FwOp lock64(nodeid_t node, nodeaddr_t addr, unsigned int extcode, octlet_t data,
+                octlet_t arg, octlet_t *result)
+    {
+        return FwOp(*this, ASYNC_LOCK64, node, addr, 8, (quadlet_t *)result, extcode, data, arg);
+    }
+
+    // start @task, it runs until its first co_await
+    void spawn(FwTask task)
+    {
+        std::coroutine_handle<FwTask::promise_type> handle = task.handle_;
+        task.handle_ = nullptr;
+        handle.promise().scheduler = this;
+        tasks_++;
+        handle.resume();
+    }
+
+    /**
+     * Run until every spawned task returned.
+     * Returns 0 or -1 when the engine failed (sets errno)
+     */
+    int run()
+    {
+        while (tasks_) {
+            if (!ready_.empty()) {
+                resume_ready();
+                continue;
+            }
+            if (engine_.iterate() && errno != EINTR) return -1;
+            submit_waiting();
+        }
+        return 0;
+    }
+
+    unsigned int tasks() const { return tasks_; }
+    unsigned long long transactions() const { return transactions_; }
+    unsigned long long waited() const { return waited_; }   /*!< awaits that found no free slot */
+    AsyncEngine &engine() { return engine_; }
+
+private:
+    friend class FwOp;
+    friend struct FwTask::promise_type;
+
+    // intrusive FIFO of operations, no allocation
+    struct op_fifo
+    {
+        FwOp *head;
+        FwOp *tail;
+
+        op_fifo() : head(NULL), tail(NULL) {}
+        bool empty() const { return head == NULL; }
+        void push(FwOp *op)
+        {
+            op->next_ = NULL;
+            if (tail) tail->next_ = op;
+            else head = op;
+            tail = op;
+        }
+        FwOp *pop()
+        {
+            FwOp *op = head;
+            head = op->next_;
+            if (!head) tail = NULL;
+            return op;
+        }
+    };
+
+    void suspend(FwOp *op)
+    {
+        if (!waiting_.empty() || !start(op)) {
+            waiting_.push(op);   // keep the order behind earlier waiters
+            waited_++;
+        }
+    }
+
+    // hand @op to the engine; false when all slots are in use
+    bool start(FwOp *op)
+    {
+        int rc;
+        switch (op->op_) {
+        case ASYNC_READ:
+            rc = engine_.read(op->node_, op->addr_, op->length_, op->buffer_, on_complete, op);
+            break;
+        case ASYNC_WRITE:
+            rc = engine_.write(op->node_, op->addr_, op->length_, op->buffer_, on_complete, op);
+            break;
+        case ASYNC_LOCK:
+            rc = engine_.lock(op->node_, op->addr_, op->extcode_, (quadlet_t)op->data_,
+                              (quadlet_t)op->arg_, op->buffer_, on_complete, op);
+            break;
+        default:
+            rc = engine_.lock64(op->node_, op->addr_, op->extcode_, op->data_, op->arg_,
+                                (octlet_t *)op->buffer_, on_complete, op);
+            break;
+        }
+        if (rc == 0) {
+            transactions_++;
+            return true;
+        }
+        if (errno == EAGAIN) return false;
+        op->error_ = errno;   // refused, resume with the error
+        ready_.push(op);
+        return true;
+    }
+
+    void submit_waiting()
+    {
+        while (!waiting_.empty()) {
+            FwOp *op = waiting_.head;
+            waiting_.pop();
+            if (!start(op)) {
+                // still full, back to the front
+                op->next_ = waiting_.head;
+                waiting_.head = op;
+                if (!waiting_.tail) waiting_.tail = op;
+                return;
+            }
+        }
+    }
+
+    // from the engine callback: only queue, run() resumes
+    static void on_complete(const async_request &request, int error, void *context)
+    {
+        FwOp *op = (FwOp *)context;
+        op->error_ = error;
+        op->scheduler_.ready_.push(op);
+    }
+
+    void resume_ready()
+    {
+        // a resumed coroutine may queue more, they wait for the next round
+        FwOp *tail = ready_.tail;
+        while (!ready_.empty()) {
+            FwOp *op = ready_.pop();
+            op->handle_.resume();
+            if (op == tail) break;
+        }
+        submit_waiting();
+    }
+
+    AsyncEngine &engine_;
+    op_fifo ready_;          /*!< completed, to resume */
+    op_fifo waiting_;        /*!< no engine slot yet */
+    unsigned int tasks_;
+    unsigned long long transactions_;
+    unsigned long long waited_;
+};
+
+
+inline void FwOp::await_suspend(std::coroutine_handle<> handle)
+{
+    handle_ = handle;
+    scheduler_.suspend(this);
+}
+
+inline std::suspend_never FwTask::promise_type::final_suspend() noexcept
+{
+    if (scheduler) scheduler->tasks_--;
+    return {};
+}
+
+#endif // ASYNC_CORO_H
@@ -0,0 +1,449 @@
+#ifndef ASYNC_ENGINE_H
+#define ASYNC_ENGINE_H
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <future>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+#include "async_transport.h"
+
+
+/**
+  * @brief: Many asynchronous transactions in flight
+  *
+  *     raw1394_read/raw1394_write wait for each response before the next
+  *     request goes out, the bus idles for the whole round trip. AsyncEngine
+  *     keeps up to a window of transactions in flight:
+  *         - requests live in a fixed table of slots; the tag handed to the
+  *           transport is the slot index plus a sequence number, so a
+  *           completion finds its request with one index and late or
+  *           duplicate completions are recognized and ignored
+  *         - flow control: at most `window` transactions in flight in total
+  *           and `per_node` per node; the rest wait in a FIFO per node and
+  *           are started round robin over the nodes as slots complete
+  *         - reads, writes and lock transactions (compare-swap, fetch-add...)
+  *         - completion by callback, or by std::future for convenience
+  *           (one allocation per request)
+  *         - no allocation on the callback path after construction
+  *
+  *     Not thread safe, use it from the thread that calls iterate(); a
+  *     callback may submit new requests.
+  *
+  * @date 2026-10-17
+  */
+
+
+#define ASYNC_IDLE_WAIT_MS  100   /*!< wait for a transport that refuses new requests */
+
+
+enum async_op
+{
+    ASYNC_READ,
+    ASYNC_WRITE,
+    ASYNC_LOCK,       /*!< quadlet lock, the old value lands in buffer[0] */
+    ASYNC_LOCK64      /*!< octlet lock, the old value lands in buffer[0..1] */
+};
+
+struct async_request;
+
+// @error is an errno value, 0 on success
+typedef void (*async_callback_t)(const async_request &request, int error, void *context);
+
+
+struct async_request
+{
+    async_op op;
+    nodeid_t node;
+    nodeaddr_t addr;
+    size_t length;                   /*!< bytes */
+    quadlet_t *buffer;               /*!< data, bus byte order */
+    unsigned int extcode;            /*!< locks: RAW1394_EXTCODE_xxx */
+    octlet_t data;                   /*!< locks: operands, bus byte order */
+    octlet_t arg;
+    async_callback_t callback;
+    void *context;
+    uint64_t submit_ns;              /*!< handed to the engine */
+    uint64_t start_ns;               /*!< handed to the transport */
+    unsigned int generation;         /*!< bus generation when started, 0 = never */
+};
+
+
+class AsyncEngine
+{
+public:
+    /**
+     * @slots requests the engine can hold (in flight plus queued),
+     * @window transactions in flight at once, @per_node of them per node
+     */
+    AsyncEngine(AsyncTransport &transport, unsigned int slots = 256,
+                unsigned int window = 32, unsigned int per_node = 8)
+        : transport_(transport), window_(window), per_node_(per_node),
+          in_flight_(0), queued_(0), rr_(0), issuing_(false),
+          issued_(0), completed_(0), failed_(0), stale_(0), max_in_flight_(0)
+    {
+        if (slots > 0xffff) slots = 0xffff;
+        slots_.resize(slots);
+        free_.reserve(slots);
+        for (unsigned int i = slots; i > 0; i--) free_.push_back(i - 1);
+        for (int n = 0; n < ASYNC_MAX_NODES; n++) {
+            head_[n] = tail_[n] = -1;
+            node_in_flight_[n] = 0;
+        }
+        transport_.set_completion(&AsyncEngine::on_complete, this);
+    }
+
+    ~AsyncEngine() { transport_.set_completion(NULL, NULL); }
+
+    void set_window(unsigned int window, unsigned int per_node)
+    {
+        window_ = window ? window : 1;
+        per_node_ = per_node ? per_node : 1;
+    }
+
+    /**
+     * Queue a transaction, @callback runs from iterate() when it completed.
+     * @buffer must stay valid until then.
+     * Returns 0 on success or -1 on failure (sets errno, EAGAIN when all
+     * slots are in use: iterate() and try again)
+     */
+    int read(nodeid_t node, nodeaddr_t addr, size_t length, quadlet_t *buffer,
+             async_callback_t callback, void *context)
+    {
+        return submit(ASYNC_READ, node, addr, length, buffer, callback, context);
+    }
+
+    int write(nodeid_t node, nodeaddr_t addr, size_t length, quadlet_t *buffer,
+              async_callback_t callback, void *context)
+    {
+        return submit(ASYNC_WRITE, node, addr, length, buffer, callback, context);
+    }
+
+    /**
+     * Lock transaction with extended code @extcode, operands @data and @arg
+     * in bus byte order as for raw1394_start_lock; the old value goes to
+     * *@result. See async_lock.h for typed wrappers.
+     */
+    int lock(nodeid_t node, nodeaddr_t addr, unsigned int extcode, quadlet_t data,
+             quadlet_t arg, quadlet_t *result, async_callback_t callback, void *context)
+    {
+        return submit(ASYNC_LOCK, node, addr, 4, result, callback, context, extcode, data, arg);
+    }
+
+    int lock64(nodeid_t node, nodeaddr_t addr, unsigned int extcode, octlet_t data,
+               octlet_t arg, octlet_t *result, async_callback_t callback, void *context)
+    {
+        return submit(ASYNC_LOCK64, node, addr, 8, (quadlet_t *)result, callback, context,
+                      extcode, data, arg);
+    }
+
+    // same with a future for the errno value, see wait()
+    std::future<int> read(nodeid_t node, nodeaddr_t addr, size_t length, quadlet_t *buffer)
+    {
+        return submit_future(ASYNC_READ, node, addr, length, buffer);
+    }
+
+    std::future<int> write(nodeid_t node, nodeaddr_t addr, size_t length, quadlet_t *buffer)
+    {
+        return submit_future(ASYNC_WRITE, node, addr, length, buffer);
+    }
+
+    /**
+     * One round of the transport. With nothing in flight it only handles
+     * events that are already pending, e.g. a bus reset; if requests are
+     * queued but the transport refused them, it waits up to
+     * ASYNC_IDLE_WAIT_MS for such an event. Returns 0 or -1 (sets errno,
+     * EAGAIN when nothing went out and nothing happened)
+     */
+    int iterate()
+    {
+        if (in_flight_ == 0) issue();
+        if (in_flight_ == 0) return idle_iterate();
+        return transport_.iterate();
+    }
+
+    /**
+     * Iterate until nothing is in flight or queued. Returns 0 or -1 (sets
+     * errno, EAGAIN when queued requests are left that the transport keeps
+     * refusing with nothing in flight)
+     */
+    int drain()
+    {
+        while (!idle()) {
+            if (iterate() && errno != EINTR) return -1;
+        }
+        return 0;
+    }
+
+    // iterate until @result is ready, returns its errno value
+    int wait(std::future<int> &result)
+    {
+        while (result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (iterate() && errno != EINTR) return errno;
+        }
+        return result.get();
+    }
+
+    /**
+     * Complete every queued, not yet started request with ECANCELED, e.g.
+     * after a bus reset changed the node ids they were addressed with.
+     * Requests the callbacks submit stay queued. Returns the number cancelled
+     */
+    unsigned int cancel_queued()
+    {
+        int heads[ASYNC_MAX_NODES];
+        for (int n = 0; n < ASYNC_MAX_NODES; n++) {
+            heads[n] = head_[n];
+            head_[n] = tail_[n] = -1;
+        }
+        const unsigned int cancelled = queued_;
+        queued_ = 0;
+        for (int n = 0; n < ASYNC_MAX_NODES; n++) {
+            for (int i = heads[n]; i >= 0; ) {
+                const int next = slots_[i].next;
+                finish(i, ECANCELED);
+                i = next;
+            }
+        }
+        return cancelled;
+    }
+
+    bool idle() const { return in_flight_ == 0 && queued_ == 0; }
+    unsigned int in_flight() const { return in_flight_; }
+    unsigned int in_flight(nodeid_t node) const { return node_in_flight_[node & ASYNC_NODE_MASK]; }
+    unsigned int queued() const { return queued_; }
+    unsigned int window() const { return window_; }
+    unsigned int per_node() const { return per_node_; }
+
+    unsigned long long issued() const { return issued_; }
+    unsigned long long completed() const { return completed_; }
+    unsigned long long failed() const { return failed_; }
+    unsigned long long stale() const { return stale_; }      /*!< completions without a request */
+    unsigned int max_in_flight() const { return max_in_flight_; }
+
+    AsyncTransport &transport() { return transport_; }
+
+private:
+    enum { SLOT_FREE, SLOT_QUEUED, SLOT_IN_FLIGHT };
+
+    struct slot
+    {
+        async_request request;
+        uint16_t seq;
+        int state;
+        int next;          /*!< next queued slot of the same node, -1 = none */
+
+        slot() : seq(0), state(SLOT_FREE), next(-1) {}
+    };
+
+    int submit(async_op op, nodeid_t node, nodeaddr_t addr, size_t length,
+               quadlet_t *buffer, async_callback_t callback, void *context,
+               unsigned int extcode = 0, octlet_t data = 0, octlet_t arg = 0)
+    {
+        if (free_.empty()) {
+            errno = EAGAIN;
+            return -1;
+        }
+        const int i = free_.back();
+        free_.pop_back();
+
+        slot &s = slots_[i];
+        s.request.op = op;
+        s.request.node = node;
+        s.request.addr = addr;
+        s.request.length = length;
+        s.request.buffer = buffer;
+        s.request.extcode = extcode;
+        s.request.data = data;
+        s.request.arg = arg;
+        s.request.callback = callback;
+        s.request.context = context;
+        s.request.submit_ns = async_now_ns();
+        s.request.start_ns = 0;
+        s.request.generation = 0;
+        s.state = SLOT_QUEUED;
+        push_back(node & ASYNC_NODE_MASK, i);
+
+        issue();
+        return 0;
+    }
+
+    std::future<int> submit_future(async_op op, nodeid_t node, nodeaddr_t addr,
+                                   size_t length, quadlet_t *buffer)
+    {
+        std::promise<int> *promise = new std::promise<int>();
+        std::future<int> result = promise->get_future();
+        if (submit(op, node, addr, length, buffer, &AsyncEngine::fulfil, promise)) {
+            promise->set_value(errno);
+            delete promise;
+        }
+        return result;
+    }
+
+    static void fulfil(const async_request &request, int error, void *context)
+    {
+        std::promise<int> *promise = (std::promise<int> *)context;
+        promise->set_value(error);
+        delete promise;
+    }
+
+    // nothing in flight: poll the transport instead of spinning on it
+    int idle_iterate()
+    {
+        const int fd = transport_.fd();
+        if (fd >= 0) {
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            const int rc = poll(&pfd, 1, queued_ ? ASYNC_IDLE_WAIT_MS : 0);
+            if (rc < 0) return -1;
+            if (rc == 0) {
+                if (queued_ == 0) return 0;
+                errno = EAGAIN;
+                return -1;
+            }
+        }
+        return transport_.iterate();
+    }
+
+    // start queued requests while the window allows, round robin over nodes
+    void issue()
+    {
+        if (issuing_) return;   // a callback inside this loop submitted
+        issuing_ = true;
+        bool progress = true;
+        while (queued_ && in_flight_ < window_ && progress) {
+            progress = false;
+            for (int k = 0; k < ASYNC_MAX_NODES && in_flight_ < window_; k++) {
+                const int n = (rr_ + k) % ASYNC_MAX_NODES;
+                if (head_[n] < 0 || node_in_flight_[n] >= per_node_) continue;
+                const int rc = start(head_[n]);
+                if (rc >= 0) {
+                    progress = true;
+                } else {
+                    // the transport is full, completions will make room
+                    rr_ = n;
+                    issuing_ = false;
+                    return;
+                }
+            }
+            rr_ = (rr_ + 1) % ASYNC_MAX_NODES;
+        }
+        issuing_ = false;
+    }
+
+    // hand queued slot @i to the transport: 1 when it went out, 0 when it
+    // failed and was completed with the error, -1 when the transport is full
+    int start(int i)
+    {
+        slot &s = slots_[i];
+        async_request &r = s.request;
+        const int n = r.node & ASYNC_NODE_MASK;
+        const unsigned long tag = ((unsigned long)s.seq << 16) | (unsigned long)i;
+        r.start_ns = async_now_ns();
+        r.generation = transport_.generation();
+
+        int rc;
+        switch (r.op) {
+        case ASYNC_READ:
+            rc = transport_.start_read(r.node, r.addr, r.length, r.buffer, tag);
+            break;
+        case ASYNC_WRITE:
+            rc = transport_.start_write(r.node, r.addr, r.length, r.buffer, tag);
+            break;
+        case ASYNC_LOCK:
+            rc = transport_.start_lock(r.node, r.addr, r.extcode, (quadlet_t)r.data,
+                                       (quadlet_t)r.arg, r.buffer, tag);
+            break;
+        default:
+            rc = transport_.start_lock64(r.node, r.addr, r.extcode, r.data, r.arg,
+                                         (octlet_t *)r.buffer, tag);
+            break;
+        }
+        if (rc) {
+            if (errno == EAGAIN) return -1;
+            const int err = errno;
+            pop_front(n);
+            finish(i, err);
+            return 0;
+        }
+
+        pop_front(n);
+        s.state = SLOT_IN_FLIGHT;
+        in_flight_++;
+        node_in_flight_[n]++;
+        issued_++;
+        if (in_flight_ > max_in_flight_) max_in_flight_ = in_flight_;
+        return 1;
+    }
+
+    static void on_complete(void *context, unsigned long tag, int error)
+    {
+        AsyncEngine *engine = (AsyncEngine *)context;
+        const unsigned int i = tag & 0xffff;
+        if (i >= engine->slots_.size() || engine->slots_[i].state != SLOT_IN_FLIGHT ||
+            engine->slots_[i].seq != (uint16_t)(tag >> 16)) {
+            engine->stale_++;
+            return;
+        }
+        slot &s = engine->slots_[i];
+        engine->in_flight_--;
+        engine->node_in_flight_[s.request.node & ASYNC_NODE_MASK]--;
+        engine->finish(i, error);
+        engine->issue();
+    }
+
+    // free slot @i and run its callback; the callback may reuse the slot
+    void finish(int i, int error)
+    {
+        slot &s = slots_[i];
+        const async_request request = s.request;
+        s.state = SLOT_FREE;
+        s.seq++;
+        free_.push_back(i);
+        completed_++;
+        if (error) failed_++;
+        if (request.callback) request.callback(request, error, request.context);
+    }
+
+    void push_back(int n, int i)
+    {
+        slots_[i].next = -1;
+        if (tail_[n] >= 0) slots_[tail_[n]].next = i;
+        else head_[n] = i;
+        tail_[n] = i;
+        queued_++;
+    }
+
+    void pop_front(int n)
+    {
+        const int i = head_[n];
+        head_[n] = slots_[i].next;
+        if (head_[n] < 0) tail_[n] = -1;
+        queued_--;
+    }
+
+    AsyncTransport &transport_;
+    std::vector<slot> slots_;
+    std::vector<int> free_;
+    unsigned int window_;
+    unsigned int per_node_;
+    unsigned int in_flight_;
+    unsigned int queued_;
+    int head_[ASYNC_MAX_NODES];      /*!< per node FIFO of queued slots */
+    int tail_[ASYNC_MAX_NODES];
+    unsigned int node_in_flight_[ASYNC_MAX_NODES];
+    int rr_;
+    bool issuing_;
+
+    unsigned long long issued_;
+    unsigned long long completed_;
+    unsigned long long failed_;
+    unsigned long long stale_;
+    unsigned int max_in_flight_;
+};
+
+#endif // ASYNC_ENGINE_H
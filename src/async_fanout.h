@@ -0,0 +1,274 @@
+#ifndef ASYNC_FANOUT_H
+#define ASYNC_FANOUT_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+#include "async_engine.h"
+
+
+/**
+  * @brief: Broadcast writes confirmed per node
+  *
+  *     Updating N controllers with raw1394_write costs N round trips.
+  *     Tutorial 4 shows that one write to node 0xffff reaches every node,
+  *     but a broadcast is not acknowledged, so nobody knows who got it.
+  *     AsyncFanout::write() does both halves:
+  *         - one broadcast write of the update (physical id 63 of the local
+  *           bus), through the AsyncEngine like any other write
+  *         - once it is sent, a pipelined read per node: either the written
+  *           block itself, or with verify_status() one status quadlet that
+  *           must hold a given value, e.g. a sequence number in the update
+  *         - nodes whose read failed or did not match get the update as a
+  *           unicast write, again all at once; only those are round trips
+  *     Nodes keep their outcome from the last write(), see state().
+  *
+  *     Broadcasts go at S100 and at most 512 bytes; the kernel only sends
+  *     them to addresses from CSR_REGISTER_BASE + CSR_CONFIG_END on (see
+  *     tutorial 4). A longer update, or a refused broadcast, goes unicast to
+  *     every node.
+  *
+  * @date 2026-10-17
+  */
+
+
+#define FANOUT_MAX_BROADCAST    512     /*!< bytes, S100 max payload */
+
+
+enum fanout_state
+{
+    FANOUT_CONFIRMED,       /*!< the broadcast arrived */
+    FANOUT_REPAIRED,        /*!< missed it, the unicast write succeeded */
+    FANOUT_FAILED           /*!< the unicast write failed too, see error */
+};
+
+
+struct fanout_node
+{
+    nodeid_t node;
+    int state;
+    int error;              /*!< errno value of the last failed transaction */
+};
+
+
+class AsyncFanout
+{
+public:
+    explicit AsyncFanout(AsyncEngine &engine)
+        : engine_(engine), status_addr_(0), use_status_(false), pending_(0), phase_(PHASE_READBACK),
+          broadcast_error_(0), first_error_(0), updates_(0), broadcasts_(0), confirmed_(0),
+          repaired_(0), failed_(0), transactions_(0), run_ns_(0)
+    {
+        broadcast_.fanout = this;
+        broadcast_.i = 0;
+        broadcast_.outstanding = false;
+    }
+
+    // a node the updates are for, never the local node
+    void add_node(nodeid_t node)
+    {
+        fanout_node n;
+        n.node = node;
+        n.state = FANOUT_CONFIRMED;
+        n.error = 0;
+        nodes_.push_back(n);
+        pending p;
+        p.fanout = this;
+        p.i = nodes_.size() - 1;
+        p.outstanding = false;
+        ctx_.push_back(p);
+    }
+
+    void clear()
+    {
+        nodes_.clear();
+        ctx_.clear();
+    }
+
+    // confirm by reading back the written block (the default)
+    void verify_readback() { use_status_ = false; }
+
+    // confirm by reading quadlet @addr, which must equal the status passed to write()
+    void verify_status(nodeaddr_t addr)
+    {
+        status_addr_ = addr;
+        use_status_ = true;
+    }
+
+    /**
+     * Write @length bytes of @data (bus byte order) at @addr of every node.
+     * With verify_status() a node counts as updated when its status
+     * quadlet reads @status (bus byte order). Returns 0 when every node
+     * has the update, -1 when any failed (sets errno to the first error)
+     */
+    int write(nodeaddr_t addr, size_t length, const quadlet_t *data, quadlet_t status = 0)
+    {
+        const uint64_t start = async_now_ns();
+        const unsigned long long before = engine_.completed();
+        update_.assign(data, data + (length + 3) / 4);
+        first_error_ = 0;
+        updates_++;
+
+        // 1. one broadcast, the reads below must not overtake it
+        bool sent = false;
+        if (length <= FANOUT_MAX_BROADCAST && !nodes_.empty()) {
+            const nodeid_t all = (engine_.transport().local_id() & 0xffc0) | ASYNC_BROADCAST;
+            broadcast_error_ = 0;
+            if (engine_.write(all, addr, length, &update_[0], on_complete, prepare(broadcast_))) {
+                finish(broadcast_, errno);
+            }
+            sent = wait() == 0 && broadcast_error_ == 0;
+            broadcasts_++;
+        }
+
+        // 2. who got it
+        const size_t read_length = use_status_ ? 4 : length;
+        const size_t stride = (read_length + 3) / 4;
+        readback_.resize(nodes_.size() * stride);
+        phase_ = PHASE_READBACK;
+        for (size_t i = 0; i < nodes_.size(); i++) {
+            fanout_node &n = nodes_[i];
+            n.state = sent ? FANOUT_CONFIRMED : FANOUT_REPAIRED;
+            n.error = 0;
+            if (sent && engine_.read(n.node, use_status_ ? status_addr_ : addr, read_length,
+                                     &readback_[i * stride], on_complete, prepare(ctx_[i]))) {
+                finish(ctx_[i], errno);
+            }
+        }
+        wait();
+        for (size_t i = 0; i < nodes_.size() && sent; i++) {
+            fanout_node &n = nodes_[i];
+            if (n.state != FANOUT_CONFIRMED) continue;
+            const bool same = use_status_ ? readback_[i * stride] == status
+                                          : memcmp(&readback_[i * stride], &update_[0], length) == 0;
+            if (!same) n.state = FANOUT_REPAIRED;
+        }
+
+        // 3. unicast to the rest
+        phase_ = PHASE_UNICAST;
+        for (size_t i = 0; i < nodes_.size(); i++) {
+            fanout_node &n = nodes_[i];
+            if (n.state == FANOUT_REPAIRED &&
+                engine_.write(n.node, addr, length, &update_[0], on_complete, prepare(ctx_[i]))) {
+                finish(ctx_[i], errno);
+            }
+        }
+        wait();
+        for (size_t i = 0; i < nodes_.size(); i++) {
+            if (nodes_[i].state == FANOUT_CONFIRMED) confirmed_++;
+            else if (nodes_[i].state == FANOUT_REPAIRED) repaired_++;
+            else failed_++;
+        }
+
+        transactions_ += engine_.completed() - before;
+        run_ns_ = async_now_ns() - start;
+        if (first_error_) {
+            errno = first_error_;
+            return -1;
+        }
+        return 0;
+    }
+
+    size_t num_nodes() const { return nodes_.size(); }
+    const fanout_node &state(size_t i) const { return nodes_[i]; }
+
+    unsigned long long updates() const { return updates_; }
+    unsigned long long broadcasts() const { return broadcasts_; }
+    unsigned long long confirmed() const { return confirmed_; }      /*!< node updates by broadcast */
+    unsigned long long repaired() const { return repaired_; }        /*!< node updates by unicast */
+    unsigned long long failed() const { return failed_; }
+    unsigned long long transactions() const { return transactions_; }
+    uint64_t run_ns() const { return run_ns_; }   /*!< duration of the last write */
+
+private:
+    enum { PHASE_READBACK, PHASE_UNICAST };
+
+    struct pending
+    {
+        AsyncFanout *fanout;
+        size_t i;               /*!< node index, unused for the broadcast */
+        bool outstanding;
+    };
+
+    // context of a transaction about to be submitted, counted as pending
+    pending *prepare(pending &p)
+    {
+        p.outstanding = true;
+        pending_++;
+        return &p;
+    }
+
+    // iterate until every submitted transaction completed. Returns 0 or -1 (sets errno)
+    int wait()
+    {
+        while (pending_) {
+            if (engine_.iterate() && errno != EINTR) {
+                // the transport gave up, nothing will complete any more
+                const int err = errno;
+                if (broadcast_.outstanding) finish(broadcast_, err);
+                for (size_t i = 0; i < nodes_.size(); i++) {
+                    if (ctx_[i].outstanding) finish(ctx_[i], err);
+                }
+                if (!first_error_) first_error_ = err;
+                errno = err;
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    // @p completed with @error, or failed to start
+    void finish(pending &p, int error)
+    {
+        if (!p.outstanding) return;   // given up on in wait()
+        p.outstanding = false;
+        pending_--;
+        if (&p == &broadcast_) {
+            broadcast_error_ = error;
+            return;
+        }
+        if (!error) return;
+        fanout_node &n = nodes_[p.i];
+        n.error = error;
+        if (phase_ == PHASE_READBACK) {
+            n.state = FANOUT_REPAIRED;   // unknown, send it again
+        } else {
+            n.state = FANOUT_FAILED;
+            if (!first_error_) first_error_ = error;
+        }
+    }
+
+    static void on_complete(const async_request &request, int error, void *context)
+    {
+        pending *p = (pending *)context;
+        p->fanout->finish(*p, error);
+    }
+
+    AsyncEngine &engine_;
+    std::vector<fanout_node> nodes_;
+    std::vector<pending> ctx_;
+    pending broadcast_;
+    std::vector<quadlet_t> update_;        /*!< copy of the data, lives until sent */
+    std::vector<quadlet_t> readback_;      /*!< one read per node */
+    nodeaddr_t status_addr_;
+    bool use_status_;
+    size_t pending_;
+    int phase_;
+    int broadcast_error_;
+    int first_error_;
+
+    unsigned long long updates_;
+    unsigned long long broadcasts_;
+    unsigned long long confirmed_;
+    unsigned long long repaired_;
+    unsigned long long failed_;
+    unsigned long long transactions_;
+    uint64_t run_ns_;
+};
+
+#endif // ASYNC_FANOUT_H
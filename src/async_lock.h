@@ -0,0 +1,344 @@
+#ifndef ASYNC_LOCK_H
+#define ASYNC_LOCK_H
+
+#include <endian.h>
+#include <errno.h>
+#include <stdint.h>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+#include "async_engine.h"
+
+
+/**
+  * @brief: Typed lock transactions
+  *
+  *     raw1394_lock/raw1394_lock64 take an extended transaction code and two
+  *     operands whose meaning depends on the code, all in bus byte order.
+  *     The wrappers below name the operations and take host byte order
+  *     values:
+  *         - fw_compare_swap   old == expected ? desired : old
+  *         - fw_fetch_add      old + add
+  *         - fw_little_add     old + add, the target is little endian
+  *         - fw_bounded_add    old != bound ? old + add : old
+  *         - fw_wrap_add       old != threshold ? old + add : add
+  *         - fw_mask_swap      (value & mask) | (old & ~mask)
+  *     each for quadlets and octlets, each reporting the old value.
+  *
+  *     fw_cas_update() builds any read-modify-write on compare-swap: with a
+  *     correct guess of the current value it costs a single transaction,
+  *     a miss returns the real value and the next attempt uses it.
+  *     AsyncCasUpdate does the same through an AsyncEngine, and the
+  *     async_xxx functions queue the typed operations there.
+  *
+  * @date 2026-10-17
+  */
+
+
+// bus byte order of the operands, little_add is the one little endian operation
+inline quadlet_t lock_to_bus(quadlet_t v, unsigned int extcode)
+{
+    return (extcode == RAW1394_EXTCODE_LITTLE_ADD) ? htole32(v) : htobe32(v);
+}
+
+inline octlet_t lock_to_bus(octlet_t v, unsigned int extcode)
+{
+    return (extcode == RAW1394_EXTCODE_LITTLE_ADD) ? htole64(v) : htobe64(v);
+}
+
+inline quadlet_t lock_from_bus(quadlet_t v, unsigned int extcode)
+{
+    return (extcode == RAW1394_EXTCODE_LITTLE_ADD) ? le32toh(v) : be32toh(v);
+}
+
+inline octlet_t lock_from_bus(octlet_t v, unsigned int extcode)
+{
+    return (extcode == RAW1394_EXTCODE_LITTLE_ADD) ? le64toh(v) : be64toh(v);
+}
+
+inline int lock_raw(raw1394handle_t handle, nodeid_t node, nodeaddr_t addr, unsigned int extcode,
+                    quadlet_t data, quadlet_t arg, quadlet_t *result)
+{
+    return raw1394_lock(handle, node, addr, extcode, data, arg, result);
+}
+
+inline int lock_raw(raw1394handle_t handle, nodeid_t node, nodeaddr_t addr, unsigned int extcode,
+                    octlet_t data, octlet_t arg, octlet_t *result)
+{
+    return raw1394_lock64(handle, node, addr, extcode, data, arg, result);
+}
+
+// keeps the operands out of template argument deduction, so fw_fetch_add(.., 1, &old) works
+template <typename T> struct lock_value { typedef T type; };
+
+
+/**
+ * Blocking lock transaction, @data, @arg and *@old in host byte order.
+ * Returns 0 on success or -1 on failure (sets errno)
+ */
+template <typename T>
+int fw_lock(raw1394handle_t handle, nodeid_t node, nodeaddr_t addr, unsigned int extcode,
+            typename lock_value<T>::type data, typename lock_value<T>::type arg, T *old)
+{
+    T result = 0;
+    if (lock_raw(handle, node, addr, extcode, lock_to_bus(data, extcode),
+                 lock_to_bus(arg, extcode), &result)) {
+        return -1;
+    }
+    if (old) *old = lock_from_bus(result, extcode);
+    return 0;
+}
+
+/**
+ * Store @desired when the target holds @expected; *@old gets what it held.
+ * Returns 1 when swapped, 0 when not, -1 on failure (sets errno)
+ */
+template <typename T>
+int fw_compare_swap(raw1394handle_t handle, nodeid_t node, nodeaddr_t addr,
+                    typename lock_value<T>::type expected, typename lock_value<T>::type desired, T *old)
+{
+    T held;
+    if (fw_lock(handle, node, addr, RAW1394_EXTCODE_COMPARE_SWAP, desired, expected, &held)) return -1;
+    if (old) *old = held;
+    return held == expected;
+}
+
+template <typename T>
+int fw_fetch_add(raw1394handle_t handle, nodeid_t node, nodeaddr_t addr,
+                 typename lock_value<T>::type add, T *old)
+{
+    return fw_lock(handle, node, addr, RAW1394_EXTCODE_FETCH_ADD, add, 0, old);
+}
+
+template <typename T>
+int fw_little_add(raw1394handle_t handle, nodeid_t node, nodeaddr_t addr,
+                  typename lock_value<T>::type add, T *old)
+{
+    return fw_lock(handle, node, addr, RAW1394_EXTCODE_LITTLE_ADD, add, 0, old);
+}
+
+// adds unless the target already holds @bound, returns 1 when it added
+template <typename T>
+int fw_bounded_add(raw1394handle_t handle, nodeid_t node, nodeaddr_t addr,
+                   typename lock_value<T>::type bound, typename lock_value<T>::type add, T *old)
+{
+    T held;
+    if (fw_lock(handle, node, addr, RAW1394_EXTCODE_BOUNDED_ADD, add, bound, &held)) return -1;
+    if (old) *old = held;
+    return held != bound;
+}
+
+template <typename T>
+int fw_wrap_add(raw1394handle_t handle, nodeid_t node, nodeaddr_t addr,
+                typename lock_value<T>::type threshold, typename lock_value<T>::type add, T *old)
+{
+    return fw_lock(handle, node, addr, RAW1394_EXTCODE_WRAP_ADD, add, threshold, old);
+}
+
+template <typename T>
+int fw_mask_swap(raw1394handle_t handle, nodeid_t node, nodeaddr_t addr,
+                 typename lock_value<T>::type mask, typename lock_value<T>::type value, T *old)
+{
+    return fw_lock(handle, node, addr, RAW1394_EXTCODE_MASK_SWAP, value, mask, old);
+}
+
+
+/**
+ * Replace the target by @update(current) with compare-swap, retrying while
+ * other nodes change it in between. *@value is the caller's guess of the
+ * current value (e.g. what it wrote last) and on success the value stored.
+ * Returns the number of transactions used or -1 on failure (sets errno,
+ * EBUSY after @max_attempts misses)
+ */
+template <typename T, typename F>
+int fw_cas_update(raw1394handle_t handle, nodeid_t node, nodeaddr_t addr, T *value,
+                  F update, int max_attempts = 16)
+{
+    T expected = *value;
+    for (int attempt = 1; attempt <= max_attempts; attempt++) {
+        const T desired = update(expected);
+        T old;
+        const int rc = fw_compare_swap(handle, node, addr, expected, desired, &old);
+        if (rc < 0) return -1;
+        if (rc == 1) {
+            *value = desired;
+            return attempt;
+        }
+        expected = old;
+    }
+    *value = expected;
+    errno = EBUSY;
+    return -1;
+}
+
+
+// ---- the same through an AsyncEngine ----
+
+inline int async_lock_start(AsyncEngine &engine, nodeid_t node, nodeaddr_t addr, unsigned int extcode,
+                            quadlet_t data, quadlet_t arg, quadlet_t *result,
+                            async_callback_t callback, void *context)
+{
+    return engine.lock(node, addr, extcode, lock_to_bus(data, extcode), lock_to_bus(arg, extcode),
+                       result, callback, context);
+}
+
+inline int async_lock_start(AsyncEngine &engine, nodeid_t node, nodeaddr_t addr, unsigned int extcode,
+                            octlet_t data, octlet_t arg, octlet_t *result,
+                            async_callback_t callback, void *context)
+{
+    return engine.lock64(node, addr, extcode, lock_to_bus(data, extcode), lock_to_bus(arg, extcode),
+                         result, callback, context);
+}
+
+// old value of a completed ASYNC_LOCK or ASYNC_LOCK64 request, host byte order
+inline octlet_t async_lock_result(const async_request &request)
+{
+    if (request.op == ASYNC_LOCK64) return lock_from_bus(*(const octlet_t *)request.buffer, request.extcode);
+    return lock_from_bus(request.buffer[0], request.extcode);
+}
+
+/**
+ * Queue a typed lock, *@result (bus byte order, see async_lock_result) must
+ * stay valid until @callback ran. Returns 0 or -1 (sets errno) as
+ * AsyncEngine::read
+ */
+template <typename T>
+int async_compare_swap(AsyncEngine &engine, nodeid_t node, nodeaddr_t addr,
+                       typename lock_value<T>::type expected, typename lock_value<T>::type desired,
+                       T *result, async_callback_t callback, void *context)
+{
+    return async_lock_start(engine, node, addr, RAW1394_EXTCODE_COMPARE_SWAP, desired, expected,
+                            result, callback, context);
+}
+
+template <typename T>
+int async_fetch_add(AsyncEngine &engine, nodeid_t node, nodeaddr_t addr,
+                    typename lock_value<T>::type add, T *result,
+                    async_callback_t callback, void *context)
+{
+    return async_lock_start(engine, node, addr, RAW1394_EXTCODE_FETCH_ADD, add, (T)0,
+                            result, callback, context);
+}
+
+template <typename T>
+int async_little_add(AsyncEngine &engine, nodeid_t node, nodeaddr_t addr,
+                     typename lock_value<T>::type add, T *result,
+                     async_callback_t callback, void *context)
+{
+    return async_lock_start(engine, node, addr, RAW1394_EXTCODE_LITTLE_ADD, add, (T)0,
+                            result, callback, context);
+}
+
+template <typename T>
+int async_bounded_add(AsyncEngine &engine, nodeid_t node, nodeaddr_t addr,
+                      typename lock_value<T>::type bound, typename lock_value<T>::type add,
+                      T *result, async_callback_t callback, void *context)
+{
+    return async_lock_start(engine, node, addr, RAW1394_EXTCODE_BOUNDED_ADD, add, bound,
+                            result, callback, context);
+}
+
+template <typename T>
+int async_wrap_add(AsyncEngine &engine, nodeid_t node, nodeaddr_t addr,
+                   typename lock_value<T>::type threshold, typename lock_value<T>::type add,
+                   T *result, async_callback_t callback, void *context)
+{
+    return async_lock_start(engine, node, addr, RAW1394_EXTCODE_WRAP_ADD, add, threshold,
+                            result, callback, context);
+}
+
+template <typename T>
+int async_mask_swap(AsyncEngine &engine, nodeid_t node, nodeaddr_t addr,
+                    typename lock_value<T>::type mask, typename lock_value<T>::type value,
+                    T *result, async_callback_t callback, void *context)
+{
+    return async_lock_start(engine, node, addr, RAW1394_EXTCODE_MASK_SWAP, value, mask,
+                            result, callback, context);
+}
+
+
+/**
+ * fw_cas_update as a chain of AsyncEngine transactions. The object holds
+ * the state of one update, keep it alive until @done ran; it can be
+ * started again from there.
+ */
+template <typename T>
+class AsyncCasUpdate
+{
+public:
+    typedef T (*update_t)(T current, void *context);
+    // @error is an errno value, 0 on success (EBUSY after max_attempts misses)
+    typedef void (*done_t)(AsyncCasUpdate &op, int error, void *context);
+
+    AsyncCasUpdate() : engine_(NULL), node_(0), addr_(0), expected_(0), desired_(0), result_(0),
+                       update_(NULL), context_(NULL), done_(NULL), done_context_(NULL),
+                       attempts_(0), max_attempts_(0) {}
+
+    /**
+     * Start replacing the target by @update(current, @context), with @guess
+     * as the current value. Returns 0 or -1 (sets errno) as AsyncEngine::read
+     */
+    int start(AsyncEngine &engine, nodeid_t node, nodeaddr_t addr, T guess,
+              update_t update, void *context, done_t done, void *done_context,
+              int max_attempts = 16)
+    {
+        engine_ = &engine;
+        node_ = node;
+        addr_ = addr;
+        expected_ = guess;
+        update_ = update;
+        context_ = context;
+        done_ = done;
+        done_context_ = done_context;
+        attempts_ = 0;
+        max_attempts_ = max_attempts;
+        return attempt();
+    }
+
+    T value() const { return desired_; }       /*!< stored, valid after success */
+    T current() const { return expected_; }    /*!< last value seen on the target */
+    int attempts() const { return attempts_; }
+    nodeid_t node() const { return node_; }
+    nodeaddr_t addr() const { return addr_; }
+
+private:
+    int attempt()
+    {
+        desired_ = update_(expected_, context_);
+        attempts_++;
+        return async_compare_swap(*engine_, node_, addr_, expected_, desired_, &result_,
+                                  &AsyncCasUpdate::on_lock, this);
+    }
+
+    static void on_lock(const async_request &request, int error, void *context)
+    {
+        AsyncCasUpdate *op = (AsyncCasUpdate *)context;
+        if (!error) {
+            const T old = (T)async_lock_result(request);
+            if (old == op->expected_) {
+                op->done_(*op, 0, op->done_context_);
+                return;
+            }
+            op->expected_ = old;
+            if (op->attempts_ >= op->max_attempts_) error = EBUSY;
+            else if (op->attempt()) error = errno;
+        }
+        if (error) op->done_(*op, error, op->done_context_);
+    }
+
+    AsyncEngine *engine_;
+    nodeid_t node_;
+    nodeaddr_t addr_;
+    T expected_;
+    T desired_;
+    T result_;            /*!< old value, bus byte order */
+    update_t update_;
+    void *context_;
+    done_t done_;
+    void *done_context_;
+    int attempts_;
+    int max_attempts_;
+};
+
+#endif // ASYNC_LOCK_H
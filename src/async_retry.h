@@ -0,0 +1,448 @@
+#ifndef ASYNC_RETRY_H
+#define ASYNC_RETRY_H
+
+#include <endian.h>
+#include <errno.h>
+#include <stdint.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+#include "async_engine.h"
+
+
+/**
+  * @brief: Transactions that survive bus resets
+  *
+  *     A bus reset renumbers the nodes and fails whatever was in flight with
+  *     a stale generation. AsyncRetry addresses nodes by GUID instead of node
+  *     id and hides the reset from its callers:
+  *         - every request remembers the generation of the node map its
+  *           node id came from; a completion counts only when the engine
+  *           started the request in that same generation
+  *         - on the reset notification queued requests are taken back from
+  *           the engine (their node ids are stale), the GUIDs are read again
+  *           from the bus info block of every node, and then everything
+  *           parked meanwhile is issued with the new node ids
+  *         - requests that failed with EAGAIN or crossed a reset are parked
+  *           and issued again, at most max_resets times each; a GUID that
+  *           left the bus completes with ENODEV
+  *     So callers see a slower transaction, not an error. The time from a
+  *     reset to the first retried transaction that succeeded is measured.
+  *
+  *     Writes and locks that were in flight during a reset may have taken
+  *     effect before it and are still issued again; keep them idempotent or
+  *     check with a read.
+  *
+  *     Not thread safe, same rules as AsyncEngine; it owns the transport's
+  *     reset function.
+  *
+  * @date 2026-10-17
+  */
+
+
+#define ASYNC_GUID_NONE     0ULL
+
+
+class AsyncRetry
+{
+public:
+    /**
+     * @slots requests the layer can hold, @max_resets times one request is
+     * issued again before its error is reported
+     */
+    AsyncRetry(AsyncEngine &engine, unsigned int slots = 256, unsigned int max_resets = 4)
+        : engine_(engine), max_resets_(max_resets), map_generation_(0), resolving_(false),
+          rom_pending_(0), rom_count_(0), resolve_generation_(0),
+          parked_head_(-1), parked_tail_(-1), used_(0),
+          resets_(0), retried_(0), lost_(0), recoveries_(0), reset_ns_(0),
+          awaiting_recovery_(false), last_recovery_ns_(0), max_recovery_ns_(0), total_recovery_ns_(0)
+    {
+        slots_.resize(slots);
+        free_.reserve(slots);
+        for (unsigned int i = slots; i > 0; i--) free_.push_back(i - 1);
+        for (unsigned int i = 0; i < slots; i++) slots_[i].owner = this;
+        for (int n = 0; n < ASYNC_MAX_NODES; n++) {
+            guid_[n] = ASYNC_GUID_NONE;
+            for (int q = 0; q < 2; q++) {
+                rom_[n][q].owner = this;
+                rom_[n][q].phy = n;
+                rom_[n][q].half = q;
+            }
+        }
+        engine_.transport().set_reset_handler(&AsyncRetry::on_reset, this);
+    }
+
+    ~AsyncRetry() { engine_.transport().set_reset_handler(NULL, NULL); }
+
+    /**
+     * Read the GUIDs of all nodes now, iterating until done.
+     * Returns 0 on success or -1 on failure (sets errno)
+     */
+    int resolve()
+    {
+        if (!resolving_) start_resolve();
+        while (resolving_) {
+            if (engine_.iterate() && errno != EINTR) return -1;
+        }
+        return 0;
+    }
+
+    // GUID of node @node in the current map, ASYNC_GUID_NONE if unknown
+    octlet_t guid_of(nodeid_t node) const { return guid_[node & ASYNC_NODE_MASK]; }
+
+    // node id of @guid in the current map, -1 if it is not on the bus
+    int node_of(octlet_t guid) const
+    {
+        if (guid == ASYNC_GUID_NONE) return -1;
+        for (int n = 0; n < ASYNC_MAX_NODES; n++) {
+            if (guid_[n] == guid) return (engine_.transport().local_id() & 0xffc0) | n;
+        }
+        return -1;
+    }
+
+    /**
+     * Queue a transaction to the node with @guid, as AsyncEngine::read.
+     * request.node in the callback is the node id it finally went to.
+     * Returns 0 on success or -1 on failure (sets errno, EAGAIN when all
+     * slots are in use)
+     */
+    int read(octlet_t guid, nodeaddr_t addr, size_t length, quadlet_t *buffer,
+             async_callback_t callback, void *context)
+    {
+        return submit(ASYNC_READ, guid, addr, length, buffer, 0, 0, 0, callback, context);
+    }
+
+    int write(octlet_t guid, nodeaddr_t addr, size_t length, quadlet_t *buffer,
+              async_callback_t callback, void *context)
+    {
+        return submit(ASYNC_WRITE, guid, addr, length, buffer, 0, 0, 0, callback, context);
+    }
+
+    // operands in bus byte order, as AsyncEngine::lock
+    int lock(octlet_t guid, nodeaddr_t addr, unsigned int extcode, quadlet_t data,
+             quadlet_t arg, quadlet_t *result, async_callback_t callback, void *context)
+    {
+        return submit(ASYNC_LOCK, guid, addr, 4, result, extcode, data, arg, callback, context);
+    }
+
+    int lock64(octlet_t guid, nodeaddr_t addr, unsigned int extcode, octlet_t data,
+               octlet_t arg, octlet_t *result, async_callback_t callback, void *context)
+    {
+        return submit(ASYNC_LOCK64, guid, addr, 8, (quadlet_t *)result, extcode, data, arg,
+                      callback, context);
+    }
+
+    // one engine round (it reports resets first), then issue what is parked
+    // if the node map is current
+    int iterate()
+    {
+        const int rc = engine_.iterate();
+        if (!resolving_) issue_parked();
+        return rc;
+    }
+
+    int drain()
+    {
+        while (!idle()) {
+            if (iterate() && errno != EINTR) return -1;
+        }
+        return 0;
+    }
+
+    bool idle() const { return used_ == 0 && !resolving_; }
+    bool resolving() const { return resolving_; }
+    unsigned int generation() const { return map_generation_; }   /*!< of the node map */
+
+    unsigned long long resets() const { return resets_; }
+    unsigned long long retried() const { return retried_; }       /*!< issued again */
+    unsigned long long lost() const { return lost_; }             /*!< gave up after max_resets */
+    unsigned long long recoveries() const { return recoveries_; }
+
+    // reset to the first retried transaction that succeeded
+    uint64_t last_recovery_ns() const { return last_recovery_ns_; }
+    uint64_t max_recovery_ns() const { return max_recovery_ns_; }
+    uint64_t mean_recovery_ns() const { return recoveries_ ? total_recovery_ns_ / recoveries_ : 0; }
+
+private:
+    enum { SLOT_FREE, SLOT_PARKED, SLOT_ISSUED };
+
+    struct slot
+    {
+        AsyncRetry *owner;
+        int state;
+        int next;                 /*!< next parked slot, -1 = none */
+        octlet_t guid;
+        async_op op;
+        nodeaddr_t addr;
+        size_t length;
+        quadlet_t *buffer;
+        unsigned int extcode;
+        octlet_t data;
+        octlet_t arg;
+        async_callback_t callback;
+        void *context;
+        unsigned int map_generation;   /*!< node map its node id came from */
+        unsigned int resets;
+
+        slot() : owner(NULL), state(SLOT_FREE), next(-1) {}
+    };
+
+    // one of the two GUID quadlets of a node
+    struct rom_read
+    {
+        AsyncRetry *owner;
+        int phy;
+        int half;
+        quadlet_t value;
+        int error;
+    };
+
+    int submit(async_op op, octlet_t guid, nodeaddr_t addr, size_t length, quadlet_t *buffer,
+               unsigned int extcode, octlet_t data, octlet_t arg,
+               async_callback_t callback, void *context)
+    {
+        if (free_.empty()) {
+            errno = EAGAIN;
+            return -1;
+        }
+        const int i = free_.back();
+        free_.pop_back();
+        used_++;
+
+        slot &s = slots_[i];
+        s.guid = guid;
+        s.op = op;
+        s.addr = addr;
+        s.length = length;
+        s.buffer = buffer;
+        s.extcode = extcode;
+        s.data = data;
+        s.arg = arg;
+        s.callback = callback;
+        s.context = context;
+        s.resets = 0;
+
+        // keep the order behind what is parked
+        if (resolving_ || parked_head_ >= 0) park(i);
+        else issue(i);
+        return 0;
+    }
+
+    // hand slot @i to the engine, park it if the engine is full
+    void issue(int i)
+    {
+        slot &s = slots_[i];
+        const int node = node_of(s.guid);
+        if (node < 0) {
+            deliver(i, NULL, ENODEV);
+            return;
+        }
+        s.map_generation = map_generation_;
+        s.state = SLOT_ISSUED;
+        int rc;
+        switch (s.op) {
+        case ASYNC_READ:
+            rc = engine_.read(node, s.addr, s.length, s.buffer, on_complete, &s);
+            break;
+        case ASYNC_WRITE:
+            rc = engine_.write(node, s.addr, s.length, s.buffer, on_complete, &s);
+            break;
+        case ASYNC_LOCK:
+            rc = engine_.lock(node, s.addr, s.extcode, (quadlet_t)s.data, (quadlet_t)s.arg,
+                              s.buffer, on_complete, &s);
+            break;
+        default:
+            rc = engine_.lock64(node, s.addr, s.extcode, s.data, s.arg, (octlet_t *)s.buffer,
+                                on_complete, &s);
+            break;
+        }
+        if (rc) park_front(i);
+    }
+
+    void issue_parked()
+    {
+        while (parked_head_ >= 0) {
+            const int i = parked_head_;
+            parked_head_ = slots_[i].next;
+            if (parked_head_ < 0) parked_tail_ = -1;
+            issue(i);
+            if (parked_head_ == i) return;   // the engine is full
+        }
+    }
+
+    void park(int i)
+    {
+        slots_[i].state = SLOT_PARKED;
+        slots_[i].next = -1;
+        if (parked_tail_ >= 0) slots_[parked_tail_].next = i;
+        else parked_head_ = i;
+        parked_tail_ = i;
+    }
+
+    void park_front(int i)
+    {
+        slots_[i].state = SLOT_PARKED;
+        slots_[i].next = parked_head_;
+        parked_head_ = i;
+        if (parked_tail_ < 0) parked_tail_ = i;
+    }
+
+    static void on_complete(const async_request &request, int error, void *context)
+    {
+        slot &s = *(slot *)context;
+        AsyncRetry *self = s.owner;
+        const int i = (int)(&s - &self->slots_[0]);
+
+        // cancelled at a reset, failed for a stale generation, or started
+        // with a node id from another generation: the result means nothing
+        const bool stale = error == ECANCELED || error == EAGAIN ||
+                           request.generation != s.map_generation;
+        if (!stale) {
+            if (!error && s.resets && self->awaiting_recovery_) self->recovered();
+            self->deliver(i, &request, error);
+            return;
+        }
+        if (s.resets >= self->max_resets_) {
+            self->lost_++;
+            self->deliver(i, &request, error ? error : EAGAIN);
+            return;
+        }
+        // issued again once the node map is current: after the new one is
+        // read, or from the next iterate() when no reset was reported yet
+        s.resets++;
+        self->retried_++;
+        self->park(i);
+    }
+
+    void deliver(int i, const async_request *request, int error)
+    {
+        slot &s = slots_[i];
+        async_request r;
+        if (request) {
+            r = *request;
+        } else {
+            r.op = s.op;
+            r.node = 0xffff;
+            r.addr = s.addr;
+            r.length = s.length;
+            r.buffer = s.buffer;
+            r.extcode = s.extcode;
+            r.data = s.data;
+            r.arg = s.arg;
+            r.submit_ns = r.start_ns = 0;
+            r.generation = 0;
+        }
+        r.callback = s.callback;
+        r.context = s.context;
+        s.state = SLOT_FREE;
+        free_.push_back(i);
+        used_--;
+        if (r.callback) r.callback(r, error, r.context);
+    }
+
+    void recovered()
+    {
+        const uint64_t ns = async_now_ns() - reset_ns_;
+        awaiting_recovery_ = false;
+        recoveries_++;
+        last_recovery_ns_ = ns;
+        total_recovery_ns_ += ns;
+        if (ns > max_recovery_ns_) max_recovery_ns_ = ns;
+    }
+
+    static void on_reset(void *context, unsigned int generation)
+    {
+        AsyncRetry *self = (AsyncRetry *)context;
+        self->resets_++;
+        self->reset_ns_ = async_now_ns();
+        self->awaiting_recovery_ = true;
+        // stop issuing with the old map, take back what the engine has not
+        // started yet; they come back through on_complete and get parked
+        self->resolving_ = true;
+        self->engine_.cancel_queued();
+        if (self->rom_pending_ == 0) self->start_resolve();
+        // else the running round sees the new generation when it ends
+    }
+
+    // read the GUID quadlets of the bus info block of every node
+    void start_resolve()
+    {
+        resolving_ = true;
+        resolve_generation_ = engine_.transport().generation();
+        const int count = engine_.transport().node_count();
+        const nodeid_t bus = engine_.transport().local_id() & 0xffc0;
+        for (int n = 0; n < count && n < ASYNC_MAX_NODES - 1; n++) {
+            for (int q = 0; q < 2; q++) {
+                rom_read &r = rom_[n][q];
+                r.error = 0;
+                r.value = 0;
+                if (engine_.read(bus | n, ASYNC_BUS_INFO_BLOCK + 12 + 4 * q, 4, &r.value,
+                                 on_rom, &r)) {
+                    r.error = errno;
+                } else {
+                    rom_pending_++;
+                }
+            }
+        }
+        rom_count_ = count;
+        if (rom_pending_ == 0) finish_resolve();
+    }
+
+    static void on_rom(const async_request &request, int error, void *context)
+    {
+        rom_read &r = *(rom_read *)context;
+        r.error = error;
+        AsyncRetry *self = r.owner;
+        if (--self->rom_pending_ == 0) self->finish_resolve();
+    }
+
+    void finish_resolve()
+    {
+        if (engine_.transport().generation() != resolve_generation_) {
+            start_resolve();   // reset again meanwhile, the answers may be stale
+            return;
+        }
+        for (int n = 0; n < ASYNC_MAX_NODES; n++) {
+            const rom_read *r = rom_[n];
+            if (n < rom_count_ && n < ASYNC_MAX_NODES - 1 && r[0].error == 0 && r[1].error == 0) {
+                guid_[n] = ((octlet_t)be32toh(r[0].value) << 32) | be32toh(r[1].value);
+            } else {
+                guid_[n] = ASYNC_GUID_NONE;   // gone, or no config ROM
+            }
+        }
+        map_generation_ = resolve_generation_;
+        resolving_ = false;
+        issue_parked();
+    }
+
+    AsyncEngine &engine_;
+    unsigned int max_resets_;
+    std::vector<slot> slots_;
+    std::vector<int> free_;
+
+    octlet_t guid_[ASYNC_MAX_NODES];             /*!< by physical id */
+    unsigned int map_generation_;
+    bool resolving_;
+    rom_read rom_[ASYNC_MAX_NODES][2];
+    int rom_pending_;
+    int rom_count_;
+    unsigned int resolve_generation_;
+
+    int parked_head_;                            /*!< FIFO waiting for a node map */
+    int parked_tail_;
+    unsigned int used_;
+
+    unsigned long long resets_;
+    unsigned long long retried_;
+    unsigned long long lost_;
+    unsigned long long recoveries_;
+    uint64_t reset_ns_;
+    bool awaiting_recovery_;
+    uint64_t last_recovery_ns_;
+    uint64_t max_recovery_ns_;
+    uint64_t total_recovery_ns_;
+};
+
+#endif // ASYNC_RETRY_H
@@ -0,0 +1,243 @@
+#ifndef ASYNC_SAMPLER_H
+#define ASYNC_SAMPLER_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+#include "async_batch.h"
+
+
+/**
+  * @brief: Synchronized sampling: latch everywhere, then read everything
+  *
+  *     A multi-axis controller wants all nodes to latch their sensors at the
+  *     same instant and the samples back as soon as possible. AsyncSampler
+  *     runs one such cycle per sample():
+  *         - SAMPLE_BROADCAST: one broadcast write of the latch quadlet, the
+  *           same packet reaches every node; once it completed, one
+  *           pipelined block read per node (AsyncBatch). Nothing orders a
+  *           read behind a write still in flight, so the reads wait
+  *         - SAMPLE_UNICAST: a latch write per node, all at once, and when
+  *           they completed the same reads
+  *         - SAMPLE_SEQUENTIAL: latch node 1, read node 1, latch node 2 ...
+  *           with blocking transactions, as a raw1394_write/raw1394_read loop
+  *     With set_timestamped() the first quadlet of every sample is the
+  *     node's CYCLE_TIME register at the latch, and skew_ns() is the spread
+  *     of those between the nodes.
+  *
+  *     The latch address takes broadcasts only from CSR_REGISTER_BASE +
+  *     CSR_CONFIG_END on (see tutorial 4).
+  *
+  * @date 2026-10-17
+  */
+
+
+enum sample_mode
+{
+    SAMPLE_SEQUENTIAL,
+    SAMPLE_UNICAST,
+    SAMPLE_BROADCAST
+};
+
+
+// CYCLE_TIME register (7 bit seconds, 13 bit cycles of 125 us, 12 bit offset at 24.576 MHz) and ns
+static inline uint64_t cycle_time_to_ns(quadlet_t cycle_time)
+{
+    const uint64_t seconds = cycle_time >> 25;
+    const uint64_t cycles = (cycle_time >> 12) & 0x1fff;
+    const uint64_t offset = cycle_time & 0xfff;
+    return seconds * 1000000000ULL + cycles * 125000 + offset * 125000 / 3072;
+}
+
+static inline quadlet_t ns_to_cycle_time(uint64_t ns)
+{
+    const uint64_t seconds = (ns / 1000000000ULL) & 0x7f;
+    const uint64_t in_second = ns % 1000000000ULL;
+    return (quadlet_t)((seconds << 25) | ((in_second / 125000) << 12) | ((in_second % 125000) * 3072 / 125000));
+}
+
+
+class AsyncSampler
+{
+public:
+    /**
+     * Latch by writing a quadlet to @latch_addr, then read @length bytes of
+     * samples from @sample_addr of every node
+     */
+    AsyncSampler(AsyncEngine &engine, nodeaddr_t latch_addr, nodeaddr_t sample_addr, size_t length)
+        : engine_(engine), batch_(engine, 0), latch_addr_(latch_addr), sample_addr_(sample_addr),
+          length_((length + 3) & ~(size_t)3), mode_(SAMPLE_BROADCAST), timestamped_(false),
+          pending_(0), latch_error_(0), read_error_(0), cycle_ns_(0), latch_spread_ns_(0), skew_ns_(-1) {}
+
+    void add_node(nodeid_t node)
+    {
+        nodes_.push_back(node);
+        errors_.push_back(0);
+        samples_.resize(nodes_.size() * length_ / 4);
+        // the batch keeps pointers into samples_, add them all again
+        batch_.clear();
+        for (size_t i = 0; i < nodes_.size(); i++) {
+            batch_.add(nodes_[i], sample_addr_, length_, &samples_[i * length_ / 4]);
+        }
+    }
+
+    void set_mode(int mode) { mode_ = mode; }
+    int mode() const { return mode_; }
+
+    // the first sample quadlet is the node's CYCLE_TIME at the latch
+    void set_timestamped(bool timestamped) { timestamped_ = timestamped; }
+
+    /**
+     * One cycle: latch with @latch (bus byte order), read all samples.
+     * Returns 0 or -1 when a transaction failed (sets errno, see error())
+     */
+    int sample(quadlet_t latch)
+    {
+        const uint64_t start = async_now_ns();
+        latch_ = latch;
+        latch_error_ = 0;
+        int rc;
+
+        if (mode_ == SAMPLE_SEQUENTIAL) {
+            rc = sequential(start);
+        } else {
+            if (mode_ == SAMPLE_BROADCAST) {
+                const nodeid_t all = (engine_.transport().local_id() & 0xffc0) | ASYNC_BROADCAST;
+                submit_latch(all);
+            } else {
+                for (size_t i = 0; i < nodes_.size(); i++) submit_latch(nodes_[i]);
+            }
+            latch_spread_ns_ = async_now_ns() - start;
+            // a read must not reach a node before its latch did
+            if (wait() && !latch_error_) latch_error_ = errno;
+            rc = batch_.read();
+            const int err = errno;
+            for (size_t i = 0; i < nodes_.size(); i++) errors_[i] = batch_.entry(i).error;
+            if (rc == 0 && latch_error_) {
+                errno = latch_error_;
+                rc = -1;
+            } else if (rc) {
+                errno = err;
+            }
+        }
+        cycle_ns_ = async_now_ns() - start;
+        skew_ns_ = (rc == 0 && timestamped_) ? timestamp_spread() : -1;
+        return rc;
+    }
+
+    size_t num_nodes() const { return nodes_.size(); }
+    const quadlet_t *data(size_t i) const { return &samples_[i * length_ / 4]; }
+    int error(size_t i) const { return errors_[i]; }   /*!< errno value of the sample read */
+
+    uint64_t cycle_ns() const { return cycle_ns_; }            /*!< last sample(), latch to last sample */
+    uint64_t latch_spread_ns() const { return latch_spread_ns_; }  /*!< first to last latch sent, host side */
+    int64_t skew_ns() const { return skew_ns_; }               /*!< spread of the latch timestamps, -1 = unknown */
+
+private:
+    // the latch write of one node or the broadcast, counted as pending
+    void submit_latch(nodeid_t node)
+    {
+        pending_++;
+        if (engine_.write(node, latch_addr_, 4, &latch_, on_latch, this)) {
+            pending_--;
+            if (!latch_error_) latch_error_ = errno;
+        }
+    }
+
+    static void on_latch(const async_request &request, int error, void *context)
+    {
+        AsyncSampler *s = (AsyncSampler *)context;
+        if (s->pending_ == 0) return;   // given up on in wait()
+        s->pending_--;
+        if (error && !s->latch_error_) s->latch_error_ = error;
+    }
+
+    // iterate until the latches completed. Returns 0 or -1 (sets errno)
+    int wait()
+    {
+        while (pending_) {
+            if (engine_.iterate() && errno != EINTR) {
+                pending_ = 0;
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    // latch and read node by node, each transaction waits for the last
+    int sequential(uint64_t start)
+    {
+        int first_error = 0;
+        for (size_t i = 0; i < nodes_.size(); i++) {
+            submit_latch(nodes_[i]);
+            if (wait() && !latch_error_) latch_error_ = errno;
+            if (i + 1 == nodes_.size()) latch_spread_ns_ = async_now_ns() - start;
+
+            read_error_ = 0;
+            pending_++;
+            if (engine_.read(nodes_[i], sample_addr_, length_, &samples_[i * length_ / 4], on_read, this)) {
+                pending_--;
+                read_error_ = errno;
+            }
+            if (wait() && !read_error_) read_error_ = errno;
+            errors_[i] = read_error_;
+            if (read_error_ && !first_error) first_error = read_error_;
+        }
+        if (!first_error) first_error = latch_error_;
+        if (first_error) {
+            errno = first_error;
+            return -1;
+        }
+        return 0;
+    }
+
+    static void on_read(const async_request &request, int error, void *context)
+    {
+        AsyncSampler *s = (AsyncSampler *)context;
+        if (s->pending_ == 0) return;
+        s->pending_--;
+        s->read_error_ = error;
+    }
+
+    // max - min of the latch timestamps, the 128 s wrap of CYCLE_TIME allowed for
+    int64_t timestamp_spread() const
+    {
+        const int64_t wrap = 128 * 1000000000LL;
+        const int64_t first = (int64_t)cycle_time_to_ns(ntohl(samples_[0]));
+        int64_t lo = 0, hi = 0;
+        for (size_t i = 1; i < nodes_.size(); i++) {
+            int64_t d = (int64_t)cycle_time_to_ns(ntohl(samples_[i * length_ / 4])) - first;
+            if (d > wrap / 2) d -= wrap;
+            if (d < -wrap / 2) d += wrap;
+            if (d < lo) lo = d;
+            if (d > hi) hi = d;
+        }
+        return hi - lo;
+    }
+
+    AsyncEngine &engine_;
+    AsyncBatch batch_;
+    std::vector<nodeid_t> nodes_;
+    std::vector<quadlet_t> samples_;     /*!< one block per node */
+    std::vector<int> errors_;
+    nodeaddr_t latch_addr_;
+    nodeaddr_t sample_addr_;
+    size_t length_;
+    int mode_;
+    bool timestamped_;
+    quadlet_t latch_;                    /*!< lives until the latch is sent */
+    size_t pending_;
+    int latch_error_;
+    int read_error_;
+    uint64_t cycle_ns_;
+    uint64_t latch_spread_ns_;
+    int64_t skew_ns_;
+};
+
+#endif // ASYNC_SAMPLER_H
@@ -0,0 +1,574 @@
+#ifndef ASYNC_TRANSPORT_H
+#define ASYNC_TRANSPORT_H
+
+#include <endian.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+
+/**
+  * @brief: Where asynchronous transactions go
+  *
+  *     AsyncTransport is the small interface AsyncEngine (async_engine.h) is
+  *     written against: start a transaction under a tag, and iterate() until
+  *     completions are reported through the completion function with that
+  *     tag and an errno value (0 = success). Bus resets are reported through
+  *     the reset function with the new generation, before any completion
+  *     that follows them.
+  *
+  *     Raw1394Transport
+  *         - raw1394_start_read/start_write/start_lock(64), iterate() is
+  *           raw1394_loop_iterate
+  *         - installs its own tag handler and uses the handle's userdata, the
+  *           handle must not be used with the default tag handler meanwhile
+  *         - chains the bus reset handler: the one installed before runs
+  *           first (and updates the generation), then the reset function
+  *
+  *     AsyncLoopback, a software stand-in when no bus is present
+  *         - every node is a block of memory at a base address, e.g. the
+  *           range 2_arm_server registers
+  *         - a transaction completes after the request and the response
+  *           packets crossed a bus of the given speed (shared, one packet at
+  *           a time) plus the node's response time, so pipelining behaves
+  *           like on a real bus: latency bound alone, bus bound when busy
+  *         - reads, writes and locks take effect when they complete, locks
+  *           with the IEEE 1394 semantics of each extended transaction code
+  *         - nodes with a GUID have a config ROM: the bus info block and a
+  *           root directory, set_rom_directory() changes it and moves the
+  *           ROM generation on
+  *         - the local node serves the topology map, one self-ID per
+  *           physical id up to node_count(), nodes daisy chained
+  *         - bus_reset() fails what is in flight with EAGAIN, as a stale
+  *           generation does, and reports the reset from the next iterate();
+  *           move_node() renumbers a node as a reset may
+  *         - a write to physical id 63 (node 0xffff) is a broadcast: one
+  *           packet at S100, no response, every other node stores it unless
+  *           set_broadcast_loss() makes it miss the packet
+  *         - a subclass can act on writes in written(), e.g. latch sensor
+  *           values as a device would
+  *
+  * @date 2026-10-17
+  */
+
+
+#define ASYNC_NODE_MASK     0x3f    /*!< physical id part of a nodeid_t */
+#define ASYNC_MAX_NODES     64
+#define ASYNC_BUS_INFO_BLOCK    (CSR_REGISTER_BASE + CSR_CONFIG_ROM)
+#define ASYNC_RESET_NS      200000  /*!< bus reset plus self identification, loopback */
+#define ASYNC_BROADCAST     0x3f    /*!< physical id of the broadcast address */
+
+
+// @error is an errno value, 0 on success
+typedef void (*async_complete_t)(void *context, unsigned long tag, int error);
+
+// the bus was reset, node ids may have changed
+typedef void (*async_reset_t)(void *context, unsigned int generation);
+
+
+static inline uint64_t async_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+class AsyncTransport
+{
+public:
+    AsyncTransport() : complete_(NULL), context_(NULL), reset_(NULL), reset_context_(NULL) {}
+    virtual ~AsyncTransport() {}
+
+    void set_completion(async_complete_t complete, void *context)
+    {
+        complete_ = complete;
+        context_ = context;
+    }
+
+    void set_reset_handler(async_reset_t reset, void *context)
+    {
+        reset_ = reset;
+        reset_context_ = context;
+    }
+
+    // Start a transaction. Returns 0 on success or -1 on failure (sets
+    // errno, EAGAIN when the transport cannot take more right now)
+    virtual int start_read(nodeid_t node, nodeaddr_t addr, size_t length,
+                           quadlet_t *buffer, unsigned long tag) = 0;
+    virtual int start_write(nodeid_t node, nodeaddr_t addr, size_t length,
+                            quadlet_t *buffer, unsigned long tag) = 0;
+    // @data, @arg and *@result in bus byte order, as for raw1394_start_lock
+    virtual int start_lock(nodeid_t node, nodeaddr_t addr, unsigned int extcode,
+                           quadlet_t data, quadlet_t arg, quadlet_t *result,
+                           unsigned long tag) = 0;
+    virtual int start_lock64(nodeid_t node, nodeaddr_t addr, unsigned int extcode,
+                             octlet_t data, octlet_t arg, octlet_t *result,
+                             unsigned long tag) = 0;
+
+    // Wait for and report completions. Returns 0 or -1 (sets errno)
+    virtual int iterate() = 0;
+    // readable when iterate() has an event, -1 if iterate() never blocks
+    virtual int fd() { return -1; }
+
+    virtual nodeid_t local_id() = 0;
+    virtual unsigned int generation() = 0;
+    virtual int node_count() = 0;
+
+protected:
+    void complete(unsigned long tag, int error)
+    {
+        if (complete_) complete_(context_, tag, error);
+    }
+
+    void bus_reset(unsigned int generation)
+    {
+        if (reset_) reset_(reset_context_, generation);
+    }
+
+private:
+    async_complete_t complete_;
+    void *context_;
+    async_reset_t reset_;
+    void *reset_context_;
+};
+
+
+class Raw1394Transport : public AsyncTransport
+{
+public:
+    explicit Raw1394Transport(raw1394handle_t handle) : handle_(handle)
+    {
+        raw1394_set_userdata(handle, this);
+        previous_ = raw1394_set_tag_handler(handle, &Raw1394Transport::tag_handler);
+        previous_reset_ = raw1394_set_bus_reset_handler(handle, &Raw1394Transport::reset_handler);
+    }
+    ~Raw1394Transport()
+    {
+        raw1394_set_bus_reset_handler(handle_, previous_reset_);
+        raw1394_set_tag_handler(handle_, previous_);
+        raw1394_set_userdata(handle_, NULL);
+    }
+
+    int start_read(nodeid_t node, nodeaddr_t addr, size_t length,
+                   quadlet_t *buffer, unsigned long tag)
+    {
+        return raw1394_start_read(handle_, node, addr, length, buffer, tag);
+    }
+
+    int start_write(nodeid_t node, nodeaddr_t addr, size_t length,
+                    quadlet_t *buffer, unsigned long tag)
+    {
+        return raw1394_start_write(handle_, node, addr, length, buffer, tag);
+    }
+
+    int start_lock(nodeid_t node, nodeaddr_t addr, unsigned int extcode,
+                   quadlet_t data, quadlet_t arg, quadlet_t *result, unsigned long tag)
+    {
+        return raw1394_start_lock(handle_, node, addr, extcode, data, arg, result, tag);
+    }
+
+    int start_lock64(nodeid_t node, nodeaddr_t addr, unsigned int extcode,
+                     octlet_t data, octlet_t arg, octlet_t *result, unsigned long tag)
+    {
+        return raw1394_start_lock64(handle_, node, addr, extcode, data, arg, result, tag);
+    }
+
+    int iterate() { return raw1394_loop_iterate(handle_); }
+    int fd() { return raw1394_get_fd(handle_); }
+
+    nodeid_t local_id() { return raw1394_get_local_id(handle_); }
+    unsigned int generation() { return raw1394_get_generation(handle_); }
+    int node_count() { return raw1394_get_nodecount(handle_); }
+
+    raw1394handle_t handle() const { return handle_; }
+
+private:
+    static int tag_handler(raw1394handle_t handle, unsigned long tag, raw1394_errcode_t errcode)
+    {
+        Raw1394Transport *transport = (Raw1394Transport *)raw1394_get_userdata(handle);
+        transport->complete(tag, raw1394_errcode_to_errno(errcode));
+        return 0;
+    }
+
+    static int reset_handler(raw1394handle_t handle, unsigned int generation)
+    {
+        Raw1394Transport *transport = (Raw1394Transport *)raw1394_get_userdata(handle);
+        if (transport->previous_reset_) transport->previous_reset_(handle, generation);
+        else raw1394_update_generation(handle, generation);
+        transport->bus_reset(generation);
+        return 0;
+    }
+
+    raw1394handle_t handle_;
+    tag_handler_t previous_;
+    bus_reset_handler_t previous_reset_;
+};
+
+
+class AsyncLoopback : public AsyncTransport
+{
+public:
+    /**
+     * @speed raw1394_iso_speed of the emulated bus, @response_ns how long a
+     * node takes to answer a request
+     */
+    AsyncLoopback(int speed = RAW1394_ISO_SPEED_400, uint64_t response_ns = 10000)
+        : local_id_(0xffc0), response_ns_(response_ns), bus_free_ns_(0),
+          ns_per_byte_(80 >> speed), transactions_(0), generation_(1), reset_pending_(false),
+          broadcast_loss_(0), seed_(1394)
+    {
+        for (int i = 0; i < ASYNC_MAX_NODES; i++) {
+            nodes_[i].present = false;
+            nodes_[i].guid = 0;
+            nodes_[i].rom_generation = 0;
+        }
+    }
+
+    // a node with @length bytes of memory at @base, filled from @init if set
+    void add_node(unsigned int phy_id, nodeaddr_t base, size_t length, const void *init = NULL)
+    {
+        node &n = nodes_[phy_id & ASYNC_NODE_MASK];
+        n.present = true;
+        n.base = base;
+        n.memory.assign(length, 0);
+        if (init) memcpy(&n.memory[0], init, length);
+    }
+
+    void remove_node(unsigned int phy_id) { nodes_[phy_id & ASYNC_NODE_MASK].present = false; }
+
+    // node @phy_id answers bus info block reads with @guid
+    void set_guid(unsigned int phy_id, octlet_t guid) { nodes_[phy_id & ASYNC_NODE_MASK].guid = guid; }
+
+    // root directory entries (host byte order, key << 24 | value) of node @phy_id
+    void set_rom_directory(unsigned int phy_id, const std::vector<quadlet_t> &entries)
+    {
+        node &n = nodes_[phy_id & ASYNC_NODE_MASK];
+        n.directory = entries;
+        n.rom_generation = n.rom_generation % 15 + 1;   // 1..15, 0 = never changes
+    }
+
+    // each node misses a broadcast with probability @percent
+    void set_broadcast_loss(unsigned int percent) { broadcast_loss_ = percent; }
+
+    // renumber node @from to @to (swaps the two), call bus_reset() after
+    void move_node(unsigned int from, unsigned int to)
+    {
+        std::swap(nodes_[from & ASYNC_NODE_MASK], nodes_[to & ASYNC_NODE_MASK]);
+    }
+
+    /**
+     * Reset the bus: the generation moves on, what is in flight fails with
+     * EAGAIN, the bus is busy for the reset and self identification, and
+     * the next iterate() reports the reset
+     */
+    void bus_reset()
+    {
+        generation_++;
+        const uint64_t now = async_now_ns();
+        bus_free_ns_ = (bus_free_ns_ > now ? bus_free_ns_ : now) + ASYNC_RESET_NS;
+        reset_pending_ = true;
+    }
+
+    // memory of node @phy_id, NULL if absent
+    byte_t *memory(unsigned int phy_id)
+    {
+        node &n = nodes_[phy_id & ASYNC_NODE_MASK];
+        return n.present ? &n.memory[0] : NULL;
+    }
+
+    int start_read(nodeid_t node, nodeaddr_t addr, size_t length,
+                   quadlet_t *buffer, unsigned long tag)
+    {
+        return start(TR_READ, node, addr, length, buffer, tag);
+    }
+
+    int start_write(nodeid_t node, nodeaddr_t addr, size_t length,
+                    quadlet_t *buffer, unsigned long tag)
+    {
+        return start(TR_WRITE, node, addr, length, buffer, tag);
+    }
+
+    int start_lock(nodeid_t node, nodeaddr_t addr, unsigned int extcode,
+                   quadlet_t data, quadlet_t arg, quadlet_t *result, unsigned long tag)
+    {
+        return start(TR_LOCK, node, addr, 4, result, tag, extcode, data, arg);
+    }
+
+    int start_lock64(nodeid_t node, nodeaddr_t addr, unsigned int extcode,
+                     octlet_t data, octlet_t arg, octlet_t *result, unsigned long tag)
+    {
+        return start(TR_LOCK, node, addr, 8, (quadlet_t *)result, tag, extcode, data, arg);
+    }
+
+    int iterate()
+    {
+        if (reset_pending_) {
+            reset_pending_ = false;
+            AsyncTransport::bus_reset(generation_);
+            return 0;
+        }
+        if (pending_.empty()) return 0;
+        const transaction t = pending_.top();
+        pending_.pop();
+        wait_until(t.done_ns);
+        complete(t.tag, execute(t));
+        return 0;
+    }
+
+    nodeid_t local_id() { return local_id_; }
+    unsigned int generation() { return generation_; }
+
+    int node_count()
+    {
+        int count = (local_id_ & ASYNC_NODE_MASK) + 1;
+        for (int i = 0; i < ASYNC_MAX_NODES - 1; i++) {
+            if (nodes_[i].present && i >= count) count = i + 1;
+        }
+        return count;
+    }
+
+    size_t outstanding() const { return pending_.size(); }
+    unsigned long long transactions() const { return transactions_; }
+
+protected:
+    enum { TR_READ, TR_WRITE, TR_LOCK };
+
+    struct transaction
+    {
+        uint64_t done_ns;
+        uint64_t arrive_ns;          /*!< the request packet reached the node */
+        unsigned long tag;
+        int type;
+        nodeid_t node;
+        nodeaddr_t addr;
+        size_t length;
+        quadlet_t *buffer;
+        unsigned int extcode;        /*!< locks only, operands in bus byte order */
+        octlet_t data;
+        octlet_t arg;
+        unsigned int generation;     /*!< bus generation it was sent in */
+
+        bool operator<(const transaction &other) const { return done_ns > other.done_ns; }
+    };
+
+    struct node
+    {
+        bool present;
+        nodeaddr_t base;
+        std::vector<byte_t> memory;
+        octlet_t guid;               /*!< 0 = no config ROM */
+        std::vector<quadlet_t> directory;
+        unsigned int rom_generation;
+    };
+
+    // packet on the wire: arbitration, header and CRCs plus the payload
+    uint64_t packet_ns(size_t payload) const { return 1000 + (20 + payload) * ns_per_byte_; }
+
+    int start(int type, nodeid_t node, nodeaddr_t addr, size_t length,
+              quadlet_t *buffer, unsigned long tag,
+              unsigned int extcode = 0, octlet_t data = 0, octlet_t arg = 0)
+    {
+        // the request waits for the bus, the node answers after response_ns
+        // and the response crosses the bus too
+        const uint64_t now = async_now_ns();
+        const uint64_t request_at = bus_free_ns_ > now ? bus_free_ns_ : now;
+        transaction t;
+        if (type == TR_WRITE && (node & ASYNC_NODE_MASK) == ASYNC_BROADCAST) {
+            // a single unacknowledged packet, broadcasts go at S100
+            bus_free_ns_ = request_at + 1000 + (20 + length) * 80;
+            t.done_ns = bus_free_ns_;
+            t.arrive_ns = bus_free_ns_;
+        } else {
+            const size_t request_payload = (type == TR_WRITE) ? length : (type == TR_LOCK) ? 2 * length : 0;
+            const size_t response_payload = (type == TR_WRITE) ? 0 : length;
+            // both packets take their share of the bus
+            bus_free_ns_ = request_at + packet_ns(request_payload) + packet_ns(response_payload);
+            t.done_ns = request_at + packet_ns(request_payload) + response_ns_ + packet_ns(response_payload);
+            t.arrive_ns = request_at + packet_ns(request_payload);
+        }
+        t.tag = tag;
+        t.type = type;
+        t.node = node;
+        t.addr = addr;
+        t.length = length;
+        t.buffer = buffer;
+        t.extcode = extcode;
+        t.data = data;
+        t.arg = arg;
+        t.generation = generation_;
+        pending_.push(t);
+        transactions_++;
+        return 0;
+    }
+
+    // the effect of @t on the node memory, returns the errno to report
+    virtual int execute(const transaction &t)
+    {
+        if (t.generation != generation_) return EAGAIN;   // crossed a bus reset
+        if ((t.node & ASYNC_NODE_MASK) == ASYNC_BROADCAST) {
+            if (t.type == TR_WRITE) broadcast(t);
+            return t.type == TR_WRITE ? 0 : EINVAL;
+        }
+        if ((t.node & ASYNC_NODE_MASK) == (local_id_ & ASYNC_NODE_MASK) && t.type == TR_READ &&
+            t.addr >= CSR_REGISTER_BASE + CSR_TOPOLOGY_MAP &&
+            t.addr + t.length <= CSR_REGISTER_BASE + CSR_TOPOLOGY_MAP_END) {
+            return topology_map(t);
+        }
+        node &n = nodes_[t.node & ASYNC_NODE_MASK];
+        if (!n.present) return ETIMEDOUT;   // no ack
+        if (n.guid && t.type == TR_READ && t.addr >= ASYNC_BUS_INFO_BLOCK &&
+            t.addr + t.length <= ASYNC_BUS_INFO_BLOCK + 4 * (6 + n.directory.size())) {
+            return config_rom(n, t);
+        }
+        if (t.addr < n.base || t.length > n.memory.size() ||
+            t.addr - n.base > n.memory.size() - t.length) return EINVAL;   // address error
+
+        byte_t *mem = &n.memory[t.addr - n.base];
+        if (t.type == TR_WRITE) {
+            memcpy(mem, t.buffer, t.length);
+            written(t.node & ASYNC_NODE_MASK, t);
+            return 0;
+        }
+        if (t.type == TR_READ) memcpy(t.buffer, mem, t.length);
+        else if (t.length == 4) return lock<quadlet_t>(t, mem);
+        else if (t.length == 8) return lock<octlet_t>(t, mem);
+        else return EINVAL;
+        return 0;
+    }
+
+    // every node but the sender stores what fits its memory, nobody answers
+    void broadcast(const transaction &t)
+    {
+        for (int i = 0; i < ASYNC_BROADCAST; i++) {
+            node &n = nodes_[i];
+            if (!n.present || i == (local_id_ & ASYNC_NODE_MASK)) continue;
+            if (broadcast_loss_ && (unsigned int)(rand_r(&seed_) % 100) < broadcast_loss_) continue;
+            if (t.addr < n.base || t.length > n.memory.size() ||
+                t.addr - n.base > n.memory.size() - t.length) continue;
+            memcpy(&n.memory[t.addr - n.base], t.buffer, t.length);
+            written(i, t);
+        }
+    }
+
+    // node @phy_id stored the data of write @t, unicast or broadcast
+    virtual void written(unsigned int phy_id, const transaction &t) {}
+
+    // bus info block ("1394", max_rec and link speed of the bus, ROM
+    // generation, GUID) and the root directory
+    int config_rom(const node &n, const transaction &t)
+    {
+        const unsigned int sp = __builtin_ctz(80 / ns_per_byte_);
+        quadlet_t rom[6 + 256];
+        const size_t entries = std::min<size_t>(n.directory.size(), 256);
+        rom[0] = htobe32(0x04000000 | (unsigned int)((5 + entries) << 16));
+        rom[1] = htobe32(0x31333934);
+        rom[2] = htobe32(0xe0000000 | ((sp + 8) << 12) | (n.rom_generation << 4) | sp);
+        rom[3] = htobe32((quadlet_t)(n.guid >> 32));
+        rom[4] = htobe32((quadlet_t)n.guid);
+        rom[5] = htobe32((quadlet_t)(entries << 16));   // CRCs are left 0
+        for (size_t e = 0; e < entries; e++) rom[6 + e] = htobe32(n.directory[e]);
+        memcpy(t.buffer, (byte_t *)rom + (t.addr - ASYNC_BUS_INFO_BLOCK), t.length);
+        return 0;
+    }
+
+    // header and one self-ID packet per physical id, a daisy chain with
+    // the root (highest id) at the end; absent nodes are phys without link
+    int topology_map(const transaction &t)
+    {
+        const unsigned int count = node_count();
+        const unsigned int sp = __builtin_ctz(80 / ns_per_byte_);
+        quadlet_t map[3 + ASYNC_MAX_NODES];
+        memset(map, 0, sizeof(map));
+        map[0] = htobe32((2 + count) << 16);
+        map[1] = htobe32(generation_);
+        map[2] = htobe32((count << 16) | count);
+        for (unsigned int phy = 0; phy < count; phy++) {
+            const bool local = phy == (local_id_ & ASYNC_NODE_MASK);
+            const bool link = local || nodes_[phy].present;
+            const unsigned int parent = phy + 1 < count ? 2 : 1;    // port 0: 10b parent, 01b none
+            const unsigned int child = phy > 0 ? 3 : 1;             // port 1: 11b child
+            map[3 + phy] = htobe32(0x80000000 | (phy << 24) | ((link ? 1u : 0u) << 22) | (63 << 16) |
+                                   (sp << 14) | ((local ? 1u : 0u) << 11) | (parent << 6) | (child << 4));
+        }
+        const nodeaddr_t offset = t.addr - (CSR_REGISTER_BASE + CSR_TOPOLOGY_MAP);
+        if (offset + t.length > sizeof(map)) return EINVAL;
+        memcpy(t.buffer, (byte_t *)map + offset, t.length);
+        return 0;
+    }
+
+    // compute the new value as the node would, report the old one
+    template <typename T>
+    int lock(const transaction &t, byte_t *mem)
+    {
+        T old_bus, arg_bus = (T)t.arg, data_bus = (T)t.data;
+        memcpy(&old_bus, mem, sizeof(T));
+        const T old = from_bus(old_bus), arg = from_bus(arg_bus), data = from_bus(data_bus);
+        T value;
+        switch (t.extcode) {
+        case RAW1394_EXTCODE_MASK_SWAP:    value = (data & arg) | (old & ~arg); break;
+        case RAW1394_EXTCODE_COMPARE_SWAP: value = (old == arg) ? data : old; break;
+        case RAW1394_EXTCODE_FETCH_ADD:    value = old + data; break;
+        case RAW1394_EXTCODE_BOUNDED_ADD:  value = (old != arg) ? old + data : old; break;
+        case RAW1394_EXTCODE_WRAP_ADD:     value = (old != arg) ? old + data : data; break;
+        case RAW1394_EXTCODE_LITTLE_ADD:
+        {
+            // the only little endian operation, add in that byte order
+            T sum = le_to_host(old_bus) + le_to_host(data_bus);
+            T sum_bus = host_to_le(sum);
+            memcpy(mem, &sum_bus, sizeof(T));
+            memcpy(t.buffer, &old_bus, sizeof(T));
+            return 0;
+        }
+        default:
+            return EINVAL;   // type error
+        }
+        const T value_bus = to_bus(value);
+        memcpy(mem, &value_bus, sizeof(T));
+        memcpy(t.buffer, &old_bus, sizeof(T));
+        return 0;
+    }
+
+    static quadlet_t from_bus(quadlet_t v) { return be32toh(v); }
+    static octlet_t from_bus(octlet_t v) { return be64toh(v); }
+    static quadlet_t to_bus(quadlet_t v) { return htobe32(v); }
+    static octlet_t to_bus(octlet_t v) { return htobe64(v); }
+    static quadlet_t le_to_host(quadlet_t v) { return le32toh(v); }
+    static octlet_t le_to_host(octlet_t v) { return le64toh(v); }
+    static quadlet_t host_to_le(quadlet_t v) { return htole32(v); }
+    static octlet_t host_to_le(octlet_t v) { return htole64(v); }
+
+    void wait_until(uint64_t ns)
+    {
+        uint64_t now = async_now_ns();
+        if (ns > now + 100000) {
+            const uint64_t sleep_ns = ns - now - 50000;
+            struct timespec ts = { (time_t)(sleep_ns / 1000000000ULL), (long)(sleep_ns % 1000000000ULL) };
+            nanosleep(&ts, NULL);
+        }
+        while (async_now_ns() < ns) {}
+    }
+
+    nodeid_t local_id_;
+    uint64_t response_ns_;
+    uint64_t bus_free_ns_;
+    unsigned int ns_per_byte_;
+    unsigned long long transactions_;
+    node nodes_[ASYNC_MAX_NODES];
+    std::priority_queue<transaction> pending_;
+    unsigned int generation_;
+    bool reset_pending_;
+    unsigned int broadcast_loss_;    /*!< percent */
+    unsigned int seed_;
+};
+
+#endif // ASYNC_TRANSPORT_H
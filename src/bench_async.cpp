@@ -0,0 +1,438 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "async_engine.h"
+#include "latency_hist.h"
+
+
+#define ARM_BASE        0xffffff000000ULL   /*!< range of 2_arm_server */
+#define ARM_LENGTH      16                  /*!< the 4 quadlets it registers */
+
+
+/**
+  * @brief: Benchmark: asynchronous transaction latency
+  *
+  *     Runs a mix of quadlet and block reads and writes against the range
+  *     2_arm_server registers and records the round trip of every
+  *     transaction in a LatencyHistogram (latency_hist.h). Modes:
+  *         - sync: one transaction at a time, raw1394_read/raw1394_write as
+  *           in tutorial 3 (AsyncEngine with a window of 1 on the stand-in)
+  *         - pipelined: AsyncEngine (async_engine.h) with each window of -w,
+  *           latency from submit to completion
+  *     For every mode and operation it prints p50, p99, p99.9 and max in
+  *     microseconds plus transactions/s and MB/s.
+  *
+  *     By default the remote node is the in-process AsyncLoopback, so this
+  *     runs on a CI box without a 1394 card:
+  *         - bench_async                        default mix on a simulated S400 bus
+  *         - bench_async -m qr=1 -w 1,4,16,64   quadlet reads only, window sweep
+  *     With -H it runs against node -n on the real bus; start 2_arm_server
+  *     there first.
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+enum bench_op { OP_QREAD, OP_QWRITE, OP_BREAD, OP_BWRITE, OP_COUNT };
+
+const char *op_names[OP_COUNT] = { "qr", "qw", "br", "bw" };
+
+
+struct bench_result
+{
+    LatencyHistogram latency[OP_COUNT];
+    unsigned long long bytes;
+    unsigned long long errors;
+    double wall_sec;
+};
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+volatile sig_atomic_t running = 1;
+
+// one transaction in flight
+struct bench_slot
+{
+    bench_op op;
+    std::vector<quadlet_t> data;
+};
+
+std::vector<bench_slot> slots;
+std::vector<int> free_slots;
+bench_result *current = NULL;
+
+
+/* signal handler stops the runs */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+// bus reset handler, update bus generation
+int my_bus_reset_handler(raw1394handle_t h, unsigned int gen)
+{
+    nodeid_t id = raw1394_get_local_id(h);
+    std::cout << "Reset bus to gen " << gen << " local id " << id << std::endl;
+
+    // update handle gen value
+    raw1394_update_generation(h, gen);
+    return 0;
+}
+
+
+// the sequence of operations, drawn by weight from the mix
+std::vector<bench_op> make_sequence(const unsigned int weights[OP_COUNT], size_t length)
+{
+    unsigned int total = 0;
+    for (int o = 0; o < OP_COUNT; o++) total += weights[o];
+    std::vector<bench_op> sequence(length, OP_QREAD);
+    unsigned int seed = 1394;
+    for (size_t i = 0; i < length && total; i++) {
+        unsigned int r = rand_r(&seed) % total;
+        int o = 0;
+        while (r >= weights[o]) r -= weights[o++];
+        sequence[i] = (bench_op)o;
+    }
+    return sequence;
+}
+
+
+size_t op_length(bench_op op, size_t block)
+{
+    return (op == OP_QREAD || op == OP_QWRITE) ? 4 : block;
+}
+
+
+// k-th address of @length bytes, walking through the ARM range
+nodeaddr_t op_addr(unsigned long long k, size_t length)
+{
+    return ARM_BASE + (k * length) % (ARM_LENGTH - length + 1) / 4 * 4;
+}
+
+
+void transaction_done(const async_request &request, int error, void *context)
+{
+    bench_slot &s = *(bench_slot *)context;
+    if (error) current->errors++;
+    else current->bytes += request.length;
+    current->latency[s.op].record(async_now_ns() - request.submit_ns);
+    free_slots.push_back((int)(&s - &slots[0]));
+}
+
+
+// @count transactions through @engine, at most its window in flight
+void run_pipelined(AsyncEngine &engine, nodeid_t node, const std::vector<bench_op> &sequence,
+                   unsigned long long count, size_t block, bench_result &r)
+{
+    current = &r;
+    const uint64_t start = async_now_ns();
+    for (unsigned long long k = 0; k < count && running; k++) {
+        while (free_slots.empty()) engine.iterate();
+        bench_slot &s = slots[free_slots.back()];
+        free_slots.pop_back();
+
+        s.op = sequence[k % sequence.size()];
+        const size_t length = op_length(s.op, block);
+        const nodeaddr_t addr = op_addr(k, length);
+        int rc;
+        do {
+            rc = (s.op == OP_QREAD || s.op == OP_BREAD) ?
+                 engine.read(node, addr, length, &s.data[0], transaction_done, &s) :
+                 engine.write(node, addr, length, &s.data[0], transaction_done, &s);
+        } while (rc && errno == EAGAIN && engine.iterate() == 0);
+        if (rc) {
+            r.errors++;
+            free_slots.push_back((int)(&s - &slots[0]));
+        }
+    }
+    engine.drain();
+    r.wall_sec = (async_now_ns() - start) * 1e-9;
+}
+
+
+// tutorial 3: raw1394_read/raw1394_write, waiting for each response
+void run_blocking(nodeid_t node, const std::vector<bench_op> &sequence,
+                  unsigned long long count, size_t block, bench_result &r)
+{
+    std::vector<quadlet_t> data(block / 4 + 1);
+    const uint64_t start = async_now_ns();
+    for (unsigned long long k = 0; k < count && running; k++) {
+        const bench_op op = sequence[k % sequence.size()];
+        const size_t length = op_length(op, block);
+        const nodeaddr_t addr = op_addr(k, length);
+        const uint64_t t0 = async_now_ns();
+        const int rc = (op == OP_QREAD || op == OP_BREAD) ?
+                       raw1394_read(handle, node, addr, length, &data[0]) :
+                       raw1394_write(handle, node, addr, length, &data[0]);
+        r.latency[op].record(async_now_ns() - t0);
+        if (rc) r.errors++;
+        else r.bytes += length;
+    }
+    r.wall_sec = (async_now_ns() - start) * 1e-9;
+}
+
+
+void print_header()
+{
+    printf("%-9s %6s %3s %9s %9s %9s %9s %9s %11s %9s %7s\n",
+           "mode", "window", "op", "count", "p50 us", "p99 us", "p99.9 us", "max us",
+           "trans/s", "MB/s", "errors");
+}
+
+
+void print_row(const char *mode, unsigned int window, const char *op,
+               const LatencyHistogram &h, const bench_result &r, bool totals)
+{
+    printf("%-9s %6u %3s %9llu %9.1f %9.1f %9.1f %9.1f", mode, window, op,
+           (unsigned long long)h.count(), h.percentile(0.50) / 1e3, h.percentile(0.99) / 1e3,
+           h.percentile(0.999) / 1e3, h.max() / 1e3);
+    if (totals && r.wall_sec > 0) {
+        printf(" %11.0f %9.2f %7llu\n", h.count() / r.wall_sec, r.bytes / r.wall_sec / 1e6, r.errors);
+    } else {
+        printf(" %11s %9s %7s\n", "", "", "");
+    }
+}
+
+
+void print_result(const char *mode, unsigned int window, const bench_result &r)
+{
+    // one row per operation of the mix, then all of them with the totals
+    LatencyHistogram all;
+    int used = 0, last = OP_QREAD;
+    for (int o = 0; o < OP_COUNT; o++) {
+        if (r.latency[o].count() == 0) continue;
+        all.merge(r.latency[o]);
+        used++;
+        last = o;
+    }
+    for (int o = 0; o < OP_COUNT && used > 1; o++) {
+        if (r.latency[o].count()) print_row(mode, window, op_names[o], r.latency[o], r, false);
+    }
+    print_row(mode, window, used > 1 ? "all" : op_names[last], all, r, true);
+    fflush(stdout);
+}
+
+
+// parse a comma separated list of numbers
+std::vector<unsigned int> parse_list(const char *arg)
+{
+    std::vector<unsigned int> values;
+    const char *p = arg;
+    while (*p) {
+        values.push_back(strtoul(p, (char **)&p, 10));
+        if (*p == ',') p++;
+        else break;
+    }
+    return values;
+}
+
+
+// parse "qr=70,qw=10,br=10,bw=10", returns false on an unknown operation
+bool parse_mix(const char *arg, unsigned int weights[OP_COUNT])
+{
+    for (int o = 0; o < OP_COUNT; o++) weights[o] = 0;
+    const char *p = arg;
+    while (*p) {
+        int o = 0;
+        while (o < OP_COUNT && strncmp(p, op_names[o], 2) != 0) o++;
+        if (o == OP_COUNT || p[2] != '=') return false;
+        weights[o] = strtoul(p + 3, (char **)&p, 10);
+        if (*p == ',') p++;
+        else if (*p) return false;
+    }
+    return true;
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: bench_async [-h] [-c count] [-m mix] [-b bytes] [-w windows]\n"
+              << "                   [-L us] [-V speed]\n"
+              << "       bench_async -H [-p port] [-n node] [...]\n"
+              << "    -h  show usage\n"
+              << "    -c  transactions per run (default 20000)\n"
+              << "    -m  operation mix, weights of qr/qw/br/bw = quadlet/block read/write\n"
+              << "        (default qr=40,qw=20,br=30,bw=10)\n"
+              << "    -b  block size in bytes, at most 16 (default 16)\n"
+              << "    -w  pipelined windows (default 4,16,64)\n"
+              << "    -L  response time of the simulated node in microseconds (default 10)\n"
+              << "    -V  speed of the simulated bus, 100/200/400/800 (default 400)\n"
+              << "    -H  use the real bus instead of the in-process stand-in\n"
+              << "    -p  specify port number\n"
+              << "    -n  physical id of the node running 2_arm_server (default 0)\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    int phy_id = 0;
+    bool hardware = false;
+    unsigned long long count = 20000;
+    unsigned int weights[OP_COUNT] = { 40, 20, 30, 10 };
+    size_t block = ARM_LENGTH;
+    std::vector<unsigned int> windows = parse_list("4,16,64");
+    unsigned int response_us = 10;
+    int speed = RAW1394_ISO_SPEED_400;
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hc:m:b:w:L:V:Hp:n:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'c':
+            count = strtoull(optarg, NULL, 10);
+            break;
+        case 'm':
+            if (!parse_mix(optarg, weights)) {
+                std::cerr << "Invalid mix " << optarg << std::endl;
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b':
+            block = (atoi(optarg) + 3) & ~3;
+            break;
+        case 'w':
+            windows = parse_list(optarg);
+            break;
+        case 'L':
+            response_us = atoi(optarg);
+            break;
+        case 'V':
+            speed = RAW1394_ISO_SPEED_100;
+            for (int v = atoi(optarg); v > 100 && speed < RAW1394_ISO_SPEED_800; v /= 2) speed++;
+            break;
+        case 'H':
+            hardware = true;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            phy_id = atoi(optarg);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+    if (block == 0 || block > ARM_LENGTH) {
+        std::cerr << "Invalid block size" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+    const std::vector<bench_op> sequence = make_sequence(weights, 4096);
+    AsyncTransport *transport = NULL;
+    nodeid_t node;
+
+    if (!hardware) {
+        // stand-in for 2_arm_server on physical id 1
+        AsyncLoopback *loopback = new AsyncLoopback(speed, response_us * 1000ULL);
+        loopback->add_node(1, ARM_BASE, ARM_LENGTH);
+        node = (loopback->local_id() & 0xffc0) | 1;
+        transport = loopback;
+        printf("software bus S%d, response time %u us, %llu transactions per run, block %zu bytes\n",
+               100 << speed, response_us, count, block);
+    } else {
+        // ----- Get handle and set port for the handle -------
+        // create handle
+        handle = raw1394_new_handle();
+        if (handle == NULL) {
+            std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // get port number & sanity check
+        int numPorts = raw1394_get_port_info(handle, NULL, 0);
+        if (port < 0 || port >= numPorts) {
+            std::cerr << "Invalid port number" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // let user to choose which port to use
+        rc = raw1394_set_port(handle, port);
+        if (rc) {
+            std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // set bus reset handler
+        raw1394_set_bus_reset_handler(handle, my_bus_reset_handler);
+
+        node = (raw1394_get_local_id(handle) & 0xffc0) | (phy_id & ASYNC_NODE_MASK);
+        printf("node %d, %llu transactions per run, block %zu bytes\n", phy_id, count, block);
+    }
+    printf("mix qr=%u qw=%u br=%u bw=%u\n", weights[OP_QREAD], weights[OP_QWRITE],
+           weights[OP_BREAD], weights[OP_BWRITE]);
+    print_header();
+
+    // sync: one transaction at a time
+    {
+        bench_result r;
+        r.bytes = r.errors = 0;
+        if (hardware) {
+            run_blocking(node, sequence, count, block, r);
+        } else {
+            AsyncEngine engine(*transport, 1, 1, 1);
+            slots.assign(1, bench_slot());
+            slots[0].data.assign(block / 4 + 1, 0);
+            free_slots.assign(1, 0);
+            run_pipelined(engine, node, sequence, count, block, r);
+        }
+        print_result("sync", 1, r);
+    }
+
+    // pipelined, the tag handler belongs to the transport from here on
+    if (hardware) transport = new Raw1394Transport(handle);
+    for (size_t w = 0; w < windows.size() && running; w++) {
+        const unsigned int window = windows[w] ? windows[w] : 1;
+        AsyncEngine engine(*transport, window, window, window);
+        slots.assign(window, bench_slot());
+        free_slots.clear();
+        for (unsigned int i = window; i > 0; i--) {
+            slots[i - 1].data.assign(block / 4 + 1, 0);
+            free_slots.push_back(i - 1);
+        }
+        bench_result r;
+        r.bytes = r.errors = 0;
+        run_pipelined(engine, node, sequence, count, block, r);
+        print_result("pipelined", window, r);
+    }
+
+    // clean up & exit
+    delete transport;
+    if (handle) raw1394_destroy_handle(handle);
+
+    return EXIT_SUCCESS;
+}
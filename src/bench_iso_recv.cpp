@@ -0,0 +1,377 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "iso_sim.h"
+
+
+#define PACKET_MAX 4096
+
+
+/**
+  * @brief: Benchmark: isochronous receive DMA modes
+  *
+  *     Compares RAW1394_DMA_PACKET_PER_BUFFER and RAW1394_DMA_BUFFERFILL:
+  *         - packet-per-buffer: every packet gets a max_packet_size slot, the
+  *           ring holds buf_packets packets whatever their real size
+  *         - buffer-fill: packets are packed back to back, small packets fit
+  *           many more per ring and per wakeup
+  *
+  *     For every mode x payload size x buffer count it reports packets/s,
+  *     MB/s, CPU time per packet (process CPU clock), wakeups and drops.
+  *
+  *     By default the kernel is replaced by the software packet source in
+  *     iso_sim.h, so this runs on a CI box without a 1394 card:
+  *         - bench_iso_recv                 unpaced, measures the host side cost
+  *                                          only; the rates are not comparable
+  *                                          to a bus or to the -H numbers
+  *         - bench_iso_recv -r 8000         paced like a real bus, shows wakeups
+  *                                          and drops at a given buffer depth
+  *     The handler copies every payload out of the ring in both cases.
+  *     With -H the same sweep runs against the real receiver for -d seconds
+  *     per point; start a transmitter (6_iso_xmit) on the bus first. Payload
+  *     size is then set by the transmitter, the sweep only changes buf_packets.
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+struct bench_result
+{
+    unsigned long long packets;
+    unsigned long long bytes;
+    unsigned long long dropped;
+    unsigned long long wakeups;
+    unsigned int ring_packets;   /*!< effective ring depth, 0 if unknown */
+    double wall_sec;
+    double cpu_sec;
+};
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+// updated by the handler
+unsigned long long bench_packets = 0;
+unsigned long long bench_bytes = 0;
+unsigned long long bench_dropped = 0;
+quadlet_t bench_checksum = 0;
+unsigned char bench_copy[PACKET_MAX];   /*!< where the handler copies each payload */
+
+volatile sig_atomic_t running = 1;
+
+
+/* signal handler stops the sweep */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+double clock_sec(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+raw1394_iso_disposition
+my_iso_recv_handler(raw1394handle_t handle,
+                    unsigned char *data,
+                    unsigned int len,
+                    unsigned char channel,
+                    unsigned char tag,
+                    unsigned char sy,
+                    unsigned int cycle,
+                    unsigned int dropped)
+{
+    // copy the payload out of the ring, like a real consumer would
+    if (len > PACKET_MAX) len = PACKET_MAX;
+    memcpy(bench_copy, data, len);
+    if (len) bench_checksum += bench_copy[0] + bench_copy[len - 1];
+    bench_packets++;
+    bench_bytes += len;
+    bench_dropped += dropped;
+    return RAW1394_ISO_OK;
+}
+
+
+void reset_counters()
+{
+    bench_packets = bench_bytes = bench_dropped = 0;
+}
+
+
+// one point against the software packet source
+bench_result run_sim(raw1394_iso_dma_recv_mode mode, unsigned int payload,
+                     unsigned int buf_packets, int irq_interval,
+                     double rate, unsigned long long packets)
+{
+    IsoSimConfig config;
+    config.mode = mode;
+    config.buf_packets = buf_packets;
+    config.max_packet_size = PACKET_MAX;
+    config.irq_interval = irq_interval;
+    config.payload_len = payload;
+    config.packet_rate = rate;
+    IsoSimRecv sim(my_iso_recv_handler, config);
+
+    reset_counters();
+    const double wall0 = clock_sec(CLOCK_MONOTONIC);
+    const double cpu0 = clock_sec(CLOCK_PROCESS_CPUTIME_ID);
+    while (running && sim.packets() < packets) {
+        if (sim.iterate(NULL)) break;
+    }
+
+    bench_result r;
+    r.cpu_sec = clock_sec(CLOCK_PROCESS_CPUTIME_ID) - cpu0;
+    r.wall_sec = clock_sec(CLOCK_MONOTONIC) - wall0;
+    r.packets = bench_packets;
+    r.bytes = bench_bytes;
+    r.dropped = sim.dropped();
+    r.wakeups = sim.wakeups();
+    r.ring_packets = sim.ring_packets();
+    return r;
+}
+
+
+// one point against the real receiver
+bench_result run_hw(raw1394_iso_dma_recv_mode mode, unsigned char channel,
+                    unsigned int buf_packets, int irq_interval, double seconds)
+{
+    bench_result r;
+    memset(&r, 0, sizeof(r));
+
+    int rc = raw1394_iso_recv_init(handle,
+                                   my_iso_recv_handler,
+                                   buf_packets,   // buf_packets
+                                   PACKET_MAX,    // max_packet_size
+                                   channel,       // channel
+                                   mode,          // dma mode
+                                   irq_interval); // irq_interval
+    if (rc) {
+        perror("raw1394_iso_recv_init");
+        return r;
+    }
+    if (raw1394_iso_recv_start(handle, -1, -1, 0)) {
+        perror("raw1394_iso_recv_start");
+        raw1394_iso_shutdown(handle);
+        return r;
+    }
+
+    reset_counters();
+    const double wall0 = clock_sec(CLOCK_MONOTONIC);
+    const double cpu0 = clock_sec(CLOCK_PROCESS_CPUTIME_ID);
+    while (running && clock_sec(CLOCK_MONOTONIC) - wall0 < seconds) {
+        if (raw1394_loop_iterate(handle)) break;
+        r.wakeups++;
+    }
+    r.cpu_sec = clock_sec(CLOCK_PROCESS_CPUTIME_ID) - cpu0;
+    r.wall_sec = clock_sec(CLOCK_MONOTONIC) - wall0;
+
+    raw1394_iso_stop(handle);
+    raw1394_iso_shutdown(handle);
+
+    r.packets = bench_packets;
+    r.bytes = bench_bytes;
+    r.dropped = bench_dropped;
+    return r;
+}
+
+
+void print_header()
+{
+    printf("%-10s %7s %7s %7s %12s %9s %10s %10s %9s %10s\n",
+           "mode", "payload", "buf", "ring", "pkt/s", "MB/s", "cpu ns/pkt",
+           "wakeups", "pkt/wake", "dropped");
+}
+
+
+void print_result(const char *mode, unsigned int payload, unsigned int buf,
+                  const bench_result &r)
+{
+    char ring[16] = "-";
+    if (r.ring_packets) snprintf(ring, sizeof(ring), "%u", r.ring_packets);
+    printf("%-10s %7u %7u %7s %12.0f %9.2f %10.1f %10llu %9.1f %10llu\n",
+           mode, payload, buf, ring,
+           r.wall_sec > 0 ? r.packets / r.wall_sec : 0.0,
+           r.wall_sec > 0 ? r.bytes / r.wall_sec / 1e6 : 0.0,
+           r.packets ? r.cpu_sec * 1e9 / r.packets : 0.0,
+           r.wakeups,
+           r.wakeups ? (double)r.packets / r.wakeups : 0.0,
+           r.dropped);
+    fflush(stdout);
+}
+
+
+// parse a comma separated list of numbers
+std::vector<unsigned int> parse_list(const char *arg)
+{
+    std::vector<unsigned int> values;
+    const char *p = arg;
+    while (*p) {
+        values.push_back(strtoul(p, (char **)&p, 10));
+        if (*p == ',') p++;
+        else break;
+    }
+    return values;
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: bench_iso_recv [-h] [-n packets] [-r rate] [-S sizes] [-B buffers] [-i irq]\n"
+              << "       bench_iso_recv -H [-p port] [-c channel] [-d seconds] [-B buffers] [-i irq]\n"
+              << "    -h  show usage\n"
+              << "    -n  packets per point with the software source (default 200000)\n"
+              << "    -r  software source packet rate, 0 = unpaced (default 0)\n"
+              << "    -S  payload sizes in bytes (default 8,64,512,1024,4096)\n"
+              << "    -B  buf_packets values (default 64,256,1000,4000)\n"
+              << "    -i  irq_interval (default -1)\n"
+              << "    -H  use the real receiver instead of the software source\n"
+              << "    -p  specify port number\n"
+              << "    -c  iso channel to receive (default 5)\n"
+              << "    -d  seconds per point with -H (default 5)\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    unsigned char channel = 0x5;
+    bool hardware = false;
+    double seconds = 5.0;
+    double rate = 0.0;
+    int irq_interval = -1;
+    unsigned long long packets = 200000;
+    std::vector<unsigned int> sizes = parse_list("8,64,512,1024,4096");
+    std::vector<unsigned int> buffers = parse_list("64,256,1000,4000");
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hn:r:S:B:i:Hp:c:d:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'n':
+            packets = strtoull(optarg, 0, 10);
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 'S':
+            sizes = parse_list(optarg);
+            break;
+        case 'B':
+            buffers = parse_list(optarg);
+            break;
+        case 'i':
+            irq_interval = atoi(optarg);
+            break;
+        case 'H':
+            hardware = true;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'c':
+            channel = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atof(optarg);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+    const raw1394_iso_dma_recv_mode modes[] = {
+        RAW1394_DMA_PACKET_PER_BUFFER,
+        RAW1394_DMA_BUFFERFILL
+    };
+    const char *mode_names[] = { "ppb", "bufferfill" };
+
+
+    if (!hardware) {
+        printf("software packet source, %llu packets per point, %s, max_packet_size %d\n",
+               packets, rate > 0 ? "paced" : "unpaced (host cost only, not comparable to -H)",
+               PACKET_MAX);
+        print_header();
+        for (size_t s = 0; s < sizes.size() && running; s++) {
+            for (size_t b = 0; b < buffers.size() && running; b++) {
+                for (int m = 0; m < 2 && running; m++) {
+                    bench_result r = run_sim(modes[m], sizes[s], buffers[b],
+                                             irq_interval, rate, packets);
+                    print_result(mode_names[m], sizes[s], buffers[b], r);
+                }
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+
+
+    // ----- Get handle and set port for the handle -------
+    // create handle
+    handle = raw1394_new_handle();
+    if (handle == NULL) {
+        std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // get port number & sanity check
+    int numPorts = raw1394_get_port_info(handle, NULL, 0);
+    if (port < 0 || port >= numPorts) {
+        std::cerr << "Invalid port number" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // let user to choose which port to use
+    rc = raw1394_set_port(handle, port);
+    if (rc) {
+        std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    printf("channel %d, %.1f s per point, payload size set by the transmitter\n",
+           channel, seconds);
+    print_header();
+    for (size_t b = 0; b < buffers.size() && running; b++) {
+        for (int m = 0; m < 2 && running; m++) {
+            bench_result r = run_hw(modes[m], channel, buffers[b], irq_interval, seconds);
+            const unsigned int payload = r.packets ? (unsigned int)(r.bytes / r.packets) : 0;
+            print_result(mode_names[m], payload, buffers[b], r);
+        }
+    }
+
+    raw1394_destroy_handle(handle);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,490 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "iso_sim.h"
+#include "irm_alloc.h"
+
+
+#define MAX_PACKET 4096
+#define POOL_PACKETS 64          // distinct prebuilt payloads the handler cycles through
+#define MAX_SAMPLES 1000000      // handler and wakeup timings kept per point
+
+
+/**
+  * @brief: Benchmark: isochronous transmit throughput and jitter
+  *
+  *     Sweeps payload size x speed x buf_packets x irq_interval and runs the
+  *     callback transmitter (xmit handler copying from a prebuilt packet pool,
+  *     as in tutorial 12) for every point. Reported per point:
+  *         - sustained packets/s and MB/s, CPU time per packet (process clock)
+  *         - underruns: cycles the bus found the buffer empty
+  *         - handler latency p50/p99/max: time spent in one handler call
+  *         - wakeup jitter p99: how far the interval between two wakeups
+  *           strays from irq_interval cycles (paced runs only)
+  *         - bandwidth units the stream would need at the IRM; points above
+  *           IRM_BANDWIDTH_TOTAL cannot be allocated on a real bus
+  *     Payloads larger than the speed allows (1024 B at S100, 2048 B at S200)
+  *     are skipped.
+  *
+  *     By default the kernel is replaced by IsoSimXmit from iso_sim.h:
+  *         - bench_iso_xmit              unpaced, measures the host side cost
+  *         - bench_iso_xmit -r 8000      paced like a real bus, shows wakeup
+  *                                       jitter and underruns at each depth
+  *     With -H every point runs against the real transmitter for -d seconds;
+  *     run 5_iso_recv or 10_iso_recv_stats on another node to consume it.
+  *
+  * @date 2026-10-17
+  *
+  * @ref http://www.dennedy.org/libraw1394/id2640614.html
+  *
+  */
+
+
+struct bench_point
+{
+    unsigned int payload;
+    int speed;
+    unsigned int buf_packets;
+    int irq_interval;
+};
+
+
+struct bench_result
+{
+    unsigned long long packets;
+    unsigned long long bytes;
+    unsigned long long underruns;
+    unsigned long long wakeups;
+    double wall_sec;
+    double cpu_sec;
+    uint64_t handler_p50_ns;
+    uint64_t handler_p99_ns;
+    uint64_t handler_max_ns;
+    long long jitter_p99_ns;     /*!< -1 if not measured */
+};
+
+
+// Global variable fw handle
+raw1394handle_t handle;
+
+// prebuilt payloads and what the handler is sending
+std::vector<unsigned char> packet_pool(POOL_PACKETS * MAX_PACKET);
+unsigned int bench_payload = 4;
+
+// updated by the handler
+unsigned long long bench_packets = 0;
+unsigned long long bench_bytes = 0;
+unsigned long long bench_dropped = 0;
+std::vector<uint32_t> handler_samples;
+
+volatile sig_atomic_t running = 1;
+
+
+/* signal handler stops the sweep */
+void signal_handler(int sig) {
+    signal(SIGINT, SIG_DFL);
+    running = 0;
+}
+
+
+double clock_sec(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+raw1394_iso_disposition
+my_iso_xmit_handler(raw1394handle_t handle,
+                    unsigned char *data,
+                    unsigned int *len,
+                    unsigned char *tag,
+                    unsigned char *sy,
+                    int cycle, /* -1 if unknown */
+                    unsigned int dropped)
+{
+    const uint64_t start = iso_sim_now_ns();
+
+    memcpy(data, &packet_pool[(bench_packets % POOL_PACKETS) * MAX_PACKET], bench_payload);
+    *len = bench_payload;
+    *tag = 1;
+    *sy = 0;
+    bench_packets++;
+    bench_bytes += bench_payload;
+    bench_dropped += dropped;
+
+    if (handler_samples.size() < MAX_SAMPLES) {
+        handler_samples.push_back((uint32_t)(iso_sim_now_ns() - start));
+    }
+    return RAW1394_ISO_OK;
+}
+
+
+void reset_counters(unsigned int payload)
+{
+    bench_payload = payload;
+    bench_packets = bench_bytes = bench_dropped = 0;
+    handler_samples.clear();
+}
+
+
+// value below which @fraction of @samples fall, reorders @samples
+template <typename T>
+T percentile(std::vector<T> &samples, double fraction)
+{
+    if (samples.empty()) return 0;
+    size_t n = (size_t)(fraction * (samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + n, samples.end());
+    return samples[n];
+}
+
+
+// tracks the interval between wakeups against irq_interval cycles
+class WakeupJitter
+{
+public:
+    WakeupJitter(int irq_interval, double rate)
+        : expected_ns_(rate > 0 ? (long long)(irq_interval * 1e9 / rate) : 0), last_ns_(0)
+    {
+        samples_.reserve(MAX_SAMPLES);
+    }
+
+    void wakeup()
+    {
+        const uint64_t now = iso_sim_now_ns();
+        if (last_ns_ && expected_ns_ > 0 && samples_.size() < MAX_SAMPLES) {
+            const long long deviation = (long long)(now - last_ns_) - expected_ns_;
+            samples_.push_back(deviation < 0 ? -deviation : deviation);
+        }
+        last_ns_ = now;
+    }
+
+    long long p99() { return expected_ns_ > 0 ? percentile(samples_, 0.99) : -1; }
+
+private:
+    long long expected_ns_;
+    uint64_t last_ns_;
+    std::vector<long long> samples_;
+};
+
+
+void finish(bench_result &r, WakeupJitter &jitter)
+{
+    r.packets = bench_packets;
+    r.bytes = bench_bytes;
+    r.handler_max_ns = handler_samples.empty() ? 0 :
+            *std::max_element(handler_samples.begin(), handler_samples.end());
+    r.handler_p50_ns = percentile(handler_samples, 0.50);
+    r.handler_p99_ns = percentile(handler_samples, 0.99);
+    r.jitter_p99_ns = jitter.p99();
+}
+
+
+// one point against the software bus
+bench_result run_sim(const bench_point &p, double rate, unsigned long long packets)
+{
+    IsoSimConfig config;
+    config.buf_packets = p.buf_packets;
+    config.max_packet_size = MAX_PACKET;
+    config.irq_interval = p.irq_interval;
+    config.packet_rate = rate;
+    IsoSimXmit sim(my_iso_xmit_handler, config);
+    WakeupJitter jitter(p.irq_interval, rate);
+
+    bench_result r;
+    memset(&r, 0, sizeof(r));
+    reset_counters(p.payload);
+    const double wall0 = clock_sec(CLOCK_MONOTONIC);
+    const double cpu0 = clock_sec(CLOCK_PROCESS_CPUTIME_ID);
+    sim.start();
+    while (running && sim.sent() < packets) {
+        if (sim.iterate(NULL)) break;
+        jitter.wakeup();
+    }
+    r.cpu_sec = clock_sec(CLOCK_PROCESS_CPUTIME_ID) - cpu0;
+    r.wall_sec = clock_sec(CLOCK_MONOTONIC) - wall0;
+
+    r.underruns = sim.underruns();
+    r.wakeups = sim.wakeups();
+    finish(r, jitter);
+    // what reached the bus, not what sits prebuffered in the ring
+    r.packets = sim.sent();
+    r.bytes = r.packets * p.payload;
+    return r;
+}
+
+
+// one point against the real transmitter
+bench_result run_hw(const bench_point &p, unsigned char channel, double seconds)
+{
+    bench_result r;
+    memset(&r, 0, sizeof(r));
+    WakeupJitter jitter(p.irq_interval, ISO_SIM_CYCLES_PER_SEC);
+
+    int rc = raw1394_iso_xmit_init(handle,
+                                   my_iso_xmit_handler,
+                                   p.buf_packets,   // iso packets to buffer
+                                   MAX_PACKET,      // max packet size
+                                   channel,         // channel
+                                   (raw1394_iso_speed)p.speed,
+                                   p.irq_interval); // irq_interval
+    if (rc) {
+        perror("raw1394_iso_xmit_init");
+        return r;
+    }
+
+    reset_counters(p.payload);
+    if (raw1394_iso_xmit_start(handle, -1, -1)) {
+        perror("raw1394_iso_xmit_start");
+        raw1394_iso_shutdown(handle);
+        return r;
+    }
+
+    // prebuffering went through the handler already, count from here
+    const unsigned long long prebuffered = bench_packets;
+    const double wall0 = clock_sec(CLOCK_MONOTONIC);
+    const double cpu0 = clock_sec(CLOCK_PROCESS_CPUTIME_ID);
+    while (running && clock_sec(CLOCK_MONOTONIC) - wall0 < seconds) {
+        if (raw1394_loop_iterate(handle)) break;
+        jitter.wakeup();
+        r.wakeups++;
+    }
+    r.cpu_sec = clock_sec(CLOCK_PROCESS_CPUTIME_ID) - cpu0;
+    r.wall_sec = clock_sec(CLOCK_MONOTONIC) - wall0;
+
+    raw1394_iso_stop(handle);
+    raw1394_iso_shutdown(handle);
+
+    r.underruns = bench_dropped;
+    finish(r, jitter);
+    r.packets -= prebuffered;
+    r.bytes -= prebuffered * p.payload;
+    return r;
+}
+
+
+// largest isochronous payload at each speed
+unsigned int max_payload(int speed)
+{
+    return speed == RAW1394_ISO_SPEED_100 ? 1024 :
+           speed == RAW1394_ISO_SPEED_200 ? 2048 : 4096;
+}
+
+
+int speed_mbit(int speed)
+{
+    return 100 << speed;
+}
+
+
+void print_header()
+{
+    printf("%7s %5s %5s %4s %6s %10s %9s %10s %8s %8s %8s %8s %9s %9s\n",
+           "payload", "speed", "buf", "irq", "units", "pkt/s", "MB/s", "cpu ns/pkt",
+           "underrun", "hnd p50", "hnd p99", "hnd max", "jit p99us", "wakeups");
+}
+
+
+void print_result(const bench_point &p, const bench_result &r)
+{
+    const unsigned int units = irm_bandwidth_units(p.payload, p.speed);
+    char jitter[16] = "-";
+    if (r.jitter_p99_ns >= 0) snprintf(jitter, sizeof(jitter), "%.1f", r.jitter_p99_ns / 1e3);
+    printf("%7u %5d %5u %4d %5u%c %10.0f %9.2f %10.1f %8llu %8llu %8llu %8llu %9s %9llu\n",
+           p.payload, speed_mbit(p.speed), p.buf_packets, p.irq_interval,
+           units, units > IRM_BANDWIDTH_TOTAL ? '!' : ' ',
+           r.wall_sec > 0 ? r.packets / r.wall_sec : 0.0,
+           r.wall_sec > 0 ? r.bytes / r.wall_sec / 1e6 : 0.0,
+           r.packets ? r.cpu_sec * 1e9 / r.packets : 0.0,
+           r.underruns,
+           (unsigned long long)r.handler_p50_ns,
+           (unsigned long long)r.handler_p99_ns,
+           (unsigned long long)r.handler_max_ns,
+           jitter, r.wakeups);
+    fflush(stdout);
+}
+
+
+// parse a comma separated list of numbers
+std::vector<unsigned int> parse_list(const char *arg)
+{
+    std::vector<unsigned int> values;
+    const char *p = arg;
+    while (*p) {
+        values.push_back(strtoul(p, (char **)&p, 10));
+        if (*p == ',') p++;
+        else break;
+    }
+    return values;
+}
+
+
+void print_usage()
+{
+    std::cout << "Usage: bench_iso_xmit [-h] [-n packets] [-r rate] [-S sizes] [-V speeds]\n"
+              << "                      [-B buffers] [-I irqs]\n"
+              << "       bench_iso_xmit -H [-p port] [-c channel] [-d seconds] [...]\n"
+              << "    -h  show usage\n"
+              << "    -n  packets per point with the software bus (default 100000)\n"
+              << "    -r  software bus packet rate, 0 = unpaced (default 0)\n"
+              << "    -S  payload sizes in bytes (default 4,64,512,1024,2048,4096)\n"
+              << "    -V  speeds (default 100,200,400)\n"
+              << "    -B  buf_packets values (default 64,256,1000)\n"
+              << "    -I  irq_interval values (default 8,64,256)\n"
+              << "    -H  use the real transmitter instead of the software bus\n"
+              << "    -p  specify port number\n"
+              << "    -c  iso channel to transmit on (default 5)\n"
+              << "    -d  seconds per point with -H (default 3)\n"
+              << "    units column: IRM bandwidth units, '!' = more than a cycle holds\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    int rc; /**< return code */
+    int port = 0;  /*!< fw handle port number */
+    unsigned char channel = 0x5;
+    bool hardware = false;
+    double seconds = 3.0;
+    double rate = 0.0;
+    unsigned long long packets = 100000;
+    std::vector<unsigned int> sizes = parse_list("4,64,512,1024,2048,4096");
+    std::vector<unsigned int> speeds = parse_list("100,200,400");
+    std::vector<unsigned int> buffers = parse_list("64,256,1000");
+    std::vector<unsigned int> irqs = parse_list("8,64,256");
+
+    // parse command line (port number)
+    opterr = 0;  // getopt no err output
+    const char short_options[] = "hn:r:S:V:B:I:Hp:c:d:";
+    int next_opt;
+    do {
+        next_opt = getopt(argc, argv, short_options);
+        switch(next_opt)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+        case 'n':
+            packets = strtoull(optarg, 0, 10);
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 'S':
+            sizes = parse_list(optarg);
+            break;
+        case 'V':
+            speeds = parse_list(optarg);
+            break;
+        case 'B':
+            buffers = parse_list(optarg);
+            break;
+        case 'I':
+            irqs = parse_list(optarg);
+            break;
+        case 'H':
+            hardware = true;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'c':
+            channel = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atof(optarg);
+            break;
+        case '?':
+            std::cerr << "Invalid argument" << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+    while(next_opt != -1);
+
+
+    // Setup signal handler to exit on Ctrl-C
+    signal(SIGINT, signal_handler);
+
+    // every payload gets its own pattern so the copies are not trivially cached
+    for (size_t i = 0; i < packet_pool.size(); i++) packet_pool[i] = (unsigned char)(i * 7 + i / MAX_PACKET);
+    handler_samples.reserve(MAX_SAMPLES);
+
+    // all valid combinations
+    std::vector<bench_point> points;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        for (size_t v = 0; v < speeds.size(); v++) {
+            bench_point p;
+            p.payload = std::min(sizes[s], (unsigned int)MAX_PACKET) & ~3u;
+            p.speed = speeds[v] >= 400 ? RAW1394_ISO_SPEED_400 :
+                      speeds[v] >= 200 ? RAW1394_ISO_SPEED_200 : RAW1394_ISO_SPEED_100;
+            if (p.payload > max_payload(p.speed)) continue;
+            for (size_t b = 0; b < buffers.size(); b++) {
+                for (size_t i = 0; i < irqs.size(); i++) {
+                    p.buf_packets = buffers[b];
+                    p.irq_interval = irqs[i];
+                    if (p.irq_interval <= 0 || (unsigned int)p.irq_interval > p.buf_packets) continue;
+                    points.push_back(p);
+                }
+            }
+        }
+    }
+
+
+    if (!hardware) {
+        printf("software bus, %llu packets per point, %s, %zu points\n",
+               packets, rate > 0 ? "paced" : "unpaced", points.size());
+        print_header();
+        for (size_t i = 0; i < points.size() && running; i++) {
+            print_result(points[i], run_sim(points[i], rate, packets));
+        }
+        return EXIT_SUCCESS;
+    }
+
+
+    // ----- Get handle and set port for the handle -------
+    // create handle
+    handle = raw1394_new_handle();
+    if (handle == NULL) {
+        std::cerr << "**** Error: could not create 1394 handle " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // get port number & sanity check
+    int numPorts = raw1394_get_port_info(handle, NULL, 0);
+    if (port < 0 || port >= numPorts) {
+        std::cerr << "Invalid port number" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // let user to choose which port to use
+    rc = raw1394_set_port(handle, port);
+    if (rc) {
+        std::cerr << "**** Error: failed to set port " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    printf("channel %d, %.1f s per point, %zu points\n", channel, seconds, points.size());
+    print_header();
+    for (size_t i = 0; i < points.size() && running; i++) {
+        print_result(points[i], run_hw(points[i], channel, seconds));
+    }
+
+    raw1394_destroy_handle(handle);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,316 @@
+#ifndef EVENT_REACTOR_H
+#define EVENT_REACTOR_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <atomic>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+
+/**
+  * @brief: epoll reactor for 1394 handles, timers and eventfds
+  *
+  *     while (running) raw1394_loop_iterate(handle) blocks the thread in one
+  *     handle. 14_arm_worker_pool polls raw1394_get_fd next to an eventfd by
+  *     hand; EventReactor does that for any number of descriptors:
+  *         - add_handle(): raw1394_loop_iterate runs only when the handle's
+  *           fd is readable, its tag, ARM and bus reset handlers are called
+  *           from there as usual
+  *         - add_timer(): a timerfd, the callback gets the expirations
+  *         - add_event(): an eventfd other threads wake with notify(), the
+  *           callback gets the summed count
+  *         - add_fd(): anything else (sockets, pipes, ArmWorkerPool::fd()),
+  *           the callback gets the epoll event mask
+  *     One epoll_wait returns every ready descriptor, up to max_events, and
+  *     run_once() serves the whole batch before it waits again.
+  *
+  *     With set_busy_poll(true) the reactor never sleeps in the kernel: it
+  *     spins on epoll_wait with a zero timeout, trading a core for the
+  *     scheduler wake-up latency.
+  *
+  *     Single threaded: everything but notify() and stop() belongs to the
+  *     thread that runs the reactor. Descriptors may be removed from inside
+  *     a callback.
+  *
+  * @date 2026-10-17
+  */
+
+
+// @value: expirations (timer), count (eventfd) or epoll events (add_fd)
+typedef void (*reactor_callback_t)(int fd, uint64_t value, void *context);
+
+
+static inline uint64_t reactor_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+class EventReactor
+{
+public:
+    explicit EventReactor(unsigned int max_events = 64)
+        : events_(max_events ? max_events : 1), dispatching_(false), busy_poll_(false), stopped_(false),
+          wakeups_(0), served_(0), iterations_(0), empty_polls_(0), errors_(0), max_batch_(0)
+    {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    }
+
+    ~EventReactor()
+    {
+        for (size_t i = 0; i < entries_.size(); i++) release(entries_[i]);
+        if (epoll_fd_ >= 0) close(epoll_fd_);
+    }
+
+    bool valid() const { return epoll_fd_ >= 0; }
+
+    /**
+     * Serve @handle: raw1394_loop_iterate when its fd is readable, then
+     * @callback (may be NULL) with the value 1.
+     * Returns the fd or -1 (sets errno)
+     */
+    int add_handle(raw1394handle_t handle, reactor_callback_t callback = NULL, void *context = NULL)
+    {
+        const int fd = raw1394_get_fd(handle);
+        if (fd < 0) return -1;
+        return add(REACTOR_1394, fd, false, handle, callback, context, EPOLLIN);
+    }
+
+    // watch @fd for @events (EPOLLIN ...), it stays open after remove()
+    int add_fd(int fd, uint32_t events, reactor_callback_t callback, void *context)
+    {
+        return add(REACTOR_FD, fd, false, NULL, callback, context, events);
+    }
+
+    /**
+     * Timer firing @first_ns from now, then every @period_ns (0 = once).
+     * Returns its fd, for set_timer() and remove(), or -1 (sets errno)
+     */
+    int add_timer(uint64_t first_ns, uint64_t period_ns, reactor_callback_t callback, void *context)
+    {
+        const int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd < 0) return -1;
+        if (set_timer(fd, first_ns, period_ns) ||
+            add(REACTOR_TIMER, fd, true, NULL, callback, context, EPOLLIN) < 0) {
+            const int err = errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        return fd;
+    }
+
+    // re-arm timer @fd, @first_ns = 0 disarms it. Returns 0 or -1 (sets errno)
+    static int set_timer(int fd, uint64_t first_ns, uint64_t period_ns)
+    {
+        struct itimerspec spec;
+        spec.it_value.tv_sec = first_ns / 1000000000ULL;
+        spec.it_value.tv_nsec = first_ns % 1000000000ULL;
+        spec.it_interval.tv_sec = period_ns / 1000000000ULL;
+        spec.it_interval.tv_nsec = period_ns % 1000000000ULL;
+        return timerfd_settime(fd, 0, &spec, NULL);
+    }
+
+    // eventfd to wake the reactor from other threads with notify()
+    int add_event(reactor_callback_t callback, void *context)
+    {
+        const int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) return -1;
+        if (add(REACTOR_EVENT, fd, true, NULL, callback, context, EPOLLIN) < 0) {
+            const int err = errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        return fd;
+    }
+
+    // any thread, async signal safe. Returns 0 or -1 (sets errno)
+    static int notify(int fd, uint64_t count = 1)
+    {
+        return write(fd, &count, sizeof(count)) == sizeof(count) ? 0 : -1;
+    }
+
+    // stop watching @fd, closes the timers and eventfds the reactor made
+    int remove(int fd)
+    {
+        for (size_t i = 0; i < entries_.size(); i++) {
+            entry *e = entries_[i];
+            if (e->fd != fd) continue;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL);
+            entries_[i] = entries_.back();
+            entries_.pop_back();
+            if (dispatching_) {
+                e->kind = REACTOR_REMOVED;   // later events of this batch may point at it
+                removed_.push_back(e);
+            } else {
+                release(e);
+            }
+            return 0;
+        }
+        errno = ENOENT;
+        return -1;
+    }
+
+    void set_busy_poll(bool busy) { busy_poll_ = busy; }
+    bool busy_poll() const { return busy_poll_; }
+
+    /**
+     * Wait up to @timeout_ms (-1 = forever) for ready descriptors and serve
+     * all of them. Returns the number served or -1 (sets errno, EINTR when
+     * a signal interrupted the wait)
+     */
+    int run_once(int timeout_ms = -1)
+    {
+        int n;
+        if (busy_poll_) {
+            const uint64_t deadline = timeout_ms < 0 ? 0 : reactor_now_ns() + timeout_ms * 1000000ULL;
+            while ((n = epoll_wait(epoll_fd_, &events_[0], (int)events_.size(), 0)) == 0) {
+                empty_polls_++;
+                if (stopped_.load(std::memory_order_relaxed)) return 0;
+                if (deadline && reactor_now_ns() >= deadline) return 0;
+            }
+        } else {
+            n = epoll_wait(epoll_fd_, &events_[0], (int)events_.size(), timeout_ms);
+        }
+        if (n <= 0) return n;
+
+        wakeups_++;
+        if ((unsigned int)n > max_batch_) max_batch_ = n;
+        int failed = 0;
+        dispatching_ = true;
+        for (int i = 0; i < n; i++) {
+            if (dispatch((entry *)events_[i].data.ptr, events_[i].events)) failed = errno;
+        }
+        dispatching_ = false;
+        for (size_t i = 0; i < removed_.size(); i++) release(removed_[i]);
+        removed_.clear();
+        served_ += n;
+
+        if (failed) {
+            errno = failed;
+            return -1;
+        }
+        return n;
+    }
+
+    // serve until stop(). Returns 0 or -1 (sets errno)
+    int run()
+    {
+        while (!stopped_.load(std::memory_order_relaxed)) {
+            if (run_once(-1) < 0 && errno != EINTR) return -1;
+        }
+        return 0;
+    }
+
+    // from a callback; from another thread also notify() an eventfd to wake run()
+    void stop() { stopped_ = true; }
+    bool stopped() const { return stopped_; }
+
+    unsigned long long wakeups() const { return wakeups_; }          /*!< epoll_wait calls with events */
+    unsigned long long served() const { return served_; }            /*!< ready descriptors served */
+    unsigned long long iterations() const { return iterations_; }    /*!< raw1394_loop_iterate calls */
+    unsigned long long empty_polls() const { return empty_polls_; }  /*!< busy poll rounds with nothing */
+    unsigned long long errors() const { return errors_; }
+    unsigned int max_batch() const { return max_batch_; }
+    double mean_batch() const { return wakeups_ ? (double)served_ / wakeups_ : 0.0; }
+
+private:
+    enum { REACTOR_1394, REACTOR_FD, REACTOR_TIMER, REACTOR_EVENT, REACTOR_REMOVED };
+
+    struct entry
+    {
+        int kind;
+        int fd;
+        bool owned;                  /*!< close() on removal */
+        raw1394handle_t handle;
+        reactor_callback_t callback;
+        void *context;
+    };
+
+    int add(int kind, int fd, bool owned, raw1394handle_t handle,
+            reactor_callback_t callback, void *context, uint32_t events)
+    {
+        entry *e = new entry;
+        e->kind = kind;
+        e->fd = fd;
+        e->owned = owned;
+        e->handle = handle;
+        e->callback = callback;
+        e->context = context;
+
+        struct epoll_event ev;
+        ev.events = events;
+        ev.data.ptr = e;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev)) {
+            delete e;
+            return -1;
+        }
+        entries_.push_back(e);
+        return fd;
+    }
+
+    void release(entry *e)
+    {
+        if (e->owned) close(e->fd);
+        delete e;
+    }
+
+    // serve one ready descriptor. Returns 0 or -1 (sets errno)
+    int dispatch(entry *e, uint32_t events)
+    {
+        uint64_t value = events;
+        switch (e->kind) {
+        case REACTOR_REMOVED:
+            return 0;
+        case REACTOR_1394:
+            iterations_++;
+            if (raw1394_loop_iterate(e->handle)) {
+                errors_++;
+                return errno == EINTR || errno == EAGAIN ? 0 : -1;
+            }
+            value = 1;
+            break;
+        case REACTOR_TIMER:
+        case REACTOR_EVENT:
+            // the counter resets on read, both report it as one uint64_t
+            if (read(e->fd, &value, sizeof(value)) != sizeof(value)) {
+                if (errno == EAGAIN) return 0;
+                errors_++;
+                return -1;
+            }
+            break;
+        default:
+            break;
+        }
+        if (e->callback) e->callback(e->fd, value, e->context);
+        return 0;
+    }
+
+    int epoll_fd_;
+    std::vector<entry *> entries_;
+    std::vector<entry *> removed_;
+    std::vector<struct epoll_event> events_;
+    bool dispatching_;
+    bool busy_poll_;
+    std::atomic<bool> stopped_;
+
+    unsigned long long wakeups_;
+    unsigned long long served_;
+    unsigned long long iterations_;
+    unsigned long long empty_polls_;
+    unsigned long long errors_;
+    unsigned int max_batch_;
+};
+
+#endif // EVENT_REACTOR_H
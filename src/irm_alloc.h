@@ -0,0 +1,249 @@
+#ifndef IRM_ALLOC_H
+#define IRM_ALLOC_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+
+/**
+  * @brief: Isochronous resource (channel + bandwidth) allocation at the IRM
+  *
+  *     Every talker on a shared bus has to reserve its channel and its share
+  *     of the 125 us cycle at the isochronous resource manager (IRM), see
+  *     raw1394_get_irm_id. libraw1394 provides the compare-swap primitives
+  *     raw1394_channel_modify and raw1394_bandwidth_modify; this class keeps
+  *     track of what was allocated so it can be given back and re-claimed:
+  *         - bandwidth units are computed from payload size and speed
+  *         - a free channel is picked from CHANNELS_AVAILABLE, the preferred
+  *           channel first, 63 (broadcast) is never handed out
+  *         - a bus reset wipes the IRM registers. Talkers get one second to
+  *           re-allocate what they had before anybody may make new
+  *           allocations, so reclaim() must be called from the bus reset
+  *           handler, right after raw1394_update_generation
+  *         - allocate() holds new allocations back until that window closed
+  *
+  *     Allocations are not thread safe, use them from the thread that runs
+  *     raw1394_loop_iterate (the bus reset handler runs there too).
+  *
+  * @date 2026-10-17
+  */
+
+
+#define IRM_BANDWIDTH_TOTAL      4915   /*!< units per cycle after a bus reset */
+#define IRM_BANDWIDTH_OVERHEAD   512    /*!< per packet, gap and arbitration */
+#define IRM_BROADCAST_CHANNEL    63
+#define IRM_RECLAIM_WINDOW_NS    1000000000ULL
+
+
+/**
+ * Bandwidth allocation units for one packet per cycle. One unit is the time
+ * to send one quadlet at S1600 (about 20 ns); the packet adds header, header
+ * CRC and data CRC quadlets to the payload.
+ */
+inline unsigned int irm_bandwidth_units(unsigned int payload_bytes, int speed)
+{
+    const unsigned int quadlets = (payload_bytes + 3) / 4 + 3;
+    unsigned int per_quadlet = 16;   // S100
+    for (int s = RAW1394_ISO_SPEED_100; s < speed && per_quadlet > 1; s++) per_quadlet >>= 1;
+    return IRM_BANDWIDTH_OVERHEAD + quadlets * per_quadlet;
+}
+
+
+struct irm_stream
+{
+    unsigned int payload;    /*!< largest payload in bytes */
+    int speed;               /*!< raw1394_iso_speed */
+    int channel;             /*!< allocated channel, -1 if none */
+    unsigned int units;      /*!< allocated bandwidth units */
+    bool allocated;
+    bool changed;            /*!< channel moved during the last reclaim */
+};
+
+
+class IrmAllocator
+{
+public:
+    explicit IrmAllocator(raw1394handle_t handle)
+        : handle_(handle), reset_ns_(0), reclaim_ns_(0) {}
+    ~IrmAllocator() { release_all(); }
+
+    /**
+     * Reserve a channel and bandwidth for one stream.
+     * Returns a stream id or -1 on failure (sets errno, EBUSY when the IRM
+     * has no free channel or not enough bandwidth left).
+     */
+    int allocate(unsigned int payload_bytes, int speed, int preferred_channel = -1)
+    {
+        wait_reclaim_window();
+
+        irm_stream s;
+        s.payload = payload_bytes;
+        s.speed = speed;
+        s.channel = preferred_channel;
+        s.units = irm_bandwidth_units(payload_bytes, speed);
+        s.allocated = false;
+        s.changed = false;
+        if (claim(s)) return -1;
+
+        streams_.push_back(s);
+        return (int)streams_.size() - 1;
+    }
+
+    // Returns 0 on success or -1 on failure (sets errno)
+    int release(int id)
+    {
+        if (id < 0 || id >= (int)streams_.size()) {
+            errno = EINVAL;
+            return -1;
+        }
+        irm_stream &s = streams_[id];
+        if (!s.allocated) return 0;
+        s.allocated = false;
+        int rc = raw1394_bandwidth_modify(handle_, s.units, RAW1394_MODIFY_FREE);
+        rc |= raw1394_channel_modify(handle_, s.channel, RAW1394_MODIFY_FREE);
+        return rc ? -1 : 0;
+    }
+
+    void release_all()
+    {
+        for (size_t i = 0; i < streams_.size(); i++) release(i);
+    }
+
+    /**
+     * Re-allocate every stream after a bus reset, the previous channel is
+     * tried first. Call from the bus reset handler after
+     * raw1394_update_generation. Returns the number of streams that could
+     * not be re-allocated.
+     */
+    int reclaim()
+    {
+        reset_ns_ = now_ns();
+        int lost = 0;
+        for (size_t i = 0; i < streams_.size(); i++) {
+            irm_stream &s = streams_[i];
+            if (!s.allocated) continue;
+
+            // the IRM forgot about us, nothing to free
+            const int previous = s.channel;
+            s.allocated = false;
+            if (claim(s)) {
+                lost++;
+                continue;
+            }
+            if (s.channel != previous) s.changed = true;
+        }
+        reclaim_ns_ = now_ns() - reset_ns_;
+        return lost;
+    }
+
+    bool allocated(int id) const { return valid(id) && streams_[id].allocated; }
+    int channel(int id) const { return valid(id) ? streams_[id].channel : -1; }
+    unsigned int units(int id) const { return valid(id) ? streams_[id].units : 0; }
+
+    // true once after reclaim() moved the stream to another channel
+    bool take_changed(int id)
+    {
+        if (!valid(id) || !streams_[id].changed) return false;
+        streams_[id].changed = false;
+        return true;
+    }
+
+    // time the last reclaim() took, must stay well below one second
+    uint64_t reclaim_ns() const { return reclaim_ns_; }
+
+    /**
+     * Read CHANNELS_AVAILABLE from the IRM, bit N set = channel N is free.
+     * Returns 0 on success or -1 on failure (sets errno)
+     */
+    int available_channels(uint64_t *mask)
+    {
+        quadlet_t hi, lo;
+        const nodeid_t irm = raw1394_get_irm_id(handle_);
+        if (raw1394_read(handle_, irm, CSR_REGISTER_BASE + CSR_CHANNELS_AVAILABLE_HI, 4, &hi) ||
+            raw1394_read(handle_, irm, CSR_REGISTER_BASE + CSR_CHANNELS_AVAILABLE_LO, 4, &lo))
+            return -1;
+
+        // on the wire the most significant bit of HI is channel 0
+        const uint64_t wire = ((uint64_t)ntohl(hi) << 32) | ntohl(lo);
+        *mask = 0;
+        for (int ch = 0; ch < 64; ch++) {
+            if (wire & (1ULL << (63 - ch))) *mask |= 1ULL << ch;
+        }
+        return 0;
+    }
+
+    // Read BANDWIDTH_AVAILABLE from the IRM, 0 on success or -1 (sets errno)
+    int available_bandwidth(unsigned int *units)
+    {
+        quadlet_t bw;
+        if (raw1394_read(handle_, raw1394_get_irm_id(handle_),
+                         CSR_REGISTER_BASE + CSR_BANDWIDTH_AVAILABLE, 4, &bw))
+            return -1;
+        *units = ntohl(bw) & 0x1fff;
+        return 0;
+    }
+
+private:
+    bool valid(int id) const { return id >= 0 && id < (int)streams_.size(); }
+
+    // bandwidth first, then s.channel if set, then any free channel
+    int claim(irm_stream &s)
+    {
+        if (raw1394_bandwidth_modify(handle_, s.units, RAW1394_MODIFY_ALLOC)) {
+            errno = EBUSY;
+            return -1;
+        }
+
+        if (s.channel >= 0 && s.channel < IRM_BROADCAST_CHANNEL &&
+            raw1394_channel_modify(handle_, s.channel, RAW1394_MODIFY_ALLOC) == 0) {
+            s.allocated = true;
+            return 0;
+        }
+
+        // if the IRM cannot be read, just try every channel
+        uint64_t mask;
+        if (available_channels(&mask)) mask = ~0ULL;
+        for (int ch = 0; ch < IRM_BROADCAST_CHANNEL; ch++) {
+            if (ch == s.channel || !(mask & (1ULL << ch))) continue;
+            if (raw1394_channel_modify(handle_, ch, RAW1394_MODIFY_ALLOC) == 0) {
+                s.channel = ch;
+                s.allocated = true;
+                return 0;
+            }
+        }
+
+        raw1394_bandwidth_modify(handle_, s.units, RAW1394_MODIFY_FREE);
+        errno = EBUSY;
+        return -1;
+    }
+
+    // new allocations must not compete with reclaims after a bus reset
+    void wait_reclaim_window()
+    {
+        if (reset_ns_ == 0) return;
+        const uint64_t elapsed = now_ns() - reset_ns_;
+        if (elapsed < IRM_RECLAIM_WINDOW_NS) usleep((IRM_RECLAIM_WINDOW_NS - elapsed) / 1000);
+    }
+
+    static uint64_t now_ns()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    raw1394handle_t handle_;
+    std::vector<irm_stream> streams_;
+    uint64_t reset_ns_;     /*!< last bus reset, 0 if none seen */
+    uint64_t reclaim_ns_;
+};
+
+#endif // IRM_ALLOC_H
@@ -0,0 +1,587 @@
+#ifndef ISO_CAPTURE_H
+#define ISO_CAPTURE_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "spsc_ring.h"
+
+
+/**
+  * @brief: Append-only isochronous capture file
+  *
+  *     File layout (all little endian, host order):
+  *
+  *         +------------------------+  0
+  *         | iso_capture_header     |  padded to ISO_CAPTURE_HEADER_SIZE
+  *         +------------------------+  ISO_CAPTURE_HEADER_SIZE
+  *         | block 0                |  block_size bytes
+  *         |   iso_capture_block    |
+  *         |   record, record, ...  |  records never cross a block
+  *         +------------------------+
+  *         | block 1 ...            |
+  *         +------------------------+
+  *         | index (optional)       |  one iso_capture_index per block written
+  *         +------------------------+
+  *
+  *     Each record is an iso_capture_record followed by its payload, padded
+  *     to 8 bytes. Blocks are fixed size and block aligned, so they can be
+  *     written with O_DIRECT and block N always lives at a known offset.
+  *
+  *     The sparse index is written on close. If the capture was killed the
+  *     reader falls back to a binary search over the block headers, which
+  *     carry the same information, so seeking never scans the records.
+  *
+  *     The writer side is split in two:
+  *         - record() runs inside the iso receive handler. It only copies
+  *           into a preallocated block and hands full blocks to a ring.
+  *           When no free block is left the packet is counted as lost,
+  *           the handler never waits for the disk.
+  *         - a writer thread does the large sequential writes and returns
+  *           the blocks to the free ring.
+  *
+  * @date 2026-10-17
+  */
+
+
+#define ISO_CAPTURE_MAGIC          "ISOCAP01"
+#define ISO_CAPTURE_BLOCK_MAGIC    0x4b4c4243   /* "CBLK" */
+#define ISO_CAPTURE_VERSION        1
+#define ISO_CAPTURE_HEADER_SIZE    4096
+#define ISO_CAPTURE_BLOCK_SIZE     (256 * 1024)
+#define ISO_CAPTURE_CYCLES         8000   /*!< bus cycles per second */
+
+
+struct iso_capture_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t block_size;
+    uint32_t reserved;
+    uint64_t start_realtime_ns;  /*!< wall clock at capture start */
+    uint64_t num_blocks;         /*!< valid once closed */
+    uint64_t num_packets;        /*!< valid once closed */
+    uint64_t index_offset;       /*!< 0 if no index was written */
+    uint64_t index_entries;
+};
+
+struct iso_capture_block
+{
+    uint32_t magic;
+    uint32_t num_records;
+    uint32_t used_bytes;         /*!< including this header */
+    uint32_t reserved;
+    uint64_t block_no;
+    uint64_t first_seq;          /*!< packet number of the first record */
+    uint64_t first_time_ns;      /*!< since capture start */
+    uint64_t first_cycle;        /*!< unwrapped cycle count, see iso_capture_record */
+    uint64_t last_time_ns;
+    uint64_t reserved2;
+};
+
+struct iso_capture_record
+{
+    uint64_t time_ns;            /*!< since capture start */
+    uint32_t seq;                /*!< low 32 bits of the packet number */
+    uint32_t dropped;            /*!< as reported by the receive handler */
+    uint16_t len;                /*!< payload bytes following this header */
+    uint16_t cycle;              /*!< bus cycle, 0 - 7999 */
+    uint8_t channel;
+    uint8_t tag;
+    uint8_t sy;
+    uint8_t reserved;
+};
+
+struct iso_capture_index
+{
+    uint64_t first_time_ns;
+    uint64_t first_cycle;
+    uint64_t first_seq;
+    uint64_t block_no;
+};
+
+
+// size a record takes in a block
+static inline size_t iso_capture_record_size(unsigned int len)
+{
+    return sizeof(iso_capture_record) + ((len + 7) & ~7u);
+}
+
+
+class IsoCaptureWriter
+{
+public:
+    /**
+     * @num_blocks: number of preallocated blocks, i.e. how far the disk may lag
+     */
+    explicit IsoCaptureWriter(size_t num_blocks = 32)
+        : fd_(-1), num_blocks_(0), pool_size_(num_blocks),
+          full_(num_blocks), free_(num_blocks), current_(NULL),
+          seq_(0), last_cycle_(-1), cycle_wraps_(0), start_ns_(0), running_(false),
+          lost_(0), blocks_written_(0), write_errors_(0), write_errno_(0) {}
+
+    ~IsoCaptureWriter() { close(); }
+
+    /**
+     * Create the capture file and start the writer thread.
+     * @direct: try O_DIRECT, silently falls back if the file system refuses it
+     * Returns 0 on success or -1 on failure (sets errno)
+     */
+    int open(const char *path, bool direct = true)
+    {
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+        fd_ = -1;
+        if (direct) fd_ = ::open(path, flags | O_DIRECT, 0644);
+        if (fd_ < 0) fd_ = ::open(path, flags, 0644);
+        if (fd_ < 0) return -1;
+
+        // every block is handed around by pointer, allocate them all up front
+        for (size_t i = 0; i < pool_size_; i++) {
+            void *mem = NULL;
+            if (posix_memalign(&mem, ISO_CAPTURE_HEADER_SIZE, ISO_CAPTURE_BLOCK_SIZE)) {
+                errno = ENOMEM;
+                return -1;
+            }
+            memset(mem, 0, ISO_CAPTURE_BLOCK_SIZE);
+            blocks_.push_back((unsigned char *)mem);
+            free_.push((unsigned char *)mem);
+        }
+
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        start_realtime_ns_ = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        start_ns_ = now_ns();
+
+        // placeholder header, rewritten on close
+        if (write_header(0, 0)) return -1;
+
+        running_ = true;
+        writer_ = std::thread(&IsoCaptureWriter::writer_thread, this);
+        return 0;
+    }
+
+    /**
+     * Hot path, call from the iso receive handler. Never blocks.
+     */
+    void record(const unsigned char *data, unsigned int len,
+                unsigned char channel, unsigned char tag, unsigned char sy,
+                unsigned int cycle, unsigned int dropped)
+    {
+        const size_t rec_size = iso_capture_record_size(len);
+        if (rec_size > ISO_CAPTURE_BLOCK_SIZE - sizeof(iso_capture_block)) {
+            lost_.store(lost_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+
+        // unwrap the 8000 Hz cycle counter so the index is monotonic, this
+        // assumes the stream is never silent for a full second
+        if (last_cycle_ >= 0 && (int)cycle < last_cycle_) cycle_wraps_++;
+        last_cycle_ = cycle;
+        const uint64_t ext_cycle = cycle_wraps_ * ISO_CAPTURE_CYCLES + cycle;
+        const uint64_t t = now_ns() - start_ns_;
+
+        if (current_ != NULL) {
+            iso_capture_block *blk = (iso_capture_block *)current_;
+            if (blk->used_bytes + rec_size > ISO_CAPTURE_BLOCK_SIZE) {
+                full_.push(current_);   // cannot fail, same number of slots as blocks
+                current_ = NULL;
+            }
+        }
+        if (current_ == NULL) {
+            if (!free_.pop(current_)) {
+                // disk is behind, drop instead of stalling the DMA loop
+                current_ = NULL;
+                lost_.store(lost_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                seq_++;
+                return;
+            }
+            iso_capture_block *blk = (iso_capture_block *)current_;
+            memset(blk, 0, sizeof(*blk));
+            blk->magic = ISO_CAPTURE_BLOCK_MAGIC;
+            blk->used_bytes = sizeof(iso_capture_block);
+            blk->block_no = num_blocks_++;
+            blk->first_seq = seq_;
+            blk->first_time_ns = t;
+            blk->first_cycle = ext_cycle;
+        }
+
+        iso_capture_block *blk = (iso_capture_block *)current_;
+        iso_capture_record *rec = (iso_capture_record *)(current_ + blk->used_bytes);
+        rec->time_ns = t;
+        rec->seq = (uint32_t)seq_;
+        rec->dropped = dropped;
+        rec->len = len;
+        rec->cycle = cycle;
+        rec->channel = channel;
+        rec->tag = tag;
+        rec->sy = sy;
+        rec->reserved = 0;
+        memcpy(rec + 1, data, len);
+
+        blk->used_bytes += rec_size;
+        blk->num_records++;
+        blk->last_time_ns = t;
+        seq_++;
+    }
+
+    /**
+     * Flush the partial block, write the index and the final header.
+     * Call from the same thread as record(), after the receive loop stopped.
+     * Returns 0, or -1 if anything failed to reach the file, including a
+     * block the writer thread could not write (sets errno)
+     */
+    int close()
+    {
+        if (fd_ < 0) return 0;
+
+        if (current_ != NULL) {
+            full_.push(current_);
+            current_ = NULL;
+        }
+        running_ = false;
+        if (writer_.joinable()) writer_.join();
+
+        // index and header are small and unaligned, leave O_DIRECT mode
+        int rc = 0;
+        int flags = fcntl(fd_, F_GETFL);
+        fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+
+        const uint64_t index_offset = ISO_CAPTURE_HEADER_SIZE +
+                (uint64_t)num_blocks_ * ISO_CAPTURE_BLOCK_SIZE;
+        if (!index_.empty()) {
+            const size_t bytes = index_.size() * sizeof(iso_capture_index);
+            if (pwrite(fd_, &index_[0], bytes, index_offset) != (ssize_t)bytes) rc = -1;
+        }
+        if (write_header(index_.empty() ? 0 : index_offset, index_.size())) rc = -1;
+        if (fsync(fd_)) rc = -1;
+        const int err = rc ? errno : write_errno_.load(std::memory_order_relaxed);
+        ::close(fd_);
+        fd_ = -1;
+
+        for (size_t i = 0; i < blocks_.size(); i++) free(blocks_[i]);
+        blocks_.clear();
+        if (err) {
+            errno = err;
+            return -1;
+        }
+        return rc;
+    }
+
+    uint64_t packets() const { return seq_; }
+    uint64_t lost() const { return lost_.load(std::memory_order_relaxed); }
+    uint64_t blocks_written() const { return blocks_written_.load(std::memory_order_relaxed); }
+    uint64_t write_errors() const { return write_errors_.load(std::memory_order_relaxed); }
+    size_t backlog() const { return full_.size(); }
+
+private:
+    static uint64_t now_ns()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    int write_header(uint64_t index_offset, uint64_t index_entries)
+    {
+        // one aligned block so it also works with O_DIRECT
+        void *mem = NULL;
+        if (posix_memalign(&mem, ISO_CAPTURE_HEADER_SIZE, ISO_CAPTURE_HEADER_SIZE)) {
+            errno = ENOMEM;
+            return -1;
+        }
+        memset(mem, 0, ISO_CAPTURE_HEADER_SIZE);
+        iso_capture_header *hdr = (iso_capture_header *)mem;
+        memcpy(hdr->magic, ISO_CAPTURE_MAGIC, sizeof(hdr->magic));
+        hdr->version = ISO_CAPTURE_VERSION;
+        hdr->header_size = ISO_CAPTURE_HEADER_SIZE;
+        hdr->block_size = ISO_CAPTURE_BLOCK_SIZE;
+        hdr->start_realtime_ns = start_realtime_ns_;
+        hdr->num_blocks = num_blocks_;
+        hdr->num_packets = seq_;
+        hdr->index_offset = index_offset;
+        hdr->index_entries = index_entries;
+        ssize_t n = pwrite(fd_, mem, ISO_CAPTURE_HEADER_SIZE, 0);
+        free(mem);
+        return (n == ISO_CAPTURE_HEADER_SIZE) ? 0 : -1;
+    }
+
+    void writer_thread()
+    {
+        while (true) {
+            unsigned char *block;
+            if (!full_.pop(block)) {
+                if (!running_.load()) {
+                    if (!full_.pop(block)) break;  // drained
+                } else {
+                    usleep(1000);
+                    continue;
+                }
+            }
+
+            const iso_capture_block *blk = (const iso_capture_block *)block;
+
+            // clear the tail so a short final block does not carry stale records
+            memset(block + blk->used_bytes, 0, ISO_CAPTURE_BLOCK_SIZE - blk->used_bytes);
+            const off_t offset = ISO_CAPTURE_HEADER_SIZE + (off_t)blk->block_no * ISO_CAPTURE_BLOCK_SIZE;
+            const ssize_t n = pwrite(fd_, block, ISO_CAPTURE_BLOCK_SIZE, offset);
+            if (n != ISO_CAPTURE_BLOCK_SIZE) {
+                // the block is a hole in the file, keep it out of the index
+                int expected = 0;
+                write_errno_.compare_exchange_strong(expected, n < 0 ? errno : EIO);
+                write_errors_.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                iso_capture_index entry;
+                entry.first_time_ns = blk->first_time_ns;
+                entry.first_cycle = blk->first_cycle;
+                entry.first_seq = blk->first_seq;
+                entry.block_no = blk->block_no;
+                index_.push_back(entry);
+                blocks_written_.fetch_add(1, std::memory_order_relaxed);
+            }
+            free_.push(block);
+        }
+    }
+
+    int fd_;
+    uint64_t num_blocks_;
+    size_t pool_size_;
+    std::vector<unsigned char *> blocks_;
+    SpscRing<unsigned char *> full_;   /*!< handler -> writer thread */
+    SpscRing<unsigned char *> free_;   /*!< writer thread -> handler */
+    unsigned char *current_;           /*!< block being filled by the handler */
+    std::vector<iso_capture_index> index_;  /*!< writer thread only */
+
+    uint64_t seq_;
+    int last_cycle_;
+    uint64_t cycle_wraps_;
+    uint64_t start_ns_;
+    uint64_t start_realtime_ns_;
+    std::atomic<bool> running_;
+    std::thread writer_;
+
+    std::atomic<uint64_t> lost_;
+    std::atomic<uint64_t> blocks_written_;
+    std::atomic<uint64_t> write_errors_;
+    std::atomic<int> write_errno_;      /*!< of the first failed block write */
+};
+
+
+class IsoCaptureReader
+{
+public:
+    IsoCaptureReader() : base_(NULL), size_(0), header_(NULL), index_(NULL), num_blocks_(0),
+                         block_(0), offset_(0), record_in_block_(0) {}
+    ~IsoCaptureReader() { close(); }
+
+    // Returns 0 on success or -1 on failure (sets errno)
+    int open(const char *path)
+    {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return -1;
+        struct stat st;
+        if (fstat(fd, &st) || (size_t)st.st_size < ISO_CAPTURE_HEADER_SIZE) {
+            ::close(fd);
+            errno = EINVAL;
+            return -1;
+        }
+        void *mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mem == MAP_FAILED) return -1;
+
+        base_ = (const unsigned char *)mem;
+        size_ = st.st_size;
+        header_ = (const iso_capture_header *)base_;
+        if (memcmp(header_->magic, ISO_CAPTURE_MAGIC, sizeof(header_->magic)) ||
+            header_->block_size == 0) {
+            close();
+            errno = EINVAL;
+            return -1;
+        }
+
+        if (header_->index_offset &&
+            header_->index_offset + header_->index_entries * sizeof(iso_capture_index) <= size_) {
+            index_ = (const iso_capture_index *)(base_ + header_->index_offset);
+            num_blocks_ = header_->index_entries;
+        } else {
+            // capture did not finish, trust whatever full blocks made it to disk
+            index_ = NULL;
+            num_blocks_ = (size_ - header_->header_size) / header_->block_size;
+            while (num_blocks_ > 0 && block(num_blocks_ - 1)->magic != ISO_CAPTURE_BLOCK_MAGIC)
+                num_blocks_--;
+        }
+        rewind();
+        return 0;
+    }
+
+    void close()
+    {
+        if (base_) munmap((void *)base_, size_);
+        base_ = NULL;
+        header_ = NULL;
+        index_ = NULL;
+        num_blocks_ = 0;
+    }
+
+    const iso_capture_header &header() const { return *header_; }
+    uint64_t num_blocks() const { return num_blocks_; }
+    bool has_index() const { return index_ != NULL; }
+
+    void rewind() { block_ = 0; offset_ = sizeof(iso_capture_block); record_in_block_ = 0; }
+
+    // position on the first packet at or after @time_ns (since capture start)
+    void seek_time(uint64_t time_ns)
+    {
+        seek_block(find_block(time_ns, &IsoCaptureReader::block_time));
+        const iso_capture_record *rec;
+        while ((rec = peek()) != NULL && rec->time_ns < time_ns) advance();
+    }
+
+    // position on the first packet at or after unwrapped cycle @cycle
+    void seek_cycle(uint64_t cycle)
+    {
+        seek_block(find_block(cycle, &IsoCaptureReader::block_cycle));
+        while (peek() != NULL && current_cycle_ < cycle) advance();
+    }
+
+    /**
+     * Return the next record and its payload, NULL at end of file.
+     * Pointers stay valid until close().
+     */
+    const iso_capture_record *next(const unsigned char **payload)
+    {
+        const iso_capture_record *rec = peek();
+        if (rec == NULL) return NULL;
+        if (payload) *payload = (const unsigned char *)(rec + 1);
+        record_cycle_ = current_cycle_;
+        advance();
+        return rec;
+    }
+
+    // unwrapped cycle of the record last returned by next()
+    uint64_t record_cycle() const { return record_cycle_; }
+
+    // block the cursor is in, for prefetching ahead of it
+    uint64_t current_block() const { return block_; }
+
+    /**
+     * Fault in blocks [first, first + count) so a reader running on a
+     * deadline does not stall on disk. Safe to call from another thread.
+     * Returns the number of blocks touched.
+     */
+    uint64_t prefetch(uint64_t first, uint64_t count) const
+    {
+        if (first >= num_blocks_) return 0;
+        if (count > num_blocks_ - first) count = num_blocks_ - first;
+        const unsigned char *start = (const unsigned char *)block_at(first);
+        const size_t len = (block_no(first + count - 1) - block_no(first) + 1) * header_->block_size;
+        const long page = sysconf(_SC_PAGESIZE);
+
+        // madvise wants a page aligned start, blocks are only block aligned
+        const uintptr_t aligned = (uintptr_t)start & ~(uintptr_t)(page - 1);
+        madvise((void *)aligned, len + ((uintptr_t)start - aligned), MADV_WILLNEED);
+
+        // and touch every page so the mapping is populated, not just cached
+        volatile unsigned char sink = 0;
+        for (size_t off = 0; off < len; off += page) sink += start[off];
+        (void)sink;
+        return count;
+    }
+
+private:
+    const iso_capture_block *block(uint64_t n) const
+    {
+        return (const iso_capture_block *)(base_ + header_->header_size + n * header_->block_size);
+    }
+
+    // file position of the n-th block, the index leaves out blocks that failed to write
+    uint64_t block_no(uint64_t n) const { return index_ ? index_[n].block_no : n; }
+    const iso_capture_block *block_at(uint64_t n) const { return block(block_no(n)); }
+
+    uint64_t block_time(uint64_t n) const
+    {
+        return index_ ? index_[n].first_time_ns : block(n)->first_time_ns;
+    }
+
+    uint64_t block_cycle(uint64_t n) const
+    {
+        return index_ ? index_[n].first_cycle : block(n)->first_cycle;
+    }
+
+    // last block whose first key is <= key, binary search, no record scan
+    uint64_t find_block(uint64_t key, uint64_t (IsoCaptureReader::*first_key)(uint64_t) const) const
+    {
+        if (num_blocks_ == 0) return 0;
+        uint64_t lo = 0, hi = num_blocks_;
+        while (hi - lo > 1) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if ((this->*first_key)(mid) <= key) lo = mid;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    void seek_block(uint64_t n)
+    {
+        block_ = n;
+        offset_ = sizeof(iso_capture_block);
+        record_in_block_ = 0;
+        if (n < num_blocks_) {
+            current_cycle_ = block_at(n)->first_cycle;
+            last_cycle_ = current_cycle_ % ISO_CAPTURE_CYCLES;
+        }
+    }
+
+    const iso_capture_record *peek()
+    {
+        while (block_ < num_blocks_) {
+            const iso_capture_block *blk = block_at(block_);
+            if (blk->magic == ISO_CAPTURE_BLOCK_MAGIC && record_in_block_ < blk->num_records) {
+                const iso_capture_record *rec =
+                        (const iso_capture_record *)((const unsigned char *)blk + offset_);
+                // keep the unwrapped cycle in step with the writer
+                if (rec->cycle < last_cycle_) current_cycle_ += ISO_CAPTURE_CYCLES;
+                current_cycle_ += rec->cycle;
+                current_cycle_ -= last_cycle_;
+                last_cycle_ = rec->cycle;
+                return rec;
+            }
+            seek_block(block_ + 1);
+        }
+        return NULL;
+    }
+
+    void advance()
+    {
+        const iso_capture_record *rec =
+                (const iso_capture_record *)((const unsigned char *)block_at(block_) + offset_);
+        offset_ += iso_capture_record_size(rec->len);
+        record_in_block_++;
+    }
+
+    const unsigned char *base_;
+    size_t size_;
+    const iso_capture_header *header_;
+    const iso_capture_index *index_;   /*!< NULL if the capture was not closed */
+    uint64_t num_blocks_;
+
+    // cursor
+    uint64_t block_;
+    size_t offset_;
+    uint32_t record_in_block_;
+    uint64_t current_cycle_ = 0;
+    unsigned int last_cycle_ = 0;
+    uint64_t record_cycle_ = 0;
+};
+
+#endif // ISO_CAPTURE_H
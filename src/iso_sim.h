@@ -0,0 +1,341 @@
+#ifndef ISO_SIM_H
+#define ISO_SIM_H
+
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+
+
+/**
+  * @brief: Software stand-in for the kernel isochronous receive/transmit path
+  *
+  *     IsoSimRecv drives a raw1394_iso_recv_handler_t the way raw1394_loop_iterate
+  *     does, so the tutorials and benchmarks can run without a FireWire card.
+  *         - packets are staged in a preallocated "DMA" ring of buf_packets slots
+  *         - one iterate() call is one wakeup and delivers up to irq_interval packets
+  *         - RAW1394_DMA_BUFFERFILL packs packets back to back (header + payload)
+  *           into the same number of bytes, so small packets get a deeper ring
+  *           and irq_interval counts max_packet_size chunks instead of packets
+  *         - when paced, packets that do not fit in the ring are dropped and
+  *           reported through the handler's dropped argument, like the kernel does
+  *
+  * @date 2026-10-17
+  */
+
+
+#define ISO_SIM_CYCLES_PER_SEC 8000
+
+
+// monotonic time in nanoseconds
+static inline uint64_t iso_sim_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+struct IsoSimConfig
+{
+    unsigned int buf_packets;      /*!< DMA ring depth, same meaning as in raw1394_iso_recv_init */
+    unsigned int max_packet_size;  /*!< slot size in bytes */
+    int irq_interval;              /*!< packets per wakeup, -1 picks buf_packets / 4 */
+    unsigned int payload_len;      /*!< bytes per generated packet */
+    double packet_rate;            /*!< packets per second, 0 delivers as fast as possible */
+    std::vector<unsigned char> channels;  /*!< channels to rotate through */
+    unsigned int skip_every;       /*!< skip one bus cycle every N packets, 0 = never */
+    raw1394_iso_dma_recv_mode mode;
+
+    IsoSimConfig()
+        : buf_packets(1000), max_packet_size(4096), irq_interval(-1),
+          payload_len(64), packet_rate(ISO_SIM_CYCLES_PER_SEC), channels(1, 0x5),
+          skip_every(0), mode(RAW1394_DMA_DEFAULT) {}
+};
+
+
+class IsoSimRecv
+{
+public:
+    IsoSimRecv(raw1394_iso_recv_handler_t handler, const IsoSimConfig &config)
+        : handler_(handler), config_(config),
+          ring_((size_t)config.buf_packets * config.max_packet_size),
+          seq_(0), dropped_pending_(0), start_ns_(0), skipped_cycles_(0),
+          dropped_(0), wakeups_(0)
+    {
+        if (config_.irq_interval <= 0) {
+            config_.irq_interval = config_.buf_packets / 4;
+            if (config_.irq_interval == 0) config_.irq_interval = 1;
+        }
+        if (config_.payload_len > config_.max_packet_size)
+            config_.payload_len = config_.max_packet_size;
+        if (config_.channels.empty())
+            config_.channels.push_back(0x5);
+
+        slot_size_ = config_.max_packet_size;
+        slots_ = config_.buf_packets;
+        batch_ = config_.irq_interval;
+        if (config_.mode == RAW1394_DMA_BUFFERFILL) {
+            // header quadlet + payload + trailer quadlet, packed
+            slot_size_ = ((config_.payload_len + 3) & ~3u) + 8;
+            slots_ = ring_.size() / slot_size_;
+            batch_ = (unsigned int)((uint64_t)config_.irq_interval * config_.max_packet_size / slot_size_);
+            if (batch_ > slots_ / 2) batch_ = slots_ / 2;
+            if (batch_ == 0) batch_ = 1;
+        }
+        // fill a recognizable pattern once, only the sequence quadlet changes later
+        for (size_t i = 0; i < ring_.size(); i++)
+            ring_[i] = (unsigned char)i;
+    }
+
+    /**
+     * One simulated wakeup, same contract as raw1394_loop_iterate:
+     * returns 0 on success, -1 when the handler asked to stop or failed.
+     */
+    int iterate(raw1394handle_t handle)
+    {
+        const unsigned int batch = batch_;
+        if (start_ns_ == 0) start_ns_ = iso_sim_now_ns();
+
+        if (config_.packet_rate > 0) {
+            // sleep until the next irq_interval packets have "arrived" on the bus
+            const uint64_t period_ns = (uint64_t)(1e9 / config_.packet_rate);
+            const uint64_t due_ns = start_ns_ + (seq_ + dropped_ + batch) * period_ns;
+            uint64_t now = iso_sim_now_ns();
+            if (now < due_ns) {
+                struct timespec ts;
+                ts.tv_sec = (due_ns - now) / 1000000000ULL;
+                ts.tv_nsec = (due_ns - now) % 1000000000ULL;
+                nanosleep(&ts, NULL);
+                now = iso_sim_now_ns();
+            }
+            // anything beyond the ring depth was overwritten while we slept
+            const uint64_t arrived = (now - start_ns_) / period_ns;
+            const uint64_t backlog = arrived - seq_ - dropped_;
+            if (backlog > slots_) {
+                const uint64_t lost = backlog - slots_;
+                dropped_ += lost;
+                dropped_pending_ += (unsigned int)lost;
+            }
+        }
+
+        wakeups_++;
+        const size_t nchan = config_.channels.size();
+        for (unsigned int i = 0; i < batch; i++) {
+            const uint64_t pos = seq_ + dropped_;
+            unsigned char *slot = &ring_[(pos % slots_) * slot_size_];
+            if (config_.mode == RAW1394_DMA_BUFFERFILL) slot += 4;   // skip the header quadlet
+            quadlet_t seq = (quadlet_t)seq_;
+            if (config_.payload_len >= sizeof(seq))
+                memcpy(slot, &seq, sizeof(seq));
+
+            // one packet per channel per cycle, optionally leave a cycle empty
+            if (config_.skip_every && seq_ > 0 && seq_ % config_.skip_every == 0)
+                skipped_cycles_++;
+            const unsigned int cycle =
+                    (unsigned int)((pos / nchan + skipped_cycles_) % ISO_SIM_CYCLES_PER_SEC);
+            const unsigned char channel = config_.channels[pos % nchan];
+            raw1394_iso_disposition disp = handler_(handle, slot, config_.payload_len,
+                                                    channel, 1, 0, cycle, dropped_pending_);
+            dropped_pending_ = 0;
+            seq_++;
+            if (disp == RAW1394_ISO_ERROR || disp == RAW1394_ISO_STOP ||
+                disp == RAW1394_ISO_STOP_NOSYNC) {
+                return -1;
+            }
+            if (disp == RAW1394_ISO_DEFER) break;
+        }
+        return 0;
+    }
+
+    uint64_t packets() const { return seq_; }
+    uint64_t dropped() const { return dropped_; }
+    uint64_t wakeups() const { return wakeups_; }
+    uint64_t skipped_cycles() const { return skipped_cycles_; }
+
+    // cycle currently on the simulated bus, stands in for raw1394_read_cycle_timer
+    unsigned int bus_cycle() const
+    {
+        uint64_t pos = seq_ + dropped_;
+        if (config_.packet_rate > 0 && start_ns_ != 0) {
+            pos = (uint64_t)((iso_sim_now_ns() - start_ns_) * 1e-9 * config_.packet_rate);
+        }
+        return (unsigned int)((pos / config_.channels.size() + skipped_cycles_) % ISO_SIM_CYCLES_PER_SEC);
+    }
+    const IsoSimConfig &config() const { return config_; }
+    unsigned int ring_packets() const { return slots_; }     /*!< effective DMA ring depth */
+    unsigned int wakeup_packets() const { return batch_; }   /*!< packets per wakeup */
+
+private:
+    raw1394_iso_recv_handler_t handler_;
+    IsoSimConfig config_;
+    std::vector<unsigned char> ring_;  /*!< stand-in for the mmap'd DMA buffer */
+    size_t slot_size_;
+    unsigned int slots_;
+    unsigned int batch_;
+    uint64_t seq_;                     /*!< packets delivered so far */
+    unsigned int dropped_pending_;     /*!< drops not yet reported to the handler */
+    uint64_t start_ns_;
+    uint64_t skipped_cycles_;
+    uint64_t dropped_;
+    uint64_t wakeups_;
+};
+
+
+class IsoSimXmit
+{
+public:
+    IsoSimXmit(raw1394_iso_xmit_handler_t handler, const IsoSimConfig &config)
+        : handler_(handler), config_(config),
+          ring_((size_t)config.buf_packets * config.max_packet_size),
+          queued_(0), sent_(0), bus_cycles_(0), next_irq_cycle_(0), start_ns_(0), start_cycle_(0),
+          underruns_(0), underruns_pending_(0), wakeups_(0), bytes_(0)
+    {
+        if (config_.irq_interval <= 0) {
+            config_.irq_interval = config_.buf_packets / 4;
+            if (config_.irq_interval == 0) config_.irq_interval = 1;
+        }
+    }
+
+    /**
+     * Like raw1394_iso_xmit_start, except that there is no bus running
+     * before the start to wait on: the first packet goes out right away
+     * and carries cycle @start_on_cycle (-1 = cycle 0), later ones count
+     * up from there.
+     */
+    void start(int start_on_cycle = -1)
+    {
+        start_ns_ = iso_sim_now_ns();
+        start_cycle_ = start_on_cycle < 0 ? 0 : start_on_cycle % ISO_SIM_CYCLES_PER_SEC;
+    }
+
+    /**
+     * One simulated wakeup, same contract as raw1394_loop_iterate: sleep until
+     * irq_interval cycles after the previous wakeup, then let the handler fill
+     * every free slot. Like the real interrupt, this does not come earlier
+     * when the handler left slots empty.
+     * Returns 0 on success, -1 when the handler asked to stop or failed.
+     */
+    int iterate(raw1394handle_t handle)
+    {
+        if (start_ns_ == 0) start();
+        wait_for_cycle(next_irq_cycle_);
+        next_irq_cycle_ = bus_cycles_ + config_.irq_interval;
+        wakeups_++;
+
+        // slots freed up to this wakeup, the bus keeps going meanwhile
+        for (unsigned int n = free_slots(); n > 0; n--) {
+            unsigned char *slot = &ring_[(queued_ % config_.buf_packets) * config_.max_packet_size];
+            unsigned int len = 0;
+            unsigned char tag = 0, sy = 0;
+            const int cycle = (int)((start_cycle_ + bus_cycles_ + (queued_ - sent_)) %
+                                    ISO_SIM_CYCLES_PER_SEC);
+            raw1394_iso_disposition disp = handler_(handle, slot, &len, &tag, &sy,
+                                                    cycle, underruns_pending_);
+            underruns_pending_ = 0;
+            if (disp == RAW1394_ISO_DEFER || disp == RAW1394_ISO_AGAIN) break;
+            if (disp != RAW1394_ISO_OK) return -1;
+            bytes_ += len;
+            queued_++;
+        }
+        return 0;
+    }
+
+    /**
+     * raw1394_iso_xmit_write stand-in: copy one packet into the ring,
+     * blocking while the ring is full.
+     */
+    int write(const unsigned char *data, unsigned int len, unsigned char tag, unsigned char sy)
+    {
+        if (start_ns_ == 0) start();
+        if (free_slots() == 0) {
+            wait_for_free(1);
+            wakeups_++;
+        }
+        if (len > config_.max_packet_size) len = config_.max_packet_size;
+        memcpy(&ring_[(queued_ % config_.buf_packets) * config_.max_packet_size], data, len);
+        bytes_ += len;
+        queued_++;
+        return 0;
+    }
+
+    // packets the bus has transmitted so far
+    uint64_t sent() { advance_bus(); return sent_; }
+    uint64_t queued() const { return queued_; }
+    uint64_t underruns() { advance_bus(); return underruns_; }
+    uint64_t wakeups() const { return wakeups_; }
+    uint64_t bytes() const { return bytes_; }
+    uint64_t bus_cycles() { advance_bus(); return bus_cycles_; }
+
+private:
+    // let the bus take one packet per elapsed cycle, empty cycles are underruns
+    void advance_bus()
+    {
+        uint64_t cycles = bus_cycles_;
+        if (config_.packet_rate > 0) {
+            cycles = (uint64_t)((iso_sim_now_ns() - start_ns_) * 1e-9 * config_.packet_rate);
+        } else {
+            cycles += queued_ - sent_;  // unpaced: the bus drains instantly
+        }
+        if (cycles <= bus_cycles_) return;
+
+        const uint64_t elapsed = cycles - bus_cycles_;
+        const uint64_t available = queued_ - sent_;
+        const uint64_t take = available < elapsed ? available : elapsed;
+        sent_ += take;
+        // underruns only count once streaming started
+        if (queued_ > 0 && elapsed > take) {
+            underruns_ += elapsed - take;
+            underruns_pending_ += (unsigned int)(elapsed - take);
+        }
+        bus_cycles_ = cycles;
+    }
+
+    unsigned int free_slots()
+    {
+        advance_bus();
+        return config_.buf_packets - (unsigned int)(queued_ - sent_);
+    }
+
+    void wait_for_free(unsigned int wanted)
+    {
+        if (config_.packet_rate <= 0) return;
+        const unsigned int free = free_slots();
+        if (free >= wanted) return;
+        wait_for_cycle(bus_cycles_ + (wanted - free) + 1);
+    }
+
+    void wait_for_cycle(uint64_t cycle)
+    {
+        if (config_.packet_rate <= 0) return;
+        const uint64_t period_ns = (uint64_t)(1e9 / config_.packet_rate);
+        const uint64_t due_ns = start_ns_ + cycle * period_ns;
+        const uint64_t now = iso_sim_now_ns();
+        if (now < due_ns) {
+            struct timespec ts;
+            ts.tv_sec = (due_ns - now) / 1000000000ULL;
+            ts.tv_nsec = (due_ns - now) % 1000000000ULL;
+            nanosleep(&ts, NULL);
+        }
+        advance_bus();
+    }
+
+    raw1394_iso_xmit_handler_t handler_;
+    IsoSimConfig config_;
+    std::vector<unsigned char> ring_;  /*!< stand-in for the mmap'd DMA buffer */
+    uint64_t queued_;                  /*!< packets handed to the "kernel" */
+    uint64_t sent_;                    /*!< packets the bus has taken */
+    uint64_t bus_cycles_;              /*!< cycles elapsed since start */
+    uint64_t next_irq_cycle_;          /*!< cycle of the next iterate() wakeup */
+    uint64_t start_ns_;
+    unsigned int start_cycle_;
+    uint64_t underruns_;
+    unsigned int underruns_pending_;   /*!< not yet reported to the handler */
+    uint64_t wakeups_;
+    uint64_t bytes_;
+};
+
+#endif // ISO_SIM_H
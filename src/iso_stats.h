@@ -0,0 +1,353 @@
+#ifndef ISO_STATS_H
+#define ISO_STATS_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+
+
+/**
+  * @brief: Low overhead statistics for the isochronous receive path
+  *
+  *     Hot path (inside the receive handler):
+  *         - every thread that calls the handler owns an IsoStatsThread block,
+  *           claimed once from a fixed table, so counters have one writer
+  *           and are updated with relaxed stores, no locks, no read-modify-write
+  *         - tracks packets, bytes, the handler's dropped argument, gaps in the
+  *           8000 Hz cycle sequence per channel and a log2 histogram of the
+  *           callback duration
+  *
+  *     Export (reporter thread, once per second):
+  *         - sums all thread blocks into an iso_stats_snapshot, computes rates
+  *         - publishes it into a POSIX shared memory page guarded by a sequence
+  *           counter; other processes map it read-only (see iso_stats_read)
+  *         - optionally rewrites a plain text file with the same numbers
+  *
+  * @date 2026-10-17
+  */
+
+
+#define ISO_STATS_MAX_THREADS   8
+#define ISO_STATS_CHANNELS      64
+#define ISO_STATS_CYCLES        8000
+#define ISO_STATS_HIST_BUCKETS  24      /*!< bucket i counts durations in [2^i, 2^(i+1)) ns */
+#define ISO_STATS_MAGIC         0x49534f53  /* "ISOS" */
+
+
+static inline uint64_t iso_stats_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+// single writer counter, the owner thread adds without a locked instruction
+struct iso_stats_counter
+{
+    std::atomic<uint64_t> value;
+
+    iso_stats_counter() : value(0) {}
+    void add(uint64_t n)
+    {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+
+// counters owned by one receiving thread
+struct IsoStatsThread
+{
+    iso_stats_counter packets;
+    iso_stats_counter bytes;
+    iso_stats_counter dropped;        /*!< sum of the handler's dropped argument */
+    iso_stats_counter cycle_gaps;     /*!< number of discontinuities */
+    iso_stats_counter cycles_missed;  /*!< cycles skipped across all gaps */
+    iso_stats_counter hist[ISO_STATS_HIST_BUCKETS];
+    int last_cycle[ISO_STATS_CHANNELS];  /*!< owner thread only, -1 = not seen */
+
+    IsoStatsThread()
+    {
+        for (int i = 0; i < ISO_STATS_CHANNELS; i++) last_cycle[i] = -1;
+    }
+
+    // call once per packet from the receive handler
+    void packet(unsigned char channel, unsigned int len, unsigned int cycle, unsigned int dropped_packets)
+    {
+        packets.add(1);
+        bytes.add(len);
+        if (dropped_packets) dropped.add(dropped_packets);
+
+        int &last = last_cycle[channel & (ISO_STATS_CHANNELS - 1)];
+        if (last >= 0) {
+            unsigned int delta = (cycle + ISO_STATS_CYCLES - last) % ISO_STATS_CYCLES;
+            if (delta > 1) {
+                cycle_gaps.add(1);
+                cycles_missed.add(delta - 1);
+            }
+        }
+        last = cycle % ISO_STATS_CYCLES;
+    }
+
+    // record how long one callback took
+    void callback_duration(uint64_t ns)
+    {
+        int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+        if (bucket >= ISO_STATS_HIST_BUCKETS) bucket = ISO_STATS_HIST_BUCKETS - 1;
+        hist[bucket].add(1);
+    }
+};
+
+
+// table of per-thread blocks, threads claim a slot the first time they report
+class IsoStatsRegistry
+{
+public:
+    IsoStatsRegistry() : used_(0) {}
+
+    // this thread's block, NULL if all slots are taken
+    IsoStatsThread *local()
+    {
+        static thread_local IsoStatsThread *mine = NULL;
+        if (mine == NULL) {
+            unsigned int slot = used_.fetch_add(1);
+            if (slot >= ISO_STATS_MAX_THREADS) return NULL;
+            mine = &threads_[slot];
+        }
+        return mine;
+    }
+
+    unsigned int threads() const
+    {
+        unsigned int n = used_.load();
+        return n < ISO_STATS_MAX_THREADS ? n : ISO_STATS_MAX_THREADS;
+    }
+    const IsoStatsThread &thread(unsigned int i) const { return threads_[i]; }
+
+private:
+    IsoStatsThread threads_[ISO_STATS_MAX_THREADS];
+    std::atomic<unsigned int> used_;
+};
+
+
+// times one callback, use at the top of the receive handler
+class IsoStatsScope
+{
+public:
+    explicit IsoStatsScope(IsoStatsThread *stats)
+        : stats_(stats), start_(stats ? iso_stats_now_ns() : 0) {}
+    ~IsoStatsScope()
+    {
+        if (stats_) stats_->callback_duration(iso_stats_now_ns() - start_);
+    }
+
+private:
+    IsoStatsThread *stats_;
+    uint64_t start_;
+};
+
+
+// what the shared memory page and the stats file contain
+struct iso_stats_snapshot
+{
+    uint32_t magic;
+    std::atomic<uint32_t> seq;       /*!< odd while the writer is updating */
+    uint64_t update_ns;              /*!< CLOCK_MONOTONIC of this update */
+    uint32_t pid;
+    uint32_t threads;
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t dropped;
+    uint64_t cycle_gaps;
+    uint64_t cycles_missed;
+    double packets_per_sec;
+    double bytes_per_sec;
+    uint64_t hist[ISO_STATS_HIST_BUCKETS];
+};
+
+
+// sum all thread blocks, rates are computed against @prev
+static inline void iso_stats_collect(const IsoStatsRegistry &registry,
+                                     const iso_stats_snapshot *prev,
+                                     iso_stats_snapshot &snap)
+{
+    snap.magic = ISO_STATS_MAGIC;
+    snap.update_ns = iso_stats_now_ns();
+    snap.pid = getpid();
+    snap.threads = registry.threads();
+    snap.packets = snap.bytes = snap.dropped = snap.cycle_gaps = snap.cycles_missed = 0;
+    memset(snap.hist, 0, sizeof(snap.hist));
+    for (unsigned int t = 0; t < snap.threads; t++) {
+        const IsoStatsThread &th = registry.thread(t);
+        snap.packets += th.packets.get();
+        snap.bytes += th.bytes.get();
+        snap.dropped += th.dropped.get();
+        snap.cycle_gaps += th.cycle_gaps.get();
+        snap.cycles_missed += th.cycles_missed.get();
+        for (int i = 0; i < ISO_STATS_HIST_BUCKETS; i++) snap.hist[i] += th.hist[i].get();
+    }
+
+    snap.packets_per_sec = snap.bytes_per_sec = 0.0;
+    if (prev && snap.update_ns > prev->update_ns) {
+        const double dt = (snap.update_ns - prev->update_ns) * 1e-9;
+        snap.packets_per_sec = (snap.packets - prev->packets) / dt;
+        snap.bytes_per_sec = (snap.bytes - prev->bytes) / dt;
+    }
+}
+
+
+// duration below which @fraction of the callbacks finished, from the histogram
+static inline uint64_t iso_stats_percentile_ns(const iso_stats_snapshot &snap, double fraction)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < ISO_STATS_HIST_BUCKETS; i++) total += snap.hist[i];
+    uint64_t seen = 0;
+    for (int i = 0; i < ISO_STATS_HIST_BUCKETS; i++) {
+        seen += snap.hist[i];
+        if (total && seen >= fraction * total) return 2ULL << i;  // bucket upper bound
+    }
+    return 0;
+}
+
+
+static inline void iso_stats_print(FILE *out, const iso_stats_snapshot &snap)
+{
+    fprintf(out, "pid %u threads %u\n", snap.pid, snap.threads);
+    fprintf(out, "packets %llu\nbytes %llu\ndropped %llu\ncycle_gaps %llu\ncycles_missed %llu\n",
+            (unsigned long long)snap.packets, (unsigned long long)snap.bytes,
+            (unsigned long long)snap.dropped, (unsigned long long)snap.cycle_gaps,
+            (unsigned long long)snap.cycles_missed);
+    fprintf(out, "packets_per_sec %.0f\nbytes_per_sec %.0f\n",
+            snap.packets_per_sec, snap.bytes_per_sec);
+    fprintf(out, "callback_p50_ns %llu\ncallback_p99_ns %llu\n",
+            (unsigned long long)iso_stats_percentile_ns(snap, 0.50),
+            (unsigned long long)iso_stats_percentile_ns(snap, 0.99));
+    for (int i = 0; i < ISO_STATS_HIST_BUCKETS; i++) {
+        if (snap.hist[i]) {
+            fprintf(out, "callback_ns_lt_%llu %llu\n",
+                    2ULL << i, (unsigned long long)snap.hist[i]);
+        }
+    }
+}
+
+
+class IsoStatsPublisher
+{
+public:
+    IsoStatsPublisher() : page_(NULL) { name_[0] = '\0'; }
+    ~IsoStatsPublisher() { close(); }
+
+    /**
+     * Create (or reuse) the shared memory page @name, e.g. "/iso_recv_stats".
+     * Returns 0 on success or -1 on failure (sets errno)
+     */
+    int open(const char *name)
+    {
+        int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+        if (fd < 0) return -1;
+        if (ftruncate(fd, sizeof(iso_stats_snapshot))) {
+            ::close(fd);
+            return -1;
+        }
+        void *mem = mmap(NULL, sizeof(iso_stats_snapshot), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mem == MAP_FAILED) return -1;
+        page_ = (iso_stats_snapshot *)mem;
+        snprintf(name_, sizeof(name_), "%s", name);
+        return 0;
+    }
+
+    void close()
+    {
+        if (page_) {
+            munmap(page_, sizeof(iso_stats_snapshot));
+            shm_unlink(name_);
+        }
+        page_ = NULL;
+    }
+
+    // seqlock style update, readers retry if they overlap with it
+    void publish(const iso_stats_snapshot &snap)
+    {
+        if (page_ == NULL) return;
+        const uint32_t seq = page_->seq.load(std::memory_order_relaxed);
+        page_->seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        copy_fields(*page_, snap);
+        page_->seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // rewrite @path through a temporary file so readers never see half a file
+    static int write_file(const char *path, const iso_stats_snapshot &snap)
+    {
+        char tmp[512];
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+        FILE *out = fopen(tmp, "w");
+        if (out == NULL) return -1;
+        iso_stats_print(out, snap);
+        if (fclose(out)) return -1;
+        return rename(tmp, path);
+    }
+
+    static void copy_fields(iso_stats_snapshot &dst, const iso_stats_snapshot &src)
+    {
+        dst.magic = src.magic;
+        dst.update_ns = src.update_ns;
+        dst.pid = src.pid;
+        dst.threads = src.threads;
+        dst.packets = src.packets;
+        dst.bytes = src.bytes;
+        dst.dropped = src.dropped;
+        dst.cycle_gaps = src.cycle_gaps;
+        dst.cycles_missed = src.cycles_missed;
+        dst.packets_per_sec = src.packets_per_sec;
+        dst.bytes_per_sec = src.bytes_per_sec;
+        memcpy(dst.hist, src.hist, sizeof(dst.hist));
+    }
+
+private:
+    iso_stats_snapshot *page_;
+    char name_[256];
+};
+
+
+/**
+ * Read a consistent snapshot published by another process.
+ * Returns 0 on success or -1 on failure (sets errno)
+ */
+static inline int iso_stats_read(const char *name, iso_stats_snapshot &snap)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return -1;
+    void *mem = mmap(NULL, sizeof(iso_stats_snapshot), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) return -1;
+
+    const iso_stats_snapshot *page = (const iso_stats_snapshot *)mem;
+    int rc = -1;
+    errno = EAGAIN;
+    for (int attempt = 0; attempt < 1000; attempt++) {
+        uint32_t before = page->seq.load(std::memory_order_acquire);
+        if (before & 1) continue;   // writer in progress
+        IsoStatsPublisher::copy_fields(snap, *page);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (page->seq.load(std::memory_order_relaxed) == before) {
+            rc = (snap.magic == ISO_STATS_MAGIC) ? 0 : -1;
+            if (rc) errno = EINVAL;
+            break;
+        }
+    }
+    munmap(mem, sizeof(iso_stats_snapshot));
+    return rc;
+}
+
+#endif // ISO_STATS_H
@@ -0,0 +1,113 @@
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <stdint.h>
+#include <string.h>
+
+
+/**
+  * @brief: Latency histogram with bounded relative error
+  *
+  *     The log2 histograms of iso_stats.h and arm_worker_pool.h are cheap but
+  *     only tell which power of two a percentile falls into. LatencyHistogram
+  *     splits every power of two into 32 linear sub-buckets (the layout of
+  *     HdrHistogram), so any recorded value, and so any percentile, is known
+  *     to within 1/32 (3%) from 1 ns to 2^63 ns:
+  *         - record() is a count increment, no allocation, no sorting
+  *         - percentile() walks 1920 buckets and reports the highest value of
+  *           the bucket, never more than the recorded maximum
+  *         - histograms of several threads or runs add up with merge()
+  *
+  *     Not thread safe, one histogram per recording thread.
+  *
+  * @date 2026-10-17
+  */
+
+
+#define LATENCY_SUB_BITS    5
+#define LATENCY_SUB_COUNT   (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS     ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_COUNT)
+
+
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() { reset(); }
+
+    void reset()
+    {
+        memset(counts_, 0, sizeof(counts_));
+        count_ = 0;
+        sum_ = 0;
+        min_ = UINT64_MAX;
+        max_ = 0;
+    }
+
+    void record(uint64_t ns)
+    {
+        counts_[index(ns)]++;
+        count_++;
+        sum_ += ns;
+        if (ns < min_) min_ = ns;
+        if (ns > max_) max_ = ns;
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        for (int i = 0; i < LATENCY_BUCKETS; i++) counts_[i] += other.counts_[i];
+        count_ += other.count_;
+        sum_ += other.sum_;
+        if (other.min_ < min_) min_ = other.min_;
+        if (other.max_ > max_) max_ = other.max_;
+    }
+
+    // value below or at which @fraction (0..1) of the recorded values lie
+    uint64_t percentile(double fraction) const
+    {
+        if (count_ == 0) return 0;
+        uint64_t rank = (uint64_t)(fraction * count_ + 0.5);
+        if (rank < 1) rank = 1;
+        if (rank > count_) rank = count_;
+        uint64_t seen = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                const uint64_t value = highest(i);
+                return value < max_ ? value : max_;
+            }
+        }
+        return max_;
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? (double)sum_ / count_ : 0.0; }
+
+private:
+    // values below 2 * LATENCY_SUB_COUNT are exact, above that each power of
+    // two gets LATENCY_SUB_COUNT buckets
+    static int index(uint64_t v)
+    {
+        if (v < 2 * LATENCY_SUB_COUNT) return (int)v;
+        const int shift = 63 - __builtin_clzll(v) - LATENCY_SUB_BITS;
+        return shift * LATENCY_SUB_COUNT + (int)(v >> shift);
+    }
+
+    // highest value that lands in bucket @i
+    static uint64_t highest(int i)
+    {
+        if (i < 2 * LATENCY_SUB_COUNT) return i;
+        const int shift = i / LATENCY_SUB_COUNT - 1;
+        const uint64_t top = i - shift * LATENCY_SUB_COUNT;
+        return ((top + 1) << shift) - 1;
+    }
+
+    uint64_t counts_[LATENCY_BUCKETS];
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t min_;
+    uint64_t max_;
+};
+
+#endif // LATENCY_HIST_H
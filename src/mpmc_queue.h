@@ -0,0 +1,108 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+
+/**
+  * @brief: Bounded lock-free multi-producer/multi-consumer queue
+  *
+  *     Every slot carries a sequence number telling whether it is free for
+  *     the producer of a given position or holds the item for the consumer
+  *     of that position (D. Vyukov's bounded queue):
+  *         - producers and consumers claim positions with one compare-swap
+  *           on head or tail, no locks, no allocation after construction
+  *         - capacity is rounded up to a power of two
+  *         - try_push/try_pop never block, callers decide how to wait
+  *
+  * @date 2026-10-17
+  */
+template <typename T>
+class MpmcQueue
+{
+public:
+    explicit MpmcQueue(size_t capacity)
+        : head_(0), tail_(0)
+    {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mask_ = size - 1;
+        std::vector<slot> slots(size);
+        slots_.swap(slots);
+        for (size_t i = 0; i < size; i++) slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // any thread, false when the queue is full
+    bool try_push(const T &item)
+    {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            slot &s = slots_[pos & mask_];
+            const size_t seq = s.seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    s.item = item;
+                    s.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;   // full
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // any thread, false when the queue is empty
+    bool try_pop(T &item)
+    {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            slot &s = slots_[pos & mask_];
+            const size_t seq = s.seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    item = s.item;
+                    s.seq.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;   // empty
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // approximate, safe to call from any thread
+    size_t size() const
+    {
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        return head > tail ? head - tail : 0;
+    }
+
+private:
+    enum { CACHE_LINE = 64 };
+
+    struct slot
+    {
+        std::atomic<size_t> seq;
+        T item;
+    };
+
+    std::vector<slot> slots_;
+    size_t mask_;
+
+    alignas(CACHE_LINE) std::atomic<size_t> head_;   /*!< next position to push */
+    alignas(CACHE_LINE) std::atomic<size_t> tail_;   /*!< next position to pop */
+};
+
+#endif // MPMC_QUEUE_H
@@ -0,0 +1,113 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+
+/**
+  * @brief: Lock-free single-producer/single-consumer ring
+  *
+  *     Used to hand work from a libraw1394 callback (producer, runs inside
+  *     raw1394_loop_iterate) to a worker thread (consumer) without locks.
+  *         - capacity is rounded up to a power of two
+  *         - head/tail live on separate cache lines to avoid false sharing
+  *         - push never blocks, it returns false when the ring is full
+  *
+  * @date 2026-10-17
+  */
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(size_t capacity)
+        : head_(0), tail_(0)
+    {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        mask_ = size - 1;
+        slots_.resize(size);
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // producer side
+    bool push(const T &item)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_cache_ > mask_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head - tail_cache_ > mask_) return false;  // full
+        }
+        slots_[head & mask_] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // producer side, true when push() would fail
+    bool full()
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_cache_ > mask_)
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+        return head - tail_cache_ > mask_;
+    }
+
+    // producer side, slot the next push() lands in; lets callers keep a
+    // parallel preallocated slab indexed the same way as the ring
+    size_t next_slot() const
+    {
+        return head_.load(std::memory_order_relaxed) & mask_;
+    }
+
+    // consumer side
+    bool pop(T &item)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_cache_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail == head_cache_) return false;  // empty
+        }
+        item = slots_[tail & mask_];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, oldest item or NULL; the slot stays owned by the
+    // consumer (and the producer cannot reuse it) until consume()
+    T *front()
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_cache_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail == head_cache_) return NULL;  // empty
+        }
+        return &slots_[tail & mask_];
+    }
+
+    // consumer side, releases the item returned by front()
+    void consume()
+    {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // approximate, safe to call from any thread
+    size_t size() const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+private:
+    enum { CACHE_LINE = 64 };
+
+    std::vector<T> slots_;
+    size_t mask_;
+
+    alignas(CACHE_LINE) std::atomic<size_t> head_;   /*!< written by producer */
+    size_t tail_cache_ = 0;                           /*!< producer copy of tail */
+    alignas(CACHE_LINE) std::atomic<size_t> tail_;   /*!< written by consumer */
+    size_t head_cache_ = 0;                           /*!< consumer copy of head */
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,439 @@
+#ifndef TOPOLOGY_CACHE_H
+#define TOPOLOGY_CACHE_H
+
+#include <endian.h>
+#include <errno.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+// libraw1394
+#include <libraw1394/raw1394.h>
+#include <libraw1394/csr.h>
+
+#include "async_batch.h"
+
+
+/**
+  * @brief: Bus topology and config ROMs, cached across bus resets
+  *
+  *     After a reset every node id may have changed, so software reads the
+  *     config ROM of every node again; on a big bus that takes hundreds of
+  *     milliseconds. TopologyCache::refresh() does the least that tells
+  *     what changed:
+  *         - the topology map of the local node (its self-ID packets) gives
+  *           the physical ids with an active link, their speed and the root;
+  *           without a map every id below node_count() is tried
+  *         - one pipelined round reads bus info quadlets 2..4 (ROM
+  *           generation, GUID) of those nodes
+  *         - a GUID seen before with the same nonzero ROM generation keeps
+  *           its cached ROM; with ROM generation 0 (not implemented by the
+  *           node) the root directory header is compared first
+  *         - only new nodes and changed ROMs are read in full, the bus info
+  *           block and the root directory, again all nodes at once
+  *     A reset during refresh() starts it over. All reads are quadlet
+  *     reads, which every node has to answer in its config ROM.
+  *
+  *     node_of() maps a GUID to its node id of the last refresh() in O(1),
+  *     an open addressing table; nodes that left keep their ROM in the
+  *     cache, node_of() returns -1 for them until they are back. stale()
+  *     tells whether the bus reset since.
+  *
+  *     CRCs are not checked, unit directories and leaves are not read.
+  *
+  * @date 2026-10-17
+  */
+
+
+#define TOPOLOGY_MAX_ATTEMPTS   4       /*!< refresh() rounds before giving up on resets */
+#define TOPOLOGY_MAX_DIRECTORY  255     /*!< root directory entries read at most */
+
+
+struct topology_node
+{
+    octlet_t guid;
+    int node;                       /*!< node id in the last refresh(), -1 = not on the bus */
+    quadlet_t self_id;              /*!< its self-ID packet 0, 0 = no topology map */
+    unsigned int rom_generation;    /*!< bus info block bits 7:4 */
+    std::vector<quadlet_t> rom;     /*!< bus info block and root directory, host byte order */
+    unsigned int read_generation;   /*!< bus generation the ROM was last read in */
+    unsigned long long reads;       /*!< times the ROM was read in full */
+    int error;                      /*!< errno value of the last failed ROM read */
+};
+
+
+class TopologyCache
+{
+public:
+    explicit TopologyCache(AsyncEngine &engine)
+        : engine_(engine), batch_(engine, 0, 4), generation_(0), refreshed_(false), node_count_(0),
+          root_(-1), has_map_(false), refreshes_(0), roms_read_(0), roms_reused_(0), moved_(0),
+          quadlets_(0), refresh_ns_(0)
+    {
+        for (int n = 0; n < ASYNC_MAX_NODES; n++) by_phy_[n] = -1;
+        table_.assign(64, -1);
+    }
+
+    /**
+     * Read what changed since the last refresh, iterating until done.
+     * Returns 0 or -1 (sets errno, EAGAIN when the bus kept resetting)
+     */
+    int refresh()
+    {
+        const uint64_t start = async_now_ns();
+        const unsigned long long before = engine_.completed();
+        int rc = -1;
+        for (unsigned int attempt = 0; attempt < TOPOLOGY_MAX_ATTEMPTS; attempt++) {
+            rc = discover();
+            if (rc == 0 || errno != EAGAIN) break;
+        }
+        const int err = errno;
+        quadlets_ += engine_.completed() - before;
+        refresh_ns_ = async_now_ns() - start;
+        refreshes_++;
+        errno = err;
+        return rc;
+    }
+
+    // forget every cached ROM, the next refresh() reads them all
+    void clear()
+    {
+        entries_.clear();
+        table_.assign(64, -1);
+        for (int n = 0; n < ASYNC_MAX_NODES; n++) by_phy_[n] = -1;
+        refreshed_ = false;
+    }
+
+    // the bus reset since the last refresh()
+    bool stale() { return !refreshed_ || generation_ != engine_.transport().generation(); }
+
+    unsigned int generation() const { return generation_; }   /*!< bus generation of the last refresh() */
+
+    // node id of @guid, -1 if it was not on the bus in the last refresh()
+    int node_of(octlet_t guid) const
+    {
+        const int i = find_index(guid);
+        return i < 0 ? -1 : entries_[i].node;
+    }
+
+    // GUID of the node at @node, 0 when unknown
+    octlet_t guid_of(nodeid_t node) const
+    {
+        const int i = by_phy_[node & ASYNC_NODE_MASK];
+        return i < 0 ? 0 : entries_[i].guid;
+    }
+
+    // cached entry of @guid, on the bus or not, NULL if never seen
+    const topology_node *find(octlet_t guid) const
+    {
+        const int i = find_index(guid);
+        return i < 0 ? NULL : &entries_[i];
+    }
+
+    // entry of the node at @node, NULL if it has no config ROM
+    const topology_node *at(nodeid_t node) const
+    {
+        const int i = by_phy_[node & ASYNC_NODE_MASK];
+        return i < 0 ? NULL : &entries_[i];
+    }
+
+    size_t num_entries() const { return entries_.size(); }
+    const topology_node &entry(size_t i) const { return entries_[i]; }
+
+    int node_count() const { return node_count_; }
+    int root() const { return root_; }                         /*!< physical id of the root, -1 = unknown */
+    bool has_topology_map() const { return has_map_; }
+    quadlet_t self_id(unsigned int phy) const { return self_id_[phy & ASYNC_NODE_MASK]; }
+
+    unsigned long long refreshes() const { return refreshes_; }
+    unsigned long long roms_read() const { return roms_read_; }
+    unsigned long long roms_reused() const { return roms_reused_; }
+    unsigned long long moved() const { return moved_; }        /*!< GUIDs seen at a new node id */
+    unsigned long long quadlets() const { return quadlets_; }  /*!< transactions of all refreshes */
+    uint64_t refresh_ns() const { return refresh_ns_; }        /*!< duration of the last refresh() */
+
+private:
+    enum { ROM_NONE, ROM_REUSE, ROM_CHECK, ROM_FULL, ROM_DIRECTORY };
+
+    // one pass over the bus. Returns 0 or -1 (sets errno)
+    int discover()
+    {
+        const unsigned int gen = engine_.transport().generation();
+        const nodeid_t local = engine_.transport().local_id();
+        const nodeid_t bus = local & 0xffc0;
+
+        // 1. who has a link
+        if (read_topology_map(local)) {
+            if (errno == EAGAIN) return -1;
+            has_map_ = false;
+            root_ = -1;
+            node_count_ = engine_.transport().node_count();
+            for (int n = 0; n < ASYNC_MAX_NODES; n++) self_id_[n] = 0;
+        }
+
+        // 2. ROM generation and GUID of each
+        batch_.clear();
+        for (int n = 0; n < node_count_; n++) {
+            state_[n] = ROM_NONE;
+            if (has_map_ && !link_active(self_id_[n])) continue;
+            state_[n] = ROM_REUSE;
+            for (int q = 0; q < 3; q++) {
+                batch_.add(bus | n, ASYNC_BUS_INFO_BLOCK + 8 + 4 * q, 4, &info_[n * 3 + q]);
+            }
+        }
+        if (batch_.read() && errno == EAGAIN) return -1;
+
+        int found[ASYNC_MAX_NODES];
+        size_t e = 0;
+        for (int n = 0; n < node_count_; n++) {
+            found[n] = -1;
+            if (state_[n] == ROM_NONE) continue;
+            const bool ok = batch_.entry(e).error == 0 && batch_.entry(e + 1).error == 0 &&
+                            batch_.entry(e + 2).error == 0;
+            e += 3;
+            const octlet_t guid = ((octlet_t)be32toh(info_[n * 3 + 1]) << 32) | be32toh(info_[n * 3 + 2]);
+            if (!ok || guid == 0) {
+                state_[n] = ROM_NONE;   // no general config ROM
+                continue;
+            }
+            const quadlet_t bus_info = be32toh(info_[n * 3]);
+            const unsigned int rom_generation = (bus_info >> 4) & 0xf;
+            found[n] = insert(guid);
+            topology_node &t = entries_[found[n]];
+            if (t.rom.size() < 6 || t.rom_generation != rom_generation) state_[n] = ROM_FULL;
+            else if (rom_generation == 0) state_[n] = ROM_CHECK;
+            else t.rom[2] = bus_info;
+            t.rom_generation = rom_generation;
+        }
+
+        // 3. first quadlets and root directory header of new or changed ROMs
+        batch_.clear();
+        for (int n = 0; n < node_count_; n++) {
+            if (state_[n] == ROM_FULL) {
+                for (int q = 0; q < 2; q++) batch_.add(bus | n, ASYNC_BUS_INFO_BLOCK + 4 * q, 4, &head_[n * 3 + q]);
+            }
+            if (state_[n] == ROM_FULL || state_[n] == ROM_CHECK) {
+                batch_.add(bus | n, ASYNC_BUS_INFO_BLOCK + 20, 4, &head_[n * 3 + 2]);
+            }
+        }
+        if (batch_.read() && errno == EAGAIN) return -1;
+
+        e = 0;
+        size_t words = 0;
+        for (int n = 0; n < node_count_; n++) {
+            if (state_[n] != ROM_FULL && state_[n] != ROM_CHECK) continue;
+            const size_t count = state_[n] == ROM_FULL ? 3 : 1;
+            int error = 0;
+            for (size_t k = 0; k < count; k++) {
+                if (batch_.entry(e + k).error) error = batch_.entry(e + k).error;
+            }
+            e += count;
+            topology_node &t = entries_[found[n]];
+            if (error) {
+                t.error = error;
+                t.rom.clear();   // read it all again next time
+                state_[n] = ROM_NONE;
+                found[n] = -1;
+                continue;
+            }
+            const quadlet_t header = be32toh(head_[n * 3 + 2]);
+            if (state_[n] == ROM_CHECK && header == t.rom[5]) {
+                state_[n] = ROM_REUSE;
+                t.rom[2] = be32toh(info_[n * 3]);
+                continue;
+            }
+            if (state_[n] == ROM_FULL) {
+                t.rom.resize(6);
+                t.rom[0] = be32toh(head_[n * 3]);
+                t.rom[1] = be32toh(head_[n * 3 + 1]);
+                for (int q = 0; q < 3; q++) t.rom[2 + q] = be32toh(info_[n * 3 + q]);
+                if ((t.rom[0] >> 24) != 4) {
+                    // not the 1394 bus info block, the directory is elsewhere
+                    t.rom.resize(5);
+                    finish_rom(t, gen);
+                    state_[n] = ROM_NONE;
+                    continue;
+                }
+            }
+            t.rom.resize(6);
+            t.rom[5] = header;
+            const size_t length = std::min<size_t>(header >> 16, TOPOLOGY_MAX_DIRECTORY);
+            directory_[n] = length;
+            words += length;
+            state_[n] = ROM_DIRECTORY;
+        }
+
+        // 4. root directories
+        batch_.clear();
+        dir_.resize(words);
+        words = 0;
+        for (int n = 0; n < node_count_; n++) {
+            if (state_[n] != ROM_DIRECTORY) continue;
+            for (size_t q = 0; q < directory_[n]; q++) {
+                batch_.add(bus | n, ASYNC_BUS_INFO_BLOCK + 24 + 4 * q, 4, &dir_[words + q]);
+            }
+            words += directory_[n];
+        }
+        if (batch_.read() && errno == EAGAIN) return -1;
+
+        e = 0;
+        words = 0;
+        for (int n = 0; n < node_count_; n++) {
+            if (state_[n] != ROM_DIRECTORY) continue;
+            topology_node &t = entries_[found[n]];
+            int error = 0;
+            for (size_t q = 0; q < directory_[n]; q++) {
+                if (batch_.entry(e + q).error) error = batch_.entry(e + q).error;
+                t.rom.push_back(be32toh(dir_[words + q]));
+            }
+            e += directory_[n];
+            words += directory_[n];
+            if (error) {
+                t.error = error;
+                t.rom.clear();   // read it all again next time
+                found[n] = -1;
+                continue;
+            }
+            finish_rom(t, gen);
+        }
+
+        if (engine_.transport().generation() != gen) {
+            errno = EAGAIN;   // reset meanwhile, the ids are stale
+            return -1;
+        }
+
+        // 5. the new map
+        for (int n = 0; n < node_count_; n++) {
+            if (found[n] < 0) continue;
+            const int before = entries_[found[n]].node;
+            if (before >= 0 && before != (bus | n)) moved_++;
+            if (state_[n] == ROM_REUSE) roms_reused_++;
+        }
+        for (size_t i = 0; i < entries_.size(); i++) entries_[i].node = -1;
+        for (int n = 0; n < ASYNC_MAX_NODES; n++) {
+            const int i = n < node_count_ ? found[n] : -1;
+            by_phy_[n] = i;
+            if (i < 0) continue;
+            entries_[i].node = bus | n;
+            entries_[i].self_id = self_id_[n];
+        }
+        generation_ = gen;
+        refreshed_ = true;
+        return 0;
+    }
+
+    // self-ID packets of the local node's topology map. Returns 0 or -1 (sets errno)
+    int read_topology_map(nodeid_t local)
+    {
+        const nodeaddr_t map = CSR_REGISTER_BASE + CSR_TOPOLOGY_MAP;
+        batch_.clear();
+        for (int q = 0; q < 3; q++) batch_.add(local, map + 4 * q, 4, &map_[q]);
+        if (batch_.read()) return -1;
+        const size_t count = be32toh(map_[2]) & 0xffff;
+        if (count == 0 || count > sizeof(map_) / 4 - 3) {
+            errno = EINVAL;
+            return -1;
+        }
+        batch_.clear();
+        for (size_t q = 0; q < count; q++) batch_.add(local, map + 12 + 4 * q, 4, &map_[3 + q]);
+        if (batch_.read()) return -1;
+
+        for (int n = 0; n < ASYNC_MAX_NODES; n++) self_id_[n] = 0;
+        node_count_ = 0;
+        for (size_t q = 0; q < count; q++) {
+            const quadlet_t packet = be32toh(map_[3 + q]);
+            if ((packet >> 30) != 2 || (packet & (1 << 23))) continue;   // not a self-ID packet 0
+            const int phy = (packet >> 24) & ASYNC_NODE_MASK;
+            self_id_[phy] = packet;
+            if (phy + 1 > node_count_) node_count_ = phy + 1;
+        }
+        root_ = node_count_ - 1;   // the root has the highest physical id
+        has_map_ = true;
+        return 0;
+    }
+
+    static bool link_active(quadlet_t self_id) { return (self_id >> 22) & 1; }
+
+    void finish_rom(topology_node &t, unsigned int gen)
+    {
+        t.read_generation = gen;
+        t.reads++;
+        t.error = 0;
+        roms_read_++;
+    }
+
+    // multiplicative hash into the table, a power of two in size
+    size_t slot(octlet_t guid) const
+    {
+        return (size_t)((guid * 0x9e3779b97f4a7c15ULL) >> 32) & (table_.size() - 1);
+    }
+
+    int find_index(octlet_t guid) const
+    {
+        for (size_t s = slot(guid);; s = (s + 1) & (table_.size() - 1)) {
+            const int i = table_[s];
+            if (i < 0) return -1;
+            if (entries_[i].guid == guid) return i;
+        }
+    }
+
+    // index of @guid, a new empty entry if never seen
+    int insert(octlet_t guid)
+    {
+        const int known = find_index(guid);
+        if (known >= 0) return known;
+        topology_node t;
+        t.guid = guid;
+        t.node = -1;
+        t.self_id = 0;
+        t.rom_generation = 0;
+        t.read_generation = 0;
+        t.reads = 0;
+        t.error = 0;
+        entries_.push_back(t);
+        if (entries_.size() * 2 > table_.size()) {
+            // at most half full, entries are never removed
+            table_.assign(table_.size() * 2, -1);
+            for (size_t i = 0; i < entries_.size(); i++) place(i);
+        } else {
+            place(entries_.size() - 1);
+        }
+        return entries_.size() - 1;
+    }
+
+    void place(size_t i)
+    {
+        size_t s = slot(entries_[i].guid);
+        while (table_[s] >= 0) s = (s + 1) & (table_.size() - 1);
+        table_[s] = (int)i;
+    }
+
+    AsyncEngine &engine_;
+    AsyncBatch batch_;                          /*!< quadlet reads, never merged */
+    std::vector<topology_node> entries_;
+    std::vector<int> table_;                    /*!< GUID hash to entries_ index, -1 = free */
+    int by_phy_[ASYNC_MAX_NODES];               /*!< entries_ index, -1 = no ROM */
+    quadlet_t self_id_[ASYNC_MAX_NODES];
+    unsigned int generation_;
+    bool refreshed_;
+    int node_count_;
+    int root_;
+    bool has_map_;
+
+    // scratch of discover(), bus byte order
+    quadlet_t map_[3 + 256];
+    quadlet_t info_[ASYNC_MAX_NODES * 3];       /*!< bus info quadlets 2..4 */
+    quadlet_t head_[ASYNC_MAX_NODES * 3];       /*!< quadlets 0, 1 and the root directory header */
+    std::vector<quadlet_t> dir_;
+    int state_[ASYNC_MAX_NODES];
+    size_t directory_[ASYNC_MAX_NODES];
+
+    unsigned long long refreshes_;
+    unsigned long long roms_read_;
+    unsigned long long roms_reused_;
+    unsigned long long moved_;
+    unsigned long long quadlets_;
+    uint64_t refresh_ns_;
+};
+
+#endif // TOPOLOGY_CACHE_H